@@ -0,0 +1,225 @@
+#ifndef COMMANDGENERATOR_H
+#define COMMANDGENERATOR_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "eventLoop.h"
+#include "httpConnection.h"
+#include "json.h"
+#include "protocol.h"
+#include "simulatorConfig.h"
+#include "simulatorStats.h"
+
+/**
+ * Follows the commands created by the generator until their ack
+ * to time delivery (created -> received by the device) and completion
+ * (created -> result accepted by the server).
+ */
+class CommandTracker {
+public:
+  // Constructor
+  explicit CommandTracker(SimulatorStats& stats) : stats(stats) {}
+
+  /**
+   * Record a command created by the generator
+   * With long-polling the device may receive it before the create response arrives.
+   * @param code - Command code returned by the server
+   * @param createdUs - nowUs() when the create request was sent
+   */
+  void onCreated(const std::string& code, uint64_t createdUs) {
+    Command& command = commands[code];
+    command.createdUs = createdUs;
+    auto early = earlyDeliveries.find(code);
+    if (early != earlyDeliveries.end()) {
+      stats.record(LATENCY_DELIVERY, early->second > createdUs ? early->second - createdUs : 0);
+      command.delivered = true;
+      earlyDeliveries.erase(early);
+    }
+  }
+
+  /**
+   * Record a command received by a device
+   * @param code - Command code
+   * @param nowUs - Current time
+   */
+  void onDelivered(const std::string& code, uint64_t nowUs) {
+    auto command = commands.find(code);
+    if (command == commands.end()) {
+      earlyDeliveries.emplace(code, nowUs);
+      return;
+    }
+    if (!command->second.delivered) {
+      command->second.delivered = true;
+      stats.record(LATENCY_DELIVERY, nowUs - command->second.createdUs);
+    }
+  }
+
+  /**
+   * Record a command result accepted by the server
+   * @param code - Command code
+   * @param nowUs - Current time
+   */
+  void onAcked(const std::string& code, uint64_t nowUs) {
+    auto command = commands.find(code);
+    if (command != commands.end()) {
+      stats.record(LATENCY_COMPLETION, nowUs - command->second.createdUs);
+      commands.erase(command);
+    }
+  }
+
+  /**
+   * Forget deliveries of commands the generator never reported (created by someone else)
+   * @param nowUs - Current time
+   */
+  void prune(uint64_t nowUs) {
+    for (auto it = earlyDeliveries.begin(); it != earlyDeliveries.end();) {
+      it = nowUs - it->second > EARLY_DELIVERY_TTL_US ? earlyDeliveries.erase(it) : std::next(it);
+    }
+  }
+
+  /**
+   * Count the created commands no device received yet
+   * @return undelivered commands
+   */
+  size_t getUndelivered() const {
+    size_t count = 0;
+    for (const auto& command : commands) {
+      count += command.second.delivered ? 0 : 1;
+    }
+    return count;
+  }
+
+private:
+  static const uint64_t EARLY_DELIVERY_TTL_US = 60ULL * 1000000;
+
+  struct Command {
+    uint64_t createdUs = 0;
+    bool delivered = false;
+  };
+
+  SimulatorStats& stats;
+  std::unordered_map<std::string, Command> commands;           // Created, result not acknowledged yet
+  std::unordered_map<std::string, uint64_t> earlyDeliveries;  // Received before the create response (code -> nowUs())
+};
+
+/**
+ * Creates commands at a fixed rate for random devices of the fleet
+ * through the API (POST /devices/:id/opendrawer/:n and /opendrawers),
+ * the way the application server queues them for real drawers.
+ */
+class CommandGenerator {
+public:
+  /**
+   * Constructor
+   * @param loop - Event loop
+   * @param config - Simulation settings
+   * @param stats - Receives the create latencies
+   * @param tracker - Receives the created commands
+   * @param server - API server
+   * @param devices - Fleet the commands are created for
+   * @param localAddresses - Source addresses to spread the connections over (may be empty)
+   */
+  CommandGenerator(EventLoop& loop, const SimulatorConfig& config, SimulatorStats& stats, CommandTracker& tracker,
+                   const ServerAddress& server, const std::vector<DeviceCredentials>& devices,
+                   const std::vector<struct sockaddr_storage>& localAddresses)
+      : loop(loop), config(config), stats(stats), tracker(tracker), devices(devices), random(config.seed ^ 0x5eed) {
+    for (int i = 0; i < config.generatorConnections; i++) {
+      const struct sockaddr_storage* local = localAddresses.empty() ? NULL : &localAddresses[i % localAddresses.size()];
+      connections.emplace_back(new HttpConnection(loop, server, local));
+    }
+    startMs = 0;
+    issued = 0;
+  }
+
+  /**
+   * Start creating commands (no-op without --rate)
+   */
+  void start() {
+    if (config.commandRate <= 0 || devices.empty()) {
+      return;
+    }
+    startMs = EventLoop::nowMs();
+    issued = 0;
+    tick();
+  }
+
+private:
+  static const uint64_t TICK_MS = 10;
+
+  EventLoop& loop;
+  const SimulatorConfig& config;
+  SimulatorStats& stats;
+  CommandTracker& tracker;
+  const std::vector<DeviceCredentials>& devices;
+  std::vector<std::unique_ptr<HttpConnection>> connections;
+  std::mt19937 random;
+  uint64_t startMs;
+  uint64_t issued;  // Commands sent or skipped since start()
+
+  void tick() {
+    uint64_t now = EventLoop::nowMs();
+    uint64_t due = (uint64_t)(config.commandRate * (now - startMs) / 1000.0);
+    for (auto& connection : connections) {
+      if (issued >= due) {
+        break;
+      }
+      if (!connection->isBusy()) {
+        send(*connection);
+        issued++;
+      }
+    }
+    if (issued < due) {
+      // Every connection busy: the server is slower than the requested rate
+      stats.increment(SIM_COMMANDS_SKIPPED, due - issued);
+      issued = due;
+    }
+    loop.addTimer(TICK_MS, [this]() { tick(); });
+  }
+
+  void send(HttpConnection& connection) {
+    const DeviceCredentials& device = devices[random() % devices.size()];
+    std::string path = std::string(commandsEndpoint) + device.id;
+    std::string body;
+    if (config.drawers > 1 && std::uniform_real_distribution<double>(0, 1)(random) < config.openManyRatio) {
+      // Two or more distinct drawers
+      std::vector<int> drawers;
+      for (int d = 1; d <= config.drawers; d++) {
+        drawers.push_back(d);
+      }
+      std::shuffle(drawers.begin(), drawers.end(), random);
+      drawers.resize(2 + random() % (config.drawers - 1));
+      path += "/opendrawers";
+      body = "{\"drawers\":[";
+      for (size_t i = 0; i < drawers.size(); i++) {
+        body += (i ? "," : "") + std::to_string(drawers[i]);
+      }
+      body += "]}";
+    } else {
+      path += "/opendrawer/" + std::to_string(1 + random() % config.drawers);
+      body = "{}";
+    }
+
+    uint64_t sentUs = EventLoop::nowUs();
+    connection.request("POST", path, "X-API-Key: " + config.apiKey + "\r\n", body, config.timeoutMs,
+                       [this, sentUs](const HttpResponse& response) {
+                         uint64_t now = EventLoop::nowUs();
+                         JsonValue doc;
+                         if (response.status == 200 && JsonParser::parse(response.body, doc) && doc["code"].asString()) {
+                           stats.record(LATENCY_CREATE, now - sentUs);
+                           stats.increment(SIM_COMMANDS_CREATED);
+                           tracker.onCreated(doc["code"].asString(), sentUs);
+                         } else {
+                           stats.error(LATENCY_CREATE);
+                         }
+                       });
+  }
+};
+
+#endif
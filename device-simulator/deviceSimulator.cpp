@@ -0,0 +1,274 @@
+/**
+ * Device simulator
+ * Load generator that runs thousands of virtual drawers in one process, each one
+ * speaking the firmware protocol (protocol.h) over its own keep-alive connection,
+ * to measure how many devices and commands per second the backend sustains.
+ * See README.md ("Simulador de Dispositivos") for usage.
+ */
+
+#include <arpa/inet.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "commandGenerator.h"
+#include "eventLoop.h"
+#include "httpConnection.h"
+#include "json.h"
+#include "simulatorConfig.h"
+#include "simulatorStats.h"
+#include "virtualDevice.h"
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void onSignal(int) {
+  interrupted = 1;
+}
+
+/**
+ * Read the credentials file ("deviceId secret" per line, # starts a comment)
+ * @param path - File to read
+ * @param devices - Receives the credentials
+ * @return false if the file can't be opened
+ */
+static bool loadDevices(const std::string& path, std::vector<DeviceCredentials>& devices) {
+  std::ifstream file(path);
+  if (!file) {
+    return false;
+  }
+  std::string line;
+  while (std::getline(file, line)) {
+    size_t hash = line.find('#');
+    if (hash != std::string::npos) {
+      line.resize(hash);
+    }
+    char id[128];
+    char secret[128];
+    if (sscanf(line.c_str(), "%127s %127s", id, secret) == 2) {
+      devices.push_back({ id, secret });
+    }
+  }
+  return true;
+}
+
+/**
+ * Create devices through the API (POST /devices) and append them to the credentials file
+ * @param loop - Event loop
+ * @param config - Simulation settings (provision, devicesFile, apiKey)
+ * @param server - API server
+ * @param devices - Receives the created devices
+ * @return number of devices created
+ */
+static int provisionDevices(EventLoop& loop, const SimulatorConfig& config, const ServerAddress& server,
+                            std::vector<DeviceCredentials>& devices) {
+  std::ofstream file(config.devicesFile, std::ios::app);
+  if (!file) {
+    fprintf(stderr, "Can't write %s\n", config.devicesFile.c_str());
+    return 0;
+  }
+
+  std::random_device entropy;
+  std::mt19937 random(entropy());
+  int next = 0;
+  int done = 0;
+  int created = 0;
+  std::vector<std::unique_ptr<HttpConnection>> pool;
+  std::function<void(HttpConnection&)> createNext = [&](HttpConnection& connection) {
+    if (next >= config.provision) {
+      return;
+    }
+    int number = next++;
+    char secret[17];
+    snprintf(secret, sizeof(secret), "%08x%08x", (unsigned)random(), (unsigned)random());
+    std::string body = "{\"name\":";
+    JsonParser::appendString(body, ("Simulated drawer " + std::to_string(number + 1)).c_str());
+    body += ",\"location\":\"device-simulator\",\"secret\":";
+    JsonParser::appendString(body, secret);
+    body += "}";
+    std::string secretText = secret;
+
+    connection.request("POST", "/devices", "X-API-Key: " + config.apiKey + "\r\n", body, config.timeoutMs,
+                       [&, secretText](const HttpResponse& response) {
+                         JsonValue doc;
+                         const char* id = NULL;
+                         if (response.status == 201 && JsonParser::parse(response.body, doc)) {
+                           id = doc["data"]["id"].asString();
+                         }
+                         if (id) {
+                           devices.push_back({ id, secretText });
+                           file << id << ' ' << secretText << '\n';
+                           created++;
+                         } else if (done - created == 0) {
+                           // Only the first failure, they usually all fail the same way
+                           fprintf(stderr, "Provisioning failed (HTTP %d): %.200s\n", response.status, response.body.c_str());
+                         }
+                         if (++done == config.provision) {
+                           loop.stop();
+                         } else {
+                           createNext(connection);
+                         }
+                       });
+  };
+
+  for (int i = 0; i < config.generatorConnections && i < config.provision; i++) {
+    pool.emplace_back(new HttpConnection(loop, server, NULL));
+  }
+  for (auto& connection : pool) {
+    createNext(*connection);
+  }
+  loop.run(0, &interrupted);
+  printf("Provisioned %d of %d devices into %s\n", created, config.provision, config.devicesFile.c_str());
+  return created;
+}
+
+/**
+ * Parse the --bind addresses
+ * @param addresses - IPv4 or IPv6 literals
+ * @param out - Receives the socket addresses (port 0)
+ * @return false if one is not an address
+ */
+static bool parseBindAddresses(const std::vector<std::string>& addresses, std::vector<struct sockaddr_storage>& out) {
+  for (const std::string& text : addresses) {
+    struct sockaddr_storage address = {};
+    struct sockaddr_in* v4 = (struct sockaddr_in*)&address;
+    struct sockaddr_in6* v6 = (struct sockaddr_in6*)&address;
+    if (inet_pton(AF_INET, text.c_str(), &v4->sin_addr) == 1) {
+      v4->sin_family = AF_INET;
+    } else if (inet_pton(AF_INET6, text.c_str(), &v6->sin6_addr) == 1) {
+      v6->sin6_family = AF_INET6;
+    } else {
+      fprintf(stderr, "Invalid --bind address: %s\n", text.c_str());
+      return false;
+    }
+    out.push_back(address);
+  }
+  return true;
+}
+
+/**
+ * Raise the open file limit to fit one socket per device
+ * @param needed - Descriptors the run needs
+ * @return false if the hard limit is too low
+ */
+static bool raiseFileLimit(rlim_t needed) {
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) != 0) {
+    return true;
+  }
+  if (limit.rlim_cur < needed) {
+    limit.rlim_cur = limit.rlim_max == RLIM_INFINITY || limit.rlim_max >= needed ? needed : limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+  if (limit.rlim_cur < needed) {
+    fprintf(stderr, "Open file limit %llu is below the %llu sockets needed, raise it (ulimit -n) or simulate fewer devices\n",
+            (unsigned long long)limit.rlim_cur, (unsigned long long)needed);
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  SimulatorConfig config;
+  if (!config.parse(argc, argv)) {
+    return 2;
+  }
+
+  ServerAddress server;
+  std::string error;
+  if (!server.resolve(config.serverUrl, error)) {
+    fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+  std::vector<struct sockaddr_storage> localAddresses;
+  if (!parseBindAddresses(config.bindAddresses, localAddresses)) {
+    return 2;
+  }
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  signal(SIGPIPE, SIG_IGN);
+
+  EventLoop loop;
+  if (!loop.isValid()) {
+    perror("epoll_create1");
+    return 1;
+  }
+
+  std::vector<DeviceCredentials> devices;
+  bool loaded = loadDevices(config.devicesFile, devices);
+  if (config.provision > 0) {
+    provisionDevices(loop, config, server, devices);
+  } else if (!loaded) {
+    fprintf(stderr, "Can't read %s (create devices with --provision N)\n", config.devicesFile.c_str());
+    return 1;
+  }
+  if (config.deviceCount > 0 && (size_t)config.deviceCount < devices.size()) {
+    devices.resize(config.deviceCount);
+  }
+  if (devices.empty()) {
+    fprintf(stderr, "No devices to simulate\n");
+    return 1;
+  }
+  if (!raiseFileLimit(devices.size() + config.generatorConnections + 64)) {
+    return 1;
+  }
+  size_t perAddress = devices.size() / (localAddresses.empty() ? 1 : localAddresses.size());
+  if (perAddress > 28000) {
+    printf("Warning: %zu connections per source address may exhaust the ephemeral ports, add --bind addresses\n", perAddress);
+  }
+
+  SimulatorStats stats;
+  CommandTracker tracker(stats);
+  std::vector<std::unique_ptr<VirtualDevice>> fleet;
+  fleet.reserve(devices.size());
+  for (size_t i = 0; i < devices.size(); i++) {
+    const struct sockaddr_storage* local = localAddresses.empty() ? NULL : &localAddresses[i % localAddresses.size()];
+    fleet.emplace_back(new VirtualDevice(loop, config, stats, tracker, server, devices[i], local, config.seed * 7919 + i));
+  }
+  CommandGenerator generator(loop, config, stats, tracker, server, devices, localAddresses);
+
+  printf("Simulating %zu devices against %s (wait %d s, poll %lu ms, %.1f commands/s, fail %.2f, ack loss %.2f, disconnect %.2f)\n",
+         devices.size(), config.serverUrl.c_str(), config.waitSeconds, config.pollIntervalMs, config.commandRate,
+         config.failRatio, config.ackLossRatio, config.disconnectRatio);
+
+  // Boots spread over the ramp, commands start once the whole fleet is up
+  uint64_t rampMs = config.rampSeconds * 1000;
+  for (size_t i = 0; i < fleet.size(); i++) {
+    fleet[i]->start(rampMs * i / fleet.size());
+  }
+  loop.addTimer(rampMs, [&generator]() { generator.start(); });
+
+  uint64_t startMs = EventLoop::nowMs();
+  uint64_t lastReportMs = startMs;
+  std::function<void()> report = [&]() {
+    uint64_t now = EventLoop::nowMs();
+    size_t online = 0;
+    for (const auto& device : fleet) {
+      online += device->isOnline() ? 1 : 0;
+    }
+    stats.reportInterval(now - lastReportMs, now - startMs, online);
+    tracker.prune(EventLoop::nowUs());
+    lastReportMs = now;
+    loop.addTimer(config.reportSeconds * 1000, report);
+  };
+  loop.addTimer(config.reportSeconds * 1000, report);
+
+  loop.run(config.durationSeconds > 0 ? startMs + config.durationSeconds * 1000 : 0, &interrupted);
+
+  uint64_t endMs = EventLoop::nowMs();
+  if (endMs > lastReportMs) {
+    size_t online = 0;
+    for (const auto& device : fleet) {
+      online += device->isOnline() ? 1 : 0;
+    }
+    stats.reportInterval(endMs - lastReportMs, endMs - startMs, online);
+  }
+  stats.reportTotal(endMs - startMs, tracker.getUndelivered());
+  return 0;
+}
@@ -0,0 +1,183 @@
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <vector>
+
+/**
+ * Receiver of the readiness events of a file descriptor
+ */
+class IoHandler {
+public:
+  virtual ~IoHandler() {}
+
+  /**
+   * Handle the events reported for the descriptor
+   * @param events - EPOLLIN / EPOLLOUT / EPOLLERR / EPOLLHUP bits
+   */
+  virtual void onIo(uint32_t events) = 0;
+};
+
+/**
+ * Single-threaded event loop: epoll for the sockets and a heap of timers
+ * Every virtual device, connection and timer of the simulator runs on it,
+ * so nothing is ever locked. Timers can't be cancelled, their owners ignore
+ * the ones that are no longer current.
+ */
+class EventLoop {
+public:
+  // Constructor
+  EventLoop() {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    stopped = false;
+    sequence = 0;
+  }
+
+  ~EventLoop() {
+    if (epollFd >= 0) {
+      close(epollFd);
+    }
+  }
+
+  /**
+   * Check if the epoll instance was created
+   * @return true if the loop can run
+   */
+  bool isValid() const {
+    return epollFd >= 0;
+  }
+
+  /**
+   * Get the monotonic time
+   * @return microseconds since an arbitrary point
+   */
+  static uint64_t nowUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+  }
+
+  /**
+   * Get the monotonic time
+   * @return milliseconds since an arbitrary point
+   */
+  static uint64_t nowMs() {
+    return nowUs() / 1000;
+  }
+
+  /**
+   * Watch a descriptor
+   * @param fd - Descriptor
+   * @param handler - Receives its events until remove()
+   * @param events - EPOLLIN / EPOLLOUT bits to watch
+   * @return true if registered
+   */
+  bool add(int fd, IoHandler* handler, uint32_t events) {
+    struct epoll_event event = {};
+    event.events = events;
+    event.data.ptr = handler;
+    return epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == 0;
+  }
+
+  /**
+   * Change the events watched on a descriptor
+   * @param fd - Descriptor registered with add()
+   * @param handler - Its handler
+   * @param events - EPOLLIN / EPOLLOUT bits to watch
+   */
+  void modify(int fd, IoHandler* handler, uint32_t events) {
+    struct epoll_event event = {};
+    event.events = events;
+    event.data.ptr = handler;
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event);
+  }
+
+  /**
+   * Stop watching a descriptor, must be called before closing it
+   * @param fd - Descriptor registered with add()
+   */
+  void remove(int fd) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+  }
+
+  /**
+   * Run a callback later on the loop
+   * @param delayMs - Delay in milliseconds (0 = on the next iteration)
+   * @param callback - Function to run
+   */
+  void addTimer(uint64_t delayMs, std::function<void()> callback) {
+    Timer timer;
+    timer.at = nowMs() + delayMs;
+    timer.sequence = sequence++;
+    timer.callback = std::move(callback);
+    timers.push(std::move(timer));
+  }
+
+  /**
+   * Run the loop until stop() is called or the deadline passes
+   * @param untilMs - nowMs() deadline, 0 = no deadline
+   * @param interrupted - Checked on every iteration (set from a signal handler), may be NULL
+   */
+  void run(uint64_t untilMs, volatile sig_atomic_t* interrupted) {
+    std::vector<struct epoll_event> events(1024);
+    stopped = false;
+    while (!stopped && !(interrupted && *interrupted)) {
+      uint64_t now = nowMs();
+      if (untilMs != 0 && now >= untilMs) {
+        break;
+      }
+
+      // Run the timers that are due, the ones they add wait for the next iteration
+      size_t due = timers.size();
+      while (due-- > 0 && !timers.empty() && timers.top().at <= now) {
+        std::function<void()> callback = std::move(const_cast<Timer&>(timers.top()).callback);
+        timers.pop();
+        callback();
+      }
+
+      // Sleep until the next timer, capped so deadlines and signals are noticed
+      int waitMs = 100;
+      if (!timers.empty()) {
+        uint64_t next = timers.top().at;
+        now = nowMs();
+        waitMs = next <= now ? 0 : (int)std::min<uint64_t>(next - now, (uint64_t)waitMs);
+      }
+      int count = epoll_wait(epollFd, events.data(), (int)events.size(), waitMs);
+      for (int i = 0; i < count; i++) {
+        static_cast<IoHandler*>(events[i].data.ptr)->onIo(events[i].events);
+      }
+    }
+  }
+
+  /**
+   * Make run() return after the current iteration
+   */
+  void stop() {
+    stopped = true;
+  }
+
+private:
+  struct Timer {
+    uint64_t at;        // nowMs() when the callback is due
+    uint64_t sequence;  // Keeps timers due at the same time in the order they were added
+    std::function<void()> callback;
+
+    bool operator>(const Timer& other) const {
+      return at != other.at ? at > other.at : sequence > other.sequence;
+    }
+  };
+
+  int epollFd;
+  bool stopped;
+  uint64_t sequence;
+  std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers;
+};
+
+#endif
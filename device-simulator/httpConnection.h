@@ -0,0 +1,513 @@
+#ifndef HTTPCONNECTION_H
+#define HTTPCONNECTION_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "eventLoop.h"
+
+// Request failures, reported instead of an HTTP status (same meaning as the HTTPC_ERROR_* codes on the device)
+#define HTTP_ERROR_CONNECT -1  // connection refused, unreachable or out of sockets
+#define HTTP_ERROR_SEND -2     // connection lost while sending the request
+#define HTTP_ERROR_READ -3     // connection lost or invalid response while reading it
+#define HTTP_ERROR_TIMEOUT -4  // no complete response in time
+
+/**
+ * Address of the API server, from serverUrl ("http://host:port/api/v1")
+ */
+struct ServerAddress {
+  struct sockaddr_storage address;
+  socklen_t addressLength = 0;
+  std::string hostHeader;  // "host:port"
+  std::string basePath;    // "/api/v1", prefix of every endpoint path
+
+  /**
+   * Resolve a server URL
+   * @param url - http:// URL of the API
+   * @param error - Receives the reason on failure
+   * @return true if resolved
+   */
+  bool resolve(const std::string& url, std::string& error) {
+    if (url.compare(0, 7, "http://") != 0) {
+      error = "only http:// servers are supported (terminate TLS in front of the simulator's target or test the plain backend)";
+      return false;
+    }
+    std::string rest = url.substr(7);
+    size_t slash = rest.find('/');
+    std::string hostPort = rest.substr(0, slash);
+    basePath = slash == std::string::npos ? "" : rest.substr(slash);
+    while (!basePath.empty() && basePath.back() == '/') {
+      basePath.pop_back();
+    }
+
+    std::string host = hostPort;
+    std::string port = "80";
+    size_t colon = hostPort.rfind(':');
+    if (colon != std::string::npos) {
+      host = hostPort.substr(0, colon);
+      port = hostPort.substr(colon + 1);
+    }
+    hostHeader = hostPort;
+
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* result = NULL;
+    int rc = getaddrinfo(host.c_str(), port.c_str(), &hints, &result);
+    if (rc != 0 || !result) {
+      error = std::string("can't resolve ") + host + ": " + gai_strerror(rc);
+      return false;
+    }
+    memcpy(&address, result->ai_addr, result->ai_addrlen);
+    addressLength = result->ai_addrlen;
+    freeaddrinfo(result);
+    return true;
+  }
+};
+
+/**
+ * Parsed HTTP response
+ */
+struct HttpResponse {
+  int status = 0;
+  std::vector<std::pair<std::string, std::string>> headers;
+  std::string body;
+
+  /**
+   * Get a response header
+   * @param name - Header name (case insensitive)
+   * @return the value, NULL if the header is missing
+   */
+  const char* header(const char* name) const {
+    for (const auto& header : headers) {
+      if (strcasecmp(header.first.c_str(), name) == 0) {
+        return header.second.c_str();
+      }
+    }
+    return NULL;
+  }
+};
+
+/**
+ * Persistent HTTP/1.1 client connection on the event loop
+ * One request at a time, the socket is kept open between requests (keep-alive)
+ * like the device's shared connection, and a request that finds the idle socket
+ * closed by the server is retried once on a fresh one.
+ */
+class HttpConnection : public IoHandler {
+public:
+  typedef std::function<void(const HttpResponse& response)> Callback;  // response.status < 0 on HTTP_ERROR_*
+
+  /**
+   * Constructor
+   * @param loop - Event loop the connection runs on
+   * @param server - Server to connect to
+   * @param localAddress - Source address to bind (NULL = chosen by the kernel)
+   */
+  HttpConnection(EventLoop& loop, const ServerAddress& server, const struct sockaddr_storage* localAddress)
+      : loop(loop), server(server), localAddress(localAddress) {
+    fd = -1;
+    state = STATE_IDLE;
+    generation = 0;
+    written = 0;
+    reused = false;
+    retried = false;
+    connects = 0;
+  }
+
+  ~HttpConnection() {
+    closeSocket();
+  }
+
+  HttpConnection(const HttpConnection&) = delete;
+  HttpConnection& operator=(const HttpConnection&) = delete;
+
+  /**
+   * Check if a request is in flight
+   * @return true until its callback ran
+   */
+  bool isBusy() const {
+    return state != STATE_IDLE;
+  }
+
+  /**
+   * Get how many TCP connections were opened
+   * @return connects since the connection was created
+   */
+  unsigned long getConnectCount() const {
+    return connects;
+  }
+
+  /**
+   * Send a request, the callback runs on the loop with the response or an HTTP_ERROR_* status
+   * @param method - HTTP method
+   * @param path - Request target, appended to the server base path
+   * @param extraHeaders - Header lines, each ending with \r\n
+   * @param body - Request body ("" for none)
+   * @param timeoutMs - Time allowed for the whole exchange
+   * @param callback - Receives the response
+   */
+  void request(const char* method, const std::string& path, const std::string& extraHeaders, const std::string& body,
+               uint64_t timeoutMs, Callback callback) {
+    outgoing.clear();
+    outgoing.reserve(256 + extraHeaders.size() + body.size());
+    outgoing += method;
+    outgoing += ' ';
+    outgoing += server.basePath;
+    outgoing += path;
+    outgoing += " HTTP/1.1\r\nHost: ";
+    outgoing += server.hostHeader;
+    outgoing += "\r\nUser-Agent: device-simulator\r\nAccept: application/json\r\nConnection: keep-alive\r\n";
+    outgoing += extraHeaders;
+    if (!body.empty()) {
+      outgoing += "Content-Type: application/json\r\nContent-Length: ";
+      outgoing += std::to_string(body.size());
+      outgoing += "\r\n";
+    }
+    outgoing += "\r\n";
+    outgoing += body;
+
+    this->callback = std::move(callback);
+    retried = false;
+    uint64_t current = ++generation;
+    loop.addTimer(timeoutMs, [this, current]() {
+      if (generation == current && state != STATE_IDLE) {
+        fail(HTTP_ERROR_TIMEOUT);
+      }
+    });
+    start();
+  }
+
+  /**
+   * Drop the socket, the next request opens a new one
+   * (an in-flight request fails with HTTP_ERROR_READ)
+   */
+  void close() {
+    if (state != STATE_IDLE) {
+      fail(HTTP_ERROR_READ);
+    } else {
+      closeSocket();
+    }
+  }
+
+  void onIo(uint32_t events) override {
+    if (fd < 0) {
+      return;
+    }
+    if (state == STATE_IDLE) {
+      // Idle socket readable: the server closed it (keep-alive timeout), reopen on the next request
+      char discard[256];
+      ssize_t n = recv(fd, discard, sizeof(discard), 0);
+      if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        closeSocket();
+      }
+      return;
+    }
+    if (state == STATE_CONNECTING) {
+      int error = 0;
+      socklen_t length = sizeof(error);
+      getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length);
+      if (error != 0 || (events & (EPOLLERR | EPOLLHUP))) {
+        fail(HTTP_ERROR_CONNECT);
+        return;
+      }
+      state = STATE_SENDING;
+    }
+    if (state == STATE_SENDING && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+      if (!flush()) {
+        return;
+      }
+    }
+    if (events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+      receive();
+    }
+  }
+
+private:
+  enum State {
+    STATE_IDLE,        // No request in flight
+    STATE_CONNECTING,  // Waiting for the TCP handshake
+    STATE_SENDING,     // Writing the request
+    STATE_READING,     // Waiting for the complete response
+  };
+
+  EventLoop& loop;
+  const ServerAddress& server;
+  const struct sockaddr_storage* localAddress;
+  int fd;
+  State state;
+  uint64_t generation;   // Incremented per request, stale timeouts are ignored
+  std::string outgoing;  // Request being sent
+  size_t written;        // Bytes of outgoing already sent
+  std::string incoming;  // Response bytes received so far
+  bool reused;           // Whether the request went out on an already open socket
+  bool retried;          // Whether the request was already retried on a fresh socket
+  unsigned long connects;
+  Callback callback;
+
+  void start() {
+    written = 0;
+    incoming.clear();
+    if (fd >= 0) {
+      reused = true;
+      state = STATE_SENDING;
+      loop.modify(fd, this, EPOLLIN | EPOLLOUT);
+      flush();
+      return;
+    }
+    reused = false;
+    if (!openSocket()) {
+      // Report on the loop, never from inside request()
+      uint64_t current = generation;
+      loop.addTimer(0, [this, current]() {
+        if (generation == current && state != STATE_IDLE) {
+          fail(HTTP_ERROR_CONNECT);
+        }
+      });
+      state = STATE_CONNECTING;
+    }
+  }
+
+  bool openSocket() {
+    fd = socket(server.address.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+      return false;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (localAddress) {
+      socklen_t length = localAddress->ss_family == AF_INET6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+      if (bind(fd, (const struct sockaddr*)localAddress, length) != 0) {
+        ::close(fd);
+        fd = -1;
+        return false;
+      }
+    }
+    connects++;
+    int rc = connect(fd, (const struct sockaddr*)&server.address, server.addressLength);
+    if (rc != 0 && errno != EINPROGRESS) {
+      ::close(fd);
+      fd = -1;
+      return false;
+    }
+    if (!loop.add(fd, this, EPOLLIN | EPOLLOUT)) {
+      ::close(fd);
+      fd = -1;
+      return false;
+    }
+    state = rc == 0 ? STATE_SENDING : STATE_CONNECTING;
+    return true;
+  }
+
+  void closeSocket() {
+    if (fd >= 0) {
+      loop.remove(fd);
+      ::close(fd);
+      fd = -1;
+    }
+  }
+
+  /**
+   * Write the pending request bytes
+   * @return false if the request failed (already reported)
+   */
+  bool flush() {
+    while (written < outgoing.size()) {
+      ssize_t n = send(fd, outgoing.data() + written, outgoing.size() - written, MSG_NOSIGNAL);
+      if (n > 0) {
+        written += n;
+        continue;
+      }
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return true;  // Wait for EPOLLOUT
+      }
+      if (retryStale()) {
+        return false;
+      }
+      fail(HTTP_ERROR_SEND);
+      return false;
+    }
+    state = STATE_READING;
+    loop.modify(fd, this, EPOLLIN);
+    return true;
+  }
+
+  void receive() {
+    char buffer[16384];
+    while (true) {
+      ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+      if (n > 0) {
+        incoming.append(buffer, n);
+        continue;
+      }
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        break;
+      }
+      // Connection closed by the server (or reset)
+      HttpResponse response;
+      if (n == 0 && parse(response, true) > 0) {
+        closeSocket();
+        finish(response);
+      } else if (!retryStale()) {
+        fail(HTTP_ERROR_READ);
+      }
+      return;
+    }
+
+    HttpResponse response;
+    int parsed = parse(response, false);
+    if (parsed < 0) {
+      fail(HTTP_ERROR_READ);
+    } else if (parsed > 0) {
+      const char* connection = response.header("Connection");
+      if (connection && strcasecmp(connection, "close") == 0) {
+        closeSocket();
+      }
+      finish(response);
+    }
+  }
+
+  /**
+   * Resend the request on a new socket if a reused one turned out to be closed
+   * (nothing received yet, the server dropped the idle keep-alive connection)
+   * @return true if the request was restarted
+   */
+  bool retryStale() {
+    if (!reused || retried || !incoming.empty()) {
+      return false;
+    }
+    retried = true;
+    closeSocket();
+    start();
+    return true;
+  }
+
+  void finish(HttpResponse& response) {
+    state = STATE_IDLE;
+    if (fd >= 0) {
+      loop.modify(fd, this, EPOLLIN);  // Notice the server closing the idle socket
+    }
+    Callback done = std::move(callback);
+    callback = nullptr;
+    done(response);
+  }
+
+  void fail(int error) {
+    closeSocket();
+    state = STATE_IDLE;
+    HttpResponse response;
+    response.status = error;
+    Callback done = std::move(callback);
+    callback = nullptr;
+    if (done) {
+      done(response);
+    }
+  }
+
+  /**
+   * Parse the received bytes
+   * @param response - Receives the response once complete
+   * @param closed - Whether the server closed the connection (ends a body without length)
+   * @return 1 if complete, 0 if more bytes are needed, -1 if invalid
+   */
+  int parse(HttpResponse& response, bool closed) {
+    size_t headerEnd = incoming.find("\r\n\r\n");
+    if (headerEnd == std::string::npos) {
+      return incoming.size() > 65536 ? -1 : 0;
+    }
+    if (incoming.compare(0, 5, "HTTP/") != 0) {
+      return -1;
+    }
+    size_t space = incoming.find(' ');
+    if (space == std::string::npos || space > headerEnd) {
+      return -1;
+    }
+    response.status = atoi(incoming.c_str() + space + 1);
+
+    long contentLength = -1;
+    bool chunked = false;
+    size_t lineStart = incoming.find("\r\n") + 2;
+    while (lineStart < headerEnd) {
+      size_t lineEnd = incoming.find("\r\n", lineStart);
+      size_t colon = incoming.find(':', lineStart);
+      if (colon != std::string::npos && colon < lineEnd) {
+        std::string name = incoming.substr(lineStart, colon - lineStart);
+        size_t valueStart = incoming.find_first_not_of(' ', colon + 1);
+        std::string value = valueStart < lineEnd ? incoming.substr(valueStart, lineEnd - valueStart) : "";
+        if (strcasecmp(name.c_str(), "Content-Length") == 0) {
+          contentLength = atol(value.c_str());
+        } else if (strcasecmp(name.c_str(), "Transfer-Encoding") == 0 && strcasestr(value.c_str(), "chunked")) {
+          chunked = true;
+        }
+        response.headers.emplace_back(std::move(name), std::move(value));
+      }
+      lineStart = lineEnd + 2;
+    }
+
+    size_t bodyStart = headerEnd + 4;
+    if (response.status == 204 || response.status == 304 || (response.status >= 100 && response.status < 200)) {
+      return 1;
+    }
+    if (chunked) {
+      return decodeChunked(bodyStart, response.body);
+    }
+    if (contentLength >= 0) {
+      if (incoming.size() - bodyStart < (size_t)contentLength) {
+        return 0;
+      }
+      response.body = incoming.substr(bodyStart, contentLength);
+      return 1;
+    }
+    // No length: the body ends with the connection
+    if (!closed) {
+      return 0;
+    }
+    response.body = incoming.substr(bodyStart);
+    return 1;
+  }
+
+  /**
+   * Decode a chunked body
+   * @param position - First byte of the body in incoming
+   * @param body - Receives the decoded body
+   * @return 1 if complete, 0 if more bytes are needed, -1 if invalid
+   */
+  int decodeChunked(size_t position, std::string& body) {
+    body.clear();
+    while (true) {
+      size_t lineEnd = incoming.find("\r\n", position);
+      if (lineEnd == std::string::npos) {
+        return 0;
+      }
+      char* end = NULL;
+      unsigned long size = strtoul(incoming.c_str() + position, &end, 16);
+      if (end == incoming.c_str() + position) {
+        return -1;
+      }
+      position = lineEnd + 2;
+      if (size == 0) {
+        // Trailers end with an empty line
+        return incoming.find("\r\n", position) == std::string::npos ? 0 : 1;
+      }
+      if (incoming.size() < position + size + 2) {
+        return 0;
+      }
+      body.append(incoming, position, size);
+      position += size + 2;
+    }
+  }
+};
+
+#endif
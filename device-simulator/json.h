@@ -0,0 +1,321 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+/**
+ * Parsed JSON value
+ * Just enough of a document model for the server responses the simulator reads
+ * (token, commands, command codes), objects keep their keys in order.
+ */
+struct JsonValue {
+  enum Type { JSON_NULL, JSON_BOOL, JSON_NUMBER, JSON_STRING, JSON_ARRAY, JSON_OBJECT };
+
+  Type type = JSON_NULL;
+  bool boolean = false;
+  double number = 0;
+  std::string string;
+  std::vector<std::string> keys;   // Member names of an object
+  std::vector<JsonValue> items;    // Elements of an array, member values of an object
+
+  /**
+   * Get a member of an object
+   * @param key - Member name
+   * @return the member, a null value if this is not an object or the member is missing
+   */
+  const JsonValue& operator[](const char* key) const {
+    static const JsonValue missing;
+    if (type == JSON_OBJECT) {
+      for (size_t i = 0; i < keys.size(); i++) {
+        if (keys[i] == key) {
+          return items[i];
+        }
+      }
+    }
+    return missing;
+  }
+
+  bool isNull() const {
+    return type == JSON_NULL;
+  }
+
+  /**
+   * Get a string value
+   * @return the string, NULL if this is not a string
+   */
+  const char* asString() const {
+    return type == JSON_STRING ? string.c_str() : NULL;
+  }
+
+  /**
+   * Get an integer value
+   * @param fallback - Returned if this is not a number
+   * @return the number truncated to an integer
+   */
+  long asInt(long fallback) const {
+    return type == JSON_NUMBER ? (long)number : fallback;
+  }
+};
+
+/**
+ * Recursive descent JSON parser (RFC 8259, nesting limited to MAX_DEPTH)
+ */
+class JsonParser {
+public:
+  static const int MAX_DEPTH = 32;
+
+  /**
+   * Parse a document
+   * @param text - JSON text
+   * @param value - Receives the parsed document
+   * @return true if the whole text is one valid value
+   */
+  static bool parse(const std::string& text, JsonValue& value) {
+    JsonParser parser(text);
+    if (!parser.parseValue(value, 0)) {
+      return false;
+    }
+    parser.skipSpace();
+    return parser.position == text.size();
+  }
+
+  /**
+   * Append a string to a JSON text as a quoted, escaped literal
+   * @param out - Text to append to
+   * @param text - String to quote
+   */
+  static void appendString(std::string& out, const char* text) {
+    static const char hex[] = "0123456789abcdef";
+    out += '"';
+    for (const unsigned char* c = (const unsigned char*)text; *c; c++) {
+      if (*c == '"' || *c == '\\') {
+        out += '\\';
+        out += (char)*c;
+      } else if (*c < 0x20) {
+        out += "\\u00";
+        out += hex[*c >> 4];
+        out += hex[*c & 0xF];
+      } else {
+        out += (char)*c;
+      }
+    }
+    out += '"';
+  }
+
+private:
+  const std::string& text;
+  size_t position;
+
+  explicit JsonParser(const std::string& text) : text(text), position(0) {}
+
+  void skipSpace() {
+    while (position < text.size() && (text[position] == ' ' || text[position] == '\t' || text[position] == '\n' || text[position] == '\r')) {
+      position++;
+    }
+  }
+
+  bool consume(const char* literal) {
+    size_t length = strlen(literal);
+    if (text.compare(position, length, literal) != 0) {
+      return false;
+    }
+    position += length;
+    return true;
+  }
+
+  bool parseValue(JsonValue& value, int depth) {
+    skipSpace();
+    if (position >= text.size() || depth > MAX_DEPTH) {
+      return false;
+    }
+    char c = text[position];
+    if (c == '{') {
+      return parseObject(value, depth);
+    }
+    if (c == '[') {
+      return parseArray(value, depth);
+    }
+    if (c == '"') {
+      value.type = JsonValue::JSON_STRING;
+      return parseString(value.string);
+    }
+    if (c == 't' || c == 'f') {
+      value.type = JsonValue::JSON_BOOL;
+      value.boolean = c == 't';
+      return consume(value.boolean ? "true" : "false");
+    }
+    if (c == 'n') {
+      value.type = JsonValue::JSON_NULL;
+      return consume("null");
+    }
+    return parseNumber(value);
+  }
+
+  bool parseObject(JsonValue& value, int depth) {
+    value.type = JsonValue::JSON_OBJECT;
+    position++;  // {
+    skipSpace();
+    if (position < text.size() && text[position] == '}') {
+      position++;
+      return true;
+    }
+    while (true) {
+      skipSpace();
+      std::string key;
+      if (position >= text.size() || text[position] != '"' || !parseString(key)) {
+        return false;
+      }
+      skipSpace();
+      if (position >= text.size() || text[position] != ':') {
+        return false;
+      }
+      position++;
+      value.keys.push_back(std::move(key));
+      value.items.emplace_back();
+      if (!parseValue(value.items.back(), depth + 1)) {
+        return false;
+      }
+      skipSpace();
+      if (position < text.size() && text[position] == ',') {
+        position++;
+      } else if (position < text.size() && text[position] == '}') {
+        position++;
+        return true;
+      } else {
+        return false;
+      }
+    }
+  }
+
+  bool parseArray(JsonValue& value, int depth) {
+    value.type = JsonValue::JSON_ARRAY;
+    position++;  // [
+    skipSpace();
+    if (position < text.size() && text[position] == ']') {
+      position++;
+      return true;
+    }
+    while (true) {
+      value.items.emplace_back();
+      if (!parseValue(value.items.back(), depth + 1)) {
+        return false;
+      }
+      skipSpace();
+      if (position < text.size() && text[position] == ',') {
+        position++;
+      } else if (position < text.size() && text[position] == ']') {
+        position++;
+        return true;
+      } else {
+        return false;
+      }
+    }
+  }
+
+  bool parseHex4(uint32_t& code) {
+    if (position + 4 > text.size()) {
+      return false;
+    }
+    code = 0;
+    for (int i = 0; i < 4; i++) {
+      char c = text[position++];
+      code <<= 4;
+      if (c >= '0' && c <= '9') {
+        code |= c - '0';
+      } else if (c >= 'a' && c <= 'f') {
+        code |= c - 'a' + 10;
+      } else if (c >= 'A' && c <= 'F') {
+        code |= c - 'A' + 10;
+      } else {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  static void appendUtf8(std::string& out, uint32_t code) {
+    if (code < 0x80) {
+      out += (char)code;
+    } else if (code < 0x800) {
+      out += (char)(0xC0 | (code >> 6));
+      out += (char)(0x80 | (code & 0x3F));
+    } else if (code < 0x10000) {
+      out += (char)(0xE0 | (code >> 12));
+      out += (char)(0x80 | ((code >> 6) & 0x3F));
+      out += (char)(0x80 | (code & 0x3F));
+    } else {
+      out += (char)(0xF0 | (code >> 18));
+      out += (char)(0x80 | ((code >> 12) & 0x3F));
+      out += (char)(0x80 | ((code >> 6) & 0x3F));
+      out += (char)(0x80 | (code & 0x3F));
+    }
+  }
+
+  bool parseString(std::string& out) {
+    position++;  // opening quote
+    while (position < text.size()) {
+      char c = text[position++];
+      if (c == '"') {
+        return true;
+      }
+      if ((unsigned char)c < 0x20) {
+        return false;
+      }
+      if (c != '\\') {
+        out += c;
+        continue;
+      }
+      if (position >= text.size()) {
+        return false;
+      }
+      char escaped = text[position++];
+      switch (escaped) {
+        case '"': out += '"'; break;
+        case '\\': out += '\\'; break;
+        case '/': out += '/'; break;
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u': {
+          uint32_t code;
+          if (!parseHex4(code)) {
+            return false;
+          }
+          // Characters outside the BMP come as a surrogate pair
+          if (code >= 0xD800 && code <= 0xDBFF && consume("\\u")) {
+            uint32_t low;
+            if (!parseHex4(low) || low < 0xDC00 || low > 0xDFFF) {
+              return false;
+            }
+            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+          }
+          appendUtf8(out, code);
+          break;
+        }
+        default:
+          return false;
+      }
+    }
+    return false;
+  }
+
+  bool parseNumber(JsonValue& value) {
+    const char* start = text.c_str() + position;
+    char* end = NULL;
+    value.number = strtod(start, &end);
+    if (end == start) {
+      return false;
+    }
+    value.type = JsonValue::JSON_NUMBER;
+    position += end - start;
+    return true;
+  }
+};
+
+#endif
@@ -0,0 +1,245 @@
+#ifndef SIMULATORCONFIG_H
+#define SIMULATORCONFIG_H
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+/**
+ * Credentials of a simulated device
+ */
+struct DeviceCredentials {
+  std::string id;
+  std::string secret;
+};
+
+/**
+ * Simulation settings (command line options)
+ * Defaults follow the firmware config.h, so an unconfigured run loads the
+ * server like a fleet of stock drawers.
+ */
+struct SimulatorConfig {
+  // Server
+  std::string serverUrl = "http://127.0.0.1:3000/api/v1";
+  std::string apiKey;                        // X-API-Key for the command generator and provisioning (default: $API_KEY)
+  std::vector<std::string> bindAddresses;    // Source addresses, spread the sockets over them (ephemeral ports)
+
+  // Fleet
+  std::string devicesFile;                   // "deviceId secret" per line
+  int deviceCount = 0;                       // Devices to simulate, 0 = every device of the file
+  int provision = 0;                         // Devices to create through the API before the run
+  int drawers = 4;                           // Drawers per device
+  const char* firmware = "sim-1.0.0";        // Release reported in the status
+
+  // Device behaviour (config.h)
+  int maxBatch = 4;                          // MAX_BATCH_COMMANDS
+  int waitSeconds = 25;                      // LONG_POLL_SECONDS, 0 = interval polling only
+  unsigned long pollIntervalMs = 2000;       // POLL_IDLE_MIN_MS, idle poll interval (without slot or hint)
+  unsigned long fastIntervalMs = 500;        // POLL_FAST_INTERVAL_MS
+  unsigned long fastWindowMs = 60000;        // POLL_FAST_WINDOW_MS
+  unsigned long idleMaxMs = 60000;           // POLL_IDLE_MAX_MS, longest server hint applied
+  unsigned long errorBaseMs = 1000;          // POLL_ERROR_BASE_MS
+  unsigned long errorMaxMs = 120000;         // POLL_ERROR_MAX_MS
+  unsigned long timeoutMs = 5000;            // HTTP_TIMEOUT_MS
+  unsigned long actuationMs = 500;           // duration, time to execute a command before acking it
+  unsigned long statusIntervalMs = 60000;    // METRICS_REPORT_INTERVAL_MS, 0 = no status reports
+  bool useHints = true;                      // Apply X-Poll-Interval
+  bool useSlots = true;                      // Poll on the slot assigned with the token
+
+  // Command load
+  double commandRate = 0;                    // Commands created per second across the fleet
+  double openManyRatio = 0;                  // Share of open_many commands
+  int generatorConnections = 16;             // Parallel create requests
+
+  // Failure injection
+  double failRatio = 0;                      // Commands acknowledged as FAILED
+  double ackLossRatio = 0;                   // Ack requests dropped before being sent (replayed before the next poll)
+  double disconnectRatio = 0;                // Requests after which the connection is dropped
+
+  // Run
+  unsigned long rampSeconds = 10;            // Device starts spread over this time
+  unsigned long durationSeconds = 60;        // Length of the run, 0 = until interrupted
+  unsigned long reportSeconds = 10;          // Time between interval reports
+  unsigned int seed = 1;
+
+  /**
+   * Print the command line help
+   * @param program - Name of the executable
+   */
+  static void usage(const char* program) {
+    printf(
+        "Usage: %s [options]\n"
+        "Simulates drawers speaking the firmware protocol against the backend and reports\n"
+        "server latency percentiles and throughput.\n"
+        "\n"
+        "Server:\n"
+        "  --server URL            API base URL (default http://127.0.0.1:3000/api/v1)\n"
+        "  --api-key KEY           X-API-Key for --rate and --provision (default $API_KEY)\n"
+        "  --bind IP[,IP...]       source addresses, sockets are spread over them\n"
+        "Fleet:\n"
+        "  --devices FILE          credentials, one \"deviceId secret\" per line\n"
+        "  --count N               devices to simulate (default: all of FILE)\n"
+        "  --provision N           create N devices through the API first (appended to FILE)\n"
+        "  --drawers N             drawers per device (default 4)\n"
+        "Devices:\n"
+        "  --batch N               commands per poll (default 4)\n"
+        "  --wait S                long-poll wait, 0 = interval polling (default 25)\n"
+        "  --poll-interval MS      idle poll interval (default 2000)\n"
+        "  --fast-interval MS      poll interval after a command (default 500)\n"
+        "  --actuation MS          time to execute a command (default 500)\n"
+        "  --status-interval MS    status report interval, 0 = none (default 60000)\n"
+        "  --timeout MS            request timeout (default 5000)\n"
+        "  --no-hints              ignore X-Poll-Interval\n"
+        "  --no-slots              ignore the poll slot sent with the token\n"
+        "Load:\n"
+        "  --rate N                commands created per second (default 0)\n"
+        "  --open-many R           share of open_many commands, 0-1 (default 0)\n"
+        "  --generator-connections N  parallel create requests (default 16)\n"
+        "Failure injection (shares, 0-1):\n"
+        "  --fail R                commands acknowledged as FAILED\n"
+        "  --ack-loss R            ack requests dropped and replayed before the next poll\n"
+        "  --disconnect R          requests after which the connection is dropped\n"
+        "Run:\n"
+        "  --ramp S                spread device starts over S seconds (default 10)\n"
+        "  --duration S            run length, 0 = until Ctrl-C (default 60)\n"
+        "  --report S              interval report period (default 10)\n"
+        "  --seed N                random seed (default 1)\n",
+        program);
+  }
+
+  /**
+   * Parse the command line
+   * @param argc - Argument count
+   * @param argv - Arguments
+   * @return true if the options are valid
+   */
+  bool parse(int argc, char** argv) {
+    enum {
+      OPT_SERVER = 1000, OPT_API_KEY, OPT_BIND, OPT_DEVICES, OPT_COUNT, OPT_PROVISION, OPT_DRAWERS, OPT_BATCH, OPT_WAIT,
+      OPT_POLL_INTERVAL, OPT_FAST_INTERVAL, OPT_ACTUATION, OPT_STATUS_INTERVAL, OPT_TIMEOUT, OPT_NO_HINTS, OPT_NO_SLOTS,
+      OPT_RATE, OPT_OPEN_MANY, OPT_GENERATOR_CONNECTIONS, OPT_FAIL, OPT_ACK_LOSS, OPT_DISCONNECT, OPT_RAMP, OPT_DURATION,
+      OPT_REPORT, OPT_SEED, OPT_HELP,
+    };
+    static const struct option options[] = {
+      { "server", required_argument, NULL, OPT_SERVER },
+      { "api-key", required_argument, NULL, OPT_API_KEY },
+      { "bind", required_argument, NULL, OPT_BIND },
+      { "devices", required_argument, NULL, OPT_DEVICES },
+      { "count", required_argument, NULL, OPT_COUNT },
+      { "provision", required_argument, NULL, OPT_PROVISION },
+      { "drawers", required_argument, NULL, OPT_DRAWERS },
+      { "batch", required_argument, NULL, OPT_BATCH },
+      { "wait", required_argument, NULL, OPT_WAIT },
+      { "poll-interval", required_argument, NULL, OPT_POLL_INTERVAL },
+      { "fast-interval", required_argument, NULL, OPT_FAST_INTERVAL },
+      { "actuation", required_argument, NULL, OPT_ACTUATION },
+      { "status-interval", required_argument, NULL, OPT_STATUS_INTERVAL },
+      { "timeout", required_argument, NULL, OPT_TIMEOUT },
+      { "no-hints", no_argument, NULL, OPT_NO_HINTS },
+      { "no-slots", no_argument, NULL, OPT_NO_SLOTS },
+      { "rate", required_argument, NULL, OPT_RATE },
+      { "open-many", required_argument, NULL, OPT_OPEN_MANY },
+      { "generator-connections", required_argument, NULL, OPT_GENERATOR_CONNECTIONS },
+      { "fail", required_argument, NULL, OPT_FAIL },
+      { "ack-loss", required_argument, NULL, OPT_ACK_LOSS },
+      { "disconnect", required_argument, NULL, OPT_DISCONNECT },
+      { "ramp", required_argument, NULL, OPT_RAMP },
+      { "duration", required_argument, NULL, OPT_DURATION },
+      { "report", required_argument, NULL, OPT_REPORT },
+      { "seed", required_argument, NULL, OPT_SEED },
+      { "help", no_argument, NULL, OPT_HELP },
+      { NULL, 0, NULL, 0 },
+    };
+
+    const char* envKey = getenv("API_KEY");
+    if (envKey) {
+      apiKey = envKey;
+    }
+
+    int option;
+    while ((option = getopt_long(argc, argv, "h", options, NULL)) != -1) {
+      switch (option) {
+        case OPT_SERVER: serverUrl = optarg; break;
+        case OPT_API_KEY: apiKey = optarg; break;
+        case OPT_BIND: splitList(optarg, bindAddresses); break;
+        case OPT_DEVICES: devicesFile = optarg; break;
+        case OPT_COUNT: deviceCount = atoi(optarg); break;
+        case OPT_PROVISION: provision = atoi(optarg); break;
+        case OPT_DRAWERS: drawers = atoi(optarg); break;
+        case OPT_BATCH: maxBatch = atoi(optarg); break;
+        case OPT_WAIT: waitSeconds = atoi(optarg); break;
+        case OPT_POLL_INTERVAL: pollIntervalMs = strtoul(optarg, NULL, 10); break;
+        case OPT_FAST_INTERVAL: fastIntervalMs = strtoul(optarg, NULL, 10); break;
+        case OPT_ACTUATION: actuationMs = strtoul(optarg, NULL, 10); break;
+        case OPT_STATUS_INTERVAL: statusIntervalMs = strtoul(optarg, NULL, 10); break;
+        case OPT_TIMEOUT: timeoutMs = strtoul(optarg, NULL, 10); break;
+        case OPT_NO_HINTS: useHints = false; break;
+        case OPT_NO_SLOTS: useSlots = false; break;
+        case OPT_RATE: commandRate = atof(optarg); break;
+        case OPT_OPEN_MANY: openManyRatio = atof(optarg); break;
+        case OPT_GENERATOR_CONNECTIONS: generatorConnections = atoi(optarg); break;
+        case OPT_FAIL: failRatio = atof(optarg); break;
+        case OPT_ACK_LOSS: ackLossRatio = atof(optarg); break;
+        case OPT_DISCONNECT: disconnectRatio = atof(optarg); break;
+        case OPT_RAMP: rampSeconds = strtoul(optarg, NULL, 10); break;
+        case OPT_DURATION: durationSeconds = strtoul(optarg, NULL, 10); break;
+        case OPT_REPORT: reportSeconds = strtoul(optarg, NULL, 10); break;
+        case OPT_SEED: seed = strtoul(optarg, NULL, 10); break;
+        default:
+          usage(argv[0]);
+          return false;
+      }
+    }
+    return validate();
+  }
+
+private:
+  static void splitList(const char* text, std::vector<std::string>& out) {
+    std::string list = text;
+    size_t start = 0;
+    while (start <= list.size()) {
+      size_t comma = list.find(',', start);
+      std::string item = list.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+      if (!item.empty()) {
+        out.push_back(item);
+      }
+      if (comma == std::string::npos) {
+        break;
+      }
+      start = comma + 1;
+    }
+  }
+
+  static bool isRatio(double value) {
+    return value >= 0 && value <= 1;
+  }
+
+  bool validate() const {
+    if (devicesFile.empty()) {
+      fprintf(stderr, "--devices is required\n");
+      return false;
+    }
+    if ((commandRate > 0 || provision > 0) && apiKey.empty()) {
+      fprintf(stderr, "--rate and --provision need --api-key (or $API_KEY)\n");
+      return false;
+    }
+    if (drawers < 1 || maxBatch < 1 || waitSeconds < 0 || generatorConnections < 1 || deviceCount < 0 || provision < 0
+        || commandRate < 0) {
+      fprintf(stderr, "--drawers, --batch and --generator-connections must be positive, --wait, --count, --rate and --provision not negative\n");
+      return false;
+    }
+    if (!isRatio(openManyRatio) || !isRatio(failRatio) || !isRatio(ackLossRatio) || !isRatio(disconnectRatio)) {
+      fprintf(stderr, "--open-many, --fail, --ack-loss and --disconnect are shares between 0 and 1\n");
+      return false;
+    }
+    if (reportSeconds == 0) {
+      fprintf(stderr, "--report must be at least 1 second\n");
+      return false;
+    }
+    return true;
+  }
+};
+
+#endif
@@ -0,0 +1,269 @@
+#ifndef SIMULATORSTATS_H
+#define SIMULATORSTATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * Latency histogram with log-linear buckets
+ * Values below 64 us are exact, above that every power of two is split into
+ * 32 buckets, so percentiles are within ~3% for any value up to ~12 days while
+ * recording stays O(1) and the memory fixed, whatever the request rate.
+ */
+class LatencyHistogram {
+public:
+  static const int SUB_BUCKETS = 32;
+  static const int MAX_BITS = 40;  // Values are capped at 2^40 us
+  static const int BUCKET_COUNT = 2 * SUB_BUCKETS + (MAX_BITS - 6) * SUB_BUCKETS;
+
+  // Constructor
+  LatencyHistogram() {
+    reset();
+  }
+
+  /**
+   * Record a duration
+   * @param us - Duration in microseconds
+   */
+  void record(uint64_t us) {
+    if (us >= (1ULL << MAX_BITS)) {
+      us = (1ULL << MAX_BITS) - 1;
+    }
+    counts[bucketOf(us)]++;
+    count++;
+    sum += us;
+    if (us > maxValue) {
+      maxValue = us;
+    }
+  }
+
+  /**
+   * Add the samples of another histogram
+   * @param other - Histogram to merge into this one
+   */
+  void merge(const LatencyHistogram& other) {
+    for (int b = 0; b < BUCKET_COUNT; b++) {
+      counts[b] += other.counts[b];
+    }
+    count += other.count;
+    sum += other.sum;
+    if (other.maxValue > maxValue) {
+      maxValue = other.maxValue;
+    }
+  }
+
+  void reset() {
+    memset(counts, 0, sizeof(counts));
+    count = 0;
+    sum = 0;
+    maxValue = 0;
+  }
+
+  uint64_t getCount() const {
+    return count;
+  }
+
+  uint64_t getMax() const {
+    return maxValue;
+  }
+
+  uint64_t getMean() const {
+    return count ? sum / count : 0;
+  }
+
+  /**
+   * Estimate a percentile
+   * @param p - Percentile (0-100)
+   * @return middle of the bucket holding the percentile in microseconds, 0 without samples
+   */
+  uint64_t percentile(double p) const {
+    if (count == 0) {
+      return 0;
+    }
+    uint64_t rank = (uint64_t)(p / 100.0 * count + 0.5);
+    if (rank < 1) {
+      rank = 1;
+    }
+    uint64_t seen = 0;
+    for (int b = 0; b < BUCKET_COUNT; b++) {
+      seen += counts[b];
+      if (seen >= rank) {
+        uint64_t low = bucketLow(b);
+        uint64_t middle = low + bucketWidth(b) / 2;
+        return middle < maxValue ? middle : maxValue;
+      }
+    }
+    return maxValue;
+  }
+
+private:
+  uint64_t counts[BUCKET_COUNT];
+  uint64_t count;
+  uint64_t sum;
+  uint64_t maxValue;
+
+  static int bucketOf(uint64_t us) {
+    if (us < 2 * SUB_BUCKETS) {
+      return (int)us;
+    }
+    int msb = 63 - __builtin_clzll(us);  // >= 6
+    int shift = msb - 5;
+    return 2 * SUB_BUCKETS + (msb - 6) * SUB_BUCKETS + (int)((us >> shift) & (SUB_BUCKETS - 1));
+  }
+
+  static uint64_t bucketLow(int bucket) {
+    if (bucket < 2 * SUB_BUCKETS) {
+      return bucket;
+    }
+    int k = bucket - 2 * SUB_BUCKETS;
+    int shift = k / SUB_BUCKETS + 1;
+    return (uint64_t)(SUB_BUCKETS + k % SUB_BUCKETS) << shift;
+  }
+
+  static uint64_t bucketWidth(int bucket) {
+    return bucket < 2 * SUB_BUCKETS ? 1 : 1ULL << ((bucket - 2 * SUB_BUCKETS) / SUB_BUCKETS + 1);
+  }
+};
+
+/**
+ * What a latency sample measures
+ */
+enum LatencyKind {
+  LATENCY_AUTH,        // POST /auth/device
+  LATENCY_POLL,        // GET /devices/:id/next-commands (includes the long-poll hold, use --wait 0 to time the query alone)
+  LATENCY_ACK,         // POST /commands/ack
+  LATENCY_STATUS,      // POST /devices/status
+  LATENCY_CREATE,      // POST /devices/:id/opendrawer(s) (command generator)
+  LATENCY_DELIVERY,    // Command created -> received by the device
+  LATENCY_COMPLETION,  // Command created -> its ack accepted by the server
+  LATENCY_KIND_COUNT
+};
+
+/**
+ * Event counted by the simulator
+ */
+enum SimulatorCounter {
+  SIM_COMMANDS_CREATED,      // Commands queued by the generator
+  SIM_COMMANDS_SKIPPED,      // Commands the generator could not send (every connection busy)
+  SIM_COMMANDS_RECEIVED,     // Commands received by the devices
+  SIM_COMMANDS_REDELIVERED,  // Commands received again after they were executed (ack lost or late)
+  SIM_COMMANDS_FAILED,       // Commands acknowledged as FAILED (injected or invalid)
+  SIM_COMMANDS_ACKED,        // Command results accepted by the server
+  SIM_ACKS_DROPPED,          // Ack requests dropped by the failure injection (replayed later)
+  SIM_DISCONNECTS,           // Connections dropped by the failure injection
+  SIM_REAUTHS,               // Tokens rejected by the server and requested again
+  SIM_CONNECTS,              // TCP connections opened
+  SIM_COUNTER_COUNT
+};
+
+/**
+ * Latencies, request outcomes and counters of a run
+ * Everything is kept twice: for the current report interval and for the whole run.
+ */
+class SimulatorStats {
+public:
+  // Constructor
+  SimulatorStats() {
+    memset(intervalCounters, 0, sizeof(intervalCounters));
+    memset(totalCounters, 0, sizeof(totalCounters));
+    memset(intervalErrors, 0, sizeof(intervalErrors));
+    memset(totalErrors, 0, sizeof(totalErrors));
+  }
+
+  /**
+   * Record a latency sample
+   * @param kind - What was timed
+   * @param us - Duration in microseconds
+   */
+  void record(LatencyKind kind, uint64_t us) {
+    interval[kind].record(us);
+  }
+
+  /**
+   * Record a request that failed (network error or unexpected HTTP status)
+   * @param kind - Endpoint of the request
+   */
+  void error(LatencyKind kind) {
+    intervalErrors[kind]++;
+  }
+
+  /**
+   * Count an event
+   * @param counter - Counter to increment
+   * @param amount - Number of events
+   */
+  void increment(SimulatorCounter counter, uint64_t amount = 1) {
+    intervalCounters[counter] += amount;
+  }
+
+  /**
+   * Print the report of the current interval and start the next one
+   * @param elapsedMs - Length of the interval
+   * @param sinceStartMs - Time since the run started
+   * @param activeDevices - Devices holding a token
+   */
+  void reportInterval(uint64_t elapsedMs, uint64_t sinceStartMs, size_t activeDevices) {
+    printf("\n[%6.1f s] %zu devices online\n", sinceStartMs / 1000.0, activeDevices);
+    printTable(interval, intervalErrors, intervalCounters, elapsedMs);
+    for (int k = 0; k < LATENCY_KIND_COUNT; k++) {
+      total[k].merge(interval[k]);
+      interval[k].reset();
+      totalErrors[k] += intervalErrors[k];
+      intervalErrors[k] = 0;
+    }
+    for (int c = 0; c < SIM_COUNTER_COUNT; c++) {
+      totalCounters[c] += intervalCounters[c];
+      intervalCounters[c] = 0;
+    }
+    fflush(stdout);
+  }
+
+  /**
+   * Print the report of the whole run (call reportInterval() first to fold in the last interval)
+   * @param elapsedMs - Length of the run
+   * @param undelivered - Created commands no device received
+   */
+  void reportTotal(uint64_t elapsedMs, size_t undelivered) {
+    printf("\n=== Summary (%.1f s) ===\n", elapsedMs / 1000.0);
+    printTable(total, totalErrors, totalCounters, elapsedMs);
+    printf("  undelivered commands: %zu\n", undelivered);
+    fflush(stdout);
+  }
+
+private:
+  LatencyHistogram interval[LATENCY_KIND_COUNT];
+  LatencyHistogram total[LATENCY_KIND_COUNT];
+  uint64_t intervalErrors[LATENCY_KIND_COUNT];
+  uint64_t totalErrors[LATENCY_KIND_COUNT];
+  uint64_t intervalCounters[SIM_COUNTER_COUNT];
+  uint64_t totalCounters[SIM_COUNTER_COUNT];
+
+  static constexpr const char* kindNames[LATENCY_KIND_COUNT] = { "auth", "poll", "ack", "status", "create", "delivery", "completion" };
+  static constexpr const char* counterNames[SIM_COUNTER_COUNT] = { "created", "skipped", "received", "redelivered", "failed",
+                                                                   "acked", "acksDropped", "disconnects", "reauths", "connects" };
+
+  static void printTable(const LatencyHistogram* histograms, const uint64_t* errors, const uint64_t* counters, uint64_t elapsedMs) {
+    double seconds = elapsedMs > 0 ? elapsedMs / 1000.0 : 1;
+    printf("  %-10s %9s %9s %9s %9s %9s %9s %9s %8s\n", "", "count", "per s", "mean ms", "p50 ms", "p90 ms", "p99 ms", "max ms", "errors");
+    for (int k = 0; k < LATENCY_KIND_COUNT; k++) {
+      const LatencyHistogram& h = histograms[k];
+      if (h.getCount() == 0 && errors[k] == 0) {
+        continue;
+      }
+      printf("  %-10s %9llu %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f %8llu\n", kindNames[k], (unsigned long long)h.getCount(),
+             h.getCount() / seconds, h.getMean() / 1000.0, h.percentile(50) / 1000.0, h.percentile(90) / 1000.0,
+             h.percentile(99) / 1000.0, h.getMax() / 1000.0, (unsigned long long)errors[k]);
+    }
+    printf(" ");
+    for (int c = 0; c < SIM_COUNTER_COUNT; c++) {
+      printf(" %s=%llu", counterNames[c], (unsigned long long)counters[c]);
+    }
+    printf("\n");
+  }
+};
+
+constexpr const char* SimulatorStats::kindNames[];
+constexpr const char* SimulatorStats::counterNames[];
+
+#endif
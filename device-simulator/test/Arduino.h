@@ -0,0 +1,80 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+// Minimal host stand-in for the Arduino core and the FreeRTOS task notifications,
+// just enough to compile the firmware's command channel (commandQueue.h) in the host tests
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+using std::max;
+using std::min;
+
+#define HIGH 1
+#define LOW 0
+
+class IPAddress {
+public:
+  IPAddress(uint8_t, uint8_t, uint8_t, uint8_t) {}
+};
+
+inline unsigned long millis() {
+  static const std::chrono::steady_clock::time_point boot = std::chrono::steady_clock::now();
+  return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - boot)
+    .count();
+}
+
+inline size_t strlcpy(char* dst, const char* src, size_t size) {
+  size_t length = strlen(src);
+  if (size > 0) {
+    size_t copied = std::min(length, size - 1);
+    memcpy(dst, src, copied);
+    dst[copied] = '\0';
+  }
+  return length;
+}
+
+/**
+ * Task notification of one host task (a thread), counting like the FreeRTOS one
+ */
+struct HostTask {
+  std::mutex lock;
+  std::condition_variable wake;
+  uint32_t notifications = 0;
+};
+
+typedef HostTask* TaskHandle_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+// Task running the current thread's ulTaskNotifyTake(), set by the test
+inline TaskHandle_t& currentHostTask() {
+  static thread_local TaskHandle_t task = NULL;
+  return task;
+}
+
+inline void xTaskNotifyGive(TaskHandle_t task) {
+  std::lock_guard<std::mutex> guard(task->lock);
+  task->notifications++;
+  task->wake.notify_one();
+}
+
+inline uint32_t ulTaskNotifyTake(int clearOnExit, TickType_t ticks) {
+  TaskHandle_t task = currentHostTask();
+  std::unique_lock<std::mutex> guard(task->lock);
+  task->wake.wait_for(guard, std::chrono::milliseconds(ticks), [task] { return task->notifications > 0; });
+  uint32_t taken = task->notifications;
+  if (taken > 0) {
+    task->notifications = clearOnExit ? 0 : taken - 1;
+  }
+  return taken;
+}
+
+#endif
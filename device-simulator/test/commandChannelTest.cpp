@@ -0,0 +1,169 @@
+/**
+ * Host test of the firmware command channel (esp32-drawer/commandQueue.h)
+ * Runs a mixed-priority batch through the actuation side (CommandBacklog) and checks
+ * the network side collects every result by code, whatever order they finish in,
+ * under one deadline for the whole batch.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+
+// Stand in for the firmware logger (its log task needs FreeRTOS), counting the discarded results
+#define LOGGER_H
+static int discardedResults = 0;
+#define LOG_ERROR(...) do {} while (0)
+#define LOG_WARN(...) discardedResults++
+#define LOG_INFO(...) do {} while (0)
+#define LOG_DEBUG(...) do {} while (0)
+
+#include "commandQueue.h"
+
+static int failures = 0;
+
+#define CHECK(condition)                                         \
+  do {                                                           \
+    if (!(condition)) {                                          \
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+      failures++;                                                \
+    }                                                            \
+  } while (0)
+
+static DrawerCommand makeCommand(const char* code, int drawer, int8_t priority) {
+  DrawerCommand command;
+  strlcpy(command.code, code, sizeof(command.code));
+  command.action = DRAWER_ACTION_OPEN;
+  command.drawerMask = 1u << (drawer - 1);
+  command.priority = priority;
+  command.receivedAt = millis();
+  return command;
+}
+
+static CommandResult makeResult(const char* code) {
+  CommandResult result;
+  strlcpy(result.code, code, sizeof(result.code));
+  result.success = true;
+  result.errorMessage[0] = '\0';
+  return result;
+}
+
+/**
+ * Prepare the network side copy of the batch (codes only, all results expected)
+ */
+static void expectBatch(CommandResult* batch, bool* waiting, const char* const* codes, int count) {
+  for (int i = 0; i < count; i++) {
+    strlcpy(batch[i].code, codes[i], sizeof(batch[i].code));
+    batch[i].success = false;
+    batch[i].errorMessage[0] = '\0';
+    waiting[i] = true;
+  }
+}
+
+/**
+ * Priorities and busy drawers make the actuation task finish a batch out of submission order
+ */
+static void testMixedPriorityBatch() {
+  HostTask network;
+  HostTask actuation;
+  currentHostTask() = &network;
+  CommandChannel channel;
+  channel.attach(&network, &actuation);
+
+  // Submission order A, B, C, D: D and C outrank A and B, A, B and D share drawer 1
+  const char* codes[] = { "A", "B", "C", "D" };
+  channel.submit(makeCommand("A", 1, 0));
+  channel.submit(makeCommand("B", 1, 0));
+  channel.submit(makeCommand("C", 2, 5));
+  channel.submit(makeCommand("D", 1, 9));
+
+  // A result left over from an earlier batch that timed out
+  channel.reply(makeResult("OLD"));
+
+  // Actuation side: drain into the backlog, finish each command before the next one on its drawer starts
+  CommandBacklog<COMMAND_QUEUE_SIZE> backlog;
+  DrawerCommand command;
+  while (channel.receive(command)) {
+    backlog.push(command);
+  }
+  char executed[4][COMMAND_CODE_SIZE];
+  int executedCount = 0;
+  while (executedCount < 4 && backlog.takeReady(0, command)) {
+    strlcpy(executed[executedCount++], command.code, COMMAND_CODE_SIZE);
+    CommandResult result = makeResult(command.code);
+    result.success = strcmp(command.code, "B") != 0;
+    if (!result.success) {
+      strlcpy(result.errorMessage, "Drawer did not open", sizeof(result.errorMessage));
+    }
+    channel.reply(result);
+  }
+  CHECK(executedCount == 4);
+  CHECK(strcmp(executed[0], "D") == 0);
+  CHECK(strcmp(executed[1], "C") == 0);
+  CHECK(strcmp(executed[2], "A") == 0);
+  CHECK(strcmp(executed[3], "B") == 0);
+
+  CommandResult batch[4];
+  bool waiting[4];
+  expectBatch(batch, waiting, codes, 4);
+  discardedResults = 0;
+  int missing = channel.awaitResults(batch, waiting, 4, 1000);
+
+  CHECK(missing == 0);
+  CHECK(discardedResults == 1);  // Only the stray result
+  for (int i = 0; i < 4; i++) {
+    CHECK(!waiting[i]);
+    CHECK(strcmp(batch[i].code, codes[i]) == 0);
+  }
+  CHECK(batch[0].success && batch[2].success && batch[3].success);
+  CHECK(!batch[1].success);
+  CHECK(strcmp(batch[1].errorMessage, "Drawer did not open") == 0);
+}
+
+/**
+ * Unsensed drawers answer at once, sensed ones once their sensor confirmed (or timed out):
+ * the batch shares one deadline instead of restarting it per command
+ */
+static void testSensedAndUnsensedBatch() {
+  HostTask network;
+  HostTask actuation;
+  currentHostTask() = &network;
+  CommandChannel channel;
+  channel.attach(&network, &actuation);
+
+  // S1 and S2 are sensed (confirmed after 60 ms), U unsensed, M never answers
+  const char* codes[] = { "S1", "S2", "U", "M" };
+  std::thread actuationTask([&channel] {
+    channel.reply(makeResult("U"));
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    channel.reply(makeResult("S2"));
+    channel.reply(makeResult("S1"));
+  });
+
+  CommandResult batch[4];
+  bool waiting[4];
+  expectBatch(batch, waiting, codes, 4);
+  discardedResults = 0;
+  unsigned long start = millis();
+  int missing = channel.awaitResults(batch, waiting, 4, 200);
+  unsigned long elapsed = millis() - start;
+  actuationTask.join();
+
+  CHECK(missing == 1);
+  CHECK(discardedResults == 0);
+  CHECK(!waiting[0] && !waiting[1] && !waiting[2]);
+  CHECK(waiting[3]);
+  CHECK(batch[0].success && batch[1].success && batch[2].success);
+  CHECK(elapsed >= 200);
+  CHECK(elapsed < 400);  // One deadline for the batch, not one per command
+}
+
+int main() {
+  testMixedPriorityBatch();
+  testSensedAndUnsensedBatch();
+  if (failures > 0) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("command channel: all checks passed\n");
+  return 0;
+}
@@ -0,0 +1,457 @@
+#ifndef VIRTUALDEVICE_H
+#define VIRTUALDEVICE_H
+
+#include <stdint.h>
+#include <time.h>
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "commandGenerator.h"
+#include "eventLoop.h"
+#include "httpConnection.h"
+#include "json.h"
+#include "protocol.h"  // Shared with the firmware
+#include "simulatorConfig.h"
+#include "simulatorStats.h"
+
+/**
+ * One simulated drawer
+ * Runs the network task of the firmware as a state machine on the event loop:
+ * authenticate, replay pending acks, report status, poll next-commands (held
+ * open by the server when long-polling), execute the batch for the actuation
+ * time and acknowledge it in one request. Requests, URLs and payloads come
+ * from protocol.h, the scheduling mirrors PollScheduler and the ack replay and
+ * deduplication mirror CommandJournal.
+ */
+class VirtualDevice {
+public:
+  /**
+   * Constructor
+   * @param loop - Event loop
+   * @param config - Simulation settings
+   * @param stats - Receives latencies and counters
+   * @param tracker - Times the commands of the generator
+   * @param server - API server
+   * @param credentials - Device ID and secret
+   * @param localAddress - Source address to bind (NULL = chosen by the kernel)
+   * @param seed - Seed of the failure injection and jitter
+   */
+  VirtualDevice(EventLoop& loop, const SimulatorConfig& config, SimulatorStats& stats, CommandTracker& tracker,
+                const ServerAddress& server, const DeviceCredentials& credentials, const struct sockaddr_storage* localAddress,
+                unsigned int seed)
+      : loop(loop), config(config), stats(stats), tracker(tracker), credentials(credentials),
+        connection(loop, server, localAddress), random(seed) {
+    char url[256];
+    Protocol::formatPollUrl(url, sizeof(url), "", credentials.id.c_str(), config.maxBatch, 0);
+    pollNowPath = url;
+    Protocol::formatPollUrl(url, sizeof(url), "", credentials.id.c_str(), config.maxBatch, config.waitSeconds);
+    pollPath = url;
+    longPolling = false;
+    fastUntil = 0;
+    errorCount = 0;
+    slotInterval = 0;
+    slotOffset = 0;
+    nextStatusAt = 0;
+    lastStatusAt = 0;
+    startedAt = 0;
+    connects = 0;
+    acked = 0;
+    reauths = 0;
+  }
+
+  VirtualDevice(const VirtualDevice&) = delete;
+  VirtualDevice& operator=(const VirtualDevice&) = delete;
+
+  /**
+   * Boot the device
+   * @param delayMs - Delay before its first request (start ramp)
+   */
+  void start(uint64_t delayMs) {
+    loop.addTimer(delayMs, [this]() {
+      startedAt = EventLoop::nowMs();
+      nextStatusAt = startedAt + config.statusIntervalMs;
+      lastStatusAt = startedAt;
+      wake();
+    });
+  }
+
+  /**
+   * Check if the device holds a token
+   * @return true once authenticated
+   */
+  bool isOnline() const {
+    return !token.empty();
+  }
+
+private:
+  struct Result {
+    std::string code;
+    bool success;
+    std::string errorMessage;
+  };
+
+  EventLoop& loop;
+  const SimulatorConfig& config;
+  SimulatorStats& stats;
+  CommandTracker& tracker;
+  const DeviceCredentials& credentials;
+  HttpConnection connection;
+  std::mt19937 random;
+
+  std::string token;
+  std::string pollPath;              // next-commands with ?wait
+  std::string pollNowPath;           // next-commands without ?wait
+  std::vector<Result> pendingAcks;   // Results not accepted by the server yet
+  std::deque<Result> journal;        // Results accepted by the server, acked again if re-delivered
+  bool longPolling;                  // Whether the last poll was held open (X-Long-Poll)
+  uint64_t fastUntil;                // Fast polling until then (nowMs())
+  int errorCount;                    // Consecutive failed requests
+  unsigned long slotInterval;        // Poll slot sent with the token (0 = none)
+  unsigned long slotOffset;
+  uint64_t nextStatusAt;             // nowMs() of the next status report
+  uint64_t lastStatusAt;
+  uint64_t startedAt;
+  unsigned long connects;            // connection.getConnectCount() already counted
+  unsigned long acked;               // Firmware counters reported with the next status
+  unsigned long reauths;
+
+  bool inject(double ratio) {
+    return ratio > 0 && std::uniform_real_distribution<double>(0, 1)(random) < ratio;
+  }
+
+  unsigned long withJitter(unsigned long base, unsigned long jitter) {
+    return base + (jitter > 0 ? random() % (jitter + 1) : 0);
+  }
+
+  std::string authHeader() const {
+    return "Authorization: Bearer " + token + "\r\n";
+  }
+
+  /**
+   * Run the next step of the network task
+   */
+  void wake() {
+    if (token.empty()) {
+      authenticate();
+    } else if (!pendingAcks.empty()) {
+      sendAcks();  // Replay results whose ack was lost before polling again
+    } else if (config.statusIntervalMs > 0 && EventLoop::nowMs() >= nextStatusAt) {
+      sendStatus();
+    } else {
+      poll();
+    }
+  }
+
+  void sleep(uint64_t delayMs) {
+    loop.addTimer(delayMs, [this]() { wake(); });
+  }
+
+  /**
+   * Record the latency of a request that got a response, count what it did on
+   * the wire and apply the disconnect injection
+   * @param kind - Endpoint of the request
+   * @param response - Its response
+   * @param sentUs - nowUs() when it was sent
+   */
+  void afterRequest(LatencyKind kind, const HttpResponse& response, uint64_t sentUs) {
+    if (response.status > 0) {
+      stats.record(kind, EventLoop::nowUs() - sentUs);
+    }
+    unsigned long opened = connection.getConnectCount();
+    if (opened != connects) {
+      stats.increment(SIM_CONNECTS, opened - connects);
+      connects = opened;
+    }
+    if (inject(config.disconnectRatio)) {
+      connection.close();
+      stats.increment(SIM_DISCONNECTS);
+    }
+  }
+
+  /**
+   * Back off after a failed request (PollScheduler::onError)
+   */
+  void onError(LatencyKind kind) {
+    stats.error(kind);
+    if (errorCount < 16) {
+      errorCount++;
+    }
+    unsigned long backoff = std::min(config.errorBaseMs << (errorCount - 1), config.errorMaxMs);
+    longPolling = false;
+    sleep(withJitter(backoff / 2, backoff / 2));
+  }
+
+  /**
+   * Drop a token rejected by the server, the next step authenticates again
+   */
+  void onUnauthorized() {
+    token.clear();
+    reauths++;
+    stats.increment(SIM_REAUTHS);
+    sleep(0);
+  }
+
+  void authenticate() {
+    char payload[256];
+    Protocol::formatAuthPayload(payload, sizeof(payload), credentials.id.c_str(), credentials.secret.c_str());
+    uint64_t sentUs = EventLoop::nowUs();
+    connection.request("POST", authEndpoint, "", payload, config.timeoutMs, [this, sentUs](const HttpResponse& response) {
+      afterRequest(LATENCY_AUTH, response, sentUs);
+      JsonValue doc;
+      if (response.status != 200 || !JsonParser::parse(response.body, doc) || !doc["token"].asString()) {
+        onError(LATENCY_AUTH);
+        return;
+      }
+      token = doc["token"].asString();
+      slotInterval = doc["poll"]["intervalMs"].asInt(0);
+      slotOffset = doc["poll"]["offsetMs"].asInt(0);
+      if (slotInterval < config.fastIntervalMs) {
+        slotInterval = 0;  // No slot, or one too short to make sense
+      }
+      slotOffset = slotInterval > 0 ? slotOffset % slotInterval : 0;
+      errorCount = 0;
+      sleep(0);
+    });
+  }
+
+  void poll() {
+    bool hold = config.waitSeconds > 0;
+    uint64_t timeoutMs = hold ? (config.waitSeconds + 5) * 1000ULL : config.timeoutMs;
+    uint64_t sentUs = EventLoop::nowUs();
+    connection.request("GET", hold ? pollPath : pollNowPath, authHeader(), "", timeoutMs, [this, sentUs](const HttpResponse& response) {
+      uint64_t nowUs = EventLoop::nowUs();
+      afterRequest(LATENCY_POLL, response, sentUs);
+
+      if (response.status == 401 || response.status == 403) {
+        onUnauthorized();
+        return;
+      }
+      if (response.status != 200 && response.status != 204) {
+        onError(LATENCY_POLL);
+        return;
+      }
+      errorCount = 0;
+      longPolling = response.header(HEADER_LONG_POLL) != NULL;
+      const char* hint = response.header(HEADER_POLL_INTERVAL);
+      long suggested = hint && config.useHints ? atol(hint) : -1;
+
+      int received = 0;
+      if (response.status == 200) {
+        JsonValue doc;
+        if (!JsonParser::parse(response.body, doc)) {
+          onError(LATENCY_POLL);
+          return;
+        }
+        received = execute(doc["commands"], nowUs);
+      }
+
+      if (received > 0) {
+        // Results are acknowledged once the drawers moved
+        fastUntil = EventLoop::nowMs() + config.fastWindowMs;
+        sleep(config.actuationMs);
+        return;
+      }
+      sleep(nextPollDelay(suggested));
+    });
+  }
+
+  /**
+   * Delay before the next poll after one without commands (PollScheduler::onIdle / applyServerHint)
+   * @param suggested - X-Poll-Interval of the response, -1 if none
+   * @return delay in milliseconds
+   */
+  uint64_t nextPollDelay(long suggested) {
+    if (longPolling) {
+      return 0;  // The server holds the next poll until a command arrives
+    }
+    // The hint replaces the idle backoff, only shortens the fast window and never moves a slot
+    unsigned long hinted = suggested >= 0 ? std::min((unsigned long)suggested, config.idleMaxMs) : 0;
+    uint64_t now = EventLoop::nowMs();
+    if (now < fastUntil) {
+      return suggested >= 0 ? std::min(hinted, config.fastIntervalMs) : config.fastIntervalMs;
+    }
+    if (slotInterval > 0 && config.useSlots) {
+      // Slots are phases of the server clock, the simulator shares the host clock with a local server
+      struct timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      uint64_t serverMs = (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+      unsigned long phase = serverMs % slotInterval;
+      unsigned long delay = (slotOffset + slotInterval - phase) % slotInterval;
+      return delay < config.fastIntervalMs ? delay + slotInterval : delay;
+    }
+    if (suggested >= 0) {
+      return hinted;
+    }
+    return withJitter(config.pollIntervalMs, config.pollIntervalMs / 10);
+  }
+
+  /**
+   * Take a batch of received commands (ServerConnector::startCommand)
+   * @param commands - "commands" array of the poll response
+   * @param nowUs - When the response arrived
+   * @return number of results to acknowledge
+   */
+  int execute(const JsonValue& commands, uint64_t nowUs) {
+    int count = 0;
+    for (const JsonValue& command : commands.items) {
+      const char* code = command["code"].asString();
+      if (!code) {
+        continue;  // Can't be acknowledged
+      }
+      stats.increment(SIM_COMMANDS_RECEIVED);
+      tracker.onDelivered(code, nowUs);
+      count++;
+
+      // Re-delivered command (its ack was lost): acknowledge it again without actuating
+      auto executed = std::find_if(journal.begin(), journal.end(), [code](const Result& result) { return result.code == code; });
+      if (executed != journal.end()) {
+        stats.increment(SIM_COMMANDS_REDELIVERED);
+        pendingAcks.push_back(*executed);
+        continue;
+      }
+
+      Result result;
+      result.code = code;
+      result.success = false;
+      const char* action = command["action"].asString();
+      switch (Protocol::parseAction(action)) {
+        case COMMAND_ACTION_OPEN:
+        case COMMAND_ACTION_CLOSE: {
+          long drawer = command["drawer"].asInt(0);
+          if (drawer < 1 || drawer > config.drawers) {
+            result.errorMessage = "Drawer " + std::to_string(drawer) + " does not exist (valid: 1-" + std::to_string(config.drawers) + ")";
+          } else {
+            result.success = true;
+          }
+          break;
+        }
+        case COMMAND_ACTION_OPEN_MANY:
+          result.success = !command["drawers"].items.empty();
+          for (const JsonValue& drawer : command["drawers"].items) {
+            long number = drawer.asInt(0);
+            if (number < 1 || number > config.drawers) {
+              result.success = false;
+              result.errorMessage = "Drawer " + std::to_string(number) + " does not exist (valid: 1-" + std::to_string(config.drawers) + ")";
+              break;
+            }
+          }
+          if (command["drawers"].items.empty()) {
+            result.errorMessage = "Missing drawers field";
+          }
+          break;
+        default:
+          result.errorMessage = action ? std::string("Unknown action: ") + action : "Missing action field";
+          break;
+      }
+      if (result.success && inject(config.failRatio)) {
+        result.success = false;
+        result.errorMessage = "Simulated actuation failure";
+      }
+      if (!result.success) {
+        stats.increment(SIM_COMMANDS_FAILED);
+      }
+      pendingAcks.push_back(result);
+    }
+    return count;
+  }
+
+  /**
+   * Acknowledge the pending results in one request (ServerConnector::sendCommandAcks)
+   */
+  void sendAcks() {
+    if (inject(config.ackLossRatio)) {
+      // Lost like a request that never made it, replayed before the next poll
+      stats.increment(SIM_ACKS_DROPPED);
+      sleep(std::max<uint64_t>(nextPollDelay(-1), config.fastIntervalMs));
+      return;
+    }
+
+    // {"results":[{"code":"...","status":"EXECUTED"},{"code":"...","status":"FAILED","errorMessage":"..."}]}
+    std::string body = "{\"results\":[";
+    for (size_t i = 0; i < pendingAcks.size(); i++) {
+      const Result& result = pendingAcks[i];
+      body += i ? ",{\"code\":" : "{\"code\":";
+      JsonParser::appendString(body, result.code.c_str());
+      body += ",\"status\":";
+      JsonParser::appendString(body, Protocol::ackStatus(result.success));
+      if (!result.success) {
+        body += ",\"errorMessage\":";
+        JsonParser::appendString(body, result.errorMessage.c_str());
+      }
+      body += "}";
+    }
+    body += "]}";
+
+    uint64_t sentUs = EventLoop::nowUs();
+    size_t count = pendingAcks.size();
+    connection.request("POST", ackEndpoint, authHeader(), body, config.timeoutMs, [this, sentUs, count](const HttpResponse& response) {
+      uint64_t nowUs = EventLoop::nowUs();
+      afterRequest(LATENCY_ACK, response, sentUs);
+
+      if (response.status == 401 || response.status == 403) {
+        onUnauthorized();  // Replayed with the new token
+        return;
+      }
+      if (response.status == 200) {
+        for (size_t i = 0; i < count && i < pendingAcks.size(); i++) {
+          tracker.onAcked(pendingAcks[i].code, nowUs);
+          journal.push_back(pendingAcks[i]);
+          if (journal.size() > (size_t)JOURNAL_SIZE) {
+            journal.pop_front();
+          }
+        }
+        stats.increment(SIM_COMMANDS_ACKED, count);
+        acked += count;
+      } else if (response.status != 400) {
+        onError(LATENCY_ACK);  // Kept and replayed
+        return;
+      } else {
+        stats.error(LATENCY_ACK);  // Malformed batch, retrying would fail forever
+      }
+      pendingAcks.erase(pendingAcks.begin(), pendingAcks.begin() + std::min(count, pendingAcks.size()));
+      errorCount = 0;
+      sleep(longPolling ? 0 : config.fastIntervalMs);
+    });
+  }
+
+  /**
+   * Report the status with the counters of the interval (Metrics::serializeReport)
+   */
+  void sendStatus() {
+    static const unsigned bounds[] = { METRICS_BUCKET_BOUNDS };
+    uint64_t now = EventLoop::nowMs();
+    // Grown like the ack body, a long --firmware release can't truncate it
+    std::string body = "{\"status\":\"ACTIVE\",\"firmware\":";
+    JsonParser::appendString(body, config.firmware);
+    body += ",\"uptimeMs\":" + std::to_string(now - startedAt) + ",\"intervalMs\":" + std::to_string(now - lastStatusAt) +
+            ",\"gauges\":{},\"counters\":{\"commandsAcked\":" + std::to_string(acked) +
+            ",\"reauths\":" + std::to_string(reauths) + "},\"buckets\":[";
+    for (size_t b = 0; b < sizeof(bounds) / sizeof(bounds[0]); b++) {
+      body += (b ? "," : "") + std::to_string(bounds[b]);
+    }
+    body += "],\"histograms\":{}}";
+    nextStatusAt = now + config.statusIntervalMs;
+
+    uint64_t sentUs = EventLoop::nowUs();
+    connection.request("POST", statusEndpoint, authHeader(), body, config.timeoutMs, [this, sentUs, now](const HttpResponse& response) {
+      afterRequest(LATENCY_STATUS, response, sentUs);
+      if (response.status == 401 || response.status == 403) {
+        onUnauthorized();
+        return;
+      }
+      if (response.status != 200) {
+        stats.error(LATENCY_STATUS);  // Like the firmware, rolled into the next report
+      } else {
+        lastStatusAt = now;
+        acked = 0;
+        reauths = 0;
+      }
+      sleep(0);
+    });
+  }
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef BOUNDEDSTREAM_H
+#define BOUNDEDSTREAM_H
+
+#include <Arduino.h>
+
+/**
+ * Reader over a response stream that stops after a fixed number of bytes
+ * ArduinoJson parses straight from it (read() / readBytes()), so a response
+ * body never has to be buffered in a String and a misbehaving server can't
+ * make the parser consume more than the cap. Hitting the cap shows up as an
+ * IncompleteInput parse error.
+ */
+class BoundedStream {
+public:
+  // Constructor
+  BoundedStream(Stream& stream, size_t limit) : stream(stream), remaining(limit), truncated(false) {}
+
+  /**
+   * Read one byte
+   * @return the byte, or -1 at the end of the stream or once the cap is reached
+   */
+  int read() {
+    if (remaining == 0) {
+      truncated = true;
+      return -1;
+    }
+    int c = stream.read();
+    if (c >= 0) {
+      remaining--;
+    }
+    return c;
+  }
+
+  /**
+   * Read several bytes (waits up to the stream timeout)
+   * @param buffer - Receives the bytes
+   * @param length - Maximum number of bytes to read
+   * @return number of bytes read
+   */
+  size_t readBytes(char* buffer, size_t length) {
+    if (remaining == 0 && length > 0) {
+      truncated = true;
+      return 0;
+    }
+    if (length > remaining) {
+      length = remaining;
+    }
+    size_t count = stream.readBytes(buffer, length);
+    remaining -= count;
+    return count;
+  }
+
+  /**
+   * Check if the parser tried to read past the cap
+   * @return true if the body was larger than the cap
+   */
+  bool isTruncated() {
+    return truncated;
+  }
+
+private:
+  Stream& stream;    // Underlying response stream
+  size_t remaining;  // Bytes left before the cap
+  bool truncated;    // A read was refused because of the cap
+};
+
+#endif
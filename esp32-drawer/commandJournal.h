@@ -0,0 +1,182 @@
+#ifndef COMMANDJOURNAL_H
+#define COMMANDJOURNAL_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+
+// Include config file
+#include "config.h"
+#include "protocol.h"
+#include "commandQueue.h"
+#include "logger.h"
+
+/**
+ * One executed command kept in the journal
+ */
+struct JournalEntry {
+  char code[COMMAND_CODE_SIZE];            // Command code (empty = free slot)
+  bool success;                            // Whether the command succeeded
+  bool acked;                              // Whether the server confirmed the acknowledgement
+  char errorMessage[ERROR_MESSAGE_SIZE];   // Failure reason (empty on success)
+};
+
+/**
+ * Ring buffer of the last JOURNAL_SIZE executed commands, persisted in NVS
+ * - Results are recorded before the acknowledgement is sent, so an ack lost
+ *   to a network drop or a restart is replayed later instead of forgotten.
+ * - A command the server hands out again (still PENDING because its ack
+ *   was lost) is found in the journal and acknowledged without actuating twice.
+ * Each slot is stored under its own NVS key so a record only rewrites one entry.
+ */
+class CommandJournal {
+public:
+  // Constructor
+  CommandJournal() {
+    head = 0;
+    memset(entries, 0, sizeof(entries));
+  }
+
+  /**
+   * Load the journal from NVS, must be called once from setup()
+   */
+  void begin() {
+    Preferences prefs;
+    if (!prefs.begin("journal", true)) {
+      return;
+    }
+    head = prefs.getUChar("head", 0) % JOURNAL_SIZE;
+    for (int i = 0; i < JOURNAL_SIZE; i++) {
+      char key[8];
+      snprintf(key, sizeof(key), "e%d", i);
+      if (prefs.getBytes(key, &entries[i], sizeof(entries[i])) != sizeof(entries[i])) {
+        memset(&entries[i], 0, sizeof(entries[i]));
+      }
+      entries[i].code[COMMAND_CODE_SIZE - 1] = '\0';
+      entries[i].errorMessage[ERROR_MESSAGE_SIZE - 1] = '\0';
+    }
+    prefs.end();
+
+    int pending = countPendingAcks();
+    if (pending > 0) {
+      LOG_INFO("Journal: %d acknowledgement(s) pending from before restart", pending);
+    }
+  }
+
+  /**
+   * Look up an executed command by code
+   * @param code - Command code
+   * @return the journal entry, or NULL if the command was never executed here
+   */
+  const JournalEntry* find(const char* code) {
+    for (int i = 0; i < JOURNAL_SIZE; i++) {
+      if (entries[i].code[0] != '\0' && strcmp(entries[i].code, code) == 0) {
+        return &entries[i];
+      }
+    }
+    return NULL;
+  }
+
+  /**
+   * Record the result of a command (before acknowledging it)
+   * Overwrites the oldest entry once the journal is full.
+   * @param result - Command result
+   */
+  void record(const CommandResult& result) {
+    JournalEntry* entry = const_cast<JournalEntry*>(find(result.code));
+    if (!entry) {
+      entry = &entries[head];
+      if (entry->code[0] != '\0' && !entry->acked) {
+        LOG_WARN("Journal full, dropping unacknowledged result (code: %s)", entry->code);
+      }
+      head = (head + 1) % JOURNAL_SIZE;
+    }
+
+    strlcpy(entry->code, result.code, sizeof(entry->code));
+    entry->success = result.success;
+    entry->acked = false;
+    strlcpy(entry->errorMessage, result.errorMessage, sizeof(entry->errorMessage));
+    persist(entry);
+  }
+
+  /**
+   * Mark commands as acknowledged by the server (or given up)
+   * @param results - Results that were sent
+   * @param acked - Which of them the server is done with
+   * @param count - Number of results
+   */
+  void markAcked(const CommandResult* results, const bool* acked, int count) {
+    for (int i = 0; i < count; i++) {
+      if (!acked[i]) {
+        continue;
+      }
+      JournalEntry* entry = const_cast<JournalEntry*>(find(results[i].code));
+      if (entry && !entry->acked) {
+        entry->acked = true;
+        persist(entry);
+      }
+    }
+  }
+
+  /**
+   * Collect results whose acknowledgement was not confirmed yet
+   * @param results - Receives the results
+   * @param max - Maximum number of results to collect
+   * @return number of results collected
+   */
+  int getPendingAcks(CommandResult* results, int max) {
+    int count = 0;
+    for (int i = 0; i < JOURNAL_SIZE && count < max; i++) {
+      if (entries[i].code[0] != '\0' && !entries[i].acked) {
+        toResult(entries[i], results[count++]);
+      }
+    }
+    return count;
+  }
+
+  /**
+   * Count the results whose acknowledgement was not confirmed yet
+   * @return number of pending acknowledgements
+   */
+  int countPendingAcks() {
+    int count = 0;
+    for (int i = 0; i < JOURNAL_SIZE; i++) {
+      if (entries[i].code[0] != '\0' && !entries[i].acked) {
+        count++;
+      }
+    }
+    return count;
+  }
+
+  /**
+   * Copy a journal entry into a command result
+   * @param entry - Journal entry
+   * @param result - Receives the result
+   */
+  static void toResult(const JournalEntry& entry, CommandResult& result) {
+    strlcpy(result.code, entry.code, sizeof(result.code));
+    result.success = entry.success;
+    strlcpy(result.errorMessage, entry.errorMessage, sizeof(result.errorMessage));
+  }
+
+private:
+  JournalEntry entries[JOURNAL_SIZE];  // Ring buffer (mirrors NVS)
+  uint8_t head;                        // Next slot to overwrite
+
+  /**
+   * Write one entry (and the ring head) to NVS
+   * @param entry - Entry to write
+   */
+  void persist(const JournalEntry* entry) {
+    Preferences prefs;
+    if (!prefs.begin("journal", false)) {
+      return;
+    }
+    char key[8];
+    snprintf(key, sizeof(key), "e%d", (int)(entry - entries));
+    prefs.putBytes(key, entry, sizeof(*entry));
+    prefs.putUChar("head", head);
+    prefs.end();
+  }
+};
+
+#endif
@@ -0,0 +1,286 @@
+#ifndef COMMANDQUEUE_H
+#define COMMANDQUEUE_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// Include config file
+#include "config.h"
+#include "logger.h"
+
+/**
+ * Actions executed by the actuation task
+ */
+enum DrawerAction : uint8_t {
+  DRAWER_ACTION_OPEN = 1,
+  DRAWER_ACTION_CLOSE = 2,  // Confirm the drawers are closed (sensed drawers only)
+};
+
+/**
+ * Command handed from the network task to the actuation task
+ */
+struct DrawerCommand {
+  char code[COMMAND_CODE_SIZE];  // Unique command code (for tracking)
+  DrawerAction action;           // Action to execute
+  uint32_t drawerMask;           // Drawers to act on, bit i = drawer i + 1
+  int8_t priority;               // Server-assigned priority, higher runs first (0 = normal)
+  unsigned long receivedAt;      // millis() when the poll response carrying it arrived (metrics)
+};
+
+/**
+ * Result handed back from the actuation task to the network task
+ */
+struct CommandResult {
+  char code[COMMAND_CODE_SIZE];            // Code of the executed command
+  bool success;                            // Whether the actuation succeeded
+  char errorMessage[ERROR_MESSAGE_SIZE];   // Failure reason (empty on success)
+};
+
+/**
+ * Bounded lock-free single-producer/single-consumer queue
+ * One task may only push and one other task may only pop.
+ * Holds up to Capacity - 1 items.
+ */
+template <typename T, size_t Capacity>
+class SpscQueue {
+public:
+  SpscQueue()
+    : head(0), tail(0) {}
+
+  /**
+   * Add an item to the queue (producer side)
+   * @param item - Item to copy into the queue
+   * @return true if added, false if the queue is full
+   */
+  bool push(const T& item) {
+    size_t currentTail = tail.load(std::memory_order_relaxed);
+    size_t nextTail = (currentTail + 1) % Capacity;
+    if (nextTail == head.load(std::memory_order_acquire)) {
+      return false;  // Full
+    }
+    items[currentTail] = item;
+    tail.store(nextTail, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Remove the oldest item from the queue (consumer side)
+   * @param item - Receives the removed item
+   * @return true if an item was removed, false if the queue is empty
+   */
+  bool pop(T& item) {
+    size_t currentHead = head.load(std::memory_order_relaxed);
+    if (currentHead == tail.load(std::memory_order_acquire)) {
+      return false;  // Empty
+    }
+    item = items[currentHead];
+    head.store((currentHead + 1) % Capacity, std::memory_order_release);
+    return true;
+  }
+
+private:
+  T items[Capacity];
+  std::atomic<size_t> head;  // Next slot to read (owned by the consumer)
+  std::atomic<size_t> tail;  // Next slot to write (owned by the producer)
+};
+
+/**
+ * Local execution queue of the actuation task
+ * Commands received from the channel wait here until their drawers are free,
+ * ordered by priority (highest first, arrival order among equals). A command
+ * whose code is already queued is dropped, the queued copy answers for both.
+ *
+ * takeReady() hands out every command whose drawers are idle, so commands on
+ * different drawers start together and commands on the same drawer run back
+ * to back, one pulse after the other, instead of restarting each other's pulse.
+ * A waiting command also holds its drawers for the commands behind it, so the
+ * order on each drawer is kept.
+ */
+template <size_t Capacity>
+class CommandBacklog {
+public:
+  CommandBacklog()
+    : count(0) {}
+
+  /**
+   * Queue a command in priority order
+   * @param command - Command to queue
+   * @return false if the backlog is full
+   */
+  bool push(const DrawerCommand& command) {
+    if (count >= Capacity) {
+      return false;
+    }
+    size_t pos = count;
+    while (pos > 0 && items[pos - 1].priority < command.priority) {
+      items[pos] = items[pos - 1];
+      pos--;
+    }
+    items[pos] = command;
+    count++;
+    return true;
+  }
+
+  /**
+   * Check if a command is already queued
+   * @param code - Command code
+   * @return true if a command with this code is waiting
+   */
+  bool contains(const char* code) {
+    for (size_t i = 0; i < count; i++) {
+      if (strcmp(items[i].code, code) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * Remove the first command, in priority order, that can start now
+   * @param busyMask - Drawers that are pulsing or waiting for a confirmation
+   * @param command - Receives the command
+   * @return true if a command was removed
+   */
+  bool takeReady(uint32_t busyMask, DrawerCommand& command) {
+    uint32_t heldMask = busyMask;
+    for (size_t i = 0; i < count; i++) {
+      if ((items[i].drawerMask & heldMask) == 0) {
+        command = items[i];
+        for (size_t j = i + 1; j < count; j++) {
+          items[j - 1] = items[j];
+        }
+        count--;
+        return true;
+      }
+      heldMask |= items[i].drawerMask;  // Waits ahead of the later commands on these drawers
+    }
+    return false;
+  }
+
+  /**
+   * Check if commands are waiting
+   * @return true if the backlog is empty
+   */
+  bool isEmpty() {
+    return count == 0;
+  }
+
+private:
+  DrawerCommand items[Capacity];  // Waiting commands, in execution order
+  size_t count;                   // Number of waiting commands
+};
+
+/**
+ * Channel between the network task and the actuation task
+ * Commands flow network -> actuation, results flow back.
+ * Each side is woken with a FreeRTOS task notification.
+ */
+class CommandChannel {
+public:
+  CommandChannel() {
+    networkTask = NULL;
+    actuationTask = NULL;
+  }
+
+  /**
+   * Register the tasks on each end of the channel
+   * @param network - Network task handle (command producer, result consumer)
+   * @param actuation - Actuation task handle (command consumer, result producer)
+   */
+  void attach(TaskHandle_t network, TaskHandle_t actuation) {
+    networkTask = network;
+    actuationTask = actuation;
+  }
+
+  /**
+   * Queue a command for the actuation task (network side)
+   * @param command - Command to execute
+   * @return true if queued, false if the queue is full
+   */
+  bool submit(const DrawerCommand& command) {
+    if (!commands.push(command)) {
+      return false;
+    }
+    if (actuationTask) {
+      xTaskNotifyGive(actuationTask);
+    }
+    return true;
+  }
+
+  /**
+   * Take the next command to execute (actuation side)
+   * @param command - Receives the command
+   * @return true if a command was available
+   */
+  bool receive(DrawerCommand& command) {
+    return commands.pop(command);
+  }
+
+  /**
+   * Send a command result back to the network task (actuation side)
+   * @param result - Result of the command
+   * @return true if queued, false if the queue is full
+   */
+  bool reply(const CommandResult& result) {
+    if (!results.push(result)) {
+      return false;
+    }
+    if (networkTask) {
+      xTaskNotifyGive(networkTask);
+    }
+    return true;
+  }
+
+  /**
+   * Wait for the results of a batch of submitted commands (network side)
+   * The actuation task answers in the order it finishes the commands (priorities,
+   * busy drawers, sensor confirmations), so each result is matched to its command
+   * by code. Results for codes outside the batch (late replies after a timeout) are discarded.
+   * @param batch - Results holding the command codes, receive the actuation results
+   * @param waiting - true for every result still expected, cleared as the results arrive
+   * @param count - Number of results
+   * @param timeoutMs - Maximum time to wait for the whole batch in milliseconds
+   * @return number of results that did not arrive in time
+   */
+  int awaitResults(CommandResult* batch, bool* waiting, int count, uint32_t timeoutMs) {
+    int missing = 0;
+    for (int i = 0; i < count; i++) {
+      missing += waiting[i] ? 1 : 0;
+    }
+
+    unsigned long start = millis();
+    while (missing > 0) {
+      CommandResult result;
+      while (missing > 0 && results.pop(result)) {
+        int match = -1;
+        for (int i = 0; i < count && match < 0; i++) {
+          if (waiting[i] && strcmp(batch[i].code, result.code) == 0) {
+            match = i;
+          }
+        }
+        if (match < 0) {
+          LOG_WARN("Discarding late actuation result (code: %s)", result.code);
+          continue;
+        }
+        batch[match] = result;
+        waiting[match] = false;
+        missing--;
+      }
+
+      unsigned long elapsed = millis() - start;
+      if (missing == 0 || elapsed >= timeoutMs) {
+        break;
+      }
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeoutMs - elapsed));
+    }
+    return missing;
+  }
+
+private:
+  SpscQueue<DrawerCommand, COMMAND_QUEUE_SIZE> commands;  // network -> actuation
+  SpscQueue<CommandResult, COMMAND_QUEUE_SIZE> results;   // actuation -> network
+  TaskHandle_t networkTask;
+  TaskHandle_t actuationTask;
+};
+
+#endif
@@ -12,25 +12,281 @@
 const char *ssid = "ssid";
 const char *password = "password";
 
+/** Fast reconnect
+ * The last access point (BSSID/channel) and DHCP lease are kept in NVS,
+ * reconnects try a directed connect to it before a full scan.
+ * WIFI_REUSE_DHCP_LEASE skips DHCP on directed connects, the lease is
+ * refreshed whenever a full scan connect goes through DHCP again.
+ */
+#define WIFI_FAST_RECONNECT 1
+#define WIFI_REUSE_DHCP_LEASE 1
+#define WIFI_DIRECTED_TIMEOUT_MS 3000  // give up on the cached access point after this
+#define WIFI_SCAN_TIMEOUT_MS 10000     // give up on a full scan connect after this
+#define WIFI_RETRY_DELAY_MS 2000       // delay between failed connection rounds
+
+// Optional static IP (takes precedence over the cached lease)
+#define WIFI_USE_STATIC_IP 0
+const IPAddress staticIp(192, 168, 0, 200);
+const IPAddress staticGateway(192, 168, 0, 1);
+const IPAddress staticSubnet(255, 255, 255, 0);
+const IPAddress staticDns(192, 168, 0, 1);
+
 /** Drawer pin definitions
+ * Default drawer table, used until the server sends one with the token
+ * (PUT /api/v1/devices/:id/config, cached in NVS, see drawerConfig.h)
  * example:
  * Drawer 1 -> GPIO 32
  * Drawer 2 -> GPIO 33
  * Drawer 3 -> GPIO 26
  * Drawer 4 -> GPIO 27
  */
-const int drawerPins[] = { 32, 33, 26, 27 };
+#define DRAWER_PINS 32, 33, 26, 27  // default table, see drawerConfig.h
 #define duration 500  // time in milliseconds to open/close drawer
+#define DRAWER_PULSE_WIDTHS_MS duration, duration, duration, duration  // pulse width of each drawer, in the order of DRAWER_PINS
+#define DRAWER_RELAY_ACTIVE_LEVEL LOW  // level that energizes the relays of the default table
+#define DRAWER_PULSE_MAX_MS 2000  // longest pulse accepted (solenoid duty limit)
+#define DRAWER_MAX_COUNT 20  // drawers a server table may define (preallocated, max 32)
+#define DRAWER_STAGGER_MS 0  // delay between relays of a multi-drawer open (0 = all at once), raise for weak power supplies
+#define DRAWER_REPEAT_GAP_MS 100  // relay released at least this long between two commands on the same drawer
+
+/** Drawer sensors (drawerSensors.h)
+ * Optional reed or limit switch per drawer, drawer 1 first (-1 = no sensor, sensors past
+ * the drawer count are ignored, a server drawer table only remaps the relays).
+ * Openings of sensed drawers are only reported as successful
+ * once the sensor saw the drawer open, the close action confirms the drawer is
+ * closed, and every state change is pushed to the server with a status report.
+ * example: #define DRAWER_SENSOR_PINS 34, 35, 36, 39 (input only, external pull-ups)
+ */
+#define DRAWER_SENSOR_PINS -1, -1, -1, -1
+#define DRAWER_SENSOR_OPEN_LEVEL HIGH   // input level of an open drawer (reed to GND with pull-up: magnet away = HIGH)
+#define DRAWER_SENSOR_DEBOUNCE_MS 30    // the input must be stable this long before a change counts
+#define DRAWER_OPEN_CONFIRM_MS 1500     // time for a sensed drawer to report open after its pulse started
+#define DRAWER_CLOSE_CONFIRM_MS 0       // time the close action waits for the drawer to be closed (0 = current state)
+#define DRAWER_CONFIRM_TIMEOUT_MS (DRAWER_OPEN_CONFIRM_MS > DRAWER_CLOSE_CONFIRM_MS ? DRAWER_OPEN_CONFIRM_MS : DRAWER_CLOSE_CONFIRM_MS)
 
 // Device credentials
 const char *device_id = "cmfbwjda30000u1ogpwwjowkw";
 const char *device_jwt_secret = "secret123";
 
+/** Benchmark build
+ * BENCHMARK_MODE builds this same firmware against the mock server in
+ * scripts/benchmarkServer.ts (npm run benchmark:server), which scripts latency,
+ * loss, errors and outages and aggregates the metrics reports into commands per
+ * minute, poll-to-ack percentiles, heap watermark and reconnect recovery time.
+ * Flash it on a bench board: the relays are really switched.
+ */
+#define BENCHMARK_MODE 0
+
 // Server endpoints
+#if BENCHMARK_MODE
+const char *serverUrl = "http://192.168.0.120:3100/api/v1";  // benchmark server (BENCH_PORT)
+#else
 const char *serverUrl = "http://192.168.0.120:3000/api/v1";
-const char *healthEndpoint = "/health";
-const char *authEndpoint = "/auth/device";
-const char *statusEndpoint = "/devices/status"; // not used yet
-const char *commandsEndpoint = "/devices/";
+#endif
+// Endpoint paths are part of the device protocol, see protocol.h
+
+/** TLS
+ * With SERVER_TLS serverUrl must be https:// and the server certificate is verified
+ * against serverRootCA (kept in flash). The default is ISRG Root X1 (Let's Encrypt),
+ * replace it with the CA that signed your server certificate. The handshake only runs when the persistent socket is (re)opened, every
+ * other request reuses the encrypted connection, so keep the server keep-alive timeout
+ * above POLL_IDLE_MAX_MS (HTTP_KEEP_ALIVE_TIMEOUT_MS on the backend).
+ */
+#define SERVER_TLS 0
+#define TLS_HANDSHAKE_TIMEOUT_S 10  // give up on a TLS handshake after this
+const char *serverRootCA = R"(-----BEGIN CERTIFICATE-----
+MIIFazCCA1OgAwIBAgIRAIIQz7DSQONZRGPgu2OCiwAwDQYJKoZIhvcNAQELBQAw
+TzELMAkGA1UEBhMCVVMxKTAnBgNVBAoTIEludGVybmV0IFNlY3VyaXR5IFJlc2Vh
+cmNoIEdyb3VwMRUwEwYDVQQDEwxJU1JHIFJvb3QgWDEwHhcNMTUwNjA0MTEwNDM4
+WhcNMzUwNjA0MTEwNDM4WjBPMQswCQYDVQQGEwJVUzEpMCcGA1UEChMgSW50ZXJu
+ZXQgU2VjdXJpdHkgUmVzZWFyY2ggR3JvdXAxFTATBgNVBAMTDElTUkcgUm9vdCBY
+MTCCAiIwDQYJKoZIhvcNAQEBBQADggIPADCCAgoCggIBAK3oJHP0FDfzm54rVygc
+h77ct984kIxuPOZXoHj3dcKi/vVqbvYATyjb3miGbESTtrFj/RQSa78f0uoxmyF+
+0TM8ukj13Xnfs7j/EvEhmkvBioZxaUpmZmyPfjxwv60pIgbz5MDmgK7iS4+3mX6U
+A5/TR5d8mUgjU+g4rk8Kb4Mu0UlXjIB0ttov0DiNewNwIRt18jA8+o+u3dpjq+sW
+T8KOEUt+zwvo/7V3LvSye0rgTBIlDHCNAymg4VMk7BPZ7hm/ELNKjD+Jo2FR3qyH
+B5T0Y3HsLuJvW5iB4YlcNHlsdu87kGJ55tukmi8mxdAQ4Q7e2RCOFvu396j3x+UC
+B5iPNgiV5+I3lg02dZ77DnKxHZu8A/lJBdiB3QW0KtZB6awBdpUKD9jf1b0SHzUv
+KBds0pjBqAlkd25HN7rOrFleaJ1/ctaJxQZBKT5ZPt0m9STJEadao0xAH0ahmbWn
+OlFuhjuefXKnEgV4We0+UXgVCwOPjdAvBbI+e0ocS3MFEvzG6uBQE3xDk3SzynTn
+jh8BCNAw1FtxNrQHusEwMFxIt4I7mKZ9YIqioymCzLq9gwQbooMDQaHWBfEbwrbw
+qHyGO0aoSCqI3Haadr8faqU9GY/rOPNk3sgrDQoo//fb4hVC1CLQJ13hef4Y53CI
+rU7m2Ys6xt0nUW7/vGT1M0NPAgMBAAGjQjBAMA4GA1UdDwEB/wQEAwIBBjAPBgNV
+HRMBAf8EBTADAQH/MB0GA1UdDgQWBBR5tFnme7bl5AFzgAiIyBpY9umbbjANBgkq
+hkiG9w0BAQsFAAOCAgEAVR9YqbyyqFDQDLHYGmkgJykIrGF1XIpu+ILlaS/V9lZL
+ubhzEFnTIZd+50xx+7LSYK05qAvqFyFWhfFQDlnrzuBZ6brJFe+GnY+EgPbk6ZGQ
+3BebYhtF8GaV0nxvwuo77x/Py9auJ/GpsMiu/X1+mvoiBOv/2X/qkSsisRcOj/KK
+NFtY2PwByVS5uCbMiogziUwthDyC3+6WVwW6LLv3xLfHTjuCvjHIInNzktHCgKQ5
+ORAzI4JMPJ+GslWYHb4phowim57iaztXOoJwTdwJx4nLCgdNbOhdjsnvzqvHu7Ur
+TkXWStAmzOVyyghqpZXjFaH3pO3JLF+l+/+sKAIuvtd7u+Nxe5AW0wdeRlN8NwdC
+jNPElpzVmbUq4JUagEiuTDkHzsxHpFKVK7q4+63SM1N95R1NbdWhscdCb+ZAJzVc
+oyi3B43njTOQ5yOf+1CceWxG1bQVs5ZufpsMljq4Ui0/1lvh+wjChP4kqKOJ2qxq
+4RgqsahDYVvTH9w7jXbyLeiNdd8XM2w9U/t7y0Ff/9yi0GE44Za4rF2LN9d11TPA
+mRGunUHBcnWEvgJBQl9nJEiU0Zsnvgc/ubhPgXRR4Xq37Z0j4r7g1SgEEzwxA57d
+emyPxgcYxn/eR44/KJ4EBs+lVDR3veyJm+kXQ99b21/+jh5Xos1AnX5iItreGCc=
+-----END CERTIFICATE-----
+)";
+
+/** Wire format
+ * With WIRE_FORMAT_MSGPACK polls ask for MessagePack (Accept header) and acks are
+ * sent as MessagePack once the server answers in it, servers without support keep using JSON.
+ */
+#define WIRE_FORMAT_MSGPACK 1
+#define MSGPACK_CONTENT_TYPE "application/msgpack"
+#if WIRE_FORMAT_MSGPACK
+#define COMPACT_ACCEPT MSGPACK_CONTENT_TYPE ", application/json"
+#else
+#define COMPACT_ACCEPT NULL
+#endif
+
+// Request timeouts
+#define HTTP_TIMEOUT_MS 5000  // timeout in milliseconds for regular requests
+
+/** Long-polling
+ * The server holds the poll request open until a command is queued or
+ * LONG_POLL_SECONDS elapse, so commands arrive as soon as they are created.
+ * Set to 0 to use plain interval polling.
+ */
+#define LONG_POLL_SECONDS 25
+
+/** Adaptive polling (see pollScheduler.h)
+ * Polls every POLL_FAST_INTERVAL_MS for POLL_FAST_WINDOW_MS after a command,
+ * then backs off from POLL_IDLE_MIN_MS up to POLL_IDLE_MAX_MS while idle.
+ * Failed polls back off from POLL_ERROR_BASE_MS up to POLL_ERROR_MAX_MS.
+ * A poll slot assigned by the server with the token replaces the idle backoff.
+ * Only used when the server does not hold polls open (long-polling).
+ */
+#define POLL_FAST_INTERVAL_MS 500
+#define POLL_FAST_WINDOW_MS 60000
+#define POLL_IDLE_MIN_MS 2000
+#define POLL_IDLE_MAX_MS 60000
+#define POLL_ERROR_BASE_MS 1000
+#define POLL_ERROR_MAX_MS 120000
+
+/** FreeRTOS tasks
+ * Network task (WiFi, polling, acks) runs on core 0 next to the WiFi stack,
+ * actuation task (drawer pulses) runs on core 1 so network stalls never delay a pulse.
+ */
+#define NETWORK_TASK_CORE 0
+#define NETWORK_TASK_STACK 8192
+#define NETWORK_TASK_PRIORITY 1
+#define ACTUATION_TASK_CORE 1
+#define ACTUATION_TASK_STACK 4096
+#define ACTUATION_TASK_PRIORITY 3
+
+// Command queue between the tasks
+#define COMMAND_QUEUE_SIZE 8              // slots in each queue (holds size - 1 items)
+#define COMMAND_CODE_SIZE 32              // max command code length + 1
+#define ERROR_MESSAGE_SIZE 64             // max error message length + 1
+#define ACTUATION_RESULT_TIMEOUT_MS 1000  // margin past the pulses and confirmations of a batch, one deadline per batch
+
+// Command batching
+#define MAX_BATCH_COMMANDS 4     // commands fetched per poll and acknowledged per request
+#define COMMANDS_DOC_SIZE 1024   // JSON memory for a batch of received commands
+#define ACK_DOC_SIZE 1024        // JSON memory for a batch of acknowledgements
+
+// Offline command journal (commandJournal.h)
+// JOURNAL_SIZE (last executed commands kept in NVS) is part of the device protocol, see protocol.h
+
+// Fixed request buffers (one per endpoint, no heap allocation per request)
+#define URL_BUFFER_SIZE 160      // full URL of an endpoint
+#define AUTH_PAYLOAD_SIZE 160    // authentication request body
+// The status request body (metrics report) is sized by metrics.h for the largest report
+#define ACK_PAYLOAD_SIZE 768     // acknowledgement request body
+#define JWT_TOKEN_SIZE 384       // JWT token + null terminator
+#define AUTH_HEADER_SIZE 400     // "Bearer " + JWT token
+#define TOKEN_PAYLOAD_SIZE 256   // decoded JWT payload (claims)
+#define TOKEN_CLAIMS_DOC_SIZE 256
+
+// Response bodies are parsed straight from the socket, never buffered in a String
+#define MAX_RESPONSE_BODY_SIZE 2048  // hard cap on a parsed success body (larger bodies are rejected)
+#define AUTH_RESPONSE_DOC_SIZE 1536  // JSON memory for the authentication response (token copied from the stream, drawer table)
+#define ERROR_BODY_SNIPPET_SIZE 96   // first bytes of an error body printed to Serial
+#define MAX_ERROR_DRAIN_SIZE 1024    // error bodies up to this size are drained to keep the connection, larger ones close it
+
+/** Metrics (metrics.h)
+ * Request phases, poll-to-actuation, actuation and poll-to-ack latencies are counted in
+ * fixed-bucket histograms and reported to statusEndpoint as deltas.
+ */
+#if BENCHMARK_MODE
+#define METRICS_REPORT_INTERVAL_MS 10000  // fine-grained heap samples for the soak
+#else
+#define METRICS_REPORT_INTERVAL_MS 60000  // time between two reports (0 = never report)
+#endif
+// Histogram bucket bounds (METRICS_BUCKET_BOUNDS) are part of the device protocol, see protocol.h
+
+// JWT refresh
+// The token is renewed TOKEN_REFRESH_MARGIN_SECONDS before it expires,
+// minus a random jitter so devices don't all refresh at the same time
+#define TOKEN_REFRESH_MARGIN_SECONDS 300
+#define TOKEN_REFRESH_JITTER_SECONDS 240
+#define TOKEN_DEFAULT_LIFETIME_SECONDS 3600  // used if the exp/iat claims can't be read
+#define TOKEN_RETRY_SECONDS 30               // delay before retrying a failed refresh
+#define TOKEN_CLOCK_SYNC_SECONDS 60          // refresh a cached token if the server time is still unknown after this
+
+/** Boot
+ * FAST_BOOT reuses the JWT cached in NVS and skips the blocking WiFi/health/auth
+ * sequence: the network task connects, authenticates if needed and its first
+ * poll doubles as the connectivity check.
+ * DEBUG_BUILD keeps the 2 s delay after Serial.begin so early logs reach the monitor.
+ */
+#define FAST_BOOT 1
+#define DEBUG_BUILD 0
+
+/** Supervision (supervisor.h)
+ * The task watchdog restarts the device when the network or actuation task stops for
+ * TASK_WDT_TIMEOUT_S (must exceed a long-poll request plus the command handling after it).
+ * Failed polls degrade instead of restarting: every SUPERVISOR_SOCKET_RESET_ERRORS
+ * consecutive failures the server connection is reopened, every SUPERVISOR_WIFI_RESET_ERRORS
+ * WiFi reassociates. Only after SUPERVISOR_OFFLINE_RESTART_MS without a successful poll
+ * does the device restart (0 = never). Restart causes are reported with the metrics.
+ */
+#define TASK_WDT_TIMEOUT_S 120
+#define SUPERVISOR_SOCKET_RESET_ERRORS 3
+#define SUPERVISOR_WIFI_RESET_ERRORS 6
+#define SUPERVISOR_OFFLINE_RESTART_MS 1800000UL  // 30 min
+
+/** Firmware updates (ota.h)
+ * FIRMWARE_VERSION is reported with the metrics and compared with the release the server
+ * announces on polls. Another release is downloaded in the background, OTA_CHUNK_SIZE bytes
+ * per request between polls, never while a relay pulse runs (flash writes stall both cores).
+ * It is checked against the server MD5 and activated by a restart once no command is in flight.
+ * While downloading, polls are not held open and run at most OTA_POLL_INTERVAL_MS apart.
+ */
+#define FIRMWARE_VERSION "1.0.0"
+#define OTA_ENABLED 1
+#define OTA_CHUNK_SIZE 16384
+#define OTA_POLL_INTERVAL_MS 1000
+#define OTA_RETRY_MAX_MS 60000  // backoff cap after failed chunks
+
+/** Power management (power.h)
+ * POWER_MODE_PERFORMANCE keeps the radio and CPU on. POWER_MODE_BALANCED lets the radio
+ * sleep as long as WAKE_LATENCY_BUDGET_MS allows (below one beacon: never, below
+ * WIFI_LISTEN_INTERVAL beacons: between DTIMs, else for a whole listen interval), scales
+ * the CPU frequency and light sleeps when the core supports it. POWER_MODE_DEEP_SLEEP also
+ * powers down between idle polls at least DEEP_SLEEP_MIN_MS apart (needs LONG_POLL_SECONDS 0).
+ * With long-polling the budget is the wake-on-command latency.
+ */
+#define POWER_MODE POWER_MODE_BALANCED  // POWER_MODE_PERFORMANCE, _BALANCED or _DEEP_SLEEP
+#define WAKE_LATENCY_BUDGET_MS 300      // extra latency allowed for a command while the radio sleeps
+#define WIFI_BEACON_INTERVAL_MS 102     // access point beacon interval (100 TU)
+#define WIFI_LISTEN_INTERVAL 3          // beacons slept in max modem sleep (ESP-IDF default)
+#define PM_MAX_CPU_FREQ_MHZ 240
+#define PM_MIN_CPU_FREQ_MHZ 80          // frequency while idle (keeps the APB clock at 80 MHz)
+#define NETWORK_IDLE_MAX_DELAY_MS 1000  // network task checks WiFi at least this often while waiting to poll
+#define DEEP_SLEEP_MIN_MS 30000         // shortest idle wait worth a deep sleep (a wakeup reconnects WiFi)
+/** Logging (logger.h)
+ * Messages above LOG_LEVEL are compiled out. With LOG_ASYNC the kept ones are queued
+ * and written to Serial by a low-priority task on the network core, so the network and
+ * actuation paths never wait on the UART. A full queue drops lines (and reports the count).
+ */
+#define LOG_LEVEL LOG_LEVEL_INFO   // LOG_LEVEL_NONE, _ERROR, _WARN, _INFO or _DEBUG
+#define LOG_ASYNC 1
+#define LOG_QUEUE_SLOTS 32         // queued lines
+#define LOG_LINE_SIZE 128          // max line length + 1 (longer lines are truncated)
+#define LOG_DRAIN_INTERVAL_MS 20   // how often the log task empties the queue
+#define LOG_TASK_CORE 0
+#define LOG_TASK_STACK 3072
+#define LOG_TASK_PRIORITY 0        // below the network and actuation tasks
 
 #endif
@@ -0,0 +1,152 @@
+#ifndef DRAWERCONFIG_H
+#define DRAWERCONFIG_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+
+// Include config file
+#include "config.h"
+#include "logger.h"
+
+/**
+ * Check that a pin is an output-capable GPIO free for a relay: 0, 2, 4, 5, 12-19, 21-23, 25-27, 32, 33
+ * (1 and 3 are the Serial TX/RX, 6-11 are wired to the flash, 20, 24 and 28-31 don't exist,
+ * 34-39 are input only). Same rule as isRelayPin in DevicesService on the backend.
+ */
+constexpr bool drawerPinValid(int pin) {
+  return pin >= 0 && pin <= 33 && pin != 1 && pin != 3 && !(pin >= 6 && pin <= 11) && pin != 20 && pin != 24 &&
+         !(pin >= 28 && pin <= 31);
+}
+
+/**
+ * Check at compile time that every pin of a list can drive a relay
+ */
+constexpr bool drawerPinsValid(int) {
+  return true;
+}
+template <typename... Rest>
+constexpr bool drawerPinsValid(int, int pin, Rest... rest) {
+  return drawerPinValid(pin) && drawerPinsValid(0, rest...);
+}
+
+/**
+ * Build the mask of the GPIOs of a list at compile time (bit n = GPIO n, -1 = none)
+ */
+constexpr uint64_t drawerPinMask() {
+  return 0;
+}
+template <typename... Rest>
+constexpr uint64_t drawerPinMask(int pin, Rest... rest) {
+  return (pin >= 0 ? 1ULL << pin : 0ULL) | drawerPinMask(rest...);
+}
+
+// GPIOs read by the drawer sensors (DRAWER_SENSOR_PINS), never usable as relays
+constexpr uint64_t DRAWER_SENSOR_PIN_MASK = drawerPinMask(DRAWER_SENSOR_PINS);
+
+/**
+ * Default drawer table (DRAWER_PINS / DRAWER_PULSE_WIDTHS_MS in config.h),
+ * used until the server sends one
+ */
+constexpr int drawerDefaultPins[] = { DRAWER_PINS };
+constexpr unsigned long drawerDefaultPulseWidths[] = { DRAWER_PULSE_WIDTHS_MS };
+constexpr int DRAWER_DEFAULT_COUNT = sizeof(drawerDefaultPins) / sizeof(drawerDefaultPins[0]);
+
+static_assert(DRAWER_MAX_COUNT <= 32, "At most 32 drawers are supported (drawer masks are 32 bits)");
+static_assert(DRAWER_DEFAULT_COUNT <= DRAWER_MAX_COUNT, "DRAWER_PINS lists more pins than DRAWER_MAX_COUNT");
+static_assert(drawerPinsValid(0, DRAWER_PINS),
+              "DRAWER_PINS contains a pin that can't drive a relay (valid: 0, 2, 4, 5, 12-19, 21-23, 25-27, 32, 33)");
+static_assert((drawerPinMask(DRAWER_PINS) & DRAWER_SENSOR_PIN_MASK) == 0, "DRAWER_PINS shares a pin with DRAWER_SENSOR_PINS");
+static_assert(sizeof(drawerDefaultPulseWidths) / sizeof(drawerDefaultPulseWidths[0]) == DRAWER_DEFAULT_COUNT,
+              "DRAWER_PULSE_WIDTHS_MS must list one width per drawer of DRAWER_PINS");
+
+/**
+ * Drawer hardware table: relay pin and pulse width of each drawer, relay active level
+ * Stored as a flat, fixed-size record so it is copied and persisted as is.
+ */
+struct DrawerConfig {
+  uint32_t version;                    // Server table version, 0 = firmware defaults
+  uint8_t count;                       // Drawers in the table (1 to DRAWER_MAX_COUNT)
+  uint8_t activeLevel;                 // Level that energizes the relays (LOW / HIGH)
+  int8_t pins[DRAWER_MAX_COUNT];       // Relay GPIO of drawer i + 1
+  uint16_t pulseMs[DRAWER_MAX_COUNT];  // Pulse width of drawer i + 1 in milliseconds
+};
+
+/**
+ * Drawer table persistence
+ * The server sends the table with the token (ServerConnector::authenticate), it is
+ * kept in NVS so the device boots with the hardware it was last told about, even
+ * before it reaches the server. Without a stored table the config.h defaults apply.
+ */
+class DrawerConfigStore {
+public:
+  /**
+   * Fill a table with the config.h defaults
+   * @param config - Receives the default table
+   */
+  static void defaults(DrawerConfig& config) {
+    memset(&config, 0, sizeof(config));
+    config.version = 0;
+    config.count = DRAWER_DEFAULT_COUNT;
+    config.activeLevel = DRAWER_RELAY_ACTIVE_LEVEL;
+    for (int i = 0; i < DRAWER_DEFAULT_COUNT; i++) {
+      config.pins[i] = drawerDefaultPins[i];
+      config.pulseMs[i] = constrain(drawerDefaultPulseWidths[i], 1UL, (unsigned long)DRAWER_PULSE_MAX_MS);
+    }
+  }
+
+  /**
+   * Check that a table can be applied to this board
+   * @param config - Table to check
+   * @return true if every pin can drive a relay, no pin is listed twice or used by a sensor
+   *         and every width is in range
+   */
+  static bool isValid(const DrawerConfig& config) {
+    if (config.count < 1 || config.count > DRAWER_MAX_COUNT) {
+      return false;
+    }
+    uint64_t used = DRAWER_SENSOR_PIN_MASK;
+    for (int i = 0; i < config.count; i++) {
+      if (!drawerPinValid(config.pins[i]) || (used & (1ULL << config.pins[i]))) {
+        return false;
+      }
+      used |= 1ULL << config.pins[i];
+      if (config.pulseMs[i] < 1 || config.pulseMs[i] > DRAWER_PULSE_MAX_MS) {
+        return false;
+      }
+    }
+    return config.activeLevel == LOW || config.activeLevel == HIGH;
+  }
+
+  /**
+   * Load the table stored in NVS, must be called once from setup() before DrawerManager::setupDrawers()
+   * @param config - Receives the stored table, or the defaults if none is stored or it is unusable
+   */
+  static void load(DrawerConfig& config) {
+    Preferences prefs;
+    bool loaded = false;
+    if (prefs.begin("drawers", true)) {
+      loaded = prefs.getBytes("table", &config, sizeof(config)) == sizeof(config) && isValid(config);
+      prefs.end();
+    }
+    if (!loaded) {
+      defaults(config);
+    }
+  }
+
+  /**
+   * Persist a table received from the server
+   * @param config - Table to store
+   * @return true if stored
+   */
+  static bool save(const DrawerConfig& config) {
+    Preferences prefs;
+    if (!prefs.begin("drawers", false)) {
+      return false;
+    }
+    bool saved = prefs.putBytes("table", &config, sizeof(config)) == sizeof(config);
+    prefs.end();
+    return saved;
+  }
+};
+
+#endif
@@ -2,23 +2,129 @@
 #define DRAWERMANAGER_H
 
 #include <Arduino.h>
+#include <atomic>
+#include <soc/gpio_struct.h>
+#include <driver/gpio.h>
+#include <esp_timer.h>
 #include "config.h"
+#include "drawerConfig.h"
+#include "drawerSensors.h"
+#include "metrics.h"
+#include "logger.h"
+
+/**
+ * Pulse end timers run from the esp_timer ISR when the core allows it,
+ * otherwise from the esp_timer task (priority above every sketch task)
+ */
+#ifdef CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD
+#define PULSE_TIMER_DISPATCH ESP_TIMER_ISR
+#else
+#define PULSE_TIMER_DISPATCH ESP_TIMER_TASK
+#endif
+
 
 /**
  * Class to manage drawer operations
+ * Openings are non-blocking: openDrawer() starts a pulse and a one-shot
+ * esp_timer per drawer releases the relay when its pulse width has elapsed,
+ * so pulse lengths hold to the timer resolution whatever the tasks are doing
+ * and several drawers can pulse at the same time while the network keeps running.
+ * tick() starts staggered pulses, records the pulse lengths and, should a timer
+ * be unavailable, releases the relay itself.
+ *
+ * The drawers come from a DrawerConfig table (drawerConfig.h): the config.h
+ * defaults, or the table the server sent with the token. Everything is held in
+ * flat arrays sized for DRAWER_MAX_COUNT, so a new table is applied at runtime
+ * without allocating, and relays are still switched with direct register writes:
+ * opening several drawers at once is a single masked write per GPIO bank
+ * (pins 0-31 and 32-33).
+ *
+ * Drawers with a sensor (DRAWER_SENSOR_PINS) also report whether they are
+ * open, so the actuation task can confirm an opening instead of assuming it.
  */
 class DrawerManager {
 public:
-  DrawerManager() {}
+  static_assert(DrawerSensors::SENSOR_COUNT <= DRAWER_MAX_COUNT, "DRAWER_SENSOR_PINS lists more sensors than DRAWER_MAX_COUNT");
+
+  // Constructor
+  DrawerManager()
+    : drawerCount(0), targetVersion(0), configRequested(false), pulsingMask(0), releasedMask(0) {
+    actuationTask = NULL;
+    pendingMask = 0;
+    activeHigh = false;
+    allLowBank = 0;
+    allHighBank = 0;
+    for (int i = 0; i < DRAWER_MAX_COUNT; i++) {
+      pins[i] = -1;
+      releaseAt[i] = 0;
+      startAt[i] = 0;
+      pulseWidthMs[i] = 0;
+      timers[i].owner = this;
+      timers[i].handle = NULL;
+      timers[i].bit = 1UL << i;
+      timers[i].lowBank = 0;
+      timers[i].highBank = 0;
+      timers[i].startedUs = 0;
+      timers[i].endedUs = 0;
+    }
+  }
 
   /**
-   * Configures the drawer pins
+   * Configures the drawer pins and creates the pulse end timers, call once from setup()
+   * @param config - Drawer table to start with (see DrawerConfigStore::load)
    */
-  void setupDrawers() {
-    for (int i = 0; i < sizeof(drawerPins) / sizeof(drawerPins[0]); i++) {
-      pinMode(drawerPins[i], OUTPUT);
-      digitalWrite(drawerPins[i], HIGH);  // Initially closed
+  void setupDrawers(const DrawerConfig& config) {
+    for (int i = 0; i < DRAWER_MAX_COUNT; i++) {
+      esp_timer_create_args_t args;
+      args.callback = onPulseEnd;
+      args.arg = &timers[i];
+      args.dispatch_method = PULSE_TIMER_DISPATCH;
+      args.name = "pulse";
+      args.skip_unhandled_events = false;
+      if (esp_timer_create(&args, &timers[i].handle) != ESP_OK) {
+        timers[i].handle = NULL;  // tick() ends this drawer's pulses instead
+      }
+    }
+
+    targetVersion.store(config.version, std::memory_order_relaxed);
+    applyConfig(config);
+  }
+
+  /**
+   * Start the drawer sensors (see drawerSensors.h), once the tasks exist
+   * @param actuation - Actuation task, woken by sensor edges and new drawer tables
+   * @param network - Network task, woken when a drawer state changes
+   */
+  void beginSensors(TaskHandle_t actuation, TaskHandle_t network) {
+    actuationTask = actuation;
+    sensors.begin(actuation, network);
+  }
+
+  /**
+   * Hand a new drawer table to the actuation task (network task)
+   * tick() applies it as soon as no pulse is running.
+   * @param config - Validated table (DrawerConfigStore::isValid)
+   * @return false if the previous table was not applied yet, try again later
+   */
+  bool requestConfig(const DrawerConfig& config) {
+    if (configRequested.load(std::memory_order_acquire)) {
+      return false;
     }
+    requestedConfig = config;
+    targetVersion.store(config.version, std::memory_order_relaxed);
+    configRequested.store(true, std::memory_order_release);
+    if (actuationTask) {
+      xTaskNotifyGive(actuationTask);
+    }
+    return true;
+  }
+
+  /**
+   * Get the version of the drawer table in use, or waiting to be applied (any task)
+   * @return server table version, 0 for the config.h defaults
+   */
+  uint32_t getConfigVersion() {
+    return targetVersion.load(std::memory_order_relaxed);
   }
 
   /**
@@ -27,27 +133,408 @@ public:
    * @return true if valid, false otherwise
    */
   bool isValidDrawer(int drawerNumber) {
-    return (drawerNumber >= 1 && drawerNumber <= (int)(sizeof(drawerPins) / sizeof(drawerPins[0])));
+    return ((unsigned)(drawerNumber - 1) < (unsigned)getDrawerCount());
+  }
+
+  /**
+   * Get the number of drawers managed
+   * @return number of drawers in the drawer table
+   */
+  int getDrawerCount() {
+    return drawerCount.load(std::memory_order_acquire);
+  }
+
+  /**
+   * Set the pulse width of a drawer (actuation task)
+   * Applies from the next pulse, capped at DRAWER_PULSE_MAX_MS to protect the solenoid.
+   * @param drawerIndex - Drawer index (1-based)
+   * @param widthMs - Pulse width in milliseconds
+   * @return true if set, false if the drawer is invalid
+   */
+  bool setPulseWidth(int drawerIndex, unsigned long widthMs) {
+    if (!isValidDrawer(drawerIndex)) {
+      return false;
+    }
+    pulseWidthMs[drawerIndex - 1] = constrain(widthMs, 1UL, (unsigned long)DRAWER_PULSE_MAX_MS);
+    return true;
+  }
+
+  /**
+   * Get the pulse width of a drawer
+   * @param drawerIndex - Drawer index (1-based)
+   * @return pulse width in milliseconds, 0 if the drawer is invalid
+   */
+  unsigned long getPulseWidth(int drawerIndex) {
+    return isValidDrawer(drawerIndex) ? pulseWidthMs[drawerIndex - 1] : 0;
   }
 
   /**
    * Opens the specified drawer
+   * Starts the relay pulse and returns immediately, its timer ends the pulse.
+   * Opening a drawer that is already pulsing restarts its pulse.
    * @param drawerIndex - Drawer index (1-based)
    * @return true if the operation was successful, false otherwise
    */
   bool openDrawer(int drawerIndex) {
-    if (drawerIndex < 1 || drawerIndex > (int)(sizeof(drawerPins) / sizeof(drawerPins[0]))) {
-      Serial.print("Invalid drawer: ");
-      Serial.println(drawerIndex);
+    if (!isValidDrawer(drawerIndex)) {
+      LOG_ERROR("Invalid drawer: %d", drawerIndex);
+      return false;
+    }
+    LOG_DEBUG("Opening drawer: %d, pin: %d", drawerIndex, pins[drawerIndex - 1]);
+    return openDrawers(1UL << (drawerIndex - 1));
+  }
+
+  /**
+   * Opens several drawers in the same pulse window
+   * Without stagger all relays are switched by one masked register write per GPIO bank.
+   * With stagger the relays are switched one after the other, staggerMs apart,
+   * to limit the inrush current on weak power supplies (tick() starts the later ones).
+   * @param drawerMask - Bit i set = open drawer i + 1
+   * @param staggerMs - Delay between consecutive relays in milliseconds (0 = all at once)
+   * @return true if the operation was successful, false if the mask has invalid drawers
+   */
+  bool openDrawers(uint32_t drawerMask, unsigned long staggerMs = 0) {
+    if (drawerMask == 0 || (drawerMask & ~validMask()) != 0) {
+      LOG_ERROR("Invalid drawer mask: 0x%08lx", (unsigned long)drawerMask);
       return false;
     }
-    int pin = drawerPins[drawerIndex - 1];  // Drawer 1 = index 0
-    Serial.printf("Opening drawer: %d, pin: %d\n", drawerIndex, pin);
-    digitalWrite(pin, LOW);  // LOW = open
-    delay(duration);
-    digitalWrite(pin, HIGH);  // Close after duration
+
+    unsigned long now = millis();
+    if (staggerMs == 0) {
+      startPulses(drawerMask, now);
+      return true;
+    }
+
+    // First relay now, the next ones staggerMs apart
+    unsigned long offset = 0;
+    int count = getDrawerCount();
+    for (int i = 0; i < count; i++) {
+      if (drawerMask & (1UL << i)) {
+        startAt[i] = now + offset;
+        offset += staggerMs;
+      }
+    }
+    pendingMask |= drawerMask;
+    tick(now);
     return true;
   }
+
+  /**
+   * Starts staggered pulses, records finished pulses, reads the sensors and
+   * applies a new drawer table once idle, must be called frequently by the actuation task
+   * @param now - Current time in milliseconds (millis())
+   */
+  void tick(unsigned long now) {
+    sensors.update(now);
+    int count = getDrawerCount();
+
+    // Start staggered pulses that are due
+    if (pendingMask != 0) {
+      uint32_t startMask = 0;
+      for (int i = 0; i < count; i++) {
+        if ((pendingMask & (1UL << i)) && (long)(now - startAt[i]) >= 0) {
+          startMask |= 1UL << i;
+        }
+      }
+      if (startMask != 0) {
+        pendingMask &= ~startMask;
+        startPulses(startMask, now);
+      }
+    }
+
+    // Backstop: release the relays whose timer did not (no timer, or far overdue)
+    uint32_t pulsing = pulsingMask.load(std::memory_order_acquire);
+    if (pulsing != 0) {
+      for (int i = 0; i < count; i++) {
+        if ((pulsing & (1UL << i)) && (long)(now - releaseAt[i]) >= 0) {
+          release(timers[i]);
+        }
+      }
+    }
+
+    // Actual pulse lengths, measured in microseconds by the timers
+    uint32_t released = releasedMask.exchange(0, std::memory_order_acq_rel);
+    for (int i = 0; released != 0 && i < count; i++) {
+      if (released & (1UL << i)) {
+        metrics.record(HIST_ACTUATION, (unsigned long)((timers[i].endedUs - timers[i].startedUs + 500) / 1000));
+      }
+    }
+
+    // New drawer table from the server, never swapped under a running pulse
+    if (configRequested.load(std::memory_order_acquire) && !isBusy()) {
+      applyConfig(requestedConfig);
+      configRequested.store(false, std::memory_order_release);
+    }
+  }
+
+  /**
+   * Latch the relay pins in their current (released) state, or let them follow GPIO writes
+   * again. Held pins keep their level through deep sleep and the reset that ends it.
+   * @param hold - true before a deep sleep, false once setupDrawers() drove them again
+   */
+  void holdPins(bool hold) {
+    int count = getDrawerCount();
+    for (int i = 0; i < count; i++) {
+      if (hold) {
+        gpio_hold_en((gpio_num_t)pins[i]);
+      } else {
+        gpio_hold_dis((gpio_num_t)pins[i]);
+      }
+    }
+    if (hold) {
+      gpio_deep_sleep_hold_en();
+    } else {
+      gpio_deep_sleep_hold_dis();
+    }
+  }
+
+  /**
+   * Check if any drawer pulse is in progress
+   * @return true if at least one relay is active
+   */
+  bool isBusy() {
+    return (pulsingMask.load(std::memory_order_acquire) | pendingMask) != 0;
+  }
+
+  /**
+   * Get the drawers that can't start a new pulse yet (actuation task)
+   * A drawer stays busy DRAWER_REPEAT_GAP_MS after its pulse, so two commands
+   * on it give two distinct openings.
+   * @return bit i set = drawer i + 1 is pulsing, waiting for a staggered pulse or just released
+   */
+  uint32_t getBusyMask() {
+    uint32_t busy = pulsingMask.load(std::memory_order_acquire) | pendingMask;
+    int64_t nowUs = esp_timer_get_time();
+    int count = getDrawerCount();
+    for (int i = 0; i < count; i++) {
+      if (timers[i].endedUs != 0 && nowUs - timers[i].endedUs < (int64_t)DRAWER_REPEAT_GAP_MS * 1000) {
+        busy |= 1UL << i;
+      }
+    }
+    return busy;
+  }
+
+  /**
+   * Check if a sensor edge is waiting for its debounce window
+   * @return true if tick() must run again soon
+   */
+  bool isSettling() {
+    return sensors.isSettling();
+  }
+
+  /**
+   * Get the drawers reported open by their sensor (any task)
+   * @return bit i set = drawer i + 1 is open, drawers without a sensor are never set
+   */
+  uint32_t getOpenMask() {
+    return sensors.getOpenMask() & getSensedMask();
+  }
+
+  /**
+   * Get the drawers that have a sensor
+   * @return bit i set = drawer i + 1 has a sensor (sensors past the drawer count are ignored)
+   */
+  uint32_t getSensedMask() {
+    return DrawerSensors::getSensedMask() & validMask();
+  }
+
+  /**
+   * Take the state changed flag (network task, to push the new state to the server)
+   * @return true if a drawer opened or closed since the last call
+   */
+  bool takeStateChanged() {
+    return sensors.takeChanged();
+  }
+
+private:
+  static const unsigned long BACKSTOP_GRACE_MS = 5;  // tick() releases a relay this late past its timer
+
+  /**
+   * Pulse end timer of one drawer, only holds RAM data so the callback can run from IRAM
+   */
+  struct PulseTimer {
+    DrawerManager* owner;
+    esp_timer_handle_t handle;   // NULL if the timer could not be created
+    uint32_t bit;                // Drawer bit in the masks
+    uint32_t lowBank;            // Relay pin in the 0-31 bank
+    uint32_t highBank;           // Relay pin in the 32-33 bank
+    int64_t startedUs;           // esp_timer_get_time() when the pulse started
+    volatile int64_t endedUs;    // esp_timer_get_time() when the pulse ended
+  };
+
+  DrawerSensors sensors;                         // Optional open/closed inputs
+  TaskHandle_t actuationTask;                    // Woken when a new table is requested
+  std::atomic<uint8_t> drawerCount;              // Drawers in the table in use
+  std::atomic<uint32_t> targetVersion;           // Version of the table in use or requested
+  std::atomic<bool> configRequested;             // requestedConfig waits for tick()
+  DrawerConfig requestedConfig;                  // Table handed over by the network task
+  bool activeHigh;                               // Relays are energized by a HIGH level
+  uint32_t allLowBank;                           // Every relay pin in the 0-31 bank
+  uint32_t allHighBank;                          // Every relay pin in the 32-33 bank (bit 0 = GPIO32)
+  int pins[DRAWER_MAX_COUNT];                    // Relay GPIO of each drawer
+  PulseTimer timers[DRAWER_MAX_COUNT];           // One pulse end timer per drawer
+  std::atomic<uint32_t> pulsingMask;             // Bit i set = relay of drawer i + 1 active (cleared by the timers)
+  std::atomic<uint32_t> releasedMask;            // Bit i set = pulse of drawer i + 1 ended, length not recorded yet
+  uint32_t pendingMask;                          // Bit i set = staggered pulse of drawer i + 1 not started yet
+  unsigned long pulseWidthMs[DRAWER_MAX_COUNT];  // Pulse width of each drawer
+  unsigned long releaseAt[DRAWER_MAX_COUNT];     // millis() deadline for the tick() backstop
+  unsigned long startAt[DRAWER_MAX_COUNT];       // millis() time to start each staggered pulse
+
+  /**
+   * Mask of the drawers in the table
+   * @return bit i set for every drawer i + 1
+   */
+  uint32_t validMask() {
+    int count = getDrawerCount();
+    return count >= 32 ? 0xFFFFFFFFUL : (1UL << count) - 1;
+  }
+
+  /**
+   * Switch to a drawer table (setup() or the actuation task, with no pulse running)
+   * The old relays are released with their own level, pins that no longer drive
+   * a relay go back to inputs, and the new relay pins get their released level
+   * latched before they become outputs so no relay clicks during the swap.
+   * @param config - Validated table
+   */
+  void applyConfig(const DrawerConfig& config) {
+    int oldCount = getDrawerCount();
+    writeInactive(allLowBank, allHighBank);
+
+    uint64_t newPins = 0;
+    for (int i = 0; i < config.count; i++) {
+      newPins |= 1ULL << config.pins[i];
+    }
+    for (int i = 0; i < oldCount; i++) {
+      if (!(newPins & (1ULL << pins[i]))) {
+        pinMode(pins[i], INPUT);  // No longer a relay
+      }
+    }
+
+    activeHigh = config.activeLevel == HIGH;
+    allLowBank = 0;
+    allHighBank = 0;
+    for (int i = 0; i < DRAWER_MAX_COUNT; i++) {
+      bool used = i < config.count;
+      pins[i] = used ? config.pins[i] : -1;
+      pulseWidthMs[i] = used ? config.pulseMs[i] : 0;
+      timers[i].lowBank = used && pins[i] < 32 ? 1UL << pins[i] : 0;
+      timers[i].highBank = used && pins[i] >= 32 ? 1UL << (pins[i] - 32) : 0;
+      allLowBank |= timers[i].lowBank;
+      allHighBank |= timers[i].highBank;
+    }
+
+    writeInactive(allLowBank, allHighBank);  // Released level latched before the pins drive
+    for (int i = 0; i < config.count; i++) {
+      pinMode(pins[i], OUTPUT);
+    }
+    writeInactive(allLowBank, allHighBank);  // Initially closed
+    drawerCount.store(config.count, std::memory_order_release);
+
+    LOG_INFO("Drawers: %d configured from %s, relays active %s", config.count,
+             config.version ? "the server table" : "config.h", activeHigh ? "HIGH" : "LOW");
+  }
+
+  /**
+   * Switch relays on and arm their pulse end timers
+   * @param drawerMask - Drawers to open, bit i = drawer i + 1
+   * @param now - Current time in milliseconds (millis())
+   */
+  void startPulses(uint32_t drawerMask, unsigned long now) {
+    int count = getDrawerCount();
+
+    // A drawer already pulsing restarts its pulse
+    for (int i = 0; i < count; i++) {
+      if ((drawerMask & (1UL << i)) && timers[i].handle) {
+        esp_timer_stop(timers[i].handle);
+      }
+    }
+
+    uint32_t lowBank, highBank;
+    toPinMasks(drawerMask, lowBank, highBank);
+    writeActive(lowBank, highBank);  // Open
+    int64_t startedUs = esp_timer_get_time();
+    pulsingMask.fetch_or(drawerMask, std::memory_order_acq_rel);
+
+    for (int i = 0; i < count; i++) {
+      if (drawerMask & (1UL << i)) {
+        timers[i].startedUs = startedUs;
+        releaseAt[i] = now + pulseWidthMs[i] + (timers[i].handle ? BACKSTOP_GRACE_MS : 0);
+        if (timers[i].handle && esp_timer_start_once(timers[i].handle, (uint64_t)pulseWidthMs[i] * 1000ULL) != ESP_OK) {
+          releaseAt[i] = now + pulseWidthMs[i];
+        }
+      }
+    }
+  }
+
+  /**
+   * Release one relay and hand its pulse length to tick()
+   * Runs from the timer callback or the tick() backstop, whichever comes first.
+   * @param timer - Pulse timer of the drawer
+   */
+  static void IRAM_ATTR release(PulseTimer& timer) {
+    DrawerManager* self = timer.owner;
+    if ((self->pulsingMask.fetch_and(~timer.bit, std::memory_order_acq_rel) & timer.bit) == 0) {
+      return;  // Already released
+    }
+    self->writeInactive(timer.lowBank, timer.highBank);  // Close after the pulse width
+    timer.endedUs = esp_timer_get_time();
+    self->releasedMask.fetch_or(timer.bit, std::memory_order_release);
+  }
+
+  /**
+   * Pulse end timer callback
+   */
+  static void IRAM_ATTR onPulseEnd(void* arg) {
+    release(*(PulseTimer*)arg);
+  }
+
+  /**
+   * Convert a drawer mask into GPIO bank masks
+   * @param drawerMask - Bit i set = drawer i + 1
+   * @param lowBank - Receives the mask of pins 0-31
+   * @param highBank - Receives the mask of pins 32-33
+   */
+  void toPinMasks(uint32_t drawerMask, uint32_t& lowBank, uint32_t& highBank) {
+    lowBank = 0;
+    highBank = 0;
+    int count = getDrawerCount();
+    for (int i = 0; i < count; i++) {
+      if (drawerMask & (1UL << i)) {
+        lowBank |= timers[i].lowBank;
+        highBank |= timers[i].highBank;
+      }
+    }
+  }
+
+  /**
+   * Energize / release relays at the table's active level
+   */
+  void writeActive(uint32_t lowBank, uint32_t highBank) {
+    if (activeHigh) {
+      writeHigh(lowBank, highBank);
+    } else {
+      writeLow(lowBank, highBank);
+    }
+  }
+  void IRAM_ATTR writeInactive(uint32_t lowBank, uint32_t highBank) {
+    if (activeHigh) {
+      writeLow(lowBank, highBank);
+    } else {
+      writeHigh(lowBank, highBank);
+    }
+  }
+
+  /**
+   * Drive pins LOW / HIGH with the write-1-to-clear / write-1-to-set registers
+   */
+  static void IRAM_ATTR writeLow(uint32_t lowBank, uint32_t highBank) {
+    if (lowBank) GPIO.out_w1tc = lowBank;
+    if (highBank) GPIO.out1_w1tc.val = highBank;
+  }
+  static void IRAM_ATTR writeHigh(uint32_t lowBank, uint32_t highBank) {
+    if (lowBank) GPIO.out_w1ts = lowBank;
+    if (highBank) GPIO.out1_w1ts.val = highBank;
+  }
 };
 
 #endif
@@ -0,0 +1,218 @@
+#ifndef DRAWERSENSORS_H
+#define DRAWERSENSORS_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <soc/gpio_struct.h>
+
+// Include config file
+#include "config.h"
+#include "metrics.h"
+#include "logger.h"
+
+/**
+ * Check at compile time that every sensor pin is an input-capable GPIO or -1 (no sensor)
+ * (6-11 are wired to the flash)
+ */
+constexpr bool drawerSensorPinsValid(int) {
+  return true;
+}
+template <typename... Rest>
+constexpr bool drawerSensorPinsValid(int, int pin, Rest... rest) {
+  return (pin == -1 || (pin >= 0 && pin <= 39 && !(pin >= 6 && pin <= 11))) && drawerSensorPinsValid(0, rest...);
+}
+
+/**
+ * Build the mask of the drawers that have a sensor at compile time (bit i = drawer i + 1)
+ */
+constexpr uint32_t drawerSensedMask() {
+  return 0;
+}
+template <typename... Rest>
+constexpr uint32_t drawerSensedMask(int pin, Rest... rest) {
+  return (pin >= 0 ? 1UL : 0UL) | (drawerSensedMask(rest...) << 1);
+}
+
+/**
+ * Class to read the drawer sensors (reed or limit switches, one per drawer)
+ * Inputs are interrupt driven: an edge on any sensor wakes the actuation task,
+ * which reads every sensor once the DRAWER_SENSOR_DEBOUNCE_MS window has passed
+ * without new edges, so switch bounce never shows up as a state change.
+ *
+ * The debounced state is published as atomics (read by the network task to
+ * push it to the server) and as the drawersOpen / drawersSensed gauges.
+ * A pin of -1 in DRAWER_SENSOR_PINS means the drawer has no sensor.
+ */
+template <int... Pins>
+class DrawerSensorsT {
+public:
+  static const int SENSOR_COUNT = sizeof...(Pins);
+
+  static_assert(SENSOR_COUNT <= 32, "At most 32 drawer sensors are supported (drawer masks are 32 bits)");
+  static_assert(drawerSensorPinsValid(0, Pins...), "DRAWER_SENSOR_PINS contains a pin that can't be read (valid: -1, 0-5, 12-39)");
+
+  // Constructor
+  DrawerSensorsT()
+    : edgeAt(0), dirty(false), openMask(0), changed(false) {
+    notifyTask = NULL;
+    stateTask = NULL;
+  }
+
+  /**
+   * Configure the inputs and read the initial state, call once the tasks exist
+   * @param actuation - Task woken on every edge (runs update())
+   * @param network - Task woken when the debounced state changes (pushes it)
+   */
+  void begin(TaskHandle_t actuation, TaskHandle_t network) {
+    notifyTask = actuation;
+    stateTask = network;
+    if (SENSED_MASK == 0) {
+      return;
+    }
+
+    for (int i = 0; i < SENSOR_COUNT; i++) {
+      if (pins[i] >= 0) {
+        pinMode(pins[i], INPUT_PULLUP);  // 34-39 have no pull-up, they need an external one
+        attachInterruptArg(pins[i], onEdge, this, CHANGE);
+      }
+    }
+    openMask.store(readOpenMask(), std::memory_order_relaxed);
+    publish();
+    LOG_INFO("Drawer sensors: open mask 0x%02lx (sensed 0x%02lx)", (unsigned long)getOpenMask(), (unsigned long)SENSED_MASK);
+  }
+
+  /**
+   * Read the sensors once the bounce settled, must be called by the actuation task
+   * The inputs are also compared with the debounced state on every call, an edge
+   * may go unseen while the CPU light sleeps (see power.h).
+   * @param now - Current time in milliseconds (millis())
+   * @return true if the debounced state changed
+   */
+  bool update(unsigned long now) {
+    if (SENSED_MASK == 0) {
+      return false;
+    }
+    if (!dirty.load(std::memory_order_acquire)) {
+      if (readOpenMask() == getOpenMask()) {
+        return false;
+      }
+      edgeAt.store(now, std::memory_order_relaxed);  // Missed edge, debounce it like a seen one
+      dirty.store(true, std::memory_order_release);
+    }
+    if (now - edgeAt.load(std::memory_order_relaxed) < DRAWER_SENSOR_DEBOUNCE_MS) {
+      return false;
+    }
+
+    dirty.store(false, std::memory_order_release);  // Cleared before reading, a later edge sets it again
+    uint32_t current = readOpenMask();
+    uint32_t previous = openMask.exchange(current, std::memory_order_acq_rel);
+    if (current == previous) {
+      return false;
+    }
+
+    for (int i = 0; i < SENSOR_COUNT; i++) {
+      if ((current ^ previous) & (1UL << i)) {
+        LOG_INFO("Drawer %d %s", i + 1, (current & (1UL << i)) ? "opened" : "closed");
+      }
+    }
+    publish();
+    changed.store(true, std::memory_order_release);
+    if (stateTask) {
+      xTaskNotifyGive(stateTask);
+    }
+    return true;
+  }
+
+  /**
+   * Check if an edge is waiting for its debounce window
+   * @return true if update() must run again soon
+   */
+  bool isSettling() {
+    return dirty.load(std::memory_order_acquire);
+  }
+
+  /**
+   * Get the debounced state (any task)
+   * @return bit i set = drawer i + 1 is open (only meaningful for sensed drawers)
+   */
+  uint32_t getOpenMask() {
+    return openMask.load(std::memory_order_acquire);
+  }
+
+  /**
+   * Get the drawers that have a sensor
+   * @return bit i set = drawer i + 1 has a sensor
+   */
+  static constexpr uint32_t getSensedMask() {
+    return SENSED_MASK;
+  }
+
+  /**
+   * Take the state changed flag (network task, to push the new state)
+   * @return true if the state changed since the last call
+   */
+  bool takeChanged() {
+    return changed.exchange(false, std::memory_order_acq_rel);
+  }
+
+private:
+  static constexpr int pins[SENSOR_COUNT] = { Pins... };
+  static const uint32_t SENSED_MASK = drawerSensedMask(Pins...);
+
+  TaskHandle_t notifyTask;              // Actuation task, woken on edges
+  TaskHandle_t stateTask;               // Network task, woken on debounced changes
+  std::atomic<unsigned long> edgeAt;    // millis() of the last edge
+  std::atomic<bool> dirty;              // Edge seen, state not read yet
+  std::atomic<uint32_t> openMask;       // Debounced state, bit i = drawer i + 1 open
+  std::atomic<bool> changed;            // State changed and not pushed yet
+
+  /**
+   * Edge interrupt: only timestamps the edge and wakes the actuation task
+   */
+  static void IRAM_ATTR onEdge(void* arg) {
+    DrawerSensorsT* self = (DrawerSensorsT*)arg;
+    self->edgeAt.store(millis(), std::memory_order_relaxed);
+    self->dirty.store(true, std::memory_order_release);
+    if (self->notifyTask) {
+      BaseType_t woken = pdFALSE;
+      vTaskNotifyGiveFromISR(self->notifyTask, &woken);
+      portYIELD_FROM_ISR(woken);
+    }
+  }
+
+  /**
+   * Read every sensor with one register read per GPIO bank
+   * @return bit i set = drawer i + 1 is open
+   */
+  static uint32_t readOpenMask() {
+    uint32_t lowBank = GPIO.in;
+    uint32_t highBank = GPIO.in1.data;
+    uint32_t mask = 0;
+    for (int i = 0; i < SENSOR_COUNT; i++) {
+      if (pins[i] < 0) {
+        continue;
+      }
+      bool level = pins[i] < 32 ? (lowBank >> pins[i]) & 1 : (highBank >> (pins[i] - 32)) & 1;
+      if (level == (DRAWER_SENSOR_OPEN_LEVEL == HIGH)) {
+        mask |= 1UL << i;
+      }
+    }
+    return mask;
+  }
+
+  /**
+   * Publish the state as gauges (sent with the next status report)
+   */
+  void publish() {
+    metrics.setGauge(GAUGE_DRAWERS_OPEN, (int32_t)getOpenMask());
+    metrics.setGauge(GAUGE_DRAWERS_SENSED, (int32_t)SENSED_MASK);
+  }
+};
+
+template <int... Pins>
+constexpr int DrawerSensorsT<Pins...>::pins[DrawerSensorsT<Pins...>::SENSOR_COUNT];
+
+// Drawer sensors for the pins configured in config.h
+typedef DrawerSensorsT<DRAWER_SENSOR_PINS> DrawerSensors;
+
+#endif
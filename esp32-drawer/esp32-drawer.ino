@@ -11,90 +11,434 @@
 #include "wifiManager.h"
 #include "serverConnector.h"
 #include "drawerManager.h"
+#include "commandQueue.h"
+#include "pollScheduler.h"
+#include "commandJournal.h"
+#include "metrics.h"
+#include "logger.h"
+#include "power.h"
+#include "supervisor.h"
+#include "ota.h"
 
 // Initialize classes
 WiFiManager wifiManager;
 DrawerManager drawerManager;
-ServerConnector serverConnector(&drawerManager);
+CommandChannel commandChannel;
+CommandJournal commandJournal;
+OtaUpdater otaUpdater;
+ServerConnector serverConnector(&drawerManager, &commandChannel, &commandJournal, &otaUpdater);
+PollScheduler pollScheduler;
+PowerManager powerManager;
+Supervisor supervisor;
 
-// Polling interval in milliseconds
-const unsigned long POLLING_INTERVAL = 5000;  // 5000 = 5 seconds
+// Task handles
+TaskHandle_t networkTaskHandle = NULL;
+TaskHandle_t actuationTaskHandle = NULL;
+
+// Time of the last poll, the delay to the next one comes from pollScheduler
 unsigned long lastPolling = 0;
 
-int errorCount = 0;  // Count consecutive errors
+// Time of the last metrics report
+unsigned long lastStatusReport = 0;
+
+// A drawer state change the server has not received yet,
+// retried with an exponential backoff (POLL_ERROR_BASE_MS up to POLL_ERROR_MAX_MS)
+bool drawerStatePending = false;
+unsigned long stateRetryAt = 0;  // millis() of the next push attempt
+int stateRetryCount = 0;         // Consecutive failed pushes
 
 void setup() {
-  // Drawers pins setup, pin configuration in config.h
-  drawerManager.setupDrawers();
+  // Drawers pins setup, from the table the server last sent (defaults in config.h)
+  DrawerConfig drawerConfig;
+  DrawerConfigStore::load(drawerConfig);
+  drawerManager.setupDrawers(drawerConfig);
 
   // Initialize Serial for debugging
   Serial.begin(115200);
-  delay(2000);
+#if DEBUG_BUILD
+  delay(2000);  // Give the serial monitor time to attach
+#endif
+  logger.begin();  // Log lines are written by a low-priority task (see logger.h)
 
-  Serial.println("=== SmartDrawer ESP32 initialized ===");
+  LOG_INFO("=== SmartDrawer ESP32 initialized ===");
 
-  // Step 1: Connect to WiFi
-  if (!wifiManager.connect())  // Try to connect to WiFi
-  {
-    Serial.println("Failed to connect to WiFi, restarting...");
-    ESP.restart();
-  }
+  // Task watchdog and the reason of this boot (see supervisor.h)
+  supervisor.begin();
+  otaUpdater.begin();
 
-  // Step 2: Test server connectivity
-  if (!serverConnector.checkServerHealth()) {
-    Serial.println("Server is not reachable, restarting...");
-    ESP.restart();
-  }
+  // Power mode (see power.h), relays held through a deep sleep follow the pins again
+  powerManager.begin();
+  drawerManager.holdPins(false);
+  pollScheduler.resumeIdleInterval(powerManager.getResumeIdleInterval());
+
+  // Results executed before a restart whose acknowledgement never reached the server
+  commandJournal.begin();
+
+  if (FAST_BOOT || powerManager.isResumed()) {
+    // Fast boot (always after a deep sleep): the network task connects in the background
+    // and the first poll doubles as the health check, a cached token avoids authenticating at all
+    if (!serverConnector.loadCachedToken()) {
+      LOG_INFO("No cached token, the network task will authenticate");
+    }
+  } else {
+    // A failed step does not restart the ESP32: the network task keeps retrying
+    // in the background (degraded mode, see supervisor.h)
+    // Step 1: Connect to WiFi
+    if (!wifiManager.connect())  // Try to connect to WiFi
+    {
+      LOG_ERROR("Failed to connect to WiFi, retrying in the background");
+    }
+
+    // Step 2: Test server connectivity
+    else if (!serverConnector.checkServerHealth()) {
+      LOG_ERROR("Server is not reachable, retrying in the background");
+    }
 
-  // Step 3: Perform initial authentication
-  if (!serverConnector.authenticate()) {
-    Serial.println("Failed initial authentication, restarting...");
-    ESP.restart();
+    // Step 3: Perform initial authentication
+    else if (!serverConnector.authenticate()) {
+      LOG_ERROR("Failed initial authentication, retrying in the background");
+    }
   }
 
-  Serial.println("=== Initialization complete! Starting polling ===");
+  LOG_INFO("=== Initialization complete! Starting polling ===");
   lastPolling = millis();
+
+  // Step 4: Start the tasks, actuation first so it is ready for the first command
+  xTaskCreatePinnedToCore(actuationTask, "actuation", ACTUATION_TASK_STACK, NULL, ACTUATION_TASK_PRIORITY, &actuationTaskHandle, ACTUATION_TASK_CORE);
+  xTaskCreatePinnedToCore(networkTask, "network", NETWORK_TASK_STACK, NULL, NETWORK_TASK_PRIORITY, &networkTaskHandle, NETWORK_TASK_CORE);
+  commandChannel.attach(networkTaskHandle, actuationTaskHandle);
+  drawerManager.beginSensors(actuationTaskHandle, networkTaskHandle);
 }
 
 void loop() {
-  // Check if WiFi is still connected, try to reconnect if disconnected
-  if (!wifiManager.reconnectIfNeeded()) {
-    delay(5000);
+  // All the work runs in the network and actuation tasks
+  vTaskDelete(NULL);
+}
+
+/**
+ * Network task (core 0)
+ * Owns WiFiManager and ServerConnector: WiFi reconnect, polling and acks
+ */
+void networkTask(void* parameter) {
+  supervisor.watch();
+  for (;;) {
+    // Tell the watchdog the task is alive, restart as a last resort after a long outage
+    supervisor.feed();
+    supervisor.checkOffline(millis());
+
+    // Check if WiFi is still connected, reconnect in the background if disconnected
+    if (!wifiManager.reconnectIfNeeded()) {
+      wifiManager.waitForConnection(250);  // Wakes up as soon as an IP is obtained
+      continue;
+    }
+
+    // Renew the JWT token before it expires, so polls never run into a 401
+    serverConnector.refreshTokenIfNeeded();
+    supervisor.feed();
+
+    // Push drawer state changes right away, a failed push is retried with a backoff
+    if (drawerManager.takeStateChanged()) {
+      drawerStatePending = true;
+    }
+    if (drawerStatePending && (long)(millis() - stateRetryAt) >= 0) {
+      pushDrawerState();
+    }
+
+    // Polling for commands with an adaptive interval (see pollScheduler.h),
+    // when the server holds polls open (long-polling) poll again right away
+    unsigned long currentTime = millis();
+    unsigned long interval = serverConnector.isLongPolling() ? 0 : pollScheduler.getInterval();
+    if (otaUpdater.isDownloading() && pollScheduler.getErrorCount() == 0) {
+      interval = min(interval, (unsigned long)OTA_POLL_INTERVAL_MS);  // Polls are not held open meanwhile
+    }
+    if (currentTime - lastPolling >= interval) {
+      LOG_DEBUG("--- Starting polling cycle ---");
+
+      // Acknowledgements lost to a network drop or a restart go out first
+      serverConnector.replayPendingAcks();
+      supervisor.feed();
+
+      // First try to fetch commands
+      bool commandsFetched = serverConnector.pollForCommands();
+      supervisor.feed();
+
+      // Errors back off exponentially instead of restarting the ESP32,
+      // repeated ones reopen the socket, then reassociate WiFi
+      if (!commandsFetched) {
+        pollScheduler.onError();
+        LOG_WARN("Error count: %d, retrying in %lu ms", pollScheduler.getErrorCount(), pollScheduler.getInterval());
+        RecoveryAction recovery = supervisor.onFailure();
+        if (recovery != RECOVERY_NONE) {
+          serverConnector.resetConnection();
+        }
+        if (recovery == RECOVERY_RESET_WIFI) {
+          wifiManager.reassociate();
+        }
+      } else if (serverConnector.getLastCommandCount() > 0) {
+        pollScheduler.onCommands(millis());
+        supervisor.onSuccess(millis());
+        otaUpdater.confirmBoot();
+      } else {
+        // Idle polls follow the slot the server assigned (spreads the fleet's polls)
+        pollScheduler.setSlot(serverConnector.getPollSlotInterval(), serverConnector.getPollSlotOffset());
+        pollScheduler.onIdle(millis(), serverConnector.getServerTimeMs());
+        supervisor.onSuccess(millis());
+        otaUpdater.confirmBoot();
+      }
+      pollScheduler.applyServerHint(serverConnector.getSuggestedInterval());
+
+      // Then report status and metrics (see metrics.h), a failed report
+      // is retried with the next one (its metrics roll into it)
+#if METRICS_REPORT_INTERVAL_MS > 0
+      if (millis() - lastStatusReport >= METRICS_REPORT_INTERVAL_MS) {
+        metrics.setGauge(GAUGE_RSSI, wifiManager.getSignalStrength());
+        if (serverConnector.sendStatus()) {
+          onDrawerStateSent();  // The report carries the drawer state too
+        }
+        lastStatusReport = millis();
+      }
+#endif
+
+      lastPolling = millis();
+      LOG_DEBUG("Heap - free: %lu, min free: %lu, largest block: %lu", (unsigned long)ESP.getFreeHeap(),
+                (unsigned long)serverConnector.getMinFreeHeap(), (unsigned long)serverConnector.getLargestFreeBlock());
+      LOG_DEBUG("--- End of polling cycle ---");
+
+      // Power down until the next poll when nothing is in flight (POWER_MODE_DEEP_SLEEP),
+      // metrics live in RAM so they are reported first
+      if (commandsFetched && PowerManager::shouldDeepSleep(pollScheduler.getInterval()) &&
+          !drawerManager.isBusy() && !drawerStatePending && commandJournal.countPendingAcks() == 0 &&
+          !otaUpdater.isDownloading()) {
+#if METRICS_REPORT_INTERVAL_MS > 0
+        metrics.setGauge(GAUGE_RSSI, wifiManager.getSignalStrength());
+        serverConnector.sendStatus();
+#endif
+        drawerManager.holdPins(true);
+        powerManager.deepSleep(pollScheduler.getInterval(), pollScheduler.getIdleInterval());
+      }
+    }
+
+    // Firmware update (see ota.h): one chunk per pass so polls keep running between chunks,
+    // none while a pulse runs since flash writes stall both cores and would stretch it
+    if (otaUpdater.isChunkDue(millis()) && !drawerManager.isBusy()) {
+      serverConnector.downloadFirmwareChunk();
+      supervisor.feed();
+    }
+
+    // Restart into a verified release once no command is in flight
+    if (otaUpdater.isReady() && !drawerManager.isBusy() && commandJournal.countPendingAcks() == 0) {
+      LOG_INFO("Restarting into firmware %s", otaUpdater.getVersion());
+      supervisor.restart(RESTART_CAUSE_UPDATE);
+    }
+
+    // Wait until the next poll is due (lets the CPU light sleep, see power.h),
+    // a drawer state change wakes the task early
+    unsigned long elapsed = millis() - lastPolling;
+    unsigned long next = serverConnector.isLongPolling() ? 0 : pollScheduler.getInterval();
+    if (otaUpdater.isChunkDue(millis())) {
+      next = 0;  // Next chunk right away
+    }
+    unsigned long wait = next > elapsed ? next - elapsed : 0;
+    if (drawerStatePending) {
+      long retryIn = (long)(stateRetryAt - millis());
+      wait = min(wait, retryIn > 0 ? (unsigned long)retryIn : 0UL);
+    }
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(PowerManager::idleDelay(wait)));
+  }
+}
+
+/**
+ * Push the drawer state (status report) to the server (network task)
+ * A failed push is retried after the error backoff instead of on every poll.
+ */
+void pushDrawerState() {
+  lastStatusReport = millis();
+  if (serverConnector.sendStatus()) {
+    onDrawerStateSent();
     return;
   }
+  if (stateRetryCount < 16) {
+    stateRetryCount++;
+  }
+  unsigned long backoff = min((unsigned long)POLL_ERROR_BASE_MS << (stateRetryCount - 1), (unsigned long)POLL_ERROR_MAX_MS);
+  stateRetryAt = millis() + backoff;
+  LOG_WARN("Drawer state not delivered, retrying in %lu ms", backoff);
+}
 
-  // Polling for commands at defined interval
-  unsigned long currentTime = millis();
-  if (currentTime - lastPolling >= POLLING_INTERVAL) {
-    Serial.println("--- Starting polling cycle ---");
-
-    // First try to fetch commands
-    bool commandsFetched = serverConnector.pollForCommands();
-
-    // error counter, if there are 3 consecutive errors, restart the ESP32
-    if (!commandsFetched) {
-      errorCount++;
-      Serial.printf("Error count: %d\n", errorCount);
-      if (errorCount >= 3) {
-        Serial.println("Too many consecutive errors, restarting...");
-        ESP.restart();
-      }
-    } else {
-      errorCount = 0;  // reset error count on success
+/**
+ * Record that the server has the current drawer state (network task)
+ */
+void onDrawerStateSent() {
+  drawerStatePending = false;
+  stateRetryCount = 0;
+  stateRetryAt = millis();
+}
+
+/**
+ * Command waiting for its drawer sensors (actuation task only)
+ */
+struct PendingConfirmation {
+  char code[COMMAND_CODE_SIZE];  // Command code (empty = free slot)
+  uint32_t drawerMask;           // Sensed drawers to confirm
+  bool expectOpen;               // Open (open actions) or closed (close action)
+  unsigned long deadline;        // millis() after which the command fails
+};
+PendingConfirmation confirmations[COMMAND_QUEUE_SIZE];
+
+// Commands waiting for their drawers (actuation task only), see CommandBacklog
+CommandBacklog<COMMAND_QUEUE_SIZE> backlog;
+
+/**
+ * Start a command on the drawers (actuation task)
+ * @param command - Command to execute
+ * @param result - Receives the result if it is known right away
+ * @return true if the result is ready, false if it waits for the drawer sensors
+ */
+bool executeCommand(const DrawerCommand& command, CommandResult& result) {
+  unsigned long now = millis();
+  uint32_t sensed = command.drawerMask & drawerManager.getSensedMask();
+  unsigned long timeoutMs;
+
+  if (command.action == DRAWER_ACTION_CLOSE) {
+    // Relays only release latches, a close can only be confirmed by a sensor
+    if (sensed != command.drawerMask) {
+      snprintf(result.errorMessage, sizeof(result.errorMessage), "No sensor to confirm close (mask 0x%lx)", (unsigned long)(command.drawerMask & ~sensed));
+      result.success = false;
+      return true;
+    }
+    timeoutMs = DRAWER_CLOSE_CONFIRM_MS;
+  } else {
+    // Every drawer of the command is switched in the same pulse window
+    // (optionally staggered by DRAWER_STAGGER_MS to limit inrush current)
+    result.success = drawerManager.openDrawers(command.drawerMask, DRAWER_STAGGER_MS);
+    if (!result.success) {
+      snprintf(result.errorMessage, sizeof(result.errorMessage), "Hardware failure opening drawers (mask 0x%lx)", (unsigned long)command.drawerMask);
+      return true;
+    }
+    if (sensed == 0) {
+      return true;  // Nothing to confirm
+    }
+    timeoutMs = DRAWER_OPEN_CONFIRM_MS + DRAWER_STAGGER_MS * (__builtin_popcount(command.drawerMask) - 1);
+  }
+
+  for (int i = 0; i < COMMAND_QUEUE_SIZE; i++) {
+    if (confirmations[i].code[0] == '\0') {
+      strlcpy(confirmations[i].code, command.code, sizeof(confirmations[i].code));
+      confirmations[i].drawerMask = sensed;
+      confirmations[i].expectOpen = command.action != DRAWER_ACTION_CLOSE;
+      confirmations[i].deadline = now + timeoutMs;
+      return false;
+    }
+  }
+  LOG_WARN("No confirmation slot, reporting %s with the current sensor state", command.code);
+  uint32_t open = drawerManager.getOpenMask() & sensed;
+  result.success = command.action == DRAWER_ACTION_CLOSE ? open == 0 : open == sensed;
+  if (!result.success) {
+    strlcpy(result.errorMessage, "Drawer state not confirmed", sizeof(result.errorMessage));
+  }
+  return true;
+}
+
+/**
+ * Answer the commands whose drawers reached the expected state, or whose time ran out
+ * @param now - Current time in milliseconds (millis())
+ * @return drawers of the commands still waiting (0 if none)
+ */
+uint32_t checkConfirmations(unsigned long now) {
+  uint32_t waiting = 0;
+  uint32_t openMask = drawerManager.getOpenMask();
+  for (int i = 0; i < COMMAND_QUEUE_SIZE; i++) {
+    PendingConfirmation& pending = confirmations[i];
+    if (pending.code[0] == '\0') {
+      continue;
     }
 
-    // Then send status (every 3 polling cycles to avoid overload) (not used yet)
-    // static int statusCounter = 0;
-    // statusCounter++;
-    // if (statusCounter >= 3) {
-    //  sendStatus();
-    //  statusCounter = 0;
-    //}
+    // Drawers of the command not in the expected state yet
+    uint32_t missing = pending.expectOpen ? pending.drawerMask & ~openMask : pending.drawerMask & openMask;
+    if (missing != 0 && (long)(now - pending.deadline) < 0) {
+      waiting |= pending.drawerMask;
+      continue;
+    }
 
-    lastPolling = currentTime;
-    Serial.println("--- End of polling cycle ---");
+    CommandResult result;
+    strlcpy(result.code, pending.code, sizeof(result.code));
+    result.success = missing == 0;
+    result.errorMessage[0] = '\0';
+    if (!result.success) {
+      snprintf(result.errorMessage, sizeof(result.errorMessage), pending.expectOpen ? "Drawer did not open (mask 0x%lx)" : "Drawer still open (mask 0x%lx)",
+               (unsigned long)missing);
+    }
+    if (!commandChannel.reply(result)) {
+      LOG_ERROR("Result queue full, dropping actuation result");
+    }
+    pending.code[0] = '\0';
   }
+  return waiting;
+}
 
-  // Small delay to avoid overloading the processor
-  delay(100);
+/**
+ * Actuation task (core 1)
+ * Owns DrawerManager: executes queued commands, ends relay pulses and
+ * confirms commands on drawers that have a sensor
+ */
+void actuationTask(void* parameter) {
+  supervisor.watch();
+  for (;;) {
+    supervisor.feed();
+
+    // Move the received commands to the backlog, in priority order
+    DrawerCommand command;
+    while (commandChannel.receive(command)) {
+      if (backlog.contains(command.code)) {
+        LOG_DEBUG("Command %s already queued, dropping the copy", command.code);
+        continue;
+      }
+      if (!backlog.push(command)) {
+        CommandResult result;
+        strlcpy(result.code, command.code, sizeof(result.code));
+        result.success = false;
+        strlcpy(result.errorMessage, "Actuation queue full", sizeof(result.errorMessage));
+        if (!commandChannel.reply(result)) {
+          LOG_ERROR("Result queue full, dropping actuation result");
+        }
+      }
+    }
+
+    // Release relays whose pulse has finished, read the drawer sensors
+    unsigned long now = millis();
+    drawerManager.tick(now);
+    uint32_t confirming = checkConfirmations(now);
+
+    // Start every command whose drawers are free, replying as soon as the pulse has
+    // started (or, for sensed drawers, once the sensor confirmed it)
+    uint32_t busy = drawerManager.getBusyMask() | confirming;
+    while (backlog.takeReady(busy, command)) {
+      busy |= command.drawerMask;  // The next command on these drawers waits for this one
+      CommandResult result;
+      strlcpy(result.code, command.code, sizeof(result.code));
+      result.errorMessage[0] = '\0';
+
+      metrics.record(HIST_POLL_TO_ACTUATION, millis() - command.receivedAt);
+
+      if (executeCommand(command, result) && !commandChannel.reply(result)) {
+        LOG_ERROR("Result queue full, dropping actuation result");
+      }
+    }
+
+    // No light sleep while a pulse runs, its length must not stretch
+    powerManager.setActuating(drawerManager.isBusy());
+
+    // Wake every tick while a pulse, a confirmation, a debounce or a queued command is waiting,
+    // otherwise sleep until a command or a sensor edge arrives
+    TickType_t wait = pdMS_TO_TICKS(TASK_WDT_TIMEOUT_S * 1000UL / 2);  // Wakes up to feed the watchdog
+    if (drawerManager.isBusy() || confirming || drawerManager.isSettling() || !backlog.isEmpty()) {
+      wait = 1;
+    }
+#if POWER_MODE != POWER_MODE_PERFORMANCE
+    else if (drawerManager.getSensedMask() != 0) {
+      wait = pdMS_TO_TICKS(NETWORK_IDLE_MAX_DELAY_MS);  // Light sleep may hide an edge, resample the sensors
+    }
+#endif
+    ulTaskNotifyTake(pdTRUE, wait);
+  }
 }
@@ -0,0 +1,228 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <stdarg.h>
+
+// Include config file
+#include "config.h"
+
+/**
+ * Log levels (LOG_LEVEL in config.h), messages above the level are compiled out
+ */
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+/**
+ * Bounded lock-free multi-producer/single-consumer queue of log lines
+ * Any task may log (network, actuation, WiFi event task), only the log task drains.
+ * Each slot carries a sequence number telling whether it is free for the producer
+ * of a given position or holds a line ready for the consumer, so producers only
+ * race on one compare-and-swap of the write position and never wait: when the
+ * queue is full the line is dropped and counted.
+ */
+class LogQueue {
+public:
+  // Constructor
+  LogQueue() : enqueuePos(0), dequeuePos(0), dropped(0) {
+    for (uint32_t i = 0; i < LOG_QUEUE_SLOTS; i++) {
+      slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * Format a line into a free slot (producer side, any task)
+   * @param level - Line level (LOG_LEVEL_*)
+   * @param format - printf format
+   * @param args - Format arguments
+   */
+  void push(uint8_t level, const char* format, va_list args) {
+    uint32_t pos = enqueuePos.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+      slot = &slots[pos % LOG_QUEUE_SLOTS];
+      int32_t diff = (int32_t)(slot->sequence.load(std::memory_order_acquire) - pos);
+      if (diff == 0) {
+        if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;  // Slot reserved
+        }
+      } else if (diff < 0) {
+        dropped.fetch_add(1, std::memory_order_relaxed);  // Full
+        return;
+      } else {
+        pos = enqueuePos.load(std::memory_order_relaxed);
+      }
+    }
+
+    slot->level = level;
+    vsnprintf(slot->text, sizeof(slot->text), format, args);
+    slot->sequence.store(pos + 1, std::memory_order_release);  // Publish
+  }
+
+  /**
+   * Remove the oldest line (consumer side, log task only)
+   * @param text - Receives the line (LOG_LINE_SIZE bytes)
+   * @param level - Receives the line level
+   * @return true if a line was removed, false if the queue is empty
+   */
+  bool pop(char* text, uint8_t& level) {
+    uint32_t pos = dequeuePos.load(std::memory_order_relaxed);
+    Slot* slot = &slots[pos % LOG_QUEUE_SLOTS];
+    if (slot->sequence.load(std::memory_order_acquire) != pos + 1) {
+      return false;  // Empty, or the next line is still being written
+    }
+    memcpy(text, slot->text, LOG_LINE_SIZE);
+    level = slot->level;
+    slot->sequence.store(pos + LOG_QUEUE_SLOTS, std::memory_order_release);  // Free for the next lap
+    dequeuePos.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Check if every reserved line was written out (any task)
+   * @return true if the queue is empty
+   */
+  bool isEmpty() {
+    return dequeuePos.load(std::memory_order_acquire) == enqueuePos.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Take the number of lines dropped since the last call
+   * @return dropped lines
+   */
+  uint32_t takeDropped() {
+    return dropped.exchange(0, std::memory_order_relaxed);
+  }
+
+private:
+  struct Slot {
+    std::atomic<uint32_t> sequence;
+    uint8_t level;
+    char text[LOG_LINE_SIZE];
+  };
+
+  Slot slots[LOG_QUEUE_SLOTS];
+  std::atomic<uint32_t> enqueuePos;  // Next position to reserve (producers)
+  std::atomic<uint32_t> dequeuePos;  // Next position to read (written by the consumer only)
+  std::atomic<uint32_t> dropped;     // Lines dropped because the queue was full
+};
+
+/**
+ * Leveled logger
+ * With LOG_ASYNC lines are formatted into LogQueue and written to Serial by a
+ * low-priority task, so logging on the network and actuation paths never waits on
+ * the UART (a 200-byte line takes ~17 ms at 115200 baud). Without it lines are
+ * printed synchronously, as before.
+ */
+class Logger {
+public:
+  /**
+   * Log a line, use the LOG_* macros so disabled levels are compiled out
+   * @param level - Line level (LOG_LEVEL_*)
+   * @param format - printf format, the newline is added
+   */
+  void log(uint8_t level, const char* format, ...) __attribute__((format(printf, 3, 4))) {
+    va_list args;
+    va_start(args, format);
+#if LOG_ASYNC
+    queue.push(level, format, args);
+#else
+    char text[LOG_LINE_SIZE];
+    vsnprintf(text, sizeof(text), format, args);
+    write(level, text);
+#endif
+    va_end(args);
+  }
+
+  /**
+   * Start the task that drains the queue (no-op without LOG_ASYNC)
+   * Lines logged earlier wait in the queue.
+   */
+  void begin() {
+#if LOG_ASYNC
+    xTaskCreatePinnedToCore(logTask, "LogTask", LOG_TASK_STACK, this, LOG_TASK_PRIORITY, NULL, LOG_TASK_CORE);
+#endif
+  }
+
+  /**
+   * Wait until the log task wrote every queued line (e.g. before a restart)
+   * @param timeoutMs - Maximum time to wait in milliseconds
+   */
+  void flush(uint32_t timeoutMs = 500) {
+#if LOG_ASYNC
+    unsigned long start = millis();
+    while (!queue.isEmpty() && millis() - start < timeoutMs) {
+      vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_INTERVAL_MS));
+    }
+#endif
+    Serial.flush();
+  }
+
+private:
+#if LOG_ASYNC
+  LogQueue queue;
+
+  /**
+   * Log task: writes queued lines to Serial whenever nothing more urgent runs
+   */
+  static void logTask(void* parameter) {
+    Logger* logger = (Logger*)parameter;
+    char text[LOG_LINE_SIZE];
+    uint8_t level;
+    for (;;) {
+      while (logger->queue.pop(text, level)) {
+        write(level, text);
+      }
+      uint32_t dropped = logger->queue.takeDropped();
+      if (dropped > 0) {
+        Serial.printf("W (log) %lu line(s) dropped, raise LOG_QUEUE_SLOTS\n", (unsigned long)dropped);
+      }
+      vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_INTERVAL_MS));
+    }
+  }
+#endif
+
+  /**
+   * Write one line to Serial with its level prefix
+   */
+  static void write(uint8_t level, const char* text) {
+    static const char prefixes[] = { ' ', 'E', 'W', 'I', 'D' };
+    Serial.printf("%c %s\n", prefixes[level <= LOG_LEVEL_DEBUG ? level : 0], text);
+  }
+};
+
+// Shared by every module, they all live in the sketch's single translation unit
+Logger logger;
+
+/**
+ * Logging macros, printf-style, one line per call
+ */
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) logger.log(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) logger.log(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) logger.log(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) logger.log(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while (0)
+#endif
+
+#endif
@@ -0,0 +1,329 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// Include config file
+#include "config.h"
+#include "protocol.h"
+
+/**
+ * Server endpoints timed by ServerConnector
+ */
+enum MetricsEndpoint : uint8_t {
+  ENDPOINT_HEALTH,
+  ENDPOINT_AUTH,
+  ENDPOINT_STATUS,
+  ENDPOINT_POLL,
+  ENDPOINT_ACK,
+  ENDPOINT_FIRMWARE,  // Firmware chunks (ota.h)
+  ENDPOINT_COUNT
+};
+
+/**
+ * Phases of a request (DNS and connect are only recorded when a new socket is opened)
+ */
+enum MetricsPhase : uint8_t {
+  PHASE_DNS,      // Host name resolution
+  PHASE_CONNECT,  // TCP connect
+  PHASE_TTFB,     // Request sent until response headers received (includes the long-poll hold)
+  PHASE_TOTAL,    // Start of the request until the body was consumed
+  PHASE_COUNT
+};
+
+/**
+ * Histograms: one per endpoint and phase, then the device-side latencies
+ */
+enum MetricsHistogram : uint8_t {
+  HIST_POLL_TO_ACTUATION = ENDPOINT_COUNT * PHASE_COUNT,  // Poll response received until relay switched
+  HIST_ACTUATION,                                         // Actual relay pulse length
+  HIST_WIFI_RECONNECT,                                    // WiFi lost until connected again
+  HIST_POLL_TO_ACK,                                       // Poll response received until the server confirmed the ack
+  HIST_COUNT
+};
+
+/**
+ * Event counters
+ */
+enum MetricsCounter : uint8_t {
+  COUNTER_SERVER_RECONNECTS,  // New sockets opened after the first one
+  COUNTER_WIFI_RECONNECTS,    // WiFi connection losses
+  COUNTER_REAUTHS,            // Authentications after the first one
+  COUNTER_REQUEST_ERRORS,     // Requests that failed without an HTTP response
+  COUNTER_COMMANDS_ACKED,     // Command results confirmed by the server
+  COUNTER_RESTARTS,           // Boots that were not a power on or a deep sleep wake (supervisor.h)
+  COUNTER_RECOVERIES,         // Socket or WiFi resets after repeated poll failures
+  COUNTER_COUNT
+};
+
+/**
+ * Latest values reported as they are
+ */
+enum MetricsGauge : uint8_t {
+  GAUGE_FREE_HEAP,
+  GAUGE_MIN_FREE_HEAP,
+  GAUGE_MAX_ALLOC_HEAP,
+  GAUGE_RSSI,
+  GAUGE_DRAWERS_OPEN,    // Bit i set = drawer i + 1 open (drawerSensors.h)
+  GAUGE_DRAWERS_SENSED,  // Bit i set = drawer i + 1 has a sensor
+  GAUGE_RESET_REASON,    // esp_reset_reason() of this boot
+  GAUGE_RESTART_CAUSE,   // RestartCause of the supervisor restart that led to this boot (0 = none)
+  GAUGE_COUNT
+};
+
+/**
+ * Number of values in a compile-time list (METRICS_BUCKET_BOUNDS)
+ */
+template <typename... Values>
+constexpr int metricsCountValues(Values...) {
+  return sizeof...(Values);
+}
+
+/**
+ * Length of a name known at compile time
+ */
+constexpr size_t metricsNameLength(const char* name) {
+  return *name ? 1 + metricsNameLength(name + 1) : 0;
+}
+
+/**
+ * Check that every name of a list is at most max characters long
+ */
+constexpr bool metricsNamesFit(const char* const* names, int count, size_t max) {
+  return count == 0 || (metricsNameLength(names[0]) <= max && metricsNamesFit(names + 1, count - 1, max));
+}
+
+/**
+ * Lightweight on-device instrumentation
+ * Latencies go into fixed-bucket histograms (METRICS_BUCKET_BOUNDS in config.h),
+ * so recording is a bucket search and a relaxed atomic increment: safe from any task,
+ * no allocation, no lock.
+ *
+ * Reports are delta encoded: serializeReport() snapshots the counts and
+ * commitReport() subtracts the snapshot once the server accepted it. Events recorded
+ * while the report was in flight, and whole reports that failed, roll into the next one.
+ */
+class Metrics {
+public:
+  static const int BUCKET_COUNT = metricsCountValues(METRICS_BUCKET_BOUNDS) + 1;  // Last bucket = overflow
+  static const size_t NAME_MAX = 23;  // Longest gauge, counter or histogram name
+
+  // Longest report: every gauge, counter and histogram present with its widest values
+  // (names quoted, 10 digits per count, 11 per gauge, separators), sizes the status request body
+  static const size_t REPORT_MAX_SIZE = 160 + sizeof(FIRMWARE_VERSION) + GAUGE_COUNT * (NAME_MAX + 4 + 11) +
+                                        COUNTER_COUNT * (NAME_MAX + 4 + 10) + (BUCKET_COUNT - 1) * 6 +
+                                        HIST_COUNT * (NAME_MAX + 5 + BUCKET_COUNT * 11);
+
+  // Constructor
+  Metrics() {
+    for (int h = 0; h < HIST_COUNT; h++) {
+      for (int b = 0; b < BUCKET_COUNT; b++) {
+        counts[h][b].store(0, std::memory_order_relaxed);
+      }
+    }
+    for (int c = 0; c < COUNTER_COUNT; c++) {
+      counters[c].store(0, std::memory_order_relaxed);
+    }
+    for (int g = 0; g < GAUGE_COUNT; g++) {
+      gauges[g].store(0, std::memory_order_relaxed);
+    }
+    lastReportAt = 0;
+  }
+
+  /**
+   * Histogram of a request phase
+   * @param endpoint - Endpoint timed
+   * @param phase - Phase of the request
+   * @return histogram index
+   */
+  static int requestHistogram(MetricsEndpoint endpoint, MetricsPhase phase) {
+    return endpoint * PHASE_COUNT + phase;
+  }
+
+  /**
+   * Record a duration
+   * @param histogram - Histogram index (MetricsHistogram or requestHistogram())
+   * @param ms - Duration in milliseconds
+   */
+  void record(int histogram, unsigned long ms) {
+    int bucket = 0;
+    while (bucket < BUCKET_COUNT - 1 && ms > bounds[bucket]) {
+      bucket++;
+    }
+    counts[histogram][bucket].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /**
+   * Count an event
+   * @param counter - Counter to increment
+   * @param amount - Number of events
+   */
+  void increment(MetricsCounter counter, uint32_t amount = 1) {
+    counters[counter].fetch_add(amount, std::memory_order_relaxed);
+  }
+
+  /**
+   * Set a gauge
+   * @param gauge - Gauge to set
+   * @param value - Current value
+   */
+  void setGauge(MetricsGauge gauge, int32_t value) {
+    gauges[gauge].store(value, std::memory_order_relaxed);
+  }
+
+  /**
+   * Snapshot the counts and write the report as JSON
+   * {"firmware":..,"uptimeMs":..,"intervalMs":..,"gauges":{..},"counters":{..},"buckets":[..],"histograms":{"poll.ttfb":[..],..}}
+   * Only non-zero counters and histograms are written.
+   * Must only be called by one task (the network task).
+   * @param buffer - Receives the JSON
+   * @param size - Size of the buffer
+   * @return JSON length, or 0 if the buffer is too small (smaller than REPORT_MAX_SIZE)
+   */
+  size_t serializeReport(char* buffer, size_t size) {
+    static_assert(metricsNamesFit(counterNames, COUNTER_COUNT, NAME_MAX) && metricsNamesFit(gaugeNames, GAUGE_COUNT, NAME_MAX) &&
+                      metricsNamesFit(deviceHistogramNames, HIST_COUNT - HIST_POLL_TO_ACTUATION, NAME_MAX) &&
+                      metricsNamesFit(endpointNames, ENDPOINT_COUNT, 15) && metricsNamesFit(phaseNames, PHASE_COUNT, 7),
+                  "Metric names must fit NAME_MAX, REPORT_MAX_SIZE is computed from it");
+    unsigned long now = millis();
+    ReportWriter out(buffer, size);
+
+    out.printf("{\"status\":\"ACTIVE\",\"firmware\":\"%s\",\"uptimeMs\":%lu,\"intervalMs\":%lu,\"gauges\":{", FIRMWARE_VERSION, now,
+               now - lastReportAt);
+    for (int g = 0; g < GAUGE_COUNT; g++) {
+      out.printf("%s\"%s\":%ld", g ? "," : "", gaugeNames[g], (long)gauges[g].load(std::memory_order_relaxed));
+    }
+
+    out.printf("},\"counters\":{");
+    bool first = true;
+    for (int c = 0; c < COUNTER_COUNT; c++) {
+      reportedCounters[c] = counters[c].load(std::memory_order_relaxed);
+      if (reportedCounters[c] != 0) {
+        out.printf("%s\"%s\":%lu", first ? "" : ",", counterNames[c], (unsigned long)reportedCounters[c]);
+        first = false;
+      }
+    }
+
+    out.printf("},\"buckets\":[");
+    for (int b = 0; b < BUCKET_COUNT - 1; b++) {
+      out.printf("%s%u", b ? "," : "", bounds[b]);
+    }
+
+    out.printf("],\"histograms\":{");
+    first = true;
+    for (int h = 0; h < HIST_COUNT; h++) {
+      uint32_t total = 0;
+      for (int b = 0; b < BUCKET_COUNT; b++) {
+        reportedCounts[h][b] = counts[h][b].load(std::memory_order_relaxed);
+        total += reportedCounts[h][b];
+      }
+      if (total == 0) {
+        continue;
+      }
+
+      char name[NAME_MAX + 1];
+      histogramName(h, name, sizeof(name));
+      out.printf("%s\"%s\":[", first ? "" : ",", name);
+      for (int b = 0; b < BUCKET_COUNT; b++) {
+        out.printf("%s%lu", b ? "," : "", (unsigned long)reportedCounts[h][b]);
+      }
+      out.printf("]");
+      first = false;
+    }
+    out.printf("}}");
+
+    return out.length();
+  }
+
+  /**
+   * Remove the counts of the last serialized report
+   * (the server accepted it, or it can never be sent and is dropped)
+   */
+  void commitReport() {
+    for (int h = 0; h < HIST_COUNT; h++) {
+      for (int b = 0; b < BUCKET_COUNT; b++) {
+        counts[h][b].fetch_sub(reportedCounts[h][b], std::memory_order_relaxed);
+        reportedCounts[h][b] = 0;
+      }
+    }
+    for (int c = 0; c < COUNTER_COUNT; c++) {
+      counters[c].fetch_sub(reportedCounters[c], std::memory_order_relaxed);
+      reportedCounters[c] = 0;
+    }
+    lastReportAt = millis();
+  }
+
+private:
+  /**
+   * Appends formatted text to a fixed buffer, remembering if it overflowed
+   */
+  class ReportWriter {
+  public:
+    ReportWriter(char* buffer, size_t size) : buffer(buffer), size(size), used(0), overflow(size == 0) {}
+
+    void printf(const char* format, ...) {
+      if (overflow) {
+        return;
+      }
+      va_list args;
+      va_start(args, format);
+      int written = vsnprintf(buffer + used, size - used, format, args);
+      va_end(args);
+      if (written < 0 || (size_t)written >= size - used) {
+        overflow = true;
+        return;
+      }
+      used += written;
+    }
+
+    size_t length() {
+      return overflow ? 0 : used;
+    }
+
+  private:
+    char* buffer;
+    size_t size;
+    size_t used;
+    bool overflow;
+  };
+
+  static constexpr uint16_t bounds[BUCKET_COUNT - 1] = { METRICS_BUCKET_BOUNDS };  // Upper bound of each bucket (ms)
+  static constexpr const char* endpointNames[ENDPOINT_COUNT] = { "health", "auth", "status", "poll", "ack", "firmware" };
+  static constexpr const char* phaseNames[PHASE_COUNT] = { "dns", "connect", "ttfb", "total" };
+  static constexpr const char* deviceHistogramNames[HIST_COUNT - HIST_POLL_TO_ACTUATION] = { "pollToActuation", "actuation", "wifiReconnect", "pollToAck" };
+  static constexpr const char* counterNames[COUNTER_COUNT] = { "serverReconnects", "wifiReconnects", "reauths", "requestErrors", "commandsAcked", "restarts", "recoveries" };
+  static constexpr const char* gaugeNames[GAUGE_COUNT] = { "freeHeap", "minFreeHeap", "maxAllocHeap", "rssi", "drawersOpen", "drawersSensed", "resetReason", "restartCause" };
+
+  std::atomic<uint32_t> counts[HIST_COUNT][BUCKET_COUNT];   // Counts since the last accepted report
+  std::atomic<uint32_t> counters[COUNTER_COUNT];            // Events since the last accepted report
+  std::atomic<int32_t> gauges[GAUGE_COUNT];                 // Latest values
+  uint32_t reportedCounts[HIST_COUNT][BUCKET_COUNT];        // Snapshot sent in the last report
+  uint32_t reportedCounters[COUNTER_COUNT];                 // Snapshot sent in the last report
+  unsigned long lastReportAt;                               // millis() of the last accepted report
+
+  /**
+   * Name of a histogram in the report ("poll.ttfb", "pollToActuation", ...)
+   */
+  static void histogramName(int histogram, char* name, size_t size) {
+    if (histogram < HIST_POLL_TO_ACTUATION) {
+      snprintf(name, size, "%s.%s", endpointNames[histogram / PHASE_COUNT], phaseNames[histogram % PHASE_COUNT]);
+    } else {
+      strlcpy(name, deviceHistogramNames[histogram - HIST_POLL_TO_ACTUATION], size);
+    }
+  }
+};
+
+static_assert(Metrics::REPORT_MAX_SIZE <= 8192, "Metrics report too large for the status request, use fewer METRICS_BUCKET_BOUNDS");
+
+constexpr uint16_t Metrics::bounds[];
+constexpr const char* Metrics::endpointNames[];
+constexpr const char* Metrics::phaseNames[];
+constexpr const char* Metrics::deviceHistogramNames[];
+constexpr const char* Metrics::counterNames[];
+constexpr const char* Metrics::gaugeNames[];
+
+// Shared by every module, they all live in the sketch's single translation unit
+Metrics metrics;
+
+#endif
@@ -0,0 +1,267 @@
+#ifndef OTA_H
+#define OTA_H
+
+#include <Arduino.h>
+#include <Update.h>
+#include <Preferences.h>
+#include <esp_ota_ops.h>
+
+// Include config file
+#include "config.h"
+#include "logger.h"
+
+#define OTA_VERSION_SIZE 33  // longest release name + 1
+
+/**
+ * Class to install firmware releases in the background
+ * The server announces the release the fleet should run on every poll
+ * (X-Firmware-Version). A different one is fetched by ServerConnector in
+ * OTA_CHUNK_SIZE Range requests over the shared connection, one per pass of the
+ * network task, so polls keep running in between and a dropped link resumes at
+ * the byte it stopped at. The image goes straight to the inactive app partition
+ * (Update), is checked against the MD5 the server sent and by the ESP-IDF image
+ * verification, and only then becomes the boot partition.
+ *
+ * A bootloader built with rollback support boots the previous partition again
+ * if the new image restarts before its first successful poll (confirmBoot()).
+ */
+class OtaUpdater {
+public:
+  // Constructor
+  OtaUpdater() {
+    state = OTA_IDLE;
+    version[0] = '\0';
+    rejectedVersion[0] = '\0';
+    offset = 0;
+    total = 0;
+    failures = 0;
+    retryAt = 0;
+    confirmed = false;
+  }
+
+  /**
+   * Check how the last installed release booted, call once from setup()
+   * A release installed before the restart that is not the one running was rolled
+   * back, or reports another FIRMWARE_VERSION than announced: it is not downloaded
+   * again, which would restart the device in a loop.
+   */
+  void begin() {
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    LOG_INFO("Firmware %s (partition %s)", FIRMWARE_VERSION, running ? running->label : "?");
+
+    Preferences prefs;
+    if (prefs.begin("ota", false)) {
+      char installed[OTA_VERSION_SIZE] = "";
+      if (prefs.getString("installed", installed, sizeof(installed)) > 0 && installed[0] != '\0') {
+        if (strcmp(installed, FIRMWARE_VERSION) != 0) {
+          LOG_ERROR("OTA: installed firmware %s is not running, not installing it again", installed);
+          strlcpy(rejectedVersion, installed, sizeof(rejectedVersion));
+        }
+        prefs.remove("installed");
+      }
+      prefs.end();
+    }
+  }
+
+  /**
+   * Mark the running image as good after the first successful poll
+   * (cancels the rollback of a freshly installed image)
+   */
+  void confirmBoot() {
+    if (confirmed) {
+      return;
+    }
+    confirmed = true;
+    esp_ota_img_states_t imageState;
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    if (running && esp_ota_get_state_partition(running, &imageState) == ESP_OK && imageState == ESP_OTA_IMG_PENDING_VERIFY) {
+      esp_ota_mark_app_valid_cancel_rollback();
+      LOG_INFO("Firmware %s confirmed", FIRMWARE_VERSION);
+    }
+  }
+
+  /**
+   * Handle the release announced by the server (network task)
+   * @param announced - Release name from the X-Firmware-Version header
+   */
+  void offer(const char* announced) {
+#if OTA_ENABLED
+    if (announced[0] == '\0' || strlen(announced) >= OTA_VERSION_SIZE || state == OTA_READY
+        || strcmp(announced, FIRMWARE_VERSION) == 0 || strcmp(announced, rejectedVersion) == 0
+        || (state == OTA_DOWNLOADING && strcmp(announced, version) == 0)) {
+      return;
+    }
+    if (state == OTA_DOWNLOADING) {
+      abort("replaced by a newer release");
+    }
+    strlcpy(version, announced, sizeof(version));
+    offset = 0;
+    total = 0;
+    failures = 0;
+    retryAt = millis();
+    state = OTA_DOWNLOADING;
+    LOG_INFO("OTA: firmware %s announced, downloading in the background", version);
+#else
+    (void)announced;
+#endif
+  }
+
+  /**
+   * Check if a release is being downloaded
+   * @return true while chunks are missing
+   */
+  bool isDownloading() {
+    return state == OTA_DOWNLOADING;
+  }
+
+  /**
+   * Check if the next chunk may be requested (failed chunks back off)
+   * @param now - Current time in milliseconds (millis())
+   * @return true if a chunk is due
+   */
+  bool isChunkDue(unsigned long now) {
+    return state == OTA_DOWNLOADING && (long)(now - retryAt) >= 0;
+  }
+
+  /**
+   * Check if a verified release waits for the restart that activates it
+   * @return true once the image is installed
+   */
+  bool isReady() {
+    return state == OTA_READY;
+  }
+
+  /**
+   * Get the release being downloaded
+   * @return release name
+   */
+  const char* getVersion() {
+    return version;
+  }
+
+  /**
+   * Get the first byte of the next chunk
+   * @return offset in the image
+   */
+  uint32_t getOffset() {
+    return offset;
+  }
+
+  /**
+   * Start writing the image, called with every chunk (only the first one opens the partition)
+   * @param size - Image size (total of the Content-Range header)
+   * @param md5 - Image MD5 as 32 hex digits (X-Firmware-MD5 header)
+   * @return true if the inactive partition is ready to receive it
+   */
+  bool start(uint32_t size, const char* md5) {
+    if (total != 0) {
+      if (size != total) {
+        reject("image size changed during the download");
+        return false;
+      }
+      return true;
+    }
+    if (size == 0 || strlen(md5) != 32) {
+      reject("no size or MD5 in the response");
+      return false;
+    }
+    if (!Update.begin(size, U_FLASH)) {
+      reject(Update.errorString());  // Usually: larger than the app partition
+      return false;
+    }
+    Update.setMD5(md5);
+    total = size;
+    return true;
+  }
+
+  /**
+   * Write bytes of the current chunk
+   * @param data - Bytes received
+   * @param length - Number of bytes
+   * @return true if written
+   */
+  bool write(uint8_t* data, size_t length) {
+    if (Update.write(data, length) != length) {
+      reject(Update.errorString());
+      return false;
+    }
+    offset += length;
+    return true;
+  }
+
+  /**
+   * End a chunk request, verifying and activating the image after the last one
+   * @param ok - Whether the whole chunk arrived (a partial one resumes at getOffset())
+   * @param now - Current time in milliseconds (millis())
+   */
+  void endChunk(bool ok, unsigned long now) {
+    if (state != OTA_DOWNLOADING) {
+      return;
+    }
+    if (!ok) {
+      failures++;
+      unsigned long delayMs = min((unsigned long)OTA_RETRY_MAX_MS, 1000UL << min(failures, 6));
+      retryAt = now + delayMs;
+      LOG_WARN("OTA: chunk at %lu failed, retrying in %lu ms", (unsigned long)offset, delayMs);
+      return;
+    }
+    failures = 0;
+    retryAt = now;
+    if (offset < total) {
+      return;
+    }
+
+    // Checks the MD5 and the image, then points the bootloader at the new partition
+    if (!Update.end()) {
+      reject(Update.errorString());
+      return;
+    }
+    Preferences prefs;
+    if (prefs.begin("ota", false)) {
+      prefs.putString("installed", version);  // Checked by begin() after the restart
+      prefs.end();
+    }
+    state = OTA_READY;
+    LOG_INFO("OTA: firmware %s verified (%lu bytes), restarting into it once idle", version, (unsigned long)total);
+  }
+
+  /**
+   * Drop the release being downloaded, it is announced again by the next poll
+   * @param reason - Logged reason
+   */
+  void abort(const char* reason) {
+    if (Update.isRunning()) {
+      Update.abort();
+    }
+    LOG_WARN("OTA: firmware %s dropped: %s", version, reason);
+    state = OTA_IDLE;
+    version[0] = '\0';
+  }
+
+private:
+  enum OtaState {
+    OTA_IDLE,         // Running the announced release (or none announced)
+    OTA_DOWNLOADING,  // Writing the announced release to the inactive partition
+    OTA_READY,        // Verified and activated, waiting for the restart
+  };
+
+  OtaState state;
+  char version[OTA_VERSION_SIZE];          // Release being downloaded
+  char rejectedVersion[OTA_VERSION_SIZE];  // Release that failed to install (not downloaded again until restart)
+  uint32_t offset;                         // Bytes written so far
+  uint32_t total;                          // Image size (0 until the first chunk)
+  int failures;                            // Consecutive failed chunks
+  unsigned long retryAt;                   // millis() of the next chunk request
+  bool confirmed;                          // Whether confirmBoot() already ran
+
+  /**
+   * Give up on the release being downloaded until the next restart
+   * @param reason - Logged reason
+   */
+  void reject(const char* reason) {
+    strlcpy(rejectedVersion, version, sizeof(rejectedVersion));
+    abort(reason);
+  }
+};
+
+#endif
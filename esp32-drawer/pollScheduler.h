@@ -0,0 +1,182 @@
+#ifndef POLLSCHEDULER_H
+#define POLLSCHEDULER_H
+
+#include <Arduino.h>
+
+// Include config file
+#include "config.h"
+
+/**
+ * Class to choose the delay before the next poll
+ * - fast polling for POLL_FAST_WINDOW_MS after a command arrives
+ * - exponential backoff toward POLL_IDLE_MAX_MS while idle
+ * - exponential backoff with jitter on errors
+ * With a poll slot from the server, idle polls are sent on the device's phase
+ * of the slot interval instead of backing off, so devices that booted together
+ * don't poll in lockstep.
+ * The server can override the idle backoff with the X-Poll-Interval header,
+ * during the fast window it can only shorten the delay (more commands queued)
+ * and it never moves a poll off its slot.
+ */
+class PollScheduler {
+public:
+  // Constructor
+  PollScheduler() {
+    fastUntil = 0;
+    idleInterval = POLL_IDLE_MIN_MS;
+    errorCount = 0;
+    interval = 0;  // First poll right after boot
+    slotInterval = 0;
+    slotOffset = 0;
+    source = DELAY_FAST;
+  }
+
+  /**
+   * Set the poll slot assigned by the server
+   * @param intervalMs - Time between two idle polls in milliseconds (0 = no slot)
+   * @param offsetMs - Phase of this device inside the interval in milliseconds
+   */
+  void setSlot(unsigned long intervalMs, unsigned long offsetMs) {
+    if (intervalMs < POLL_FAST_INTERVAL_MS) {
+      intervalMs = 0;  // No slot, or one too short to make sense
+    }
+    slotInterval = intervalMs;
+    slotOffset = intervalMs > 0 ? offsetMs % intervalMs : 0;
+  }
+
+  /**
+   * Record a poll that returned commands
+   * @param now - Current time in milliseconds (millis())
+   */
+  void onCommands(unsigned long now) {
+    errorCount = 0;
+    source = DELAY_FAST;
+    fastUntil = now + POLL_FAST_WINDOW_MS;
+    idleInterval = POLL_IDLE_MIN_MS;
+    interval = POLL_FAST_INTERVAL_MS;
+  }
+
+  /**
+   * Record a poll that returned no command
+   * @param now - Current time in milliseconds (millis())
+   * @param serverTimeMs - Current server time in milliseconds (0 if unknown, the slot is then not used)
+   */
+  void onIdle(unsigned long now, int64_t serverTimeMs = 0) {
+    errorCount = 0;
+    if ((long)(now - fastUntil) < 0) {
+      interval = POLL_FAST_INTERVAL_MS;  // Still in an interactive session
+      source = DELAY_FAST;
+      return;
+    }
+
+    if (slotInterval > 0 && serverTimeMs > 0) {
+      // Wait for the next start of this device's slot
+      unsigned long phase = (unsigned long)(serverTimeMs % slotInterval);
+      interval = (slotOffset + slotInterval - phase) % slotInterval;
+      if (interval < POLL_FAST_INTERVAL_MS) {
+        interval += slotInterval;  // Already polled in this slot
+      }
+      source = DELAY_SLOT;
+      return;
+    }
+
+    interval = withJitter(idleInterval, idleInterval / 10);
+    idleInterval = min(idleInterval * 2, (unsigned long)POLL_IDLE_MAX_MS);
+    source = DELAY_IDLE;
+  }
+
+  /**
+   * Record a failed poll
+   * Backoff doubles on every consecutive error, with random jitter
+   * so a fleet recovering from an outage doesn't retry in lockstep.
+   */
+  void onError() {
+    source = DELAY_ERROR;
+    if (errorCount < 16) {
+      errorCount++;
+    }
+    unsigned long backoff = min((unsigned long)POLL_ERROR_BASE_MS << (errorCount - 1), (unsigned long)POLL_ERROR_MAX_MS);
+    interval = withJitter(backoff / 2, backoff / 2);
+  }
+
+  /**
+   * Apply the interval suggested by the server for the next poll
+   * Replaces the idle backoff, only shortens the fast window delay and is
+   * ignored after an error or when the poll slot chose the delay.
+   * @param suggestedMs - Suggested delay in milliseconds, negative if none
+   */
+  void applyServerHint(long suggestedMs) {
+    if (suggestedMs < 0) {
+      return;
+    }
+    unsigned long suggested = min((unsigned long)suggestedMs, (unsigned long)POLL_IDLE_MAX_MS);
+    if (source == DELAY_IDLE) {
+      interval = suggested;
+    } else if (source == DELAY_FAST) {
+      interval = min(interval, suggested);
+    }
+  }
+
+  /**
+   * Get the idle backoff the next idle poll will use (saved across deep sleep)
+   * @return idle delay in milliseconds
+   */
+  unsigned long getIdleInterval() {
+    return idleInterval;
+  }
+
+  /**
+   * Resume the idle backoff saved before a deep sleep
+   * @param idleMs - Saved idle delay in milliseconds (0 = keep the default)
+   */
+  void resumeIdleInterval(unsigned long idleMs) {
+    if (idleMs > 0) {
+      idleInterval = constrain(idleMs, (unsigned long)POLL_IDLE_MIN_MS, (unsigned long)POLL_IDLE_MAX_MS);
+    }
+  }
+
+  /**
+   * Get the delay before the next poll
+   * @return delay in milliseconds
+   */
+  unsigned long getInterval() {
+    return interval;
+  }
+
+  /**
+   * Get the number of consecutive failed polls
+   * @return consecutive error count
+   */
+  int getErrorCount() {
+    return errorCount;
+  }
+
+private:
+  // What chose the current delay
+  enum DelaySource {
+    DELAY_FAST,   // Fast window after a command
+    DELAY_SLOT,   // Poll slot from the server
+    DELAY_IDLE,   // Idle backoff
+    DELAY_ERROR,  // Error backoff
+  };
+
+  unsigned long fastUntil;     // millis() deadline of the fast polling window
+  unsigned long idleInterval;  // Next idle delay, doubled on every idle poll
+  int errorCount;              // Consecutive failed polls
+  unsigned long interval;      // Delay before the next poll
+  unsigned long slotInterval;  // Poll slot interval from the server (0 = none)
+  unsigned long slotOffset;    // Phase of this device inside the slot interval
+  DelaySource source;          // What chose interval
+
+  /**
+   * Add a random amount of time to a delay
+   * @param base - Minimum delay in milliseconds
+   * @param spread - Maximum random delay added in milliseconds
+   * @return delay between base and base + spread
+   */
+  static unsigned long withJitter(unsigned long base, unsigned long spread) {
+    return base + (spread > 0 ? esp_random() % (spread + 1) : 0);
+  }
+};
+
+#endif
@@ -0,0 +1,205 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <esp_pm.h>
+#include <esp_sleep.h>
+
+// Include config file
+#include "config.h"
+#include "logger.h"
+
+/**
+ * Power modes (POWER_MODE in config.h)
+ */
+#define POWER_MODE_PERFORMANCE 0  // Radio and CPU always on
+#define POWER_MODE_BALANCED 1     // Modem sleep within the latency budget, frequency scaling, light sleep
+#define POWER_MODE_DEEP_SLEEP 2   // Balanced, plus deep sleep between idle polls
+
+#if POWER_MODE == POWER_MODE_DEEP_SLEEP && LONG_POLL_SECONDS > 0
+#error "POWER_MODE_DEEP_SLEEP needs interval polling, set LONG_POLL_SECONDS to 0"
+#endif
+
+/**
+ * State kept in RTC memory across deep sleep (RAM is lost, setup() runs again)
+ */
+struct PowerRtcState {
+  uint32_t magic;         // POWER_RTC_MAGIC when the state is valid
+  uint32_t sleeps;        // Deep sleeps since the last cold boot
+  uint32_t idleInterval;  // Idle poll backoff to resume with (PollScheduler)
+};
+
+RTC_DATA_ATTR PowerRtcState powerRtcState;
+
+/**
+ * Class to manage the power mode
+ * The radio dominates the draw, so the WiFi power save level follows
+ * WAKE_LATENCY_BUDGET_MS: how late a command may reach the device while the
+ * radio sleeps (it wakes every DTIM in modem sleep, every listen interval in
+ * max modem sleep). The CPU scales its frequency and, if the core was built with
+ * tickless idle, light sleeps whenever every task is blocked; relay pulses hold a
+ * lock so their timing never stretches.
+ *
+ * In POWER_MODE_DEEP_SLEEP the device powers down between idle polls. Relays are
+ * held released through the sleep, the token, WiFi access point and lease come from
+ * NVS (FAST_BOOT) so a wakeup goes straight to polling.
+ */
+class PowerManager {
+public:
+  // Constructor
+  PowerManager() {
+    pulseLock = NULL;
+    actuating = false;
+    resumed = false;
+  }
+
+  /**
+   * Configure frequency scaling / light sleep and read the wakeup cause, call once from setup()
+   */
+  void begin() {
+    resumed = esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER && powerRtcState.magic == POWER_RTC_MAGIC;
+    if (!resumed) {
+      memset(&powerRtcState, 0, sizeof(powerRtcState));
+    }
+
+#if POWER_MODE != POWER_MODE_PERFORMANCE
+    if (!configurePm(true)) {
+      if (configurePm(false)) {
+        LOG_INFO("Power: light sleep not supported by this core, frequency scaling only");
+      } else {
+        LOG_INFO("Power: frequency scaling not supported by this core");
+      }
+    }
+    if (esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "pulse", &pulseLock) != ESP_OK) {
+      pulseLock = NULL;
+    }
+#endif
+
+    if (resumed) {
+      LOG_INFO("Power: woke from deep sleep #%lu", (unsigned long)powerRtcState.sleeps);
+    }
+  }
+
+  /**
+   * Check if this boot is a wakeup from deep sleep
+   * @return true if the device woke from a deep sleep it scheduled itself
+   */
+  bool isResumed() {
+    return resumed;
+  }
+
+  /**
+   * Get the idle poll backoff saved before the deep sleep
+   * @return backoff in milliseconds, 0 if none was saved
+   */
+  unsigned long getResumeIdleInterval() {
+    return resumed ? powerRtcState.idleInterval : 0;
+  }
+
+  /**
+   * WiFi power save level for the latency budget
+   * @return WIFI_PS_NONE, WIFI_PS_MIN_MODEM (wake every DTIM) or WIFI_PS_MAX_MODEM (wake every listen interval)
+   */
+  static wifi_ps_type_t wifiPowerSave() {
+#if POWER_MODE == POWER_MODE_PERFORMANCE
+    return WIFI_PS_NONE;
+#else
+    if (WAKE_LATENCY_BUDGET_MS < WIFI_BEACON_INTERVAL_MS) {
+      return WIFI_PS_NONE;
+    }
+    if (WAKE_LATENCY_BUDGET_MS < WIFI_BEACON_INTERVAL_MS * WIFI_LISTEN_INTERVAL) {
+      return WIFI_PS_MIN_MODEM;
+    }
+    return WIFI_PS_MAX_MODEM;
+#endif
+  }
+
+  /**
+   * Keep the CPU out of light sleep while a relay pulse runs (actuation task)
+   * @param busy - Whether a pulse is in progress
+   */
+  void setActuating(bool busy) {
+    if (busy == actuating || !pulseLock) {
+      return;
+    }
+    actuating = busy;
+    if (busy) {
+      esp_pm_lock_acquire(pulseLock);
+    } else {
+      esp_pm_lock_release(pulseLock);
+    }
+  }
+
+  /**
+   * Delay of the network task between two checks
+   * Sleeping until the next poll lets the CPU light sleep, WiFi is still
+   * checked at least every NETWORK_IDLE_MAX_DELAY_MS.
+   * @param untilNextPollMs - Time left before the next poll
+   * @return delay in milliseconds
+   */
+  static unsigned long idleDelay(unsigned long untilNextPollMs) {
+#if POWER_MODE == POWER_MODE_PERFORMANCE
+    return 100;
+#else
+    return constrain(untilNextPollMs, 100UL, (unsigned long)NETWORK_IDLE_MAX_DELAY_MS);
+#endif
+  }
+
+  /**
+   * Check if the time until the next poll is worth a deep sleep
+   * @param untilNextPollMs - Time left before the next poll
+   * @return true in POWER_MODE_DEEP_SLEEP when the poll is at least DEEP_SLEEP_MIN_MS away
+   */
+  static bool shouldDeepSleep(unsigned long untilNextPollMs) {
+#if POWER_MODE == POWER_MODE_DEEP_SLEEP
+    return untilNextPollMs >= DEEP_SLEEP_MIN_MS;
+#else
+    (void)untilNextPollMs;
+    return false;
+#endif
+  }
+
+  /**
+   * Power down until the next poll, the relays must be held released (DrawerManager::holdPins)
+   * @param sleepMs - Time to sleep in milliseconds
+   * @param idleInterval - Idle poll backoff to resume with
+   */
+  void deepSleep(unsigned long sleepMs, unsigned long idleInterval) {
+    powerRtcState.magic = POWER_RTC_MAGIC;
+    powerRtcState.sleeps++;
+    powerRtcState.idleInterval = idleInterval;
+
+    LOG_INFO("Power: deep sleep for %lu ms", sleepMs);
+    logger.flush();
+    WiFi.disconnect(true);
+    esp_sleep_enable_timer_wakeup((uint64_t)sleepMs * 1000ULL);
+    esp_deep_sleep_start();
+  }
+
+private:
+  static const uint32_t POWER_RTC_MAGIC = 0x50574552;
+
+  esp_pm_lock_handle_t pulseLock;  // NO_LIGHT_SLEEP lock held during relay pulses (NULL if unsupported)
+  bool actuating;                  // Whether pulseLock is held
+  bool resumed;                    // Woke from a deep sleep scheduled by deepSleep()
+
+  /**
+   * Enable dynamic frequency scaling, with or without automatic light sleep
+   * @param lightSleep - Whether to light sleep when every task is idle
+   * @return true if the core accepted the configuration
+   */
+  static bool configurePm(bool lightSleep) {
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+    esp_pm_config_t config;
+#else
+    esp_pm_config_esp32_t config;
+#endif
+    config.max_freq_mhz = PM_MAX_CPU_FREQ_MHZ;
+    config.min_freq_mhz = PM_MIN_CPU_FREQ_MHZ;
+    config.light_sleep_enable = lightSleep;
+    return esp_pm_configure(&config) == ESP_OK;
+  }
+};
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * Device protocol spoken with the backend: endpoint paths, headers, request
+ * payloads and command actions. Kept free of Arduino dependencies so the load
+ * generator (device-simulator/) is built from the same definitions as
+ * ServerConnector and loads the server exactly like a fleet of drawers.
+ */
+
+// Endpoint paths, appended to serverUrl (config.h)
+const char *healthEndpoint = "/health";
+const char *authEndpoint = "/auth/device";
+const char *statusEndpoint = "/devices/status";
+const char *commandsEndpoint = "/devices/";
+const char *ackEndpoint = "/commands/ack";
+const char *firmwareEndpoint = "/firmware/download";
+
+// Response headers read by the device
+#define HEADER_LONG_POLL "X-Long-Poll"                // poll was held open by the server
+#define HEADER_POLL_INTERVAL "X-Poll-Interval"        // suggested delay before the next poll (ms)
+#define HEADER_CONFIG_VERSION "X-Config-Version"      // drawer table the device should run
+#define HEADER_FIRMWARE_VERSION "X-Firmware-Version"  // release the device should run
+#define HEADER_FIRMWARE_MD5 "X-Firmware-MD5"          // MD5 of that release
+
+// Histogram bucket upper bounds in ms (max 65535), sent as "buckets" with every metrics report
+#define METRICS_BUCKET_BOUNDS 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000
+
+// Executed commands a device remembers, to replay lost acks and answer re-deliveries without actuating twice
+#define JOURNAL_SIZE 16
+
+// Status of an acknowledged command ({"results":[{"code":"...","status":"EXECUTED"}]})
+#define ACK_STATUS_EXECUTED "EXECUTED"
+#define ACK_STATUS_FAILED "FAILED"
+
+/**
+ * Action of a received command
+ */
+enum CommandAction : uint8_t {
+  COMMAND_ACTION_UNKNOWN,
+  COMMAND_ACTION_OPEN,       // "open" / "open_drawer" with "drawer"
+  COMMAND_ACTION_OPEN_MANY,  // "open_many" / "open many" with "drawers"
+  COMMAND_ACTION_CLOSE,      // "close" with "drawer"
+};
+
+/**
+ * Formatting and parsing of the protocol messages
+ */
+class Protocol {
+public:
+  /**
+   * Build the authentication request body (POST authEndpoint)
+   * @param buffer - Receives the JSON body
+   * @param size - Size of the buffer
+   * @param deviceId - Device ID
+   * @param secret - Device secret
+   * @return length of the body, >= size if it was truncated
+   */
+  static int formatAuthPayload(char* buffer, size_t size, const char* deviceId, const char* secret) {
+    return snprintf(buffer, size, "{\"device_id\":\"%s\",\"secret\":\"%s\"}", deviceId, secret);
+  }
+
+  /**
+   * Build the URL of the batched command poll (GET /devices/:id/next-commands)
+   * @param buffer - Receives the URL
+   * @param size - Size of the buffer
+   * @param serverUrl - Base URL of the API, "" for a path only
+   * @param deviceId - Device ID
+   * @param maxCommands - Most commands returned by one poll
+   * @param waitSeconds - Time the server may hold the poll open, 0 for a poll that returns right away
+   * @return length of the URL, >= size if it was truncated
+   */
+  static int formatPollUrl(char* buffer, size_t size, const char* serverUrl, const char* deviceId, int maxCommands,
+                           int waitSeconds) {
+    if (waitSeconds > 0) {
+      return snprintf(buffer, size, "%s%s%s/next-commands?max=%d&wait=%d", serverUrl, commandsEndpoint, deviceId, maxCommands,
+                      waitSeconds);
+    }
+    return snprintf(buffer, size, "%s%s%s/next-commands?max=%d", serverUrl, commandsEndpoint, deviceId, maxCommands);
+  }
+
+  /**
+   * Parse the action of a received command
+   * @param action - "action" field of the command (may be NULL)
+   * @return the action, COMMAND_ACTION_UNKNOWN if missing or not supported
+   */
+  static CommandAction parseAction(const char* action) {
+    if (!action) {
+      return COMMAND_ACTION_UNKNOWN;
+    }
+    if (strcmp(action, "open") == 0 || strcmp(action, "open_drawer") == 0) {
+      return COMMAND_ACTION_OPEN;
+    }
+    if (strcmp(action, "open_many") == 0 || strcmp(action, "open many") == 0) {
+      return COMMAND_ACTION_OPEN_MANY;
+    }
+    if (strcmp(action, "close") == 0) {
+      return COMMAND_ACTION_CLOSE;
+    }
+    return COMMAND_ACTION_UNKNOWN;
+  }
+
+  /**
+   * Get the acknowledged status of a command
+   * @param success - Whether the command was executed
+   * @return ACK_STATUS_EXECUTED or ACK_STATUS_FAILED
+   */
+  static const char* ackStatus(bool success) {
+    return success ? ACK_STATUS_EXECUTED : ACK_STATUS_FAILED;
+  }
+};
+
+#endif
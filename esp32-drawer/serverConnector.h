@@ -3,11 +3,29 @@
 
 // Include necessary libraries
 #include <HTTPClient.h>
+#include <WiFiClientSecure.h>
 #include <ArduinoJson.h>
+#include <Preferences.h>
 
 // Include config file
 #include "config.h"
+#include "protocol.h"
 #include "drawerManager.h"
+#include "commandQueue.h"
+#include "commandJournal.h"
+#include "ota.h"
+#include "boundedStream.h"
+#include "metrics.h"
+#include "logger.h"
+
+/**
+ * Outcome of one acknowledgement request
+ */
+enum AckOutcome {
+  ACK_ACCEPTED,  // Applied by the server
+  ACK_RETRY,     // Not sent or not answered, replay it from the journal
+  ACK_REJECTED,  // Can never be accepted as is (too large, HTTP 400)
+};
 
 /**
  * Class to manage server connection, authentication, and command polling
@@ -15,9 +33,142 @@
 class ServerConnector {
 public:
   // Constructor
-  ServerConnector(DrawerManager* drawerManager) {
-    this->jwtToken = "";                  // Initialize JWT token as empty
-    this->drawerManager = drawerManager;  // Store pointer to DrawerManager instance
+  ServerConnector(DrawerManager* drawerManager, CommandChannel* commandChannel, CommandJournal* journal, OtaUpdater* ota) {
+    this->jwtToken[0] = '\0';               // Initialize JWT token as empty
+    this->authHeader[0] = '\0';
+    this->drawerManager = drawerManager;    // Store pointer to DrawerManager instance (validation only)
+    this->commandChannel = commandChannel;  // Channel to the actuation task
+    this->journal = journal;                // Executed commands, for ack replay and deduplication
+    this->ota = ota;                        // Firmware releases announced on polls
+    this->reconnectCount = 0;
+    this->hasConnected = false;
+    this->longPolling = false;
+    this->lastCommandCount = 0;
+    this->suggestedInterval = -1;
+    this->pollSlotInterval = 0;
+    this->pollSlotOffset = 0;
+    this->tokenRefreshAt = 0;
+    this->tokenExp = 0;
+    this->clockOffset = 0;
+    this->clockSynced = false;
+    this->serverSpeaksMsgpack = false;
+    this->authCount = 0;
+    this->requestActive = false;
+    this->requestStart = 0;
+    this->requestEndpoint = ENDPOINT_HEALTH;
+    this->pollReceivedAt = 0;
+    this->rejectedConfigVersion = 0;
+
+    // Endpoint URLs only depend on config.h and protocol.h, build them once
+    buildEndpointUrls();
+
+#if SERVER_TLS
+    // Verify the server against the pinned CA, the handshake only runs when the socket is opened
+    client.setCACert(serverRootCA);
+    client.setHandshakeTimeout(TLS_HANDSHAKE_TIMEOUT_S);
+#endif
+
+    // Keep the TCP connection open between requests (HTTP keep-alive)
+    http.setReuse(true);
+    http.setTimeout(HTTP_TIMEOUT_MS);
+
+    // Response headers read by the connector
+    const char* headerKeys[] = { HEADER_LONG_POLL, HEADER_POLL_INTERVAL, HEADER_CONFIG_VERSION, HEADER_FIRMWARE_VERSION,
+                                 HEADER_FIRMWARE_MD5, "Content-Range", "Date", "Content-Type" };
+    http.collectHeaders(headerKeys, sizeof(headerKeys) / sizeof(headerKeys[0]));
+  }
+
+  /**
+   * Check if the server is holding polls open (long-polling)
+   * If not, the caller should fall back to interval polling
+   * @return true if the last poll was served as a long-poll
+   */
+  bool isLongPolling() {
+    return longPolling;
+  }
+
+  /**
+   * Get the current server time
+   * Learned from the iat claim of a new token or the Date header of a response.
+   * @return Unix time in seconds, 0 if not known yet
+   */
+  long getServerTime() {
+    return clockSynced ? clockOffset + (long)(millis() / 1000) : 0;
+  }
+
+  /**
+   * Get the current server time in milliseconds (to the second of the last clock sync)
+   * @return Unix time in milliseconds, 0 if not known yet
+   */
+  int64_t getServerTimeMs() {
+    return clockSynced ? (int64_t)clockOffset * 1000 + millis() : 0;
+  }
+
+  /**
+   * Get the poll slot assigned by the server with the token (see PollScheduler::setSlot)
+   * @return slot interval in milliseconds, 0 if the server assigned none
+   */
+  unsigned long getPollSlotInterval() {
+    return pollSlotInterval;
+  }
+
+  /**
+   * Get the phase of this device inside the poll slot interval
+   * @return slot offset in milliseconds
+   */
+  unsigned long getPollSlotOffset() {
+    return pollSlotOffset;
+  }
+
+  /**
+   * Get the number of commands received by the last poll
+   * @return commands in the last poll response (0 if none or on error)
+   */
+  int getLastCommandCount() {
+    return lastCommandCount;
+  }
+
+  /**
+   * Get the poll interval suggested by the server in the last poll response
+   * @return suggested delay in milliseconds, -1 if the server sent none
+   */
+  long getSuggestedInterval() {
+    return suggestedInterval;
+  }
+
+  /**
+   * Get how many times the persistent connection had to be re-established
+   * @return number of reconnects since boot
+   */
+  unsigned long getReconnectCount() {
+    return reconnectCount;
+  }
+
+  /**
+   * Get the heap low-water mark
+   * A value that keeps falling over days of uptime points to a leak or fragmentation.
+   * @return lowest free heap (bytes) seen since boot
+   */
+  uint32_t getMinFreeHeap() {
+    return ESP.getMinFreeHeap();
+  }
+
+  /**
+   * Get the largest block that can currently be allocated
+   * @return size in bytes of the largest free heap block
+   */
+  uint32_t getLargestFreeBlock() {
+    return ESP.getMaxAllocHeap();
+  }
+
+  /**
+   * Close the persistent connection, the next request opens a fresh socket
+   * (recovery for a connection that keeps failing without being detected as stale)
+   */
+  void resetConnection() {
+    http.end();
+    client.stop();
+    LOG_INFO("Server connection closed");
   }
 
   /**
@@ -26,331 +177,1341 @@ public:
    * @return true if server is operational, false otherwise
    */
   bool checkServerHealth() {
-    HTTPClient http;
-    Serial.print("Testing server connectivity...");
+    LOG_INFO("Testing server connectivity...");
 
     // Retry logic
     int retries = 0;
     while (retries < 10) {
-      if (http.begin(String(serverUrl) + healthEndpoint)) {
-        int code = http.GET();
-        http.end();
+      int code = sendRequest("GET", healthUrl, "", false);
+      discardBody(false);
 
-        if (code == 200) {
-          Serial.println();
-          Serial.println("Server is operational!");
-          return true;
-        }
+      if (code == 200) {
+        LOG_INFO("Server is operational!");
+        return true;
       }
 
-      Serial.print(".");
+      LOG_DEBUG("Server not ready (%d), retrying...", code);
       delay(1000);
       retries++;
     }
 
     // After retries, failed
-    Serial.println();
-    Serial.println("Server is not responding!");
+    LOG_ERROR("Server is not responding!");
+    return false;
+  }
+
+  /**
+   * Renew the JWT token ahead of its expiry
+   * The current token stays in use until the new one is obtained,
+   * so requests never run without a valid token on the normal path.
+   * Must be called regularly from the network task.
+   * @return true if the token is still valid or was renewed
+   */
+  bool refreshTokenIfNeeded() {
+    if ((long)(millis() - tokenRefreshAt) < 0) {
+      return hasToken();
+    }
+
+    LOG_INFO("%s", hasToken() ? "Token close to expiry, refreshing..." : "No token, authenticating...");
+    if (authenticate()) {
+      return true;
+    }
+
+    // Keep the old token (if any) and try again shortly
+    tokenRefreshAt = millis() + TOKEN_RETRY_SECONDS * 1000UL;
     return false;
   }
 
+  /**
+   * Reuse the JWT token cached in NVS by the last authentication
+   * The device doesn't know the current time at boot, so the token is used
+   * optimistically: its remaining validity is checked against the Date header
+   * of the first response, and a rejected token falls back to authenticate().
+   * @return true if a cached token was loaded
+   */
+  bool loadCachedToken() {
+    Preferences prefs;
+    if (!prefs.begin("auth", true)) {
+      return false;
+    }
+    char token[JWT_TOKEN_SIZE];
+    size_t length = prefs.getString("token", token, sizeof(token));
+    uint32_t exp = prefs.getUInt("exp", 0);
+    pollSlotInterval = prefs.getUInt("slotInterval", 0);
+    pollSlotOffset = prefs.getUInt("slotOffset", 0);
+    prefs.end();
+
+    // getString returns the stored length including the null terminator
+    if (length <= 1 || exp == 0 || !setToken(token, strlen(token))) {
+      return false;
+    }
+    tokenExp = exp;
+
+    // Refresh anyway if no response tells us the time soon
+    tokenRefreshAt = millis() + TOKEN_CLOCK_SYNC_SECONDS * 1000UL;
+    LOG_DEBUG("Using cached token: %.20s...", jwtToken);
+    return true;
+  }
+
   /**
    * Authenticate with the server to obtain the JWT token
+   * On success the next refresh is scheduled from the token lifetime.
    * @return true if authentication is successful, false otherwise
    */
   bool authenticate() {
-    HTTPClient http;
-    Serial.println("Starting authentication...");
-
-    // Connect to authentication endpoint
-    if (http.begin(String(serverUrl) + authEndpoint)) {
-      http.addHeader("Content-Type", "application/json");
+    LOG_INFO("Starting authentication...");
 
-      String payload = String("{\"device_id\":\"") + device_id + "\",\"secret\":\"" + device_jwt_secret + "\"}";
-      int code = http.POST(payload);
+    // Send credentials to authentication endpoint
+    Protocol::formatAuthPayload(authPayload, sizeof(authPayload), device_id, device_jwt_secret);
+    int code = sendRequest("POST", authUrl, authPayload, false);
 
+    if (code > 0) {
       // Handle response
       if (code == 200) {
-        // Handle response success from server
-        String response = http.getString();
-        Serial.println("Response from authentication: " + response);
-
-        // Simple JSON parsing to extract the token
-        int start = response.indexOf("\"token\":\"") + 9;
-        int end = response.indexOf("\"", start);
+        // Handle response success from server, keeping only the token field
+        StaticJsonDocument<128> filter;
+        filter["token"] = true;
+        filter["poll"]["intervalMs"] = true;
+        filter["poll"]["offsetMs"] = true;
+        filter["config"] = true;
+        StaticJsonDocument<AUTH_RESPONSE_DOC_SIZE> doc;
+        if (!parseBody(doc, &filter)) {
+          return false;
+        }
+        const char* token = doc["token"];
 
         // If token found, store it
-        if (start > 8 && end > start) {
-          jwtToken = response.substring(start, end);
-          Serial.println("JWT token obtained successfully!");
-          Serial.println("Token: " + jwtToken.substring(0, 20) + "...");
-          http.end();
+        if (token && token[0] != '\0') {
+          if (!setToken(token, strlen(token))) {
+            LOG_ERROR("Token too long, increase JWT_TOKEN_SIZE");
+            return false;
+          }
+          if (authCount++ > 0) {
+            metrics.increment(COUNTER_REAUTHS);
+          }
+          // Poll slot spreading the fleet's idle polls (absent = keep the adaptive backoff)
+          pollSlotInterval = doc["poll"]["intervalMs"] | 0UL;
+          pollSlotOffset = doc["poll"]["offsetMs"] | 0UL;
+          // Drawer table (absent = keep the table in use)
+          if (!doc["config"].isNull()) {
+            updateDrawerConfig(doc["config"]);
+          }
+          LOG_INFO("JWT token obtained successfully!");
+          LOG_DEBUG("Token: %.20s...", jwtToken);
+          scheduleTokenRefresh();
           return true;
         } else {
-          Serial.println("Error extracting token from response");
+          LOG_ERROR("Error extracting token from response");
+          return false;
         }
       } else {
         // Handle response error from server
-        Serial.printf("Authentication error - Code: %d\n", code);
-        Serial.println("Response: " + http.getString());
+        LOG_ERROR("Authentication error - Code: %d", code);
+        discardBody();
+        return false;
       }
-      http.end();
     } else {
-      Serial.println("Error connecting to authentication endpoint");
+      LOG_ERROR("Error connecting to authentication endpoint");
     }
+    endRequest();
     return false;
   }
 
   /**
-   * Send the current device status to the server
-   * (not used yet)
+   * Send the device status and the metrics collected since the last report
+   * (see metrics.h). The metrics are only cleared once the server accepted them,
+   * a failed report rolls into the next one. A report the server rejects (HTTP 400)
+   * is dropped instead, its counts would be rejected again.
+   * @return true if the server accepted or rejected the report (false = retry)
    */
-  void sendStatus() {
-    if (jwtToken == "") {
-      Serial.println("No token, skipping status send...");
-      return;
+  bool sendStatus() {
+    if (!hasToken()) {
+      LOG_WARN("No token, skipping status send...");
+      return false;
     }
 
-    HTTPClient http;
-    if (http.begin(String(serverUrl) + statusEndpoint)) {
-      http.addHeader("Content-Type", "application/json");
-      http.addHeader("Authorization", "Bearer " + jwtToken);
-
-      String payload = "{\"status\":\"ACTIVE\",\"message\":\"Device operating normally\",\"timestamp\":\"" + String(millis()) + "\"}";
-      int code = http.POST(payload);
-
-      if (code == 200) {
-        Serial.println("Status sent successfully!");
-      } else if (code == 401 || code == 403) {
-        Serial.println("Invalid/expired token. Reauthenticating...");
-        jwtToken = "";
-        authenticate();
-      } else {
-        Serial.printf("Error sending status: %d\n", code);
-        Serial.println("Response: " + http.getString());
+    metrics.setGauge(GAUGE_FREE_HEAP, ESP.getFreeHeap());
+    metrics.setGauge(GAUGE_MIN_FREE_HEAP, getMinFreeHeap());
+    metrics.setGauge(GAUGE_MAX_ALLOC_HEAP, getLargestFreeBlock());
+    if (metrics.serializeReport(statusPayload, sizeof(statusPayload)) == 0) {
+      // Counts only grow until a report is accepted, drop them or no later report would fit either
+      LOG_ERROR("Metrics report too large, dropping the metrics collected since the last report");
+      metrics.commitReport();
+      if (metrics.serializeReport(statusPayload, sizeof(statusPayload)) == 0) {
+        return false;
       }
-      http.end();
     }
+    int code = sendRequest("POST", statusUrl, statusPayload);
+
+    if (code == 200) {
+      LOG_DEBUG("Status sent successfully!");
+      metrics.commitReport();
+      discardBody(false);
+      return true;
+    } else if (code == 400) {
+      // Rejected report, resending the same counts would fail forever
+      LOG_ERROR("Status rejected (HTTP %d), dropping its metrics", code);
+      metrics.commitReport();
+      discardBody();
+      return true;
+    } else if (code == 401 || code == 403) {
+      LOG_WARN("Invalid/expired token. Reauthenticating...");
+      discardBody(false);
+      clearToken();
+      authenticate();
+    } else if (code > 0) {
+      LOG_ERROR("Error sending status: %d", code);
+      discardBody();
+    } else {
+      LOG_ERROR("Error sending status: %d", code);
+      endRequest();
+    }
+    return false;
   }
 
   /**
    * Poll for new commands from the server
-   * and process them as needed
+   * and process them as needed.
+   * Up to MAX_BATCH_COMMANDS commands are fetched per round trip and
+   * their results are sent back in a single acknowledgement request.
+   * When LONG_POLL_SECONDS is set the server holds the request
+   * until a command is available or the wait expires.
    * @return true if polling was attempted, false if skipped due to no token
    */
   bool pollForCommands() {
-    if (jwtToken == "") {
-      Serial.println("No token, skipping command polling...");
+    if (!hasToken()) {
+      LOG_WARN("No token, skipping command polling...");
+      longPolling = false;
       return false;
     }
 
-    // Connect to commands endpoint sending polling request to the server
-    HTTPClient http;
-    String pollUrl = String(serverUrl) + commandsEndpoint + device_id + "/next-command";
+    // Send polling request to the commands endpoint over the shared connection,
+    // while a firmware update downloads polls return right away so chunks go out between them
+    bool hold = LONG_POLL_SECONDS > 0 && !ota->isDownloading();
+    if (hold) {
+      http.setTimeout((LONG_POLL_SECONDS + 5) * 1000);  // Allow the server to hold the request
+    }
+    int code = sendRequest("GET", hold ? pollUrl : pollNowUrl, NULL, 0, NULL, COMPACT_ACCEPT);
+    http.setTimeout(HTTP_TIMEOUT_MS);
 
-    // Begin connection to the polling URL
-    if (http.begin(pollUrl)) {
-      http.addHeader("Authorization", "Bearer " + jwtToken);
+    // A token loaded from NVS is checked against the server time of the first response
+    if (!clockSynced && code > 0 && http.hasHeader("Date")) {
+      syncClock(parseHttpDate(http.header("Date").c_str()));
+    }
 
-      int code = http.GET();
+    // Server confirms long-polling with the X-Long-Poll header, otherwise fall back to interval polling
+    longPolling = (code == 200 || code == 204) && http.hasHeader(HEADER_LONG_POLL);
+    suggestedInterval = (code == 200 || code == 204) && http.hasHeader(HEADER_POLL_INTERVAL) ? http.header(HEADER_POLL_INTERVAL).toInt() : -1;
+    lastCommandCount = 0;
 
-      if (code == 200) {
-        // Handle response success from server
-        String response = http.getString();
-        Serial.println("Command received: " + response);
-
-        // Process the command (confirmation/failure is sent inside processCommand)
-        processCommand(response);
-      } else if (code == 204) {
-        // No command available
-        Serial.println("No pending command");
-      } else if (code == 401 || code == 403) {
-        // Token expired during polling. Reauthenticating...
-        Serial.println("Token expired during polling. Reauthenticating...");
-        jwtToken = "";
-        authenticate();
-        return false;
+    // A new drawer table comes with a token, authenticate again now instead of at the next renewal
+    if ((code == 200 || code == 204) && http.hasHeader(HEADER_CONFIG_VERSION)) {
+      uint32_t version = strtoul(http.header(HEADER_CONFIG_VERSION).c_str(), NULL, 10);
+      if (version != 0 && version != drawerManager->getConfigVersion() && version != rejectedConfigVersion) {
+        LOG_INFO("Drawer table v%lu announced, refreshing the token", (unsigned long)version);
+        tokenRefreshAt = millis();
+      }
+    }
+
+    // The release the fleet should run, another one is installed in the background (see ota.h)
+    if ((code == 200 || code == 204) && http.hasHeader(HEADER_FIRMWARE_VERSION)) {
+      ota->offer(http.header(HEADER_FIRMWARE_VERSION).c_str());
+    }
+
+    if (code == 200) {
+      pollReceivedAt = millis();
+
+      // Handle response success from server, parsing straight from the socket
+      // (MessagePack if the server accepted our Accept header, JSON otherwise)
+      StaticJsonDocument<COMMANDS_DOC_SIZE> doc;
+      serverSpeaksMsgpack = http.header("Content-Type").startsWith(MSGPACK_CONTENT_TYPE);
+      if (!parseBody(doc)) {
+        // If we can't parse, we can't confirm
+        return true;
+      }
+
+      // Process the commands (acknowledgement is sent inside processCommands)
+      processCommands(doc);
+      return true;
+    } else if (code == 204) {
+      // No command available
+      LOG_DEBUG("No pending command");
+    } else if (code == 401 || code == 403) {
+      // Token expired during polling. Reauthenticating...
+      // (only happens if the proactive refresh was missed, e.g. server restarted with a new secret)
+      LOG_WARN("Token expired during polling. Reauthenticating...");
+      discardBody(false);
+      clearToken();
+      return authenticate();  // A successful reauth is not a polling error
+    } else {
+      // Handle other HTTP errors
+      LOG_ERROR("Error during polling: %d", code);
+      if (code > 0) {
+        discardBody();
       } else {
-        // Handle other HTTP errors
-        Serial.printf("Error during polling: %d\n", code);
-        Serial.println("Response: " + http.getString());
-        return false;
+        endRequest();
       }
-      http.end();
+      return false;
     }
+    endRequest();
     return true;
   }
 
   /**
-   * Process the received command JSON
-   * Example command: {"action":"open","drawer":1,"code":"ABC123XYZ"}
-   * @param commandJson - JSON string representing the command
+   * Process a batch of received commands and acknowledge them
+   * Every command is handed to the actuation task before waiting for
+   * any result, so pulses on different drawers start together.
+   * Example response: {"commands":[{"action":"open","drawer":1,"code":"ABC123XYZ"}],"count":1}
+   * @param doc - Parsed response with the commands array
    */
-  void processCommand(String commandJson) {
-    StaticJsonDocument<256> doc;                                     // reserve 256 bytes for the JSON
-    DeserializationError error = deserializeJson(doc, commandJson);  // Parse the JSON
-    if (error) {
-      Serial.print("Error parsing JSON: ");
-      Serial.println(error.c_str());
+  void processCommands(JsonDocument& doc) {
+    CommandResult results[MAX_BATCH_COMMANDS];
+    bool submitted[MAX_BATCH_COMMANDS];
+    uint32_t masks[MAX_BATCH_COMMANDS];
+    int count = 0;
 
-      // If we can't parse, we can't confirm
-      return;
+    JsonArray commands = doc["commands"];
+    for (JsonVariant command : commands) {
+      if (count >= MAX_BATCH_COMMANDS) {
+        break;
+      }
+      if (isDuplicate(command["code"], results, count)) {
+        LOG_WARN("Command %s listed twice in the batch, dropping the copy", (const char*)command["code"]);
+        continue;
+      }
+      if (startCommand(command, results[count], submitted[count], masks[count])) {
+        count++;
+      }
+    }
+    lastCommandCount = count;
+
+    // Collect the results of the commands handed to the actuation task,
+    // journaling them (once the pulses ended) before the acknowledgement is attempted
+    finishCommands(results, submitted, masks, count);
+    waitForPulses();
+    for (int i = 0; i < count; i++) {
+      if (submitted[i]) {
+        journal->record(results[i]);
+      }
     }
 
+    // Send every result to the server in one request
+    bool acked[MAX_BATCH_COMMANDS];
+    if (count > 0) {
+      sendCommandAcks(results, count, acked);
+      journal->markAcked(results, acked, count);
+      unsigned long pollToAck = millis() - pollReceivedAt;
+      for (int i = 0; i < count; i++) {
+        if (acked[i]) {
+          metrics.record(HIST_POLL_TO_ACK, pollToAck);
+        }
+      }
+    }
+  }
+
+  /**
+   * Resend acknowledgements that were journaled but not confirmed
+   * (network drop, server error or restart before the ack went through)
+   * @return true if nothing is pending or the replay succeeded
+   */
+  bool replayPendingAcks() {
+    CommandResult results[MAX_BATCH_COMMANDS];
+    int count = journal->getPendingAcks(results, MAX_BATCH_COMMANDS);
+    if (count == 0) {
+      return true;
+    }
+
+    LOG_INFO("Replaying %d pending acknowledgement(s)", count);
+    bool acked[MAX_BATCH_COMMANDS];
+    bool complete = sendCommandAcks(results, count, acked);
+    waitForPulses();
+    journal->markAcked(results, acked, count);
+    return complete;
+  }
+
+  /**
+   * Validate a received command and hand it to the actuation task
+   * Example command: {"action":"open","drawer":1,"priority":5,"code":"ABC123XYZ"} (priority optional)
+   * or {"action":"open_many","drawers":[1,3,4],"code":"ABC123XYZ"}
+   * @param command - Parsed command
+   * @param result - Receives the command code and, if not submitted, the failure
+   * @param submitted - Set to true if the command was queued for actuation
+   * @param submittedMask - Receives the drawers of the queued command (0 if not submitted)
+   * @return true if the command has a code and must be acknowledged
+   */
+  bool startCommand(JsonVariant command, CommandResult& result, bool& submitted, uint32_t& submittedMask) {
+    submitted = false;
+    submittedMask = 0;
+
     // Extract action, drawer number, and command code
-    const char* action = doc["action"];
-    int drawer = doc["drawer"] | 0;  // Default to 0 if not present
-    const char* code = doc["code"];
+    const char* action = command["action"];
+    int drawer = command["drawer"] | 0;  // Default to 0 if not present
+    const char* code = command["code"];
 
     // Validate command has a code (required for tracking)
     if (!code) {
-      Serial.println("Invalid command: missing command code");
-      return;
+      LOG_WARN("Invalid command: missing command code");
+      return false;
+    }
+
+    strlcpy(result.code, code, sizeof(result.code));
+    result.success = false;
+    result.errorMessage[0] = '\0';
+
+    // Re-delivered command (its ack was lost): acknowledge it again without actuating
+    const JournalEntry* executed = journal->find(code);
+    if (executed) {
+      LOG_INFO("Command %s already executed, acknowledging again", code);
+      CommandJournal::toResult(*executed, result);
+      return true;
     }
 
     // Validate action
     if (!action) {
-      Serial.println("Invalid command: missing action");
-      sendCommandFailure(String(code), "Missing action field");
+      LOG_WARN("Invalid command: missing action");
+      strlcpy(result.errorMessage, "Missing action field", sizeof(result.errorMessage));
+      return true;
+    }
+
+    LOG_INFO("Processing command - Code: %s, Action: %s, Drawer: %d", code, action, drawer);
+
+    // Execute command based on action, failures are written straight into the result
+    char* errorMsg = result.errorMessage;
+    size_t errorSize = sizeof(result.errorMessage);
+
+    uint32_t drawerMask = 0;  // Drawers to act on, bit i = drawer i + 1
+    DrawerAction drawerAction = DRAWER_ACTION_OPEN;
+    switch (Protocol::parseAction(action)) {
+      case COMMAND_ACTION_OPEN:
+        drawerMask = parseDrawer(drawer, errorMsg, errorSize);
+        break;
+      case COMMAND_ACTION_OPEN_MANY:
+        drawerMask = parseDrawerList(command["drawers"], errorMsg, errorSize);
+        break;
+      case COMMAND_ACTION_CLOSE:
+        // Confirmed by the drawer sensor in the actuation task, drawers without one fail there
+        drawerMask = parseDrawer(drawer, errorMsg, errorSize);
+        drawerAction = DRAWER_ACTION_CLOSE;
+        break;
+      default:
+        LOG_WARN("Unknown action: %s", action);
+        snprintf(errorMsg, errorSize, "Unknown action: %s", action);
+        break;
+    }
+
+    if (drawerMask != 0) {
+      // Hand the command to the actuation task, the result is collected by finishCommands()
+      DrawerCommand drawerCommand;
+      strlcpy(drawerCommand.code, code, sizeof(drawerCommand.code));
+      drawerCommand.action = drawerAction;
+      drawerCommand.drawerMask = drawerMask;
+      drawerCommand.priority = constrain(command["priority"] | 0, 0, 127);
+      drawerCommand.receivedAt = pollReceivedAt;
+
+      if (commandChannel->submit(drawerCommand)) {
+        submitted = true;
+        submittedMask = drawerMask;
+        return true;
+      }
+      strlcpy(errorMsg, "Actuation queue full", errorSize);
+    }
+
+    LOG_ERROR("Error: %s", errorMsg);
+    return true;
+  }
+
+  /**
+   * Check if a command code was already taken from the current batch
+   * @param code - Code of the command
+   * @param results - Results of the commands taken so far (hold their codes)
+   * @param count - Number of commands taken so far
+   * @return true if the code is already in the batch
+   */
+  bool isDuplicate(const char* code, const CommandResult* results, int count) {
+    for (int i = 0; code && i < count; i++) {
+      if (strcmp(results[i].code, code) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * Validate the drawer of a single-drawer command
+   * @param drawer - The "drawer" field of the command (0 if missing)
+   * @param errorMsg - Receives the failure reason
+   * @param errorSize - Size of the errorMsg buffer
+   * @return mask of the drawer (bit i = drawer i + 1), 0 on error
+   */
+  uint32_t parseDrawer(int drawer, char* errorMsg, size_t errorSize) {
+    if (drawer == 0) {
+      strlcpy(errorMsg, "Invalid drawer number (must be >= 1)", errorSize);
+      return 0;
+    }
+    if (!drawerManager->isValidDrawer(drawer)) {
+      snprintf(errorMsg, errorSize, "Drawer %d does not exist (valid: 1-%d)", drawer, drawerManager->getDrawerCount());
+      return 0;
+    }
+    return 1UL << (drawer - 1);
+  }
+
+  /**
+   * Validate the drawer list of an open_many command
+   * The command is all-or-nothing: if any drawer is invalid none is opened,
+   * and the error lists every invalid drawer.
+   * @param drawers - The "drawers" array of the command
+   * @param errorMsg - Receives the failure reason
+   * @param errorSize - Size of the errorMsg buffer
+   * @return mask of the drawers to open (bit i = drawer i + 1), 0 on error
+   */
+  uint32_t parseDrawerList(JsonArray drawers, char* errorMsg, size_t errorSize) {
+    if (drawers.isNull() || drawers.size() == 0) {
+      strlcpy(errorMsg, "Missing drawers list", errorSize);
+      return 0;
+    }
+
+    uint32_t mask = 0;
+    int invalidCount = 0;
+    size_t used = 0;
+    for (JsonVariant value : drawers) {
+      int drawer = value | 0;
+      if (drawerManager->isValidDrawer(drawer)) {
+        mask |= 1UL << (drawer - 1);
+        continue;
+      }
+      // Collect the invalid drawers: "Drawers 5, 7 ..."
+      if (used < errorSize) {
+        used += snprintf(errorMsg + used, errorSize - used, invalidCount == 0 ? "Drawers %d" : ", %d", drawer);
+      }
+      invalidCount++;
+    }
+
+    if (invalidCount > 0) {
+      if (used < errorSize) {
+        snprintf(errorMsg + used, errorSize - used, " do not exist (valid: 1-%d)", drawerManager->getDrawerCount());
+      }
+      return 0;
+    }
+    return mask;
+  }
+
+  /**
+   * Wait for the actuation task to report the results of a batch of submitted commands
+   * Results are matched by code under one deadline for the whole batch: the actuation
+   * task finishes them out of order (priorities, busy drawers, sensor confirmations).
+   * @param results - Hold the command codes, receive the actuation results
+   * @param submitted - Which commands were handed to the actuation task
+   * @param masks - Drawers of each submitted command
+   * @param count - Number of commands
+   */
+  void finishCommands(CommandResult* results, const bool* submitted, const uint32_t* masks, int count) {
+    // Commands on the same drawer run one after the other, the longest such chain
+    // bounds the batch: each link pulses, waits for its sensor and the repeat gap
+    int chain = 0;
+    bool waiting[MAX_BATCH_COMMANDS];
+    for (int i = 0; i < count; i++) {
+      waiting[i] = submitted[i];
+      if (!submitted[i]) {
+        continue;
+      }
+      int links = 1;
+      for (int j = 0; j < i; j++) {
+        links += submitted[j] && (masks[j] & masks[i]) != 0 ? 1 : 0;
+      }
+      chain = max(chain, links);
+    }
+    if (chain == 0) {
       return;
     }
 
-    Serial.print("Processing command - Code: ");
-    Serial.print(code);
-    Serial.print(", Action: ");
-    Serial.print(action);
-    Serial.print(", Drawer: ");
-    Serial.println(drawer);
-
-    // Execute command based on action
-    bool success = false;
-    String errorMsg = "";
-
-    if (strcmp(action, "open") == 0 || strcmp(action, "open_drawer") == 0) {
-      if (drawer == 0) {
-        errorMsg = "Invalid drawer number (must be >= 1)";
-        Serial.println("Error: " + errorMsg);
-      } else if (!drawerManager->isValidDrawer(drawer)) {
-        errorMsg = "Drawer " + String(drawer) + " does not exist (valid: 1-" + String(sizeof(drawerPins) / sizeof(drawerPins[0])) + ")";
-        Serial.println("Error: " + errorMsg);
-      } else {
-        success = drawerManager->openDrawer(drawer);  // Send command to DrawerManager
-        if (!success) {
-          errorMsg = "Hardware failure opening drawer " + String(drawer);
-          Serial.println("Error: " + errorMsg);
-        }
+    // Sensed drawers answer once their sensor confirmed the action (after the last staggered pulse)
+    uint32_t timeoutMs = ACTUATION_RESULT_TIMEOUT_MS + DRAWER_STAGGER_MS * drawerManager->getDrawerCount() +
+                         chain * (DRAWER_CONFIRM_TIMEOUT_MS + DRAWER_PULSE_MAX_MS + DRAWER_REPEAT_GAP_MS);
+    commandChannel->awaitResults(results, waiting, count, timeoutMs);
+
+    for (int i = 0; i < count; i++) {
+      if (!submitted[i]) {
+        continue;
       }
-    } else if (strcmp(action, "close") == 0) {
-      // Add close logic here if needed
-      Serial.println("Close action not yet implemented");
-      errorMsg = "Action not implemented: close";
-    } else {
-      Serial.print("Unknown action: ");
-      Serial.println(action);
-      errorMsg = "Unknown action: " + String(action);
+      if (waiting[i]) {
+        results[i].success = false;
+        strlcpy(results[i].errorMessage, "Actuation timeout", sizeof(results[i].errorMessage));
+      }
+      if (!results[i].success) {
+        LOG_ERROR("Error: %s (code: %s)", results[i].errorMessage, results[i].code);
+      }
+    }
+  }
+
+  /**
+   * Send the execution results of several commands to the server
+   * in a single request (POST /commands/ack)
+   * A batch the server can never accept (too large, HTTP 400) is resent one result
+   * at a time, so only the offending results are given up, not the whole batch.
+   * @param results - Results to acknowledge
+   * @param count - Number of results
+   * @param acked - Receives true for every result the journal no longer has to replay
+   * @return true if every result is done with
+   */
+  bool sendCommandAcks(const CommandResult* results, int count, bool* acked) {
+    for (int i = 0; i < count; i++) {
+      acked[i] = false;
+    }
+    AckOutcome outcome = postCommandAcks(results, count);
+    if (outcome == ACK_RETRY) {
+      return false;
+    }
+    if (outcome == ACK_ACCEPTED) {
+      for (int i = 0; i < count; i++) {
+        acked[i] = true;
+      }
+      return true;
+    }
+
+    for (int i = 0; i < count; i++) {
+      outcome = count > 1 ? postCommandAcks(&results[i], 1) : ACK_REJECTED;
+      if (outcome == ACK_REJECTED && results[i].errorMessage[0] != '\0') {
+        // The failure reason is the only free-form field, report the failure without it
+        CommandResult bare = results[i];
+        bare.errorMessage[0] = '\0';
+        outcome = postCommandAcks(&bare, 1);
+      }
+      if (outcome == ACK_RETRY) {
+        return false;
+      }
+      if (outcome == ACK_REJECTED) {
+        LOG_ERROR("✗ Result of %s rejected by the server, giving up its acknowledgement", results[i].code);
+      }
+      acked[i] = true;
+    }
+    return true;
+  }
+
+  /**
+   * Download the next chunk of the firmware release being installed (see ota.h)
+   * Range request of OTA_CHUNK_SIZE bytes over the shared connection, the release
+   * is named in the URL so one replaced mid-download is dropped (409) instead of mixed.
+   * @return true if the chunk was written
+   */
+  bool downloadFirmwareChunk() {
+    if (!hasToken() || !ota->isDownloading()) {
+      return false;
     }
 
-    // Send confirmation or failure to server
-    if (success) {
-      sendCommandConfirmation(String(code));
+    uint32_t offset = ota->getOffset();
+    char range[32];
+    snprintf(range, sizeof(range), "bytes=%lu-%lu", (unsigned long)offset, (unsigned long)(offset + OTA_CHUNK_SIZE - 1));
+    snprintf(firmwareUrl, sizeof(firmwareUrl), "%s%s?version=%s", serverUrl, firmwareEndpoint, ota->getVersion());
+    int code = sendRequest("GET", firmwareUrl, NULL, 0, NULL, NULL, true, range);
+
+    if (code == 206) {
+      bool written = receiveFirmwareChunk(offset);
+      ota->endChunk(written, millis());
+      return written;
+    } else if (code == 404 || code == 409 || code == 416) {
+      // Release withdrawn or replaced, the next poll announces the current one
+      LOG_WARN("Firmware %s no longer served (%d)", ota->getVersion(), code);
+      discardBody(false);
+      ota->abort("no longer served");
+      return false;
+    } else if (code == 401 || code == 403) {
+      LOG_WARN("Invalid/expired token. Reauthenticating...");
+      discardBody(false);
+      clearToken();
+      authenticate();
+    } else if (code > 0) {
+      LOG_ERROR("Error downloading firmware: %d", code);
+      discardBody();
     } else {
-      sendCommandFailure(String(code), errorMsg);
+      LOG_ERROR("Error downloading firmware: %d", code);
+      endRequest();
+    }
+    ota->endChunk(false, millis());
+    return false;
+  }
+
+private:
+  char jwtToken[JWT_TOKEN_SIZE];      // Stores the JWT token
+  char authHeader[AUTH_HEADER_SIZE];  // "Bearer <token>", rebuilt only when the token changes
+  DrawerManager* drawerManager;    // Pointer to DrawerManager instance
+  CommandChannel* commandChannel;  // Channel to the actuation task
+  CommandJournal* journal;         // Executed commands (ack replay, deduplication)
+  OtaUpdater* ota;                 // Firmware update in progress
+
+#if SERVER_TLS
+  WiFiClientSecure client;        // Persistent TLS socket shared by every endpoint
+#else
+  WiFiClient client;              // Persistent socket shared by every endpoint
+#endif
+  HTTPClient http;                // HTTP client reused across requests (keep-alive)
+  unsigned long reconnectCount;   // Times the connection had to be re-established
+  bool hasConnected;              // Whether a connection was ever opened
+  bool longPolling;               // Whether the server is serving polls as long-polls
+  int lastCommandCount;           // Commands received by the last poll
+  long suggestedInterval;         // X-Poll-Interval of the last poll in ms (-1 = none)
+  unsigned long pollSlotInterval; // Poll slot interval from the auth response in ms (0 = none)
+  unsigned long pollSlotOffset;   // Phase of this device inside the slot interval in ms
+  unsigned long tokenRefreshAt;   // millis() deadline to renew the JWT token
+  long tokenExp;                  // exp claim of the JWT token (Unix time, 0 = unknown)
+  long clockOffset;               // Server Unix time minus millis() / 1000
+  bool clockSynced;               // Whether clockOffset is known
+  bool serverSpeaksMsgpack;       // Whether the last poll response was MessagePack
+  unsigned long authCount;        // Successful authentications since boot
+  bool requestActive;             // Whether a response is being read (timed until endRequest())
+  unsigned long requestStart;     // millis() when the current request started
+  MetricsEndpoint requestEndpoint;  // Endpoint of the current request
+  unsigned long pollReceivedAt;   // millis() when the last poll response arrived
+  uint32_t rejectedConfigVersion; // Drawer table version this board can't run (not requested again)
+
+  // Server address, resolved and connected by the connector so each phase can be timed
+  char serverHost[URL_BUFFER_SIZE];
+  uint16_t serverPort;
+
+  // Fixed per-endpoint buffers, so requests don't allocate on the heap
+  char healthUrl[URL_BUFFER_SIZE];
+  char authUrl[URL_BUFFER_SIZE];
+  char statusUrl[URL_BUFFER_SIZE];
+  char pollUrl[URL_BUFFER_SIZE];
+  char pollNowUrl[URL_BUFFER_SIZE];   // Poll that is never held open (during firmware downloads)
+  char firmwareUrl[URL_BUFFER_SIZE];  // Chunk of the release being downloaded (rebuilt per release)
+  char ackUrl[URL_BUFFER_SIZE];
+  char authPayload[AUTH_PAYLOAD_SIZE];
+  char statusPayload[Metrics::REPORT_MAX_SIZE];
+  char ackPayload[ACK_PAYLOAD_SIZE];
+
+  /**
+   * Build the URLs of every endpoint into their fixed buffers
+   */
+  void buildEndpointUrls() {
+    snprintf(healthUrl, sizeof(healthUrl), "%s%s", serverUrl, healthEndpoint);
+    snprintf(authUrl, sizeof(authUrl), "%s%s", serverUrl, authEndpoint);
+    snprintf(statusUrl, sizeof(statusUrl), "%s%s", serverUrl, statusEndpoint);
+    snprintf(ackUrl, sizeof(ackUrl), "%s%s", serverUrl, ackEndpoint);
+    Protocol::formatPollUrl(pollNowUrl, sizeof(pollNowUrl), serverUrl, device_id, MAX_BATCH_COMMANDS, 0);
+    Protocol::formatPollUrl(pollUrl, sizeof(pollUrl), serverUrl, device_id, MAX_BATCH_COMMANDS, LONG_POLL_SECONDS);
+    firmwareUrl[0] = '\0';
+
+    // "http://host:port/path" -> host, port
+    const char* host = strstr(serverUrl, "://");
+    host = host ? host + 3 : serverUrl;
+    size_t hostLength = strcspn(host, ":/");
+    snprintf(serverHost, sizeof(serverHost), "%.*s", (int)hostLength, host);
+    serverPort = host[hostLength] == ':' ? atoi(host + hostLength + 1) : (SERVER_TLS ? 443 : 80);
+  }
+
+  /**
+   * Map a request URL to the endpoint it is timed under
+   * @param url - One of the endpoint URL buffers
+   * @return the endpoint
+   */
+  MetricsEndpoint endpointOf(const char* url) {
+    if (url == pollUrl || url == pollNowUrl) return ENDPOINT_POLL;
+    if (url == ackUrl) return ENDPOINT_ACK;
+    if (url == authUrl) return ENDPOINT_AUTH;
+    if (url == statusUrl) return ENDPOINT_STATUS;
+    if (url == firmwareUrl) return ENDPOINT_FIRMWARE;
+    return ENDPOINT_HEALTH;
+  }
+
+  /**
+   * Open the socket to the server, timing name resolution and connect
+   * (HTTPClient then reuses the connected socket).
+   * With SERVER_TLS the connect phase includes the TLS handshake, which is
+   * given the host name so the certificate is checked against it.
+   * @param endpoint - Endpoint the connection is opened for
+   * @return true if connected
+   */
+  bool openConnection(MetricsEndpoint endpoint) {
+    unsigned long start = millis();
+    IPAddress address;
+    if (!WiFi.hostByName(serverHost, address)) {
+      LOG_ERROR("Failed to resolve %s", serverHost);
+      return false;
     }
+    unsigned long resolved = millis();
+    metrics.record(Metrics::requestHistogram(endpoint, PHASE_DNS), resolved - start);
+
+#if SERVER_TLS
+    // Resolved again from the lwIP DNS cache, the name is needed for SNI and certificate checks
+    if (!client.connect(serverHost, serverPort, HTTP_TIMEOUT_MS)) {
+      LOG_ERROR("TLS connection to %s:%u failed", serverHost, serverPort);
+      return false;
+    }
+#else
+    if (!client.connect(address, serverPort, HTTP_TIMEOUT_MS)) {
+      return false;
+    }
+#endif
+    metrics.record(Metrics::requestHistogram(endpoint, PHASE_CONNECT), millis() - resolved);
+    return true;
+  }
+
+  /**
+   * End the current request and record its total time
+   */
+  void endRequest() {
+    http.end();
+    if (requestActive) {
+      metrics.record(Metrics::requestHistogram(requestEndpoint, PHASE_TOTAL), millis() - requestStart);
+      requestActive = false;
+    }
+  }
+
+  /**
+   * Check if a JWT token is available
+   * @return true if authenticated
+   */
+  bool hasToken() {
+    return jwtToken[0] != '\0';
   }
 
   /**
-   * Send command execution confirmation to the server
-   * Uses the new tracking system with unique command codes
-   * @param commandCode - Unique code of the command to confirm as executed
+   * Store a new JWT token and rebuild the Authorization header
+   * @param token - Token characters (not necessarily null-terminated)
+   * @param length - Number of characters in the token
+   * @return true if stored, false if the token does not fit in the buffer
    */
-  void sendCommandConfirmation(const String commandCode) {
-    if (jwtToken == "") {
-      Serial.println("No token, skipping command confirmation...");
+  bool setToken(const char* token, size_t length) {
+    if (length == 0 || length >= sizeof(jwtToken)) {
+      return false;
+    }
+    memcpy(jwtToken, token, length);
+    jwtToken[length] = '\0';
+    snprintf(authHeader, sizeof(authHeader), "Bearer %s", jwtToken);
+    return true;
+  }
+
+  /**
+   * Schedule the next token refresh after a successful authentication
+   * The iat claim also gives the server time, and the token is cached
+   * in NVS for the next boot.
+   */
+  void scheduleTokenRefresh() {
+    long iat, exp;
+    if (!readTokenClaims(iat, exp)) {
+      LOG_WARN("Could not read token expiry, using default lifetime");
+      tokenExp = 0;
+      scheduleRefresh(TOKEN_DEFAULT_LIFETIME_SECONDS);
       return;
     }
 
-    HTTPClient http;
-    // New endpoint: POST /commands/:code/execute
-    String confirmUrl = String(serverUrl) + "/commands/" + commandCode + "/execute";
+    tokenExp = exp;
+    clockOffset = iat - (long)(millis() / 1000);
+    clockSynced = true;
+    scheduleRefresh(exp - iat);
 
-    if (http.begin(confirmUrl)) {
-      http.addHeader("Content-Type", "application/json");
-      http.addHeader("Authorization", "Bearer " + jwtToken);
+#if FAST_BOOT
+    Preferences prefs;
+    if (prefs.begin("auth", false)) {
+      prefs.putString("token", jwtToken);
+      prefs.putUInt("exp", (uint32_t)exp);
+      prefs.putUInt("slotInterval", (uint32_t)pollSlotInterval);
+      prefs.putUInt("slotOffset", (uint32_t)pollSlotOffset);
+      prefs.end();
+    }
+#endif
+  }
 
-      // Send POST request (empty body is fine for this endpoint)
-      String payload = "{}";
-      int code = http.POST(payload);
+  /**
+   * Schedule the next token refresh
+   * Refreshes TOKEN_REFRESH_MARGIN_SECONDS before expiry minus a random jitter,
+   * so the fleet's refreshes are spread apart (never later than half the validity).
+   * @param validFor - Seconds until the token expires
+   */
+  void scheduleRefresh(long validFor) {
+    long refreshIn = validFor - TOKEN_REFRESH_MARGIN_SECONDS - (long)(esp_random() % (TOKEN_REFRESH_JITTER_SECONDS + 1));
+    if (refreshIn < validFor / 2) {
+      refreshIn = validFor / 2;  // Short-lived token, refresh at half its validity
+    }
+    if (refreshIn < 0) {
+      refreshIn = 0;  // Already expired
+    }
 
-      if (code == 200) {
-        Serial.println("✓ Command marked as EXECUTED on server (code: " + commandCode + ")");
-      } else if (code == 401 || code == 403) {
-        Serial.println("Invalid/expired token. Reauthenticating...");
-        jwtToken = "";
-        authenticate();
-      } else if (code == 404) {
-        Serial.println("✗ Command not found on server (code: " + commandCode + ")");
-      } else if (code == 400) {
-        Serial.println("✗ Command already processed (code: " + commandCode + ")");
-        Serial.println("Response: " + http.getString());
-      } else {
-        Serial.printf("✗ Error confirming command (HTTP %d): ", code);
-        Serial.println(http.getString());
+    tokenRefreshAt = millis() + (unsigned long)refreshIn * 1000UL;
+    LOG_INFO("Token valid for %lds, refreshing in %lds", validFor, refreshIn);
+  }
+
+  /**
+   * Record the server time and reschedule the refresh of a cached token
+   * @param serverTime - Current server Unix time (0 if unknown)
+   */
+  void syncClock(long serverTime) {
+    if (serverTime <= 0) {
+      return;
+    }
+    clockOffset = serverTime - (long)(millis() / 1000);
+    clockSynced = true;
+    if (tokenExp > 0) {
+      scheduleRefresh(tokenExp - serverTime);
+    }
+  }
+
+  /**
+   * Decode the payload of the current JWT token and read its timestamps
+   * @param iat - Receives the issued-at claim (Unix time)
+   * @param exp - Receives the expiry claim (Unix time)
+   * @return true if both claims were read
+   */
+  bool readTokenClaims(long& iat, long& exp) {
+    const char* payloadStart = strchr(jwtToken, '.');
+    if (!payloadStart) {
+      return false;
+    }
+    payloadStart++;
+    const char* payloadEnd = strchr(payloadStart, '.');
+    if (!payloadEnd) {
+      return false;
+    }
+
+    char payload[TOKEN_PAYLOAD_SIZE];
+    int length = decodeBase64Url(payloadStart, payloadEnd - payloadStart, payload, sizeof(payload));
+    if (length < 0) {
+      return false;
+    }
+
+    StaticJsonDocument<TOKEN_CLAIMS_DOC_SIZE> claims;
+    if (deserializeJson(claims, payload, length)) {
+      return false;
+    }
+
+    exp = claims["exp"] | 0L;
+    iat = claims["iat"] | 0L;
+    return exp > 0 && iat > 0 && exp > iat;
+  }
+
+  /**
+   * Parse an HTTP Date header (RFC 7231 IMF-fixdate)
+   * Example: "Sun, 06 Nov 1994 08:49:37 GMT"
+   * @param date - Header value
+   * @return Unix time in seconds, 0 if the date can't be parsed
+   */
+  static long parseHttpDate(const char* date) {
+    int day, year, hour, minute, second;
+    char month[4];
+    if (sscanf(date, "%*3s, %d %3s %d %d:%d:%d", &day, month, &year, &hour, &minute, &second) != 6) {
+      return 0;
+    }
+    const char* months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    const char* found = strstr(months, month);
+    if (!found || strlen(month) != 3 || (found - months) % 3 != 0) {
+      return 0;
+    }
+    int mon = (found - months) / 3 + 1;
+
+    // Days since 1970-01-01 (civil calendar)
+    int y = year - (mon <= 2);
+    int era = y / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (mon + (mon > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    long days = (long)era * 146097 + doe - 719468;
+
+    return days * 86400L + hour * 3600L + minute * 60L + second;
+  }
+
+  /**
+   * Decode base64url (unpadded) text
+   * @param input - Encoded characters
+   * @param length - Number of encoded characters
+   * @param output - Receives the decoded bytes (null-terminated)
+   * @param outputSize - Size of the output buffer
+   * @return number of decoded bytes, or -1 on invalid input or overflow
+   */
+  static int decodeBase64Url(const char* input, size_t length, char* output, size_t outputSize) {
+    uint32_t buffer = 0;
+    int bits = 0;
+    size_t written = 0;
+
+    for (size_t i = 0; i < length; i++) {
+      char c = input[i];
+      int value;
+      if (c >= 'A' && c <= 'Z') value = c - 'A';
+      else if (c >= 'a' && c <= 'z') value = c - 'a' + 26;
+      else if (c >= '0' && c <= '9') value = c - '0' + 52;
+      else if (c == '-' || c == '+') value = 62;
+      else if (c == '_' || c == '/') value = 63;
+      else if (c == '=') break;
+      else return -1;
+
+      buffer = (buffer << 6) | value;
+      bits += 6;
+      if (bits >= 8) {
+        bits -= 8;
+        if (written + 1 >= outputSize) {
+          return -1;
+        }
+        output[written++] = (char)((buffer >> bits) & 0xFF);
       }
-      http.end();
-    } else {
-      Serial.println("✗ Failed to connect to confirmation endpoint");
     }
+
+    output[written] = '\0';
+    return (int)written;
   }
 
   /**
-   * Send command failure notification to the server
-   * Uses the new tracking system with unique command codes
-   * @param commandCode - Unique code of the command that failed
-   * @param errorMessage - Description of why the command failed
+   * Take the drawer table sent with the token, persist it and hand it to the actuation task
+   * A table is identified by its version: the one in use is ignored, one this board
+   * can't run (pin not able to drive a relay, too many drawers) is logged once and ignored.
+   * Example: {"v":3735928559,"pins":[32,33,26,27],"pulse":[500,500,500,800],"active":0}
+   * @param config - The config object of the authentication response
    */
-  void sendCommandFailure(const String commandCode, const String errorMessage) {
-    if (jwtToken == "") {
-      Serial.println("No token, skipping command failure report...");
+  void updateDrawerConfig(JsonVariant config) {
+    uint32_t version = config["v"] | 0UL;
+    if (version == 0 || version == drawerManager->getConfigVersion() || version == rejectedConfigVersion) {
       return;
     }
 
-    HTTPClient http;
-    // New endpoint: POST /commands/:code/fail
-    String failUrl = String(serverUrl) + "/commands/" + commandCode + "/fail";
+    DrawerConfig table;
+    memset(&table, 0, sizeof(table));
+    table.version = version;
+    table.activeLevel = (config["active"] | 0) ? HIGH : LOW;
+    JsonArray pins = config["pins"];
+    JsonArray pulse = config["pulse"];
+    bool accepted = pins.size() >= 1 && pins.size() <= DRAWER_MAX_COUNT && pulse.size() == pins.size();
+    if (accepted) {
+      table.count = pins.size();
+      for (int i = 0; i < table.count && accepted; i++) {
+        // Range-check before narrowing into the table (65537 would wrap to a 1 ms pulse)
+        long pin = pins[i] | -1L;
+        long width = pulse[i] | 0L;
+        accepted = pin >= 0 && pin <= INT8_MAX && width >= 1 && width <= DRAWER_PULSE_MAX_MS;
+        table.pins[i] = accepted ? (int8_t)pin : -1;
+        table.pulseMs[i] = accepted ? (uint16_t)width : 0;
+      }
+    }
+    if (!accepted || !DrawerConfigStore::isValid(table)) {
+      LOG_ERROR("Drawer table v%lu rejected: needs 1-%d distinct relay pins (0, 2, 4, 5, 12-19, 21-23, 25-27, 32, 33, "
+                "not a sensor pin) and widths of 1-%d ms",
+                (unsigned long)version, DRAWER_MAX_COUNT, DRAWER_PULSE_MAX_MS);
+      rejectedConfigVersion = version;
+      return;
+    }
 
-    if (http.begin(failUrl)) {
-      http.addHeader("Content-Type", "application/json");
-      http.addHeader("Authorization", "Bearer " + jwtToken);
+    if (!drawerManager->requestConfig(table)) {
+      LOG_WARN("Drawer table v%lu deferred, the previous one is not applied yet", (unsigned long)version);
+      return;
+    }
+    if (!DrawerConfigStore::save(table)) {
+      LOG_WARN("Drawer table v%lu not saved to NVS, the next boot uses the previous one", (unsigned long)version);
+    }
+    LOG_INFO("Drawer table v%lu received: %d drawers", (unsigned long)version, table.count);
+  }
 
-      // Send error message in the body
-      String payload = "{\"errorMessage\":\"" + errorMessage + "\"}";
-      int code = http.POST(payload);
+  /**
+   * Send one acknowledgement request (POST /commands/ack)
+   * @param results - Results to acknowledge
+   * @param count - Number of results
+   * @return whether the server applied them, or they must be replayed or split
+   */
+  AckOutcome postCommandAcks(const CommandResult* results, int count) {
+    if (!hasToken()) {
+      LOG_WARN("No token, skipping command acknowledgement...");
+      return ACK_RETRY;
+    }
 
-      if (code == 200) {
-        Serial.println("✓ Command marked as FAILED on server (code: " + commandCode + ")");
-        Serial.println("  Reason: " + errorMessage);
-      } else if (code == 401 || code == 403) {
-        Serial.println("Invalid/expired token. Reauthenticating...");
-        jwtToken = "";
-        authenticate();
-      } else if (code == 404) {
-        Serial.println("✗ Command not found on server (code: " + commandCode + ")");
-      } else if (code == 400) {
-        Serial.println("✗ Command already processed (code: " + commandCode + ")");
-        Serial.println("Response: " + http.getString());
-      } else {
-        Serial.printf("✗ Error reporting failure (HTTP %d): ", code);
-        Serial.println(http.getString());
+    // Build {"results":[{"code":"...","status":"EXECUTED"},{"code":"...","status":"FAILED","errorMessage":"..."}]}
+    StaticJsonDocument<ACK_DOC_SIZE> doc;
+    JsonArray entries = doc.createNestedArray("results");
+    for (int i = 0; i < count; i++) {
+      JsonObject entry = entries.createNestedObject();
+      entry["code"] = results[i].code;
+      entry["status"] = Protocol::ackStatus(results[i].success);
+      if (!results[i].success) {
+        entry["errorMessage"] = results[i].errorMessage;
       }
-      http.end();
+    }
+    // Acks are only sent as MessagePack once the server answered a poll in MessagePack,
+    // so a server that doesn't support it keeps receiving JSON
+    size_t length = serverSpeaksMsgpack ? measureMsgPack(doc) : measureJson(doc);
+    if (length >= sizeof(ackPayload) || doc.overflowed()) {
+      LOG_ERROR("✗ Acknowledgement payload too large, increase ACK_PAYLOAD_SIZE");
+      return ACK_REJECTED;  // Can never be sent as is
+    }
+    if (serverSpeaksMsgpack) {
+      serializeMsgPack(doc, ackPayload, sizeof(ackPayload));
+    } else {
+      serializeJson(doc, ackPayload, sizeof(ackPayload));
+    }
+
+    int code = sendRequest("POST", ackUrl, (const uint8_t*)ackPayload, length,
+                           serverSpeaksMsgpack ? MSGPACK_CONTENT_TYPE : "application/json", COMPACT_ACCEPT);
+
+    if (code == 200) {
+      LOG_INFO("✓ %d command result(s) acknowledged on server", count);
+      metrics.increment(COUNTER_COMMANDS_ACKED, count);
+      discardBody(false);  // Per-command details are not needed
+      return ACK_ACCEPTED;
+    } else if (code == 401 || code == 403) {
+      LOG_WARN("Invalid/expired token. Reauthenticating...");
+      discardBody(false);
+      clearToken();
+      authenticate();
+      return ACK_RETRY;  // Replayed from the journal with the new token
+    } else if (code == 400) {
+      // Malformed batch, retrying the same payload would fail forever
+      LOG_ERROR("✗ Acknowledgement rejected (HTTP %d)", code);
+      discardBody();
+      return ACK_REJECTED;
+    } else if (code > 0) {
+      LOG_ERROR("✗ Error acknowledging commands (HTTP %d)", code);
+      discardBody();
+      return ACK_RETRY;
     } else {
-      Serial.println("✗ Failed to connect to failure endpoint");
+      LOG_ERROR("✗ Failed to connect to acknowledgement endpoint");
     }
+    endRequest();
+    return ACK_RETRY;
   }
 
-private:
-  String jwtToken;               // Stores the JWT token
-  DrawerManager* drawerManager;  // Pointer to DrawerManager instance
+  /**
+   * Wait for the running relay pulses to end before writing to flash
+   * NVS writes suspend the flash cache of both cores, which holds back the
+   * timers ending the pulses and stretches them (up to DRAWER_PULSE_MAX_MS).
+   */
+  void waitForPulses() {
+    unsigned long start = millis();
+    while (drawerManager->isBusy() && millis() - start < DRAWER_PULSE_MAX_MS) {
+      vTaskDelay(1);
+    }
+  }
+
+  /**
+   * Forget the current JWT token (expired or rejected)
+   */
+  void clearToken() {
+    jwtToken[0] = '\0';
+    authHeader[0] = '\0';
+    tokenExp = 0;
+    tokenRefreshAt = millis() + TOKEN_RETRY_SECONDS * 1000UL;  // Retry delay if reauthentication fails
+  }
+
+  /**
+   * Parse the body of the current response straight from the socket and end the request
+   * The body is read through a BoundedStream, so at most MAX_RESPONSE_BODY_SIZE bytes
+   * are consumed and nothing is buffered besides the document itself.
+   * MessagePack is expected when the server answered in MessagePack.
+   * @param doc - Receives the parsed body
+   * @return true if the body was parsed, false if it was too large or invalid
+   */
+  bool parseBody(JsonDocument& doc) {
+    return parseBody(doc, NULL);
+  }
+
+  /**
+   * Parse a JSON body keeping only the fields set in the filter document
+   * @param doc - Receives the parsed body
+   * @param filter - Fields to keep (NULL = keep everything)
+   * @return true if the body was parsed, false if it was too large or invalid
+   */
+  bool parseBody(JsonDocument& doc, JsonDocument* filter) {
+    int size = http.getSize();  // -1 when the server didn't send Content-Length
+    if (size > MAX_RESPONSE_BODY_SIZE) {
+      LOG_ERROR("Response too large (%d bytes, max %d), dropping it", size, MAX_RESPONSE_BODY_SIZE);
+      closeConnection();
+      return false;
+    }
+
+    BoundedStream body(http.getStream(), size >= 0 ? size : MAX_RESPONSE_BODY_SIZE);
+    DeserializationError error;
+    if (http.header("Content-Type").startsWith(MSGPACK_CONTENT_TYPE)) {
+      error = deserializeMsgPack(doc, body);
+    } else if (filter) {
+      error = deserializeJson(doc, body, DeserializationOption::Filter(*filter));
+    } else {
+      error = deserializeJson(doc, body);
+    }
+
+    if (body.isTruncated()) {
+      LOG_ERROR("Response exceeds %d bytes, dropping it", MAX_RESPONSE_BODY_SIZE);
+      closeConnection();
+      return false;
+    }
+    // Release the connection before the next request (e.g. the acknowledgement)
+    discardBody(false);
+
+    if (error) {
+      LOG_ERROR("Error parsing response: %s", error.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  /**
+   * Skip the rest of the current response body and end the request
+   * Prints at most ERROR_BODY_SNIPPET_SIZE bytes of it (error pages can be kilobytes
+   * of HTML from a proxy). Small bodies are drained so the keep-alive connection can be
+   * reused, large or unknown-length ones close the connection instead of being read.
+   * @param logSnippet - Print the beginning of the body to Serial
+   */
+  void discardBody(bool logSnippet = true) {
+    int size = http.getSize();  // -1 when the server didn't send Content-Length
+    if (size < 0 || size > MAX_ERROR_DRAIN_SIZE) {
+      if (logSnippet) {
+        LOG_DEBUG("Response body skipped (%d bytes)", size);
+      }
+      closeConnection();
+      return;
+    }
+
+    char chunk[ERROR_BODY_SNIPPET_SIZE];
+    WiFiClient& stream = http.getStream();
+    bool first = true;
+    while (size > 0) {
+      size_t count = stream.readBytes(chunk, min(size, (int)sizeof(chunk) - 1));
+      if (count == 0) {
+        // Body didn't arrive in time, the connection can't be reused
+        closeConnection();
+        return;
+      }
+      if (first && logSnippet) {
+        chunk[count] = '\0';
+        LOG_WARN("Response: %s%s", chunk, (int)count < size ? "..." : "");
+      }
+      first = false;
+      size -= count;
+    }
+    endRequest();
+  }
+
+  /**
+   * Stream a firmware chunk response into the inactive partition
+   * A chunk cut short keeps the bytes already written, the next request resumes after them.
+   * @param offset - First byte requested
+   * @return true if the whole chunk was written
+   */
+  bool receiveFirmwareChunk(uint32_t offset) {
+    // Content-Range: bytes <first>-<last>/<image size>
+    unsigned long first = 0, last = 0, size = 0;
+    if (sscanf(http.header("Content-Range").c_str(), "bytes %lu-%lu/%lu", &first, &last, &size) != 3 || first != offset || last < first) {
+      LOG_ERROR("Firmware chunk with an unexpected range: %s", http.header("Content-Range").c_str());
+      closeConnection();
+      return false;
+    }
+    if (!ota->start(size, http.header(HEADER_FIRMWARE_MD5).c_str())) {
+      closeConnection();
+      return false;
+    }
+
+    uint8_t chunk[1024];
+    WiFiClient& stream = http.getStream();
+    size_t remaining = last - first + 1;
+    while (remaining > 0) {
+      size_t count = stream.readBytes(chunk, min(remaining, sizeof(chunk)));
+      if (count == 0 || !ota->write(chunk, count)) {
+        closeConnection();
+        return false;
+      }
+      remaining -= count;
+    }
+    endRequest();
+    return true;
+  }
+
+  /**
+   * End the current request and close the socket instead of returning it to keep-alive
+   * (used when the rest of the body is left unread)
+   */
+  void closeConnection() {
+    http.setReuse(false);
+    endRequest();
+    http.setReuse(true);
+  }
+
+  /**
+   * Check if an HTTP client error means the reused socket went stale
+   * (closed by the server, dropped by an AP roam, etc.)
+   * @param code - Result code returned by HTTPClient
+   * @return true if the request should be retried on a fresh connection
+   */
+  bool isStaleConnectionError(int code) {
+    return code == HTTPC_ERROR_SEND_HEADER_FAILED || code == HTTPC_ERROR_SEND_PAYLOAD_FAILED
+           || code == HTTPC_ERROR_NOT_CONNECTED || code == HTTPC_ERROR_CONNECTION_LOST;
+  }
+
+  /**
+   * Send a request over the persistent connection,
+   * reconnecting once if the kept-alive socket was dropped.
+   * The caller must read the response and call endRequest() afterwards.
+   * @param method - HTTP method ("GET", "POST", ...)
+   * @param url - Full request URL
+   * @param payload - JSON request body (empty for none)
+   * @param withAuth - Whether to send the Authorization header
+   * @return HTTP status code, or a negative HTTPClient error code
+   */
+  int sendRequest(const char* method, const char* url, const char* payload = "", bool withAuth = true) {
+    return sendRequest(method, url, (const uint8_t*)payload, strlen(payload), "application/json", NULL, withAuth);
+  }
+
+  /**
+   * Send a request with a binary body over the persistent connection
+   * @param method - HTTP method ("GET", "POST", ...)
+   * @param url - Full request URL
+   * @param payload - Request body (NULL for none)
+   * @param payloadLength - Number of bytes in the body
+   * @param contentType - Content-Type of the body
+   * @param accept - Accept header value (NULL for none)
+   * @param withAuth - Whether to send the Authorization header
+   * @param range - Range header value (NULL for the whole resource)
+   * @return HTTP status code, or a negative HTTPClient error code
+   */
+  int sendRequest(const char* method, const char* url, const uint8_t* payload, size_t payloadLength,
+                  const char* contentType, const char* accept, bool withAuth = true, const char* range = NULL) {
+
+    int code = HTTPC_ERROR_CONNECTION_REFUSED;
+    MetricsEndpoint endpoint = endpointOf(url);
+    unsigned long start = millis();
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+      bool reused = client.connected();
+      if (!reused && hasConnected) {
+        reconnectCount++;
+        metrics.increment(COUNTER_SERVER_RECONNECTS);
+        LOG_INFO("Reconnecting to server (reconnects: %lu)", reconnectCount);
+      }
+      if (!reused && !openConnection(endpoint)) {
+        client.stop();
+        break;
+      }
+
+      if (!http.begin(client, url)) {
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+      }
+      if (payloadLength > 0) {
+        http.addHeader("Content-Type", contentType);
+      }
+      if (accept) {
+        http.addHeader("Accept", accept);
+      }
+      if (withAuth && hasToken()) {
+        http.addHeader("Authorization", authHeader);
+      }
+      if (range) {
+        http.addHeader("Range", range);
+      }
+
+      unsigned long sent = millis();
+      code = http.sendRequest(method, (uint8_t*)payload, payloadLength);
+      if (code > 0) {
+        hasConnected = true;
+        metrics.record(Metrics::requestHistogram(endpoint, PHASE_TTFB), millis() - sent);
+        requestActive = true;
+        requestStart = start;
+        requestEndpoint = endpoint;
+        return code;
+      }
+
+      // Drop the socket so the next attempt opens a new one
+      http.end();
+      client.stop();
+
+      // Only a reused socket may have gone stale, a fresh one really failed
+      if (!reused || !isStaleConnectionError(code)) {
+        break;
+      }
+    }
+    metrics.increment(COUNTER_REQUEST_ERRORS);
+    return code;
+  }
 };
 
 #endif
@@ -0,0 +1,187 @@
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <esp_system.h>
+#include <esp_task_wdt.h>
+
+// Include config file
+#include "config.h"
+#include "metrics.h"
+#include "logger.h"
+
+#if TASK_WDT_TIMEOUT_S <= LONG_POLL_SECONDS + 5 + TLS_HANDSHAKE_TIMEOUT_S
+#error "TASK_WDT_TIMEOUT_S must be longer than a long-poll request (LONG_POLL_SECONDS + 5 s + TLS handshake)"
+#endif
+
+/**
+ * Why the supervisor restarted the device (restartCause gauge, kept in NVS across the restart)
+ */
+enum RestartCause : uint8_t {
+  RESTART_CAUSE_NONE = 0,     // Not a supervisor restart (power on, crash, watchdog: see the resetReason gauge)
+  RESTART_CAUSE_OFFLINE = 1,  // No successful poll for SUPERVISOR_OFFLINE_RESTART_MS
+  RESTART_CAUSE_UPDATE = 2,   // Firmware update installed (ota.h)
+};
+
+/**
+ * Recovery the network task must apply after a failed poll
+ */
+enum RecoveryAction : uint8_t {
+  RECOVERY_NONE,          // Retry with the poll backoff only
+  RECOVERY_RESET_SOCKET,  // Close the persistent connection, the next request opens a fresh one
+  RECOVERY_RESET_WIFI,    // Also drop the WiFi association and reconnect with a scan
+};
+
+/**
+ * Class to supervise the device health
+ * Hangs are caught by the task watchdog: the network and actuation tasks must
+ * feed it at least every TASK_WDT_TIMEOUT_S or the device restarts. Transient
+ * errors are degraded gracefully instead: failed polls back off (pollScheduler.h),
+ * then escalate to reopening the socket, then to reassociating WiFi, so a server
+ * blip never turns into a fleet-wide reboot and reconnect storm. Restarting is the
+ * last resort, after SUPERVISOR_OFFLINE_RESTART_MS without a successful poll.
+ *
+ * The reset reason of every boot and the cause of a supervisor restart are
+ * reported with the next metrics upload (resetReason / restartCause gauges,
+ * restarts counter).
+ */
+class Supervisor {
+public:
+  // Constructor
+  Supervisor() {
+    consecutiveFailures = 0;
+    lastSuccess = 0;
+  }
+
+  /**
+   * Configure the task watchdog and report why the device booted, call once from setup()
+   */
+  void begin() {
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+    esp_task_wdt_config_t config;
+    config.timeout_ms = TASK_WDT_TIMEOUT_S * 1000;
+    config.idle_core_mask = 0;  // Keep the idle tasks the sdkconfig already watches
+#if CONFIG_ESP_TASK_WDT_CHECK_IDLE_TASK_CPU0
+    config.idle_core_mask |= 1 << 0;
+#endif
+#if CONFIG_ESP_TASK_WDT_CHECK_IDLE_TASK_CPU1
+    config.idle_core_mask |= 1 << 1;
+#endif
+    config.trigger_panic = true;
+    if (esp_task_wdt_reconfigure(&config) != ESP_OK) {
+      esp_task_wdt_init(&config);
+    }
+#else
+    esp_task_wdt_init(TASK_WDT_TIMEOUT_S, true);
+#endif
+
+    esp_reset_reason_t reason = esp_reset_reason();
+    RestartCause cause = takeRestartCause();
+    metrics.setGauge(GAUGE_RESET_REASON, reason);
+    metrics.setGauge(GAUGE_RESTART_CAUSE, cause);
+    if (reason != ESP_RST_POWERON && reason != ESP_RST_DEEPSLEEP) {
+      metrics.increment(COUNTER_RESTARTS);
+      LOG_WARN("Supervisor: restarted (reset reason %d, cause %d)", (int)reason, (int)cause);
+    }
+    lastSuccess = millis();
+  }
+
+  /**
+   * Put the calling task under the task watchdog, it must call feed() from then on
+   */
+  void watch() {
+    esp_task_wdt_add(NULL);
+  }
+
+  /**
+   * Tell the task watchdog the calling task is alive
+   */
+  void feed() {
+    esp_task_wdt_reset();
+  }
+
+  /**
+   * Record a successful poll, leaving the degraded mode
+   * @param now - Current time in milliseconds (millis())
+   */
+  void onSuccess(unsigned long now) {
+    if (consecutiveFailures >= SUPERVISOR_SOCKET_RESET_ERRORS) {
+      LOG_INFO("Supervisor: recovered after %d failed polls", consecutiveFailures);
+    }
+    consecutiveFailures = 0;
+    lastSuccess = now;
+  }
+
+  /**
+   * Record a failed poll and pick the recovery for it
+   * @return RECOVERY_RESET_WIFI every SUPERVISOR_WIFI_RESET_ERRORS failures, RECOVERY_RESET_SOCKET
+   *         every SUPERVISOR_SOCKET_RESET_ERRORS failures in between, RECOVERY_NONE otherwise
+   */
+  RecoveryAction onFailure() {
+    consecutiveFailures++;
+    if (consecutiveFailures % SUPERVISOR_WIFI_RESET_ERRORS == 0) {
+      LOG_WARN("Supervisor: %d failed polls, reconnecting WiFi", consecutiveFailures);
+      metrics.increment(COUNTER_RECOVERIES);
+      return RECOVERY_RESET_WIFI;
+    }
+    if (consecutiveFailures % SUPERVISOR_SOCKET_RESET_ERRORS == 0) {
+      LOG_WARN("Supervisor: %d failed polls, reopening the server connection", consecutiveFailures);
+      metrics.increment(COUNTER_RECOVERIES);
+      return RECOVERY_RESET_SOCKET;
+    }
+    return RECOVERY_NONE;
+  }
+
+  /**
+   * Restart the device if it has been offline too long (last resort), call regularly from the network task
+   * @param now - Current time in milliseconds (millis())
+   */
+  void checkOffline(unsigned long now) {
+#if SUPERVISOR_OFFLINE_RESTART_MS > 0
+    if (now - lastSuccess >= SUPERVISOR_OFFLINE_RESTART_MS) {
+      LOG_ERROR("Supervisor: no successful poll for %lu s, restarting", (now - lastSuccess) / 1000);
+      restart(RESTART_CAUSE_OFFLINE);
+    }
+#else
+    (void)now;
+#endif
+  }
+
+  /**
+   * Restart the device, keeping the cause in NVS for the next metrics upload
+   * @param cause - Why the device restarts
+   */
+  void restart(RestartCause cause) {
+    Preferences prefs;
+    if (prefs.begin("supervisor", false)) {
+      prefs.putUChar("cause", cause);
+      prefs.end();
+    }
+    logger.flush();
+    ESP.restart();
+  }
+
+private:
+  int consecutiveFailures;    // Failed polls since the last successful one
+  unsigned long lastSuccess;  // millis() of the last successful poll
+
+  /**
+   * Read and clear the cause stored by restart()
+   * @return cause of the restart that led to this boot, RESTART_CAUSE_NONE if there was none
+   */
+  static RestartCause takeRestartCause() {
+    Preferences prefs;
+    if (!prefs.begin("supervisor", false)) {
+      return RESTART_CAUSE_NONE;
+    }
+    RestartCause cause = (RestartCause)prefs.getUChar("cause", RESTART_CAUSE_NONE);
+    if (cause != RESTART_CAUSE_NONE) {
+      prefs.putUChar("cause", RESTART_CAUSE_NONE);
+    }
+    prefs.end();
+    return cause;
+  }
+};
+
+#endif
@@ -3,12 +3,34 @@
 
 // Include necessary libraries
 #include <WiFi.h>
+#include <Preferences.h>
+#include <freertos/event_groups.h>
 
 // Include config file
 #include "config.h"
+#include "metrics.h"
+#include "logger.h"
+#include "power.h"
+
+/**
+ * Last good access point and DHCP lease, kept in NVS
+ */
+struct WiFiCache {
+  uint32_t magic;     // WIFI_CACHE_MAGIC when the entry is valid
+  uint8_t bssid[6];   // Access point MAC address
+  int32_t channel;    // Access point channel
+  uint32_t ip;        // DHCP lease
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+};
 
 /**
  * Class to manage WiFi connection
+ * Connection state comes from WiFi events, so waiting never busy-polls.
+ * With WIFI_FAST_RECONNECT the last access point (BSSID/channel) and
+ * DHCP lease are cached in NVS and tried first with a directed connect,
+ * a full scan is only done when the directed connect fails.
  */
 class WiFiManager {
 public:
@@ -16,43 +38,44 @@ public:
   WiFiManager() {
     // Initialize WiFi status
     connected = false;
+    initialized = false;
+    events = NULL;
+    attempt = ATTEMPT_NONE;
+    attemptStart = 0;
+    lastAttemptEnd = 0;
+    disconnectedAt = 0;
+    cacheValid = false;
+    memset(&cache, 0, sizeof(cache));
   }
 
   /**
-   * Connect to WiFi with retry logic,
-   * Try 20 times, 500ms interval until connected
+   * Connect to WiFi, blocking until connected or timed out
+   * Tries a directed connect to the cached access point first (WIFI_DIRECTED_TIMEOUT_MS),
+   * then a full scan (WIFI_SCAN_TIMEOUT_MS).
    * @return true if connected, false otherwise
    */
   bool connect() {
-    WiFi.disconnect(true);  // Disconnect and clear old config
-    delay(1000);
-
-    int retries = 0;
-    Serial.print("Connecting to WiFi...");
-    WiFi.mode(WIFI_STA);
-    WiFi.begin(ssid, password);
+    init();
 
-    // Retry connection
-    while (!isConnected() && retries < 20) {
-      delay(500);
-      Serial.print(".");
-      retries++;
+    LOG_INFO("Connecting to WiFi...");
+    if (cacheValid) {
+      startAttempt(ATTEMPT_DIRECTED);
+      if (waitForConnection(WIFI_DIRECTED_TIMEOUT_MS)) {
+        return onConnected();
+      }
+      LOG_WARN("Directed connect failed, scanning...");
     }
 
-    // Check if connected
-    if (isConnected()) {
-      Serial.println();
-      Serial.println("WiFi connected!");
-      Serial.print("IP: ");
-      Serial.println(WiFi.localIP());
-      connected = true;
-      return true;
-    } else {
-      Serial.println();
-      Serial.println("Failed to connect to WiFi!");
-      connected = false;
-      return false;
+    startAttempt(ATTEMPT_SCAN);
+    if (waitForConnection(WIFI_SCAN_TIMEOUT_MS)) {
+      return onConnected();
     }
+
+    LOG_ERROR("Failed to connect to WiFi!");
+    attempt = ATTEMPT_NONE;
+    lastAttemptEnd = millis();
+    connected = false;
+    return false;
   }
 
   /**
@@ -64,15 +87,62 @@ public:
   }
 
   /**
-   * Reconnect if disconnected
-   * @return true if connected or reconnected, false otherwise
+   * Reconnect if disconnected, without blocking
+   * Starts a connection attempt and returns right away, later calls
+   * advance the attempt (directed connect -> full scan -> retry delay).
+   * @return true if connected, false while (re)connecting
    */
   bool reconnectIfNeeded() {
-    if (!isConnected()) {
-      Serial.println("WiFi disconnected! trying to reconnect...");
-      return connect();
+    init();
+
+    if (isConnected()) {
+      if (attempt != ATTEMPT_NONE || !connected) {
+        onConnected();
+      }
+      return true;
     }
-    return true;
+
+    unsigned long now = millis();
+    if (connected) {
+      LOG_WARN("WiFi disconnected! trying to reconnect...");
+      connected = false;
+      disconnectedAt = now;
+      metrics.increment(COUNTER_WIFI_RECONNECTS);
+      lastAttemptEnd = now - WIFI_RETRY_DELAY_MS;  // Reconnect right away
+    }
+
+    if (attempt == ATTEMPT_NONE) {
+      if (now - lastAttemptEnd >= WIFI_RETRY_DELAY_MS) {
+        startAttempt(cacheValid ? ATTEMPT_DIRECTED : ATTEMPT_SCAN);
+      }
+      return false;
+    }
+
+    bool failed = (xEventGroupGetBits(events) & FAILED_BIT) != 0;
+    unsigned long timeout = attempt == ATTEMPT_DIRECTED ? WIFI_DIRECTED_TIMEOUT_MS : WIFI_SCAN_TIMEOUT_MS;
+    if (failed || now - attemptStart >= timeout) {
+      if (attempt == ATTEMPT_DIRECTED) {
+        LOG_WARN("Directed connect failed, scanning...");
+        startAttempt(ATTEMPT_SCAN);
+      } else {
+        LOG_ERROR("Failed to connect to WiFi!");
+        attempt = ATTEMPT_NONE;
+        lastAttemptEnd = now;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * Wait until WiFi is connected or the timeout expires
+   * Sleeps on the WiFi event group, wakes up as soon as an IP is obtained.
+   * @param timeoutMs - Maximum time to wait in milliseconds
+   * @return true if connected
+   */
+  bool waitForConnection(uint32_t timeoutMs) {
+    init();
+    EventBits_t bits = xEventGroupWaitBits(events, CONNECTED_BIT, pdFALSE, pdTRUE, pdMS_TO_TICKS(timeoutMs));
+    return (bits & CONNECTED_BIT) != 0;
   }
 
   /**
@@ -111,11 +181,170 @@ public:
   void disconnect() {
     WiFi.disconnect(true);
     connected = false;
-    Serial.println("WiFi disconnected.");
+    LOG_INFO("WiFi disconnected.");
+  }
+
+  /**
+   * Drop the association and let reconnectIfNeeded() connect again after a full scan
+   * (recovery for a link that stays associated but passes no traffic, e.g. a stuck AP)
+   */
+  void reassociate() {
+    LOG_WARN("WiFi: dropping the association to recover the link");
+    WiFi.disconnect(false);
+    cacheValid = false;  // The cached BSSID may be the stuck AP, rescan; the cache is saved again on connect
   }
 
 private:
-  bool connected;  // Track connection status
+  enum ConnectAttempt {
+    ATTEMPT_NONE,      // Idle (connected, or waiting WIFI_RETRY_DELAY_MS)
+    ATTEMPT_DIRECTED,  // Connecting to the cached BSSID/channel
+    ATTEMPT_SCAN,      // Connecting after a full scan
+  };
+
+  static const EventBits_t CONNECTED_BIT = BIT0;  // Station has an IP
+  static const EventBits_t FAILED_BIT = BIT1;     // Station disconnected during an attempt
+  static const uint32_t WIFI_CACHE_MAGIC = 0x57494649;
+
+  static WiFiManager* instance;  // Target of the WiFi event callback
+
+  bool connected;                 // Track connection status
+  bool initialized;               // Whether WiFi and the event handler are set up
+  EventGroupHandle_t events;      // CONNECTED_BIT / FAILED_BIT, set from WiFi events
+  ConnectAttempt attempt;         // Connection attempt in progress
+  unsigned long attemptStart;     // millis() when the attempt started
+  unsigned long lastAttemptEnd;   // millis() when the last attempt gave up
+  unsigned long disconnectedAt;   // millis() when the connection was lost (0 = not reconnecting)
+  WiFiCache cache;                // Last good access point and lease
+  bool cacheValid;                // Whether cache can be used for a directed connect
+
+  /**
+   * Set up the station and the event handler (once)
+   */
+  void init() {
+    if (initialized) {
+      return;
+    }
+    initialized = true;
+    instance = this;
+    events = xEventGroupCreate();
+
+    WiFi.persistent(false);         // Don't rewrite the WiFi config in flash on every begin()
+    WiFi.mode(WIFI_STA);
+    WiFi.setAutoReconnect(false);   // Reconnects are driven by reconnectIfNeeded()
+    WiFi.setSleep(PowerManager::wifiPowerSave());  // Modem sleep level for the latency budget
+    WiFi.onEvent(onWiFiEvent);
+
+#if WIFI_FAST_RECONNECT
+    loadCache();
+#endif
+  }
+
+  /**
+   * Start a connection attempt
+   * @param type - ATTEMPT_DIRECTED (cached access point) or ATTEMPT_SCAN
+   */
+  void startAttempt(ConnectAttempt type) {
+    xEventGroupClearBits(events, CONNECTED_BIT | FAILED_BIT);
+    attempt = type;
+    attemptStart = millis();
+
+    if (type == ATTEMPT_DIRECTED) {
+#if WIFI_USE_STATIC_IP
+      WiFi.config(staticIp, staticGateway, staticSubnet, staticDns);
+#elif WIFI_REUSE_DHCP_LEASE
+      // Reuse the previous lease to skip DHCP
+      WiFi.config(IPAddress(cache.ip), IPAddress(cache.gateway), IPAddress(cache.subnet), IPAddress(cache.dns));
+#endif
+      WiFi.begin(ssid, password, cache.channel, cache.bssid, true);
+    } else {
+#if WIFI_USE_STATIC_IP
+      WiFi.config(staticIp, staticGateway, staticSubnet, staticDns);
+#else
+      WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0));  // DHCP
+#endif
+      WiFi.begin(ssid, password);
+    }
+  }
+
+  /**
+   * Finish a successful attempt and remember the access point
+   * @return always true
+   */
+  bool onConnected() {
+    LOG_INFO("WiFi connected! IP: %s", WiFi.localIP().toString().c_str());
+    LOG_INFO("Connected in %lu ms (%s)", millis() - attemptStart, attempt == ATTEMPT_DIRECTED ? "directed" : "scan");
+    if (disconnectedAt != 0) {
+      metrics.record(HIST_WIFI_RECONNECT, millis() - disconnectedAt);
+      disconnectedAt = 0;
+    }
+    attempt = ATTEMPT_NONE;
+    connected = true;
+#if WIFI_FAST_RECONNECT
+    saveCache();
+#endif
+    return true;
+  }
+
+  /**
+   * Load the cached access point and lease from NVS
+   */
+  void loadCache() {
+    Preferences prefs;
+    if (!prefs.begin("wifi", true)) {
+      return;
+    }
+    cacheValid = prefs.getBytes("cache", &cache, sizeof(cache)) == sizeof(cache) && cache.magic == WIFI_CACHE_MAGIC;
+    prefs.end();
+  }
+
+  /**
+   * Store the current access point and lease in NVS
+   * Flash is only written when they changed.
+   */
+  void saveCache() {
+    WiFiCache current;
+    memset(&current, 0, sizeof(current));
+    current.magic = WIFI_CACHE_MAGIC;
+    uint8_t* bssid = WiFi.BSSID();
+    if (bssid) {
+      memcpy(current.bssid, bssid, sizeof(current.bssid));
+    }
+    current.channel = WiFi.channel();
+    current.ip = (uint32_t)WiFi.localIP();
+    current.gateway = (uint32_t)WiFi.gatewayIP();
+    current.subnet = (uint32_t)WiFi.subnetMask();
+    current.dns = (uint32_t)WiFi.dnsIP();
+
+    if (cacheValid && memcmp(&current, &cache, sizeof(cache)) == 0) {
+      return;
+    }
+
+    Preferences prefs;
+    if (!prefs.begin("wifi", false)) {
+      return;
+    }
+    prefs.putBytes("cache", &current, sizeof(current));
+    prefs.end();
+    cache = current;
+    cacheValid = true;
+  }
+
+  /**
+   * WiFi event callback (runs in the WiFi event task)
+   */
+  static void onWiFiEvent(arduino_event_id_t event, arduino_event_info_t info) {
+    if (!instance || !instance->events) {
+      return;
+    }
+    if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) {
+      xEventGroupSetBits(instance->events, CONNECTED_BIT);
+    } else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED) {
+      xEventGroupClearBits(instance->events, CONNECTED_BIT);
+      xEventGroupSetBits(instance->events, FAILED_BIT);
+    }
+  }
 };
 
+WiFiManager* WiFiManager::instance = NULL;
+
 #endif
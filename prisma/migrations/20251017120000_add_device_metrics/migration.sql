@@ -0,0 +1,3 @@
+-- AlterTable
+ALTER TABLE "DeviceStatus" ADD COLUMN "lastReport" DATETIME;
+ALTER TABLE "DeviceStatus" ADD COLUMN "metrics" TEXT;
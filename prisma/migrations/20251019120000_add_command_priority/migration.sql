@@ -0,0 +1,2 @@
+-- AlterTable
+ALTER TABLE "Command" ADD COLUMN "priority" INTEGER NOT NULL DEFAULT 0;
@@ -0,0 +1,16 @@
+-- CreateTable
+CREATE TABLE "Firmware" (
+    "id" TEXT NOT NULL PRIMARY KEY,
+    "version" TEXT NOT NULL,
+    "size" INTEGER NOT NULL,
+    "md5" TEXT NOT NULL,
+    "sha256" TEXT NOT NULL,
+    "data" BLOB NOT NULL,
+    "createdAt" DATETIME NOT NULL DEFAULT CURRENT_TIMESTAMP
+);
+
+-- CreateIndex
+CREATE UNIQUE INDEX "Firmware_version_key" ON "Firmware"("version");
+
+-- AlterTable
+ALTER TABLE "Device" ADD COLUMN "firmwareVersion" TEXT;
@@ -0,0 +1,517 @@
+/**
+ * Benchmark server for the ESP32 firmware (BENCHMARK_MODE in esp32-drawer/config.h)
+ *
+ * Speaks the part of the API the firmware uses (health, device auth, batched
+ * long-polling, batched acks and status/metrics reports) with scriptable latency,
+ * loss, errors and outages. Commands are generated at a fixed rate, and every
+ * BENCH_REPORT_INTERVAL_S it prints commands per minute, poll-to-ack latency,
+ * the device heap watermark and reconnect recovery time. It only uses the Node
+ * http module, so it runs without the database.
+ *
+ * Usage: BENCH_COMMANDS_PER_MIN=60 BENCH_DROP_RATE=0.02 npm run benchmark:server
+ */
+import http from 'http';
+import { Socket } from 'net';
+
+const envNumber = (name: string, fallback: number): number => {
+  const value = process.env[name];
+  const parsed = value === undefined || value === '' ? NaN : Number(value);
+  return isNaN(parsed) ? fallback : parsed;
+};
+
+const config = {
+  port: envNumber('BENCH_PORT', 3100),
+  latencyMs: envNumber('BENCH_LATENCY_MS', 20), // added before every response
+  jitterMs: envNumber('BENCH_JITTER_MS', 10), // random extra latency, 0..jitter
+  dropRate: envNumber('BENCH_DROP_RATE', 0), // fraction of requests reset without a response
+  errorRate: envNumber('BENCH_ERROR_RATE', 0), // fraction of requests answered with 503
+  commandsPerMinute: envNumber('BENCH_COMMANDS_PER_MIN', 30), // per authenticated device
+  drawers: envNumber('BENCH_DRAWERS', 4),
+  tokenTtlSeconds: envNumber('BENCH_TOKEN_TTL_S', 3600),
+  outageEverySeconds: envNumber('BENCH_OUTAGE_EVERY_S', 0), // 0 = no outages
+  outageSeconds: envNumber('BENCH_OUTAGE_S', 10), // every connection is reset during an outage
+  redeliverSeconds: envNumber('BENCH_REDELIVER_S', 30), // unacknowledged commands are handed out again after this
+  reportIntervalSeconds: envNumber('BENCH_REPORT_INTERVAL_S', 60),
+  durationSeconds: envNumber('BENCH_DURATION_S', 0), // 0 = run until Ctrl+C
+};
+
+const MAX_BODY_SIZE = 64 * 1024;
+const MAX_LONG_POLL_SECONDS = 60;
+
+/**
+ * Latency samples with exact percentiles
+ */
+class Samples {
+  private values: number[] = [];
+
+  add(value: number): void {
+    this.values.push(value);
+  }
+
+  get count(): number {
+    return this.values.length;
+  }
+
+  percentile(quantile: number): number | null {
+    if (this.values.length === 0) {
+      return null;
+    }
+    const sorted = [...this.values].sort((a, b) => a - b);
+    return sorted[Math.min(sorted.length - 1, Math.ceil(sorted.length * quantile) - 1)];
+  }
+}
+
+/**
+ * Counts of one measurement period (a report window or the whole run)
+ */
+class Period {
+  startedAt = Date.now();
+  requests = 0;
+  dropped = 0;
+  errors = 0;
+  issued = 0;
+  delivered = 0;
+  acked = 0;
+  failed = 0;
+  duplicateAcks = 0;
+  issueToAck = new Samples(); // command created until its ack arrived (includes the long-poll hold)
+  deliverToAck = new Samples(); // poll response sent until the ack arrived
+  recovery = new Samples(); // outage over until the device polled successfully again
+}
+
+/**
+ * Metrics reported by the device itself (POST /devices/status), summed over the run
+ */
+class DeviceReports {
+  reports = 0;
+  restarts = 0;
+  buckets: number[] = [];
+  histograms: Record<string, number[]> = {};
+  counters: Record<string, number> = {};
+  firstFreeHeap: number | null = null;
+  lastFreeHeap: number | null = null;
+  minFreeHeap: number | null = null;
+  lastUptimeMs = 0;
+
+  add(report: DeviceReport): void {
+    this.reports++;
+    if (typeof report.uptimeMs === 'number') {
+      if (report.uptimeMs < this.lastUptimeMs) {
+        this.restarts++;
+      }
+      this.lastUptimeMs = report.uptimeMs;
+    }
+
+    const gauges = report.gauges ?? {};
+    if (typeof gauges.freeHeap === 'number') {
+      this.firstFreeHeap ??= gauges.freeHeap;
+      this.lastFreeHeap = gauges.freeHeap;
+    }
+    if (typeof gauges.minFreeHeap === 'number' && gauges.minFreeHeap > 0) {
+      this.minFreeHeap =
+        this.minFreeHeap === null ? gauges.minFreeHeap : Math.min(this.minFreeHeap, gauges.minFreeHeap);
+    }
+
+    for (const [name, value] of Object.entries(report.counters ?? {})) {
+      this.counters[name] = (this.counters[name] ?? 0) + value;
+    }
+    if (Array.isArray(report.buckets)) {
+      this.buckets = report.buckets;
+    }
+    for (const [name, counts] of Object.entries(report.histograms ?? {})) {
+      const total = (this.histograms[name] ??= new Array(counts.length).fill(0));
+      counts.forEach((count, bucket) => (total[bucket] = (total[bucket] ?? 0) + count));
+    }
+  }
+
+  /**
+   * Upper bound of the bucket holding a quantile (null = overflow bucket or no data)
+   */
+  percentile(name: string, quantile: number): number | null {
+    const counts = this.histograms[name];
+    if (!counts) {
+      return null;
+    }
+    const target = Math.ceil(counts.reduce((sum, count) => sum + count, 0) * quantile);
+    let seen = 0;
+    for (let bucket = 0; bucket < counts.length; bucket++) {
+      seen += counts[bucket];
+      if (target > 0 && seen >= target) {
+        return bucket < this.buckets.length ? this.buckets[bucket] : null;
+      }
+    }
+    return null;
+  }
+}
+
+interface DeviceReport {
+  uptimeMs?: number;
+  gauges?: Record<string, number>;
+  counters?: Record<string, number>;
+  buckets?: number[];
+  histograms?: Record<string, number[]>;
+}
+
+interface BenchCommand {
+  code: string;
+  drawer: number;
+  createdAt: number;
+  deliveredAt: number | null;
+}
+
+interface DeviceState {
+  commands: BenchCommand[]; // created and not acknowledged yet
+  waiters: Set<() => void>; // long-polls waiting for a command
+  recovering: boolean; // an outage ended and the device has not polled successfully since
+}
+
+const devices = new Map<string, DeviceState>();
+const reports = new DeviceReports();
+const total = new Period();
+let current = new Period();
+let commandSequence = 0;
+let outageUntil = 0;
+let outageEndedAt = 0;
+
+const count = (update: (period: Period) => void) => {
+  update(total);
+  update(current);
+};
+
+/**
+ * Whether a command can be handed out: never delivered, or delivered and not acknowledged in time
+ */
+const isDeliverable = (command: BenchCommand, now: number) =>
+  command.deliveredAt === null || now - command.deliveredAt >= config.redeliverSeconds * 1000;
+
+const getDevice = (id: string): DeviceState => {
+  let device = devices.get(id);
+  if (!device) {
+    device = { commands: [], waiters: new Set(), recovering: false };
+    devices.set(id, device);
+  }
+  return device;
+};
+
+// ---------- Requests ----------
+
+const base64Url = (value: object) => Buffer.from(JSON.stringify(value)).toString('base64url');
+
+/**
+ * Unsigned JWT with the claims the firmware reads (sub, iat, exp)
+ */
+const issueToken = (deviceId: string): string => {
+  const iat = Math.floor(Date.now() / 1000);
+  const claims = { sub: deviceId, type: 'device', iat, exp: iat + config.tokenTtlSeconds };
+  return `${base64Url({ alg: 'none', typ: 'JWT' })}.${base64Url(claims)}.bench`;
+};
+
+/**
+ * Device id of a valid bearer token, null if missing or expired
+ */
+const authenticate = (req: http.IncomingMessage): string | null => {
+  const match = /^Bearer [^.]+\.([^.]+)\./.exec(req.headers.authorization ?? '');
+  if (!match) {
+    return null;
+  }
+  try {
+    const claims = JSON.parse(Buffer.from(match[1], 'base64url').toString());
+    return typeof claims.sub === 'string' && claims.exp * 1000 > Date.now() ? claims.sub : null;
+  } catch {
+    return null;
+  }
+};
+
+const sendJson = (res: http.ServerResponse, status: number, body: unknown) => {
+  const payload = JSON.stringify(body);
+  res.writeHead(status, { 'Content-Type': 'application/json', 'Content-Length': Buffer.byteLength(payload) });
+  res.end(payload);
+};
+
+const handleAuth = (res: http.ServerResponse, body: { device_id?: unknown; secret?: unknown }) => {
+  if (typeof body.device_id !== 'string' || typeof body.secret !== 'string') {
+    sendJson(res, 400, { error: 'Device ID and secret are required' });
+    return;
+  }
+  getDevice(body.device_id);
+  sendJson(res, 200, { token: issueToken(body.device_id) });
+};
+
+const handlePoll = (res: http.ServerResponse, deviceId: string, url: URL) => {
+  const device = getDevice(deviceId);
+  const max = Math.max(1, parseInt(url.searchParams.get('max') ?? '1', 10) || 1);
+  const wait = parseInt(url.searchParams.get('wait') ?? '0', 10) || 0;
+  const waitSeconds = Math.min(MAX_LONG_POLL_SECONDS, Math.max(0, wait));
+  if (waitSeconds > 0) {
+    res.setHeader('X-Long-Poll', String(waitSeconds));
+  }
+
+  const respond = () => {
+    const now = Date.now();
+    const batch = device.commands.filter((command) => isDeliverable(command, now)).slice(0, max);
+
+    if (device.recovering) {
+      device.recovering = false;
+      count((period) => period.recovery.add(now - outageEndedAt));
+    }
+
+    if (batch.length === 0) {
+      res.writeHead(204).end();
+      return;
+    }
+    for (const command of batch) {
+      command.deliveredAt = now;
+    }
+    count((period) => (period.delivered += batch.length));
+    if (batch.length >= max) {
+      res.setHeader('X-Poll-Interval', '0');
+    }
+    sendJson(res, 200, {
+      commands: batch.map(({ code, drawer }) => ({ action: 'open', drawer, code })),
+      count: batch.length,
+    });
+  };
+
+  if (waitSeconds === 0 || device.commands.some((command) => isDeliverable(command, Date.now()))) {
+    respond();
+    return;
+  }
+
+  // Long-poll: answer as soon as a command is created or the wait expires
+  const wake = () => {
+    clearTimeout(timer);
+    device.waiters.delete(wake);
+    if (!res.writableEnded && !res.destroyed) {
+      respond();
+    }
+  };
+  const timer = setTimeout(wake, waitSeconds * 1000);
+  device.waiters.add(wake);
+  res.on('close', () => {
+    clearTimeout(timer);
+    device.waiters.delete(wake);
+  });
+};
+
+const handleAck = (res: http.ServerResponse, deviceId: string, body: { results?: unknown }) => {
+  if (!Array.isArray(body.results) || body.results.length === 0) {
+    sendJson(res, 400, { success: false, error: 'Invalid acknowledgements' });
+    return;
+  }
+
+  const device = getDevice(deviceId);
+  const now = Date.now();
+  for (const result of body.results as { code?: string; status?: string }[]) {
+    const index = device.commands.findIndex((command) => command.code === result.code);
+    if (index < 0) {
+      count((period) => period.duplicateAcks++);
+      continue;
+    }
+    const [command] = device.commands.splice(index, 1);
+    count((period) => {
+      period.acked++;
+      period.failed += result.status === 'EXECUTED' ? 0 : 1;
+      period.issueToAck.add(now - command.createdAt);
+      if (command.deliveredAt !== null) {
+        period.deliverToAck.add(now - command.deliveredAt);
+      }
+    });
+  }
+  sendJson(res, 200, { success: true, message: 'Command acknowledgements processed' });
+};
+
+const handleStatus = (res: http.ServerResponse, body: DeviceReport) => {
+  reports.add(body);
+  sendJson(res, 200, { success: true, message: 'Device status updated' });
+};
+
+const route = (req: http.IncomingMessage, res: http.ServerResponse, rawBody: string) => {
+  const url = new URL(req.url ?? '/', 'http://localhost');
+  const path = url.pathname.replace(/^\/api\/v1/, '');
+  let body: Record<string, unknown> = {};
+  if (rawBody.length > 0) {
+    try {
+      body = JSON.parse(rawBody);
+    } catch {
+      sendJson(res, 400, { error: 'Invalid JSON body' });
+      return;
+    }
+  }
+
+  if (req.method === 'GET' && path === '/health') {
+    sendJson(res, 200, { status: 'ok', message: 'SmartDrawer benchmark server' });
+    return;
+  }
+  if (req.method === 'POST' && path === '/auth/device') {
+    handleAuth(res, body);
+    return;
+  }
+
+  const deviceId = authenticate(req);
+  const poll = /^\/devices\/([^/]+)\/next-commands$/.exec(path);
+  if ((poll || path === '/commands/ack' || path === '/devices/status') && !deviceId) {
+    sendJson(res, 401, { error: 'Invalid or expired token' });
+    return;
+  }
+  if (req.method === 'GET' && poll && deviceId) {
+    handlePoll(res, decodeURIComponent(poll[1]), url);
+  } else if (req.method === 'POST' && path === '/commands/ack' && deviceId) {
+    handleAck(res, deviceId, body);
+  } else if (req.method === 'POST' && path === '/devices/status') {
+    handleStatus(res, body as DeviceReport);
+  } else {
+    sendJson(res, 404, { error: 'Not found' });
+  }
+};
+
+const server = http.createServer((req, res) => {
+  const chunks: Buffer[] = [];
+  let size = 0;
+  req.on('data', (chunk: Buffer) => {
+    size += chunk.length;
+    if (size > MAX_BODY_SIZE) {
+      req.socket.destroy();
+      return;
+    }
+    chunks.push(chunk);
+  });
+  req.on('end', () => {
+    count((period) => period.requests++);
+    const delay = config.latencyMs + Math.random() * config.jitterMs;
+    setTimeout(() => {
+      if (Date.now() < outageUntil || Math.random() < config.dropRate) {
+        count((period) => period.dropped++);
+        req.socket.destroy();
+      } else if (Math.random() < config.errorRate) {
+        count((period) => period.errors++);
+        sendJson(res, 503, { error: 'Injected error' });
+      } else {
+        route(req, res, Buffer.concat(chunks).toString());
+      }
+    }, delay);
+  });
+});
+
+// Same keep-alive as the real server (src/config/http.ts), the firmware reuses its socket
+server.keepAliveTimeout = 65000;
+server.headersTimeout = 66000;
+
+// ---------- Scripted load and outages ----------
+
+const sockets = new Set<Socket>();
+server.on('connection', (socket: Socket) => {
+  if (Date.now() < outageUntil) {
+    socket.destroy();
+    return;
+  }
+  sockets.add(socket);
+  socket.on('close', () => sockets.delete(socket));
+});
+
+const issueCommands = () => {
+  for (const device of devices.values()) {
+    device.commands.push({
+      code: `BENCH${(++commandSequence).toString(36).toUpperCase().padStart(6, '0')}`,
+      drawer: 1 + (commandSequence % config.drawers),
+      createdAt: Date.now(),
+      deliveredAt: null,
+    });
+    count((period) => period.issued++);
+    for (const wake of [...device.waiters]) {
+      wake();
+    }
+  }
+};
+
+const startOutage = () => {
+  console.log(`[bench] outage for ${config.outageSeconds} s, resetting ${sockets.size} connection(s)`);
+  outageUntil = Date.now() + config.outageSeconds * 1000;
+  for (const socket of sockets) {
+    socket.destroy();
+  }
+  setTimeout(() => {
+    outageEndedAt = Date.now();
+    for (const device of devices.values()) {
+      device.recovering = true;
+    }
+  }, config.outageSeconds * 1000);
+};
+
+// ---------- Reports ----------
+
+const formatMs = (value: number | null) => (value === null ? '-' : `${Math.round(value)} ms`);
+
+const formatElapsed = (ms: number) => {
+  const seconds = Math.floor(ms / 1000);
+  const pad = (value: number) => String(value).padStart(2, '0');
+  return `${pad(Math.floor(seconds / 3600))}:${pad(Math.floor(seconds / 60) % 60)}:${pad(seconds % 60)}`;
+};
+
+const summarize = (period: Period) => ({
+  elapsed: formatElapsed(Date.now() - total.startedAt),
+  commandsPerMinute: Number(((period.acked * 60000) / Math.max(1, Date.now() - period.startedAt)).toFixed(1)),
+  issued: period.issued,
+  delivered: period.delivered,
+  acked: period.acked,
+  failed: period.failed,
+  duplicateAcks: period.duplicateAcks,
+  pending: [...devices.values()].reduce((sum, device) => sum + device.commands.length, 0),
+  pollToAck: { p50: period.deliverToAck.percentile(0.5), p99: period.deliverToAck.percentile(0.99) },
+  issueToAck: { p50: period.issueToAck.percentile(0.5), p99: period.issueToAck.percentile(0.99) },
+  recovery: {
+    count: period.recovery.count,
+    p50: period.recovery.percentile(0.5),
+    p99: period.recovery.percentile(0.99),
+  },
+  requests: period.requests,
+  dropped: period.dropped,
+  errors: period.errors,
+  device: {
+    reports: reports.reports,
+    restarts: reports.restarts,
+    minFreeHeap: reports.minFreeHeap,
+    freeHeap: reports.lastFreeHeap,
+    freeHeapDrift:
+      reports.firstFreeHeap === null || reports.lastFreeHeap === null
+        ? null
+        : reports.lastFreeHeap - reports.firstFreeHeap,
+    pollToAck: { p50: reports.percentile('pollToAck', 0.5), p99: reports.percentile('pollToAck', 0.99) },
+    wifiReconnect: { p50: reports.percentile('wifiReconnect', 0.5), p99: reports.percentile('wifiReconnect', 0.99) },
+    counters: reports.counters,
+  },
+});
+
+const printWindow = () => {
+  const s = summarize(current);
+  console.log(
+    `[bench ${s.elapsed}] ${s.commandsPerMinute} cmd/min` +
+      ` | acked ${s.acked}/${s.issued} (failed ${s.failed}, dup ${s.duplicateAcks}, pending ${s.pending})` +
+      ` | poll-to-ack p50 ${formatMs(s.pollToAck.p50)} p99 ${formatMs(s.pollToAck.p99)}` +
+      ` | recovery ${s.recovery.count ? `p50 ${formatMs(s.recovery.p50)} p99 ${formatMs(s.recovery.p99)}` : '-'}` +
+      ` | heap min ${s.device.minFreeHeap ?? '-'} free ${s.device.freeHeap ?? '-'} | restarts ${s.device.restarts}` +
+      ` | requests ${s.requests} dropped ${s.dropped} errors ${s.errors}`,
+  );
+  current = new Period();
+};
+
+const finish = () => {
+  printWindow();
+  console.log(JSON.stringify({ config, total: summarize(total) }, null, 2));
+  process.exit(0);
+};
+
+server.listen(config.port, () => {
+  console.log(`[bench] listening on port ${config.port}`, config);
+});
+
+if (config.commandsPerMinute > 0) {
+  setInterval(issueCommands, 60000 / config.commandsPerMinute);
+}
+if (config.outageEverySeconds > 0) {
+  setInterval(startOutage, config.outageEverySeconds * 1000);
+}
+setInterval(printWindow, config.reportIntervalSeconds * 1000);
+if (config.durationSeconds > 0) {
+  setTimeout(finish, config.durationSeconds * 1000);
+}
+process.on('SIGINT', finish);
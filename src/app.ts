@@ -1,13 +1,16 @@
 import express from 'express';
 import cors from 'cors';
-import { json } from 'body-parser';
+import { json, raw } from 'body-parser';
 import devicesRoutes from './routes/devices/devices.routes';
 import commandsRoutes from './routes/commands/commands.routes';
+import firmwareRoutes from './routes/firmware/firmware.routes';
 import healthRoutes from './routes/health.routes';
 import { setupSwagger } from './config/swagger';
 import Logger, { logInitialConfig } from './logger/logger';
 import morganMiddleware from './logger/morganMiddleware';
 import authRoutes from './routes/auth.routes';
+import { msgpackNegotiation } from './middleware/msgpack';
+import { MSGPACK_CONTENT_TYPE } from './utils/msgpack';
 //import jwt from 'jsonwebtoken';
 
 /**
@@ -21,6 +24,8 @@ logInitialConfig(Logger);
 // Middlewares
 app.use(cors());
 app.use(json());
+app.use(raw({ type: MSGPACK_CONTENT_TYPE, limit: '16kb' }));
+app.use(msgpackNegotiation);
 
 // Morgan middleware
 app.use(morganMiddleware);
@@ -38,6 +43,7 @@ Logger.info('App initialized');
 // rotas principais
 app.use('/api/v1/devices', devicesRoutes);
 app.use('/api/v1/commands', commandsRoutes);
+app.use('/api/v1/firmware', firmwareRoutes);
 app.use('/api/v1/auth', authRoutes);
 app.use('/api/v1', healthRoutes);
 
@@ -0,0 +1,11 @@
+/**
+ * Largest firmware image accepted by POST /firmware (bytes).
+ * Must fit the device's OTA app partition (1.25 MB with the default ESP32 partition table).
+ */
+export const FIRMWARE_MAX_SIZE = process.env.FIRMWARE_MAX_SIZE ? parseInt(process.env.FIRMWARE_MAX_SIZE, 10) : 2 * 1024 * 1024;
+
+/**
+ * Largest part served by one Range request of GET /firmware/download (bytes).
+ * Devices ask for OTA_CHUNK_SIZE bytes, larger ranges are cut to this size.
+ */
+export const FIRMWARE_MAX_CHUNK = process.env.FIRMWARE_MAX_CHUNK ? parseInt(process.env.FIRMWARE_MAX_CHUNK, 10) : 65536;
@@ -0,0 +1,9 @@
+/**
+ * How long (ms) an idle keep-alive connection stays open.
+ * Devices keep one persistent socket (TLS in production), so this must outlast the
+ * longest idle poll interval of the firmware (POLL_IDLE_MAX_MS, 60 s), otherwise
+ * every idle poll pays a new TCP/TLS handshake. Node's default is only 5 s.
+ */
+export const HTTP_KEEP_ALIVE_TIMEOUT_MS = process.env.HTTP_KEEP_ALIVE_TIMEOUT_MS
+  ? parseInt(process.env.HTTP_KEEP_ALIVE_TIMEOUT_MS, 10)
+  : 65000;
@@ -0,0 +1,25 @@
+/**
+ * Poll interval (ms) suggested to idle devices through the X-Poll-Interval header.
+ * Unset = devices use their own adaptive backoff.
+ */
+export const DEVICE_IDLE_POLL_INTERVAL_MS = process.env.DEVICE_IDLE_POLL_INTERVAL_MS
+  ? parseInt(process.env.DEVICE_IDLE_POLL_INTERVAL_MS, 10)
+  : undefined;
+
+/**
+ * Maximum number of pending commands kept in memory per device (PendingCommandIndex).
+ * Larger backlogs stay in the database and are loaded as the in-memory ones drain.
+ */
+export const PENDING_INDEX_MAX_PER_DEVICE = process.env.PENDING_INDEX_MAX_PER_DEVICE
+  ? parseInt(process.env.PENDING_INDEX_MAX_PER_DEVICE, 10)
+  : 100;
+
+/**
+ * Interval (ms) of the poll slots assigned to devices with their token.
+ * Each device gets a stable phase inside the interval (derived from its ID), so a fleet
+ * that boots together spreads its polls instead of polling in lockstep. Long-poll holds
+ * are aligned the same way. 0 disables slots.
+ */
+export const DEVICE_POLL_SLOT_INTERVAL_MS = process.env.DEVICE_POLL_SLOT_INTERVAL_MS
+  ? parseInt(process.env.DEVICE_POLL_SLOT_INTERVAL_MS, 10)
+  : 30000;
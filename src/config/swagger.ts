@@ -55,6 +55,10 @@ const options = {
         name: 'Authentication',
         description: 'Device authentication operations',
       },
+      {
+        name: 'Firmware',
+        description: 'Over-the-air firmware releases',
+      },
     ],
     security: [
       {
@@ -110,6 +114,18 @@ const options = {
               description: 'Number of drawers this device has',
               example: 4,
             },
+            drawerConfig: {
+              type: 'string',
+              nullable: true,
+              description: 'Drawer hardware table as JSON (see PUT /devices/{id}/config), null when the firmware defaults apply',
+              example: '{"pins":[32,33,26,27],"pulseMs":[500,500,800,500],"activeLevel":0}',
+            },
+            firmwareVersion: {
+              type: 'string',
+              nullable: true,
+              description: 'Firmware release last reported by the device (FIRMWARE_VERSION)',
+              example: '1.0.0',
+            },
             createdAt: {
               type: 'string',
               format: 'date-time',
@@ -301,6 +317,13 @@ const options = {
               description: 'Command to be executed',
               example: 'turn_on',
             },
+            priority: {
+              type: 'integer',
+              minimum: 0,
+              maximum: 9,
+              description: 'Delivery priority, pending commands are sent highest priority first, then oldest',
+              example: 0,
+            },
             status: {
               type: 'string',
               enum: ['PENDING', 'EXECUTED', 'FAILED'],
@@ -341,6 +364,39 @@ const options = {
             },
           },
         },
+        Firmware: {
+          type: 'object',
+          properties: {
+            id: {
+              type: 'string',
+              example: 'clxfw0001',
+            },
+            version: {
+              type: 'string',
+              description: 'Release name (FIRMWARE_VERSION of the image)',
+              example: '1.1.0',
+            },
+            size: {
+              type: 'integer',
+              description: 'Image size in bytes',
+              example: 1048576,
+            },
+            md5: {
+              type: 'string',
+              description: 'Image MD5, checked by the device before activating it',
+              example: '9e107d9d372bb6826bd81d3542a419d6',
+            },
+            sha256: {
+              type: 'string',
+              example: 'd7a8fbb307d7809469ca9abcb0082e4f8d5651e46d3cdb762d02d0bf37c9e592',
+            },
+            createdAt: {
+              type: 'string',
+              format: 'date-time',
+              example: '2025-10-20T12:00:00.000Z',
+            },
+          },
+        },
         Error: {
           type: 'object',
           required: ['success', 'error'],
@@ -2,9 +2,17 @@ import { DevicesRepository } from './repositories/devices/DevicesRepository';
 import { DevicesService } from './services/devices/DevicesService';
 import { CommandsRepository } from './repositories/commands/CommandsRepository';
 import { CommandsService } from './services/commands/CommandsService';
+import { CommandNotifier } from './services/commands/CommandNotifier';
+import { PendingCommandIndex } from './services/commands/PendingCommandIndex';
+import { FirmwareRepository } from './repositories/firmware/FirmwareRepository';
+import { FirmwareService } from './services/firmware/FirmwareService';
 
 // Instâncias únicas para todo o app
 export const devicesRepository = new DevicesRepository();
 export const commandsRepository = new CommandsRepository();
-export const commandsService = new CommandsService(commandsRepository);
-export const devicesService = new DevicesService(devicesRepository, commandsService);
+export const commandNotifier = new CommandNotifier();
+export const pendingCommandIndex = new PendingCommandIndex(commandsRepository);
+export const commandsService = new CommandsService(commandsRepository, commandNotifier, pendingCommandIndex);
+export const firmwareRepository = new FirmwareRepository();
+export const firmwareService = new FirmwareService(firmwareRepository);
+export const devicesService = new DevicesService(devicesRepository, commandsService, firmwareService);
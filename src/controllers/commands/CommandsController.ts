@@ -181,6 +181,45 @@ export class CommandsController {
     }
   };
 
+  /**
+   * Acknowledge a batch of command executions
+   * POST /commands/ack
+   */
+  acknowledgeCommands = async (req: Request, res: Response): Promise<void> => {
+    const acks = req.body?.results;
+    this.logger.info('POST /commands/ack called', { count: Array.isArray(acks) ? acks.length : 0 });
+
+    try {
+      const results = await this.commandsService.acknowledgeCommands(acks);
+
+      res.status(200).json({
+        message: 'Command acknowledgements processed',
+        applied: results.filter((result) => result.success).length,
+        rejected: results.filter((result) => !result.success).length,
+        results,
+      });
+    } catch (error) {
+      this.logger.error('Error acknowledging commands', {
+        error: error instanceof Error ? error.message : 'Unknown error',
+      });
+
+      const errorMessage = error instanceof Error ? error.message : 'Unknown error';
+
+      if (errorMessage.includes('Invalid acknowledgements')) {
+        res.status(400).json({
+          error: 'Invalid request',
+          message: errorMessage,
+        });
+        return;
+      }
+
+      res.status(500).json({
+        error: 'Internal server error',
+        message: 'Failed to acknowledge commands',
+      });
+    }
+  };
+
   /**
    * Get all commands for a device
    * GET /commands/device/:deviceId
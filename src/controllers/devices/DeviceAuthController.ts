@@ -71,7 +71,11 @@ export class DeviceAuthController {
       //const token = jwt.sign({ sub: device.id, type: 'device' }, JWT_SECRET, { expiresIn: '1h' });
 
       this.logger.info('Device authenticated successfully', { device_id: device.id });
-      res.json({ token });
+      // Slot for idle polls, spreads the fleet's polls over the interval
+      const poll = devicesService.getPollSlot(device.id);
+      // Drawer hardware table, cached by the device and reapplied when its version changes
+      const config = devicesService.getDeviceConfigBlob(device);
+      res.json({ token, ...(poll && { poll }), ...(config && { config }) });
     } catch (error) {
       this.logger.error('Authentication error', {
         device_id,
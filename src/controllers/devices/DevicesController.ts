@@ -1,7 +1,16 @@
 import { Request, Response } from 'express';
 import { DevicesService } from '../../services/devices/DevicesService';
-import { CreateDeviceDto, UpdateDeviceDto, DeviceStatus, CommandDto } from '../../types/devices.types';
+import {
+  CreateDeviceDto,
+  UpdateDeviceDto,
+  DeviceStatus,
+  CommandDto,
+  DeviceMetricsReport,
+  DrawerConfig,
+} from '../../types/devices.types';
+import { AuthenticatedRequest } from '../../middleware/deviceAuth';
 import Logger from '../../logger/logger';
+import { DEVICE_IDLE_POLL_INTERVAL_MS } from '../../config/polling';
 
 /**
  * DevicesController
@@ -14,6 +23,12 @@ export class DevicesController {
   private devicesService: DevicesService;
   private logger = Logger.child({ component: 'DevicesController' });
 
+  /** Maximum time (in seconds) a long-poll request may be held open */
+  private static readonly MAX_LONG_POLL_SECONDS = 30;
+
+  /** Maximum number of commands returned by a batched poll */
+  private static readonly MAX_BATCH_COMMANDS = 10;
+
   /**
    * Constructor - Injects the DevicesService dependency
    * @param devicesService - The service to handle business logic
@@ -416,18 +431,40 @@ export class DevicesController {
   /**
    * GET /devices/:id/next-command
    * Dispositivo faz polling para buscar próximo comando
+   * Com ?wait=N o servidor segura a requisição por até N segundos (long-polling)
    */
   getNextCommand = async (req: Request, res: Response): Promise<void> => {
     try {
       const { id } = req.params;
+      const waitSeconds = this.parseLongPollWait(req.query.wait);
 
       // Atualiza a ultima verificação de comandos do dispositivo
       this.devicesService.updateLastPoll(id);
 
+      // Cancela a espera se o dispositivo desconectar
+      const abortController = new AbortController();
+      res.on('close', () => abortController.abort());
+
+      if (waitSeconds > 0) {
+        // Informa ao dispositivo que o long-polling é suportado
+        res.setHeader('X-Long-Poll', String(waitSeconds));
+      }
+
       // Aqui você busca o próximo comando pendente para o dispositivo
-      const command = await this.devicesService.getNextCommandForDevice(id);
+      const command = await this.devicesService.getNextCommandForDevice(
+        id,
+        this.devicesService.getLongPollHoldMs(id, waitSeconds),
+        abortController.signal,
+      );
+
+      if (res.writableEnded || abortController.signal.aborted) {
+        return;
+      }
+      this.setConfigVersion(res, id);
+      this.setFirmwareVersion(res);
 
       if (!command) {
+        this.setPollIntervalHint(res, DEVICE_IDLE_POLL_INTERVAL_MS);
         res.status(204).send(); // Sem comando pendente
         return;
       }
@@ -442,6 +479,126 @@ export class DevicesController {
     }
   };
 
+  /**
+   * GET /devices/:id/next-commands
+   * Dispositivo busca vários comandos pendentes em uma única requisição (?max=N),
+   * aceitando o mesmo ?wait=N do long-polling
+   */
+  getNextCommands = async (req: Request, res: Response): Promise<void> => {
+    try {
+      const { id } = req.params;
+      const waitSeconds = this.parseLongPollWait(req.query.wait);
+      const max = this.parseBatchMax(req.query.max);
+
+      // Atualiza a ultima verificação de comandos do dispositivo
+      this.devicesService.updateLastPoll(id);
+
+      // Cancela a espera se o dispositivo desconectar
+      const abortController = new AbortController();
+      res.on('close', () => abortController.abort());
+
+      if (waitSeconds > 0) {
+        // Informa ao dispositivo que o long-polling é suportado
+        res.setHeader('X-Long-Poll', String(waitSeconds));
+      }
+
+      const commands = await this.devicesService.getNextCommandsForDevice(
+        id,
+        max,
+        this.devicesService.getLongPollHoldMs(id, waitSeconds),
+        abortController.signal,
+      );
+
+      if (res.writableEnded || abortController.signal.aborted) {
+        return;
+      }
+      this.setConfigVersion(res, id);
+      this.setFirmwareVersion(res);
+
+      if (commands.length === 0) {
+        this.setPollIntervalHint(res, DEVICE_IDLE_POLL_INTERVAL_MS);
+        res.status(204).send(); // Sem comandos pendentes
+        return;
+      }
+
+      // Lote cheio: provavelmente há mais comandos na fila, o dispositivo deve buscar de novo imediatamente
+      if (commands.length >= max) {
+        this.setPollIntervalHint(res, 0);
+      }
+
+      res.status(200).json({ commands, count: commands.length });
+    } catch (error) {
+      res.status(500).json({
+        success: false,
+        error: 'Failed to fetch next commands',
+        message: error instanceof Error ? error.message : 'Unknown error',
+      });
+    }
+  };
+
+  /**
+   * Suggest the delay before the device's next poll (X-Poll-Interval header)
+   * @param res - Response to set the header on
+   * @param intervalMs - Suggested delay in milliseconds, nothing is sent when undefined
+   */
+  private setPollIntervalHint(res: Response, intervalMs: number | undefined): void {
+    if (intervalMs === undefined || isNaN(intervalMs) || intervalMs < 0) {
+      return;
+    }
+    res.setHeader('X-Poll-Interval', String(intervalMs));
+  }
+
+  /**
+   * Announce the drawer table version the device should run (X-Config-Version header),
+   * a device running another version authenticates again to fetch the new table
+   * @param res - Response to set the header on
+   * @param id - The device ID
+   */
+  private setConfigVersion(res: Response, id: string): void {
+    const version = this.devicesService.getConfigVersion(id);
+    if (version !== undefined) {
+      res.setHeader('X-Config-Version', String(version));
+    }
+  }
+
+  /**
+   * Announce the firmware release devices should run (X-Firmware-Version header),
+   * a device running another release downloads it in the background
+   * @param res - Response to set the header on
+   */
+  private setFirmwareVersion(res: Response): void {
+    const version = this.devicesService.getFirmwareVersion();
+    if (version !== undefined) {
+      res.setHeader('X-Firmware-Version', version);
+    }
+  }
+
+  /**
+   * Parse the batch size query parameter
+   * @param value - Raw ?max= value
+   * @returns Number of commands to return, between 1 and MAX_BATCH_COMMANDS (default 1)
+   */
+  private parseBatchMax(value: unknown): number {
+    const max = parseInt(typeof value === 'string' ? value : '', 10);
+    if (isNaN(max) || max < 1) {
+      return 1;
+    }
+    return Math.min(max, DevicesController.MAX_BATCH_COMMANDS);
+  }
+
+  /**
+   * Parse the long-poll wait query parameter
+   * @param value - Raw ?wait= value (seconds)
+   * @returns Wait time in seconds, clamped to MAX_LONG_POLL_SECONDS (0 = no long-polling)
+   */
+  private parseLongPollWait(value: unknown): number {
+    const seconds = parseInt(typeof value === 'string' ? value : '', 10);
+    if (isNaN(seconds) || seconds <= 0) {
+      return 0;
+    }
+    return Math.min(seconds, DevicesController.MAX_LONG_POLL_SECONDS);
+  }
+
   /**
    * POST /devices/:id/queue-command
    * Queue a command for the device
@@ -453,6 +610,7 @@ export class DevicesController {
       const command: CommandDto = {
         action: req.body.action,
         drawer: req.body.drawer,
+        priority: req.body.priority,
       };
 
       if (
@@ -477,7 +635,8 @@ export class DevicesController {
         message: 'Command queued successfully',
       });
     } catch (error) {
-      res.status(500).json({
+      const statusCode = error instanceof Error && error.message.includes('Invalid') ? 400 : 500;
+      res.status(statusCode).json({
         success: false,
         error: 'Failed to queue command',
         message: error instanceof Error ? error.message : 'Unknown error',
@@ -505,7 +664,7 @@ export class DevicesController {
         return;
       }
 
-      const commandCode = await this.devicesService.openDrawer(id, drawerNumberInt);
+      const commandCode = await this.devicesService.openDrawer(id, drawerNumberInt, req.body?.priority);
 
       res.status(200).json({
         success: true,
@@ -531,6 +690,209 @@ export class DevicesController {
     }
   };
 
+  /**
+   * Open several drawers of a device with a single command
+   * Body: { "drawers": [1, 3, 4], "priority": 5 } (priority optional)
+   * @param req - The request object
+   * @param res - The response object
+   * @returns Promise<void>
+   */
+  openDrawers = async (req: Request, res: Response): Promise<void> => {
+    try {
+      const { id } = req.params;
+      const drawers = req.body?.drawers;
+
+      if (!Array.isArray(drawers) || drawers.length === 0) {
+        res.status(400).json({
+          success: false,
+          error: 'Invalid request',
+          message: 'drawers must be a non-empty array of drawer numbers',
+        });
+        return;
+      }
+
+      const commandCode = await this.devicesService.openDrawers(id, drawers, req.body?.priority);
+
+      res.status(200).json({
+        success: true,
+        message: `Drawers ${drawers.join(', ')} open command queued successfully`,
+        code: commandCode,
+      });
+    } catch (error) {
+      let statusCode = 500;
+
+      if (error instanceof Error) {
+        if (error.message.includes('not found')) {
+          statusCode = 404;
+        } else if (error.message.includes('Invalid') || error.message.includes('out of range')) {
+          statusCode = 400;
+        }
+      }
+
+      res.status(statusCode).json({
+        success: false,
+        error: 'Failed to queue open drawers command',
+        message: error instanceof Error ? error.message : 'Unknown error',
+      });
+    }
+  };
+
+  /**
+   * POST /devices/status
+   * Device reports its status and the metrics collected since the last report
+   * (the device is identified by its JWT)
+   * @param req - The request object
+   * @param res - The response object
+   * @returns Promise<void>
+   */
+  reportStatus = async (req: AuthenticatedRequest, res: Response): Promise<void> => {
+    try {
+      const deviceId = req.device?.sub;
+      if (!deviceId) {
+        res.status(401).json({ success: false, error: 'Invalid token' });
+        return;
+      }
+
+      await this.devicesService.reportMetrics(deviceId, req.body as DeviceMetricsReport);
+
+      res.status(200).json({ success: true, message: 'Status received' });
+    } catch (error) {
+      let statusCode = 500;
+
+      if (error instanceof Error) {
+        if (error.message.includes('not found')) {
+          statusCode = 404;
+        } else if (error.message.includes('Invalid')) {
+          statusCode = 400;
+        }
+      }
+
+      res.status(statusCode).json({
+        success: false,
+        error: 'Failed to store device status',
+        message: error instanceof Error ? error.message : 'Unknown error',
+      });
+    }
+  };
+
+  /**
+   * GET /devices/:id/metrics
+   * Get the metrics accumulated from the device reports
+   * @param req - The request object
+   * @param res - The response object
+   * @returns Promise<void>
+   */
+  getDeviceMetrics = async (req: Request, res: Response): Promise<void> => {
+    try {
+      const { id } = req.params;
+      const metrics = await this.devicesService.getDeviceMetrics(id);
+
+      if (!metrics) {
+        res.status(404).json({
+          success: false,
+          error: 'No metrics',
+          message: `Device ${id} has not reported metrics yet`,
+        });
+        return;
+      }
+
+      res.status(200).json({ success: true, data: metrics });
+    } catch (error) {
+      const statusCode = error instanceof Error && error.message.includes('not found') ? 404 : 500;
+
+      res.status(statusCode).json({
+        success: false,
+        error: 'Failed to retrieve device metrics',
+        message: error instanceof Error ? error.message : 'Unknown error',
+      });
+    }
+  };
+
+  /**
+   * GET /devices/:id/config
+   * Get the drawer hardware table of a device
+   * @param req - The request object
+   * @param res - The response object
+   * @returns Promise<void>
+   */
+  getDrawerConfig = async (req: Request, res: Response): Promise<void> => {
+    try {
+      const { id } = req.params;
+      const config = await this.devicesService.getDrawerConfig(id);
+
+      res.status(200).json({ success: true, data: config });
+    } catch (error) {
+      const statusCode = error instanceof Error && error.message.includes('not found') ? 404 : 500;
+
+      res.status(statusCode).json({
+        success: false,
+        error: 'Failed to retrieve drawer config',
+        message: error instanceof Error ? error.message : 'Unknown error',
+      });
+    }
+  };
+
+  /**
+   * PUT /devices/:id/config
+   * Set the drawer hardware table of a device (fetched by the device after its next poll)
+   * Body: { "pins": [32, 33, 26, 27], "pulseMs": [500, 500, 800, 500], "activeLevel": 0 }
+   * @param req - The request object
+   * @param res - The response object
+   * @returns Promise<void>
+   */
+  setDrawerConfig = async (req: Request, res: Response): Promise<void> => {
+    try {
+      const { id } = req.params;
+      const device = await this.devicesService.setDrawerConfig(id, req.body as DrawerConfig);
+
+      res.status(200).json({
+        success: true,
+        data: device,
+        message: 'Drawer config updated, the device fetches it after its next poll',
+      });
+    } catch (error) {
+      let statusCode = 500;
+
+      if (error instanceof Error) {
+        if (error.message.includes('not found')) {
+          statusCode = 404;
+        } else if (error.message.includes('Invalid')) {
+          statusCode = 400;
+        }
+      }
+
+      res.status(statusCode).json({
+        success: false,
+        error: 'Failed to update drawer config',
+        message: error instanceof Error ? error.message : 'Unknown error',
+      });
+    }
+  };
+
+  /**
+   * GET /devices/:id/drawers
+   * Get the open/closed state of the drawers, as reported by the device sensors
+   * @param req - The request object
+   * @param res - The response object
+   * @returns Promise<void>
+   */
+  getDrawerStates = async (req: Request, res: Response): Promise<void> => {
+    try {
+      const { id } = req.params;
+      const states = await this.devicesService.getDrawerStates(id);
+
+      res.status(200).json({ success: true, data: states });
+    } catch (error) {
+      const statusCode = error instanceof Error && error.message.includes('not found') ? 404 : 500;
+
+      res.status(statusCode).json({
+        success: false,
+        error: 'Failed to retrieve drawer states',
+        message: error instanceof Error ? error.message : 'Unknown error',
+      });
+    }
+  };
+
   /**
    * Confirm command execution for a device
    * @param req - Express request object
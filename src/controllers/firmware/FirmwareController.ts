@@ -0,0 +1,136 @@
+import { Request, Response } from 'express';
+import { FirmwareService } from '../../services/firmware/FirmwareService';
+import { AuthenticatedRequest } from '../../middleware/deviceAuth';
+import Logger from '../../logger/logger';
+
+/**
+ * FirmwareController
+ *
+ * Handles HTTP requests related to firmware releases (OTA updates).
+ * Routes requests to the appropriate service methods and formats responses.
+ */
+export class FirmwareController {
+  private firmwareService: FirmwareService;
+  private logger = Logger.child({ component: 'FirmwareController' });
+
+  /**
+   * Constructor - Injects the FirmwareService dependency
+   * @param firmwareService - The service to handle business logic
+   */
+  constructor(firmwareService: FirmwareService) {
+    this.firmwareService = firmwareService;
+    this.logger.debug('FirmwareController initialized');
+  }
+
+  /**
+   * POST /firmware?version=X
+   * Publish a new release (raw .bin body), announced to every device from the next poll
+   */
+  uploadFirmware = async (req: Request, res: Response): Promise<void> => {
+    try {
+      const firmware = await this.firmwareService.uploadFirmware(req.query.version, req.body);
+      res.status(201).json({ success: true, data: firmware });
+    } catch (error) {
+      let statusCode = 500;
+
+      if (error instanceof Error) {
+        if (error.message.includes('already exists')) {
+          statusCode = 409;
+        } else if (error.message.includes('Invalid')) {
+          statusCode = 400;
+        }
+      }
+
+      res.status(statusCode).json({
+        success: false,
+        error: 'Failed to upload firmware',
+        message: error instanceof Error ? error.message : 'Unknown error',
+      });
+    }
+  };
+
+  /**
+   * GET /firmware
+   * List the releases, the first one is the current release
+   */
+  listFirmware = async (req: Request, res: Response): Promise<void> => {
+    try {
+      const releases = await this.firmwareService.listFirmware();
+      res.status(200).json({ success: true, data: releases, count: releases.length });
+    } catch (error) {
+      res.status(500).json({
+        success: false,
+        error: 'Failed to list firmware',
+        message: error instanceof Error ? error.message : 'Unknown error',
+      });
+    }
+  };
+
+  /**
+   * DELETE /firmware/:version
+   * Withdraw a release, devices still downloading it drop it
+   */
+  deleteFirmware = async (req: Request, res: Response): Promise<void> => {
+    try {
+      await this.firmwareService.deleteFirmware(req.params.version);
+      res.status(200).json({ success: true, message: `Firmware ${req.params.version} deleted` });
+    } catch (error) {
+      const statusCode = error instanceof Error && error.message.includes('not found') ? 404 : 500;
+
+      res.status(statusCode).json({
+        success: false,
+        error: 'Failed to delete firmware',
+        message: error instanceof Error ? error.message : 'Unknown error',
+      });
+    }
+  };
+
+  /**
+   * GET /firmware/download?version=X
+   * Device downloads the current release, one Range request per chunk
+   * (409 when ?version= no longer is the current release, so a device never mixes two images)
+   */
+  downloadFirmware = async (req: AuthenticatedRequest, res: Response): Promise<void> => {
+    try {
+      const firmware = await this.firmwareService.getCurrentFirmware();
+      if (!firmware) {
+        res.status(404).json({ success: false, error: 'No firmware', message: 'No firmware release was uploaded' });
+        return;
+      }
+      if (typeof req.query.version === 'string' && req.query.version !== firmware.version) {
+        res.status(409).json({
+          success: false,
+          error: 'Firmware changed',
+          message: `Current firmware is ${firmware.version}`,
+        });
+        return;
+      }
+
+      res.setHeader('X-Firmware-Version', firmware.version);
+      res.setHeader('X-Firmware-MD5', firmware.md5);
+      res.setHeader('Accept-Ranges', 'bytes');
+      res.setHeader('Content-Type', 'application/octet-stream');
+
+      const range = this.firmwareService.resolveRange(req.headers.range, firmware.size);
+      if (range === null) {
+        res.setHeader('Content-Range', `bytes */${firmware.size}`);
+        res.status(416).end();
+        return;
+      }
+      if (!range) {
+        res.status(200).end(firmware.data);
+        return;
+      }
+
+      this.logger.debug('Firmware chunk requested', { deviceId: req.device?.sub, version: firmware.version, ...range });
+      res.setHeader('Content-Range', `bytes ${range.start}-${range.end}/${firmware.size}`);
+      res.status(206).end(firmware.data.subarray(range.start, range.end + 1));
+    } catch (error) {
+      res.status(500).json({
+        success: false,
+        error: 'Failed to download firmware',
+        message: error instanceof Error ? error.message : 'Unknown error',
+      });
+    }
+  };
+}
@@ -0,0 +1,37 @@
+import { Request, Response, NextFunction } from 'express';
+import { decode, encode, MSGPACK_CONTENT_TYPE } from '../utils/msgpack';
+import Logger from '../logger/logger';
+
+const logger = Logger.child({ component: 'MsgpackMiddleware' });
+
+/**
+ * Middleware to negotiate the MessagePack wire format (JSON stays the default)
+ * - Request bodies sent as application/msgpack (read raw by app.ts) are decoded into req.body
+ * - Responses are encoded as MessagePack when the client sends Accept: application/msgpack
+ * @param req - Express request object
+ * @param res - Express response object
+ * @param next - Next middleware function
+ */
+export function msgpackNegotiation(req: Request, res: Response, next: NextFunction) {
+  if (req.is(MSGPACK_CONTENT_TYPE) && Buffer.isBuffer(req.body)) {
+    try {
+      req.body = req.body.length > 0 ? decode(req.body) : {};
+    } catch (err) {
+      logger.warn('Invalid MessagePack body', {
+        path: req.path,
+        error: err instanceof Error ? err.message : 'Unknown error',
+      });
+      return res.status(400).json({ error: 'Invalid MessagePack body' });
+    }
+  }
+
+  res.vary('Accept');
+  if (req.get('Accept')?.includes(MSGPACK_CONTENT_TYPE)) {
+    res.json = (body?: unknown) => {
+      res.type(MSGPACK_CONTENT_TYPE);
+      return res.send(encode(body));
+    };
+  }
+
+  next();
+}
@@ -5,6 +5,8 @@ export interface CreateCommandDto {
   deviceId: string;
   action: string;
   drawer?: number;
+  drawers?: number[]; // Drawer list (OPEN_MANY)
+  priority?: number; // Delivery priority, higher first (default 0)
 }
 
 export interface Command {
@@ -13,6 +15,8 @@ export interface Command {
   code: string;
   action: string;
   drawer: number | null;
+  drawers: string | null;
+  priority: number;
   status: string;
   createdAt: Date;
   executedAt: Date | null;
@@ -38,6 +42,8 @@ export class CommandsRepository {
       deviceId: data.deviceId,
       action: data.action,
       drawer: data.drawer,
+      drawers: data.drawers,
+      priority: data.priority,
     });
 
     try {
@@ -46,6 +52,8 @@ export class CommandsRepository {
           deviceId: data.deviceId,
           action: data.action,
           drawer: data.drawer || null,
+          drawers: data.drawers && data.drawers.length > 0 ? data.drawers.join(',') : null,
+          priority: data.priority ?? 0,
           status: 'PENDING',
         },
       });
@@ -91,7 +99,7 @@ export class CommandsRepository {
   }
 
   /**
-   * Find next pending command for a device
+   * Find next pending command for a device (highest priority, then oldest)
    * @param deviceId - Device ID
    * @returns Promise<Command | null>
    */
@@ -104,9 +112,7 @@ export class CommandsRepository {
           deviceId,
           status: 'PENDING',
         },
-        orderBy: {
-          createdAt: 'asc',
-        },
+        orderBy: [{ priority: 'desc' }, { createdAt: 'asc' }],
       });
 
       if (command) {
@@ -129,6 +135,89 @@ export class CommandsRepository {
     }
   }
 
+  /**
+   * Find the pending commands for a device, highest priority first, then oldest
+   * @param deviceId - Device ID
+   * @param limit - Maximum number of commands to return
+   * @returns Promise<Command[]>
+   */
+  async findPendingByDevice(deviceId: string, limit: number): Promise<Command[]> {
+    this.logger.debug('Finding pending commands', { deviceId, limit });
+
+    try {
+      const commands = await prisma.command.findMany({
+        where: {
+          deviceId,
+          status: 'PENDING',
+        },
+        orderBy: [{ priority: 'desc' }, { createdAt: 'asc' }],
+        take: limit,
+      });
+
+      this.logger.debug(`Found ${commands.length} pending commands`, { deviceId, limit });
+      return commands;
+    } catch (error) {
+      this.logger.error('Error finding pending commands', {
+        deviceId,
+        limit,
+        error: error instanceof Error ? error.message : 'Unknown error',
+      });
+      throw error;
+    }
+  }
+
+  /**
+   * Find commands by a list of codes
+   * @param codes - Command codes
+   * @returns Promise<Command[]> Commands found (missing codes are omitted)
+   */
+  async findByCodes(codes: string[]): Promise<Command[]> {
+    this.logger.debug('Finding commands by codes', { count: codes.length });
+
+    try {
+      return await prisma.command.findMany({
+        where: { code: { in: codes } },
+      });
+    } catch (error) {
+      this.logger.error('Error finding commands by codes', {
+        count: codes.length,
+        error: error instanceof Error ? error.message : 'Unknown error',
+      });
+      throw error;
+    }
+  }
+
+  /**
+   * Mark several pending commands as executed in a single query
+   * @param codes - Command codes
+   * @returns Promise<number> Number of commands updated
+   */
+  async markManyAsExecuted(codes: string[]): Promise<number> {
+    this.logger.info('Marking commands as executed', { count: codes.length });
+
+    try {
+      const result = await prisma.command.updateMany({
+        where: {
+          code: { in: codes },
+          status: 'PENDING',
+        },
+        data: {
+          status: 'EXECUTED',
+          executedAt: new Date(),
+        },
+      });
+
+      this.logger.info('Commands marked as executed', { count: result.count });
+      return result.count;
+    } catch (error) {
+      this.logger.error('Error marking commands as executed', {
+        count: codes.length,
+        error: error instanceof Error ? error.message : 'Unknown error',
+      });
+      throw error;
+    }
+  }
+
   /**
    * Mark command as executed
    * @param code - Command code
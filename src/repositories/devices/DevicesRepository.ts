@@ -173,6 +173,48 @@ export class DevicesRepository {
     });
   }
 
+  /**
+   * Store the accumulated metrics of a device
+   * @param deviceId - The device ID
+   * @param metrics - Accumulated metrics serialized as JSON
+   * @returns Promise<void>
+   */
+  async updateMetrics(deviceId: string, metrics: string): Promise<void> {
+    const now = new Date();
+    await prisma.deviceStatus.upsert({
+      where: { deviceId },
+      update: { metrics, lastReport: now },
+      create: { deviceId, lastPoll: now, lastCommand: now, metrics, lastReport: now },
+    });
+  }
+
+  /**
+   * Store the drawer table of a device, the drawer count follows the table
+   * @param id - The device ID
+   * @param drawerConfig - Drawer table serialized as JSON
+   * @param drawerCount - Number of drawers in the table
+   * @returns Promise<Device> The updated device
+   */
+  async updateDrawerConfig(id: string, drawerConfig: string, drawerCount: number): Promise<Device> {
+    return prisma.device.update({
+      where: { id },
+      data: { drawerConfig, drawerCount },
+    });
+  }
+
+  /**
+   * Store the firmware release a device reported
+   * @param id - The device ID
+   * @param firmwareVersion - Release name
+   * @returns Promise<void>
+   */
+  async updateFirmwareVersion(id: string, firmwareVersion: string): Promise<void> {
+    await prisma.device.update({
+      where: { id },
+      data: { firmwareVersion },
+    });
+  }
+
   /**
    * Update an existing device
    * @param id - The device ID to update
@@ -0,0 +1,95 @@
+import prisma from '../../db/prisma';
+import Logger from '../../logger/logger';
+
+export interface CreateFirmwareDto {
+  version: string;
+  size: number;
+  md5: string;
+  sha256: string;
+  data: Buffer;
+}
+
+/**
+ * Firmware release without its image
+ */
+export interface FirmwareInfo {
+  id: string;
+  version: string;
+  size: number;
+  md5: string;
+  sha256: string;
+  createdAt: Date;
+}
+
+export interface Firmware extends FirmwareInfo {
+  data: Buffer;
+}
+
+const infoFields = { id: true, version: true, size: true, md5: true, sha256: true, createdAt: true };
+
+/**
+ * FirmwareRepository
+ *
+ * Handles all database operations related to firmware releases.
+ */
+export class FirmwareRepository {
+  private logger = Logger.child({ component: 'FirmwareRepository' });
+
+  /**
+   * Store a new firmware release
+   * @param data - Release metadata and image
+   * @returns Promise<FirmwareInfo> The stored release (without the image)
+   */
+  async create(data: CreateFirmwareDto): Promise<FirmwareInfo> {
+    this.logger.debug('Creating firmware release', { version: data.version, size: data.size });
+
+    try {
+      const firmware = await prisma.firmware.create({ data, select: infoFields });
+      this.logger.info('Firmware release created', { version: firmware.version, size: firmware.size });
+      return firmware;
+    } catch (error) {
+      this.logger.error('Error creating firmware release', {
+        version: data.version,
+        error: error instanceof Error ? error.message : 'Unknown error',
+      });
+      throw error;
+    }
+  }
+
+  /**
+   * Find the latest release with its image
+   * @returns Promise<Firmware | null> The newest release, null if none was uploaded
+   */
+  async findLatest(): Promise<Firmware | null> {
+    const firmware = await prisma.firmware.findFirst({ orderBy: { createdAt: 'desc' } });
+    return firmware && { ...firmware, data: Buffer.from(firmware.data) };
+  }
+
+  /**
+   * List every release, newest first (without the images)
+   * @returns Promise<FirmwareInfo[]>
+   */
+  async findAll(): Promise<FirmwareInfo[]> {
+    return prisma.firmware.findMany({ select: infoFields, orderBy: { createdAt: 'desc' } });
+  }
+
+  /**
+   * Check if a release name is taken
+   * @param version - Release name
+   * @returns Promise<boolean>
+   */
+  async exists(version: string): Promise<boolean> {
+    const count = await prisma.firmware.count({ where: { version } });
+    return count > 0;
+  }
+
+  /**
+   * Delete a release
+   * @param version - Release name
+   * @returns Promise<boolean> true if a release was deleted
+   */
+  async delete(version: string): Promise<boolean> {
+    const { count } = await prisma.firmware.deleteMany({ where: { version } });
+    return count > 0;
+  }
+}
@@ -40,6 +40,40 @@ const deviceAuthController = new DeviceAuthController();
  *                 token:
  *                   type: string
  *                   description: JWT token for authenticated device
+ *                 poll:
+ *                   type: object
+ *                   description: Poll slot of the device (omitted when DEVICE_POLL_SLOT_INTERVAL_MS is 0). Idle polls are sent when server time % intervalMs == offsetMs.
+ *                   properties:
+ *                     intervalMs:
+ *                       type: integer
+ *                       example: 30000
+ *                     offsetMs:
+ *                       type: integer
+ *                       example: 12345
+ *                 config:
+ *                   type: object
+ *                   description: Drawer hardware table (omitted when the firmware defaults apply, see PUT /devices/{id}/config). The device caches it in NVS and rebuilds its drawer table when v changes.
+ *                   properties:
+ *                     v:
+ *                       type: integer
+ *                       description: Version of the table
+ *                       example: 2166136261
+ *                     pins:
+ *                       type: array
+ *                       items:
+ *                         type: integer
+ *                       example: [32, 33, 26, 27]
+ *                     pulse:
+ *                       type: array
+ *                       description: Pulse width of each drawer in ms
+ *                       items:
+ *                         type: integer
+ *                       example: [500, 500, 800, 500]
+ *                     active:
+ *                       type: integer
+ *                       enum: [0, 1]
+ *                       description: GPIO level that energizes the relays
+ *                       example: 0
  *       400:
  *         description: Bad request - missing required fields
  *         content:
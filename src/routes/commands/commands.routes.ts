@@ -88,6 +88,103 @@ const commandsController = new CommandsController(commandsService);
  */
 router.get('/:code', authenticateApiKey, commandsController.getCommandByCode);
 
+/**
+ * @swagger
+ * /commands/ack:
+ *   post:
+ *     summary: Acknowledge a batch of command executions
+ *     description: Report the result of several commands in a single request (typically called by ESP32 device). Each result is applied independently; rejected results are reported per code. The body may also be sent as application/msgpack (same structure).
+ *     tags:
+ *       - Commands
+ *     security:
+ *       - bearerAuth: []
+ *     requestBody:
+ *       required: true
+ *       content:
+ *         application/json:
+ *           schema:
+ *             type: object
+ *             required:
+ *               - results
+ *             properties:
+ *               results:
+ *                 type: array
+ *                 maxItems: 50
+ *                 items:
+ *                   type: object
+ *                   required:
+ *                     - code
+ *                     - status
+ *                   properties:
+ *                     code:
+ *                       type: string
+ *                       example: ABC123
+ *                     status:
+ *                       type: string
+ *                       enum: [EXECUTED, FAILED]
+ *                     errorMessage:
+ *                       type: string
+ *                       example: "Drawer 5 does not exist"
+ *           example:
+ *             results:
+ *               - code: ABC123
+ *                 status: EXECUTED
+ *               - code: DEF456
+ *                 status: FAILED
+ *                 errorMessage: "Drawer 5 does not exist"
+ *     responses:
+ *       200:
+ *         description: Acknowledgements processed
+ *         content:
+ *           application/json:
+ *             schema:
+ *               type: object
+ *               properties:
+ *                 message:
+ *                   type: string
+ *                   example: "Command acknowledgements processed"
+ *                 applied:
+ *                   type: integer
+ *                   example: 1
+ *                 rejected:
+ *                   type: integer
+ *                   example: 1
+ *                 results:
+ *                   type: array
+ *                   items:
+ *                     type: object
+ *                     properties:
+ *                       code:
+ *                         type: string
+ *                       success:
+ *                         type: boolean
+ *                       status:
+ *                         type: string
+ *                         example: "EXECUTED"
+ *                       error:
+ *                         type: string
+ *                         example: "not found"
+ *       400:
+ *         description: Invalid request body
+ *         content:
+ *           application/json:
+ *             schema:
+ *               $ref: '#/components/schemas/Error'
+ *       401:
+ *         description: Unauthorized - Invalid or missing JWT token
+ *         content:
+ *           application/json:
+ *             schema:
+ *               $ref: '#/components/schemas/Error'
+ *       500:
+ *         description: Internal server error
+ *         content:
+ *           application/json:
+ *             schema:
+ *               $ref: '#/components/schemas/Error'
+ */
+router.post('/ack', authenticateDeviceJWT, commandsController.acknowledgeCommands);
+
 /**
  * @swagger
  * /commands/{code}/execute:
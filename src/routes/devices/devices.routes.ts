@@ -89,6 +89,262 @@ router.get('/stats', authenticateApiKey, devicesController.getDeviceStats);
  */
 router.get('/stats/:id', authenticateApiKey, devicesController.getDeviceStat);
 
+/**
+ * @swagger
+ * /devices/status:
+ *   post:
+ *     summary: Report device status and metrics
+ *     description: Endpoint for devices to report their status and the metrics collected since the previous accepted report. Counters and histograms are deltas and are accumulated by the server; gauges replace the previous values. The device is identified by its JWT. Requires device authentication.
+ *     tags: [Devices]
+ *     security:
+ *       - bearerAuth: []
+ *     requestBody:
+ *       required: true
+ *       content:
+ *         application/json:
+ *           schema:
+ *             type: object
+ *             required:
+ *               - buckets
+ *             properties:
+ *               status:
+ *                 type: string
+ *                 example: ACTIVE
+ *               firmware:
+ *                 type: string
+ *                 description: Firmware release the device runs (FIRMWARE_VERSION), stored as the device firmwareVersion
+ *                 example: 1.0.0
+ *               uptimeMs:
+ *                 type: integer
+ *                 example: 3600000
+ *               intervalMs:
+ *                 type: integer
+ *                 description: Time covered by this report
+ *                 example: 60000
+ *               gauges:
+ *                 type: object
+ *                 additionalProperties:
+ *                   type: number
+ *                 example: { freeHeap: 182340, minFreeHeap: 170112, maxAllocHeap: 110580, rssi: -61, drawersOpen: 2, drawersSensed: 11 }
+ *               counters:
+ *                 type: object
+ *                 additionalProperties:
+ *                   type: integer
+ *                 example: { serverReconnects: 1, reauths: 1 }
+ *               buckets:
+ *                 type: array
+ *                 description: Upper bound in ms of each histogram bucket, histograms have one more (overflow) bucket
+ *                 items:
+ *                   type: integer
+ *                 example: [10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000]
+ *               histograms:
+ *                 type: object
+ *                 description: Bucket counts keyed by histogram name (endpoint.phase with phases dns, connect, ttfb, total; pollToActuation; actuation; wifiReconnect)
+ *                 additionalProperties:
+ *                   type: array
+ *                   items:
+ *                     type: integer
+ *                 example: { poll.ttfb: [0, 0, 12, 40, 3, 0, 0, 0, 0, 0, 0] }
+ *     responses:
+ *       200:
+ *         description: Status received
+ *       400:
+ *         $ref: '#/components/responses/ValidationError'
+ *       401:
+ *         $ref: '#/components/responses/Unauthorized'
+ *       404:
+ *         $ref: '#/components/responses/NotFound'
+ *       500:
+ *         $ref: '#/components/responses/InternalServerError'
+ */
+router.post('/status', authenticateDeviceJWT, devicesController.reportStatus);
+
+/**
+ * @swagger
+ * /devices/{id}/metrics:
+ *   get:
+ *     summary: Get the metrics reported by a device
+ *     description: Retrieve the metrics accumulated from the device reports, with the p50/p90/p99 of each histogram estimated as the upper bound of the bucket holding it (null when it falls in the overflow bucket). Requires API Key authentication.
+ *     tags: [Devices]
+ *     security:
+ *       - apiKeyAuth: []
+ *     parameters:
+ *       - in: path
+ *         name: id
+ *         required: true
+ *         schema:
+ *           type: string
+ *           minLength: 1
+ *         description: The device unique identifier
+ *         example: clp123abc456def789
+ *     responses:
+ *       200:
+ *         description: Device metrics retrieved successfully
+ *       401:
+ *         $ref: '#/components/responses/Unauthorized'
+ *       404:
+ *         $ref: '#/components/responses/NotFound'
+ *       500:
+ *         $ref: '#/components/responses/InternalServerError'
+ */
+router.get('/:id/metrics', authenticateApiKey, devicesController.getDeviceMetrics);
+
+/**
+ * @swagger
+ * /devices/{id}/drawers:
+ *   get:
+ *     summary: Get the open/closed state of the drawers of a device
+ *     description: State of each drawer as reported by the device sensors (reed or limit switches). Devices push a status report as soon as a drawer opens or closes, so the state is served from the last report. open is null for drawers without a sensor. Requires API Key authentication.
+ *     tags: [Devices]
+ *     security:
+ *       - apiKeyAuth: []
+ *     parameters:
+ *       - in: path
+ *         name: id
+ *         required: true
+ *         schema:
+ *           type: string
+ *           minLength: 1
+ *         description: The device unique identifier
+ *         example: clp123abc456def789
+ *     responses:
+ *       200:
+ *         description: Drawer states retrieved successfully
+ *         content:
+ *           application/json:
+ *             schema:
+ *               type: object
+ *               properties:
+ *                 success:
+ *                   type: boolean
+ *                   example: true
+ *                 data:
+ *                   type: object
+ *                   properties:
+ *                     drawers:
+ *                       type: array
+ *                       items:
+ *                         type: object
+ *                         properties:
+ *                           drawer:
+ *                             type: integer
+ *                             example: 1
+ *                           open:
+ *                             type: boolean
+ *                             nullable: true
+ *                             example: false
+ *                     reportedAt:
+ *                       type: string
+ *                       format: date-time
+ *                       nullable: true
+ *       401:
+ *         $ref: '#/components/responses/Unauthorized'
+ *       404:
+ *         $ref: '#/components/responses/NotFound'
+ *       500:
+ *         $ref: '#/components/responses/InternalServerError'
+ */
+router.get('/:id/drawers', authenticateApiKey, devicesController.getDrawerStates);
+
+/**
+ * @swagger
+ * /devices/{id}/config:
+ *   get:
+ *     summary: Get the drawer hardware table of a device
+ *     description: Relay pin, pulse width and relay active level of each drawer, as sent to the device with its token. data is null when the firmware defaults (config.h) apply. Requires API Key authentication.
+ *     tags: [Devices]
+ *     security:
+ *       - apiKeyAuth: []
+ *     parameters:
+ *       - in: path
+ *         name: id
+ *         required: true
+ *         schema:
+ *           type: string
+ *           minLength: 1
+ *         description: The device unique identifier
+ *         example: clp123abc456def789
+ *     responses:
+ *       200:
+ *         description: Drawer config retrieved successfully
+ *       401:
+ *         $ref: '#/components/responses/Unauthorized'
+ *       404:
+ *         $ref: '#/components/responses/NotFound'
+ *       500:
+ *         $ref: '#/components/responses/InternalServerError'
+ *   put:
+ *     summary: Set the drawer hardware table of a device
+ *     description: Sets the relay pin, pulse width and relay active level of each drawer. The device receives the table with its next token, caches it in NVS and rebuilds its drawer table without reflashing. The device drawerCount follows the number of pins. Requires API Key authentication.
+ *     tags: [Devices]
+ *     security:
+ *       - apiKeyAuth: []
+ *     parameters:
+ *       - in: path
+ *         name: id
+ *         required: true
+ *         schema:
+ *           type: string
+ *           minLength: 1
+ *         description: The device unique identifier
+ *         example: clp123abc456def789
+ *     requestBody:
+ *       required: true
+ *       content:
+ *         application/json:
+ *           schema:
+ *             type: object
+ *             required:
+ *               - pins
+ *               - pulseMs
+ *             properties:
+ *               pins:
+ *                 type: array
+ *                 description: Relay GPIO of each drawer (0, 2, 4, 5, 12-19, 21-23, 25-27, 32, 33, no duplicates, not a sensor pin)
+ *                 minItems: 1
+ *                 maxItems: 20
+ *                 items:
+ *                   type: integer
+ *                 example: [32, 33, 26, 27]
+ *               pulseMs:
+ *                 type: array
+ *                 description: Pulse width of each drawer in ms (1-2000), one per pin
+ *                 items:
+ *                   type: integer
+ *                 example: [500, 500, 800, 500]
+ *               activeLevel:
+ *                 type: integer
+ *                 enum: [0, 1]
+ *                 description: GPIO level that energizes the relays (default 0 = LOW)
+ *                 example: 0
+ *     responses:
+ *       200:
+ *         description: Drawer config updated successfully
+ *         content:
+ *           application/json:
+ *             schema:
+ *               type: object
+ *               properties:
+ *                 success:
+ *                   type: boolean
+ *                   example: true
+ *                 data:
+ *                   $ref: '#/components/schemas/Device'
+ *                 message:
+ *                   type: string
+ *                   example: Drawer config updated, the device fetches it after its next poll
+ *       400:
+ *         $ref: '#/components/responses/ValidationError'
+ *       401:
+ *         $ref: '#/components/responses/Unauthorized'
+ *       404:
+ *         $ref: '#/components/responses/NotFound'
+ *       500:
+ *         $ref: '#/components/responses/InternalServerError'
+ */
+router.get('/:id/config', authenticateApiKey, devicesController.getDrawerConfig);
+router.put('/:id/config', authenticateApiKey, devicesController.setDrawerConfig);
+
 /**
  * @swagger
  * /devices:
@@ -434,7 +690,7 @@ router.delete('/:id', authenticateApiKey, devicesController.deleteDevice);
  * /devices/{id}/next-command:
  *   get:
  *     summary: Get the next command for a device
- *     description: Retrieve the next scheduled command for a specific device. Requires device authentication.
+ *     description: Retrieve the next scheduled command for a specific device. With the wait parameter the request is held open (long-polling) until a command is queued or the wait expires. Requires device authentication.
  *     tags: [Devices]
  *     security:
  *       - bearerAuth: []
@@ -447,6 +703,15 @@ router.delete('/:id', authenticateApiKey, devicesController.deleteDevice);
  *           minLength: 1
  *         description: The device unique identifier
  *         example: clp123abc456def789
+ *       - in: query
+ *         name: wait
+ *         required: false
+ *         schema:
+ *           type: integer
+ *           minimum: 1
+ *           maximum: 30
+ *         description: Long-poll timeout in seconds. The response carries an X-Long-Poll header when long-polling is active. With poll slots enabled the hold ends on the device slot, which can be earlier than the timeout.
+ *         example: 25
  *     responses:
  *       200:
  *         description: Next command retrieved successfully
@@ -460,6 +725,8 @@ router.delete('/:id', authenticateApiKey, devicesController.deleteDevice);
  *                   example: true
  *                 data:
  *                   $ref: '#/components/schemas/Command'
+ *       204:
+ *         description: No pending command (returned after the wait expires when long-polling)
  *       400:
  *         $ref: '#/components/responses/ValidationError'
  *       401:
@@ -472,6 +739,99 @@ router.delete('/:id', authenticateApiKey, devicesController.deleteDevice);
 //router.get('/:id/next-command', verifyJWT, devicesController.getNextCommand);
 router.get('/:id/next-command', authenticateDeviceJWT, devicesController.getNextCommand);
 
+/**
+ * @swagger
+ * /devices/{id}/next-commands:
+ *   get:
+ *     summary: Get several pending commands for a device
+ *     description: Retrieve up to max pending commands (oldest first) in a single round trip. Supports the same wait parameter as next-command for long-polling. Requires device authentication. Send Accept: application/msgpack to receive the response as MessagePack.
+ *     tags: [Devices]
+ *     security:
+ *       - bearerAuth: []
+ *     parameters:
+ *       - in: path
+ *         name: id
+ *         required: true
+ *         schema:
+ *           type: string
+ *           minLength: 1
+ *         description: The device unique identifier
+ *         example: clp123abc456def789
+ *       - in: query
+ *         name: max
+ *         required: false
+ *         schema:
+ *           type: integer
+ *           minimum: 1
+ *           maximum: 10
+ *           default: 1
+ *         description: Maximum number of commands to return
+ *         example: 4
+ *       - in: query
+ *         name: wait
+ *         required: false
+ *         schema:
+ *           type: integer
+ *           minimum: 1
+ *           maximum: 30
+ *         description: Long-poll timeout in seconds. The response carries an X-Long-Poll header when long-polling is active. With poll slots enabled the hold ends on the device slot, which can be earlier than the timeout.
+ *         example: 25
+ *     responses:
+ *       200:
+ *         description: Pending commands retrieved successfully
+ *         content:
+ *           application/json:
+ *             schema:
+ *               type: object
+ *               properties:
+ *                 commands:
+ *                   type: array
+ *                   items:
+ *                     type: object
+ *                     properties:
+ *                       action:
+ *                         type: string
+ *                         example: open
+ *                       drawer:
+ *                         type: integer
+ *                         example: 1
+ *                       priority:
+ *                         type: integer
+ *                         description: Delivery priority (omitted when 0), commands are returned highest priority first, then oldest
+ *                         example: 5
+ *                       code:
+ *                         type: string
+ *                         example: clq123xyz789
+ *                 count:
+ *                   type: integer
+ *                   example: 1
+ *         headers:
+ *           X-Poll-Interval:
+ *             description: Suggested delay in milliseconds before the next poll (0 when the batch was full)
+ *             schema:
+ *               type: integer
+ *       204:
+ *         description: No pending command (returned after the wait expires when long-polling)
+ *         headers:
+ *           X-Poll-Interval:
+ *             description: Suggested delay in milliseconds before the next poll (set by DEVICE_IDLE_POLL_INTERVAL_MS)
+ *             schema:
+ *               type: integer
+ *           X-Config-Version:
+ *             description: Version of the drawer table the device should run (see PUT /devices/{id}/config), a device running another version authenticates again to fetch it
+ *             schema:
+ *               type: integer
+ *           X-Firmware-Version:
+ *             description: Firmware release the device should run (see POST /firmware), a device running another release downloads it in the background
+ *             schema:
+ *               type: string
+ *       401:
+ *         $ref: '#/components/responses/Unauthorized'
+ *       500:
+ *         $ref: '#/components/responses/InternalServerError'
+ */
+router.get('/:id/next-commands', authenticateDeviceJWT, devicesController.getNextCommands);
+
 /**
  * @swagger
  * /devices/{id}/commands:
@@ -506,6 +866,12 @@ router.get('/:id/next-command', authenticateDeviceJWT, devicesController.getNext
  *                 type: integer
  *                 description: The drawer index to open
  *                 example: 1
+ *               priority:
+ *                 type: integer
+ *                 minimum: 0
+ *                 maximum: 9
+ *                 description: Delivery priority, higher priorities reach the device first (default 0)
+ *                 example: 0
  *             required:
  *               - action
  *               - drawer
@@ -572,6 +938,19 @@ router.post('/:id/commands', authenticateApiKey, devicesController.queueCommand)
  *           minimum: 1
  *         description: The Number of the drawer to open
  *         example: 1
+ *     requestBody:
+ *       required: false
+ *       content:
+ *         application/json:
+ *           schema:
+ *             type: object
+ *             properties:
+ *               priority:
+ *                 type: integer
+ *                 minimum: 0
+ *                 maximum: 9
+ *                 description: Delivery priority, higher priorities reach the device first (default 0)
+ *                 example: 5
  *     responses:
  *       200:
  *         description: Drawer opened successfully
@@ -596,6 +975,74 @@ router.post('/:id/commands', authenticateApiKey, devicesController.queueCommand)
  */
 router.post('/:id/opendrawer/:drawerNumber', authenticateApiKey, devicesController.openDrawer);
 
+/**
+ * @swagger
+ * /devices/{id}/opendrawers:
+ *   post:
+ *     summary: Open several drawers on the device together
+ *     description: Queue a single open_many command. The device validates every drawer and switches all relays in the same pulse, reporting one result for the whole set. Requires API Key authentication.
+ *     tags: [Devices]
+ *     security:
+ *       - apiKeyAuth: []
+ *     parameters:
+ *       - in: path
+ *         name: id
+ *         required: true
+ *         schema:
+ *           type: string
+ *           minLength: 1
+ *         description: The device unique identifier
+ *         example: clp123abc456def789
+ *     requestBody:
+ *       required: true
+ *       content:
+ *         application/json:
+ *           schema:
+ *             type: object
+ *             required:
+ *               - drawers
+ *             properties:
+ *               drawers:
+ *                 type: array
+ *                 minItems: 1
+ *                 items:
+ *                   type: integer
+ *                   minimum: 1
+ *                 example: [1, 3, 4]
+ *               priority:
+ *                 type: integer
+ *                 minimum: 0
+ *                 maximum: 9
+ *                 description: Delivery priority, higher priorities reach the device first (default 0)
+ *                 example: 0
+ *     responses:
+ *       200:
+ *         description: Open drawers command queued successfully
+ *         content:
+ *           application/json:
+ *             schema:
+ *               type: object
+ *               properties:
+ *                 success:
+ *                   type: boolean
+ *                   example: true
+ *                 message:
+ *                   type: string
+ *                   example: Drawers 1, 3, 4 open command queued successfully
+ *                 code:
+ *                   type: string
+ *                   example: clq123xyz789
+ *       400:
+ *         $ref: '#/components/responses/ValidationError'
+ *       401:
+ *         $ref: '#/components/responses/Unauthorized'
+ *       404:
+ *         $ref: '#/components/responses/NotFound'
+ *       500:
+ *         $ref: '#/components/responses/InternalServerError'
+ */
+router.post('/:id/opendrawers', authenticateApiKey, devicesController.openDrawers);
+
 /**
  * @swagger
  * /devices/{id}/commandconfirm:
@@ -0,0 +1,185 @@
+import { Router } from 'express';
+import { raw } from 'body-parser';
+import { FirmwareController } from '../../controllers/firmware/FirmwareController';
+import { firmwareService } from '../../container';
+import { authenticateApiKey } from '../../middleware/apiKeyAuth';
+import { authenticateDeviceJWT } from '../../middleware/deviceAuth';
+import { FIRMWARE_MAX_SIZE } from '../../config/firmware';
+
+/**
+ * Firmware Routes
+ *
+ * OTA releases: operators publish images, devices download the current one.
+ * Repository -> Service -> Controller -> Routes
+ */
+const router = Router();
+const firmwareController = new FirmwareController(firmwareService);
+
+/**
+ * @swagger
+ * /firmware:
+ *   post:
+ *     summary: Publish a firmware release
+ *     description: Upload an ESP32 application image (the .bin built by the Arduino IDE / arduino-cli). The newest release is announced to every device on its polls (X-Firmware-Version header); devices running another FIRMWARE_VERSION download it in the background, verify its MD5 and restart into it once idle. Requires API Key authentication.
+ *     tags: [Firmware]
+ *     security:
+ *       - apiKeyAuth: []
+ *     parameters:
+ *       - in: query
+ *         name: version
+ *         required: true
+ *         schema:
+ *           type: string
+ *           pattern: '^[0-9A-Za-z._+-]{1,32}$'
+ *         description: Release name, must match FIRMWARE_VERSION in the image's config.h
+ *         example: 1.1.0
+ *     requestBody:
+ *       required: true
+ *       content:
+ *         application/octet-stream:
+ *           schema:
+ *             type: string
+ *             format: binary
+ *     responses:
+ *       201:
+ *         description: Release published
+ *         content:
+ *           application/json:
+ *             schema:
+ *               type: object
+ *               properties:
+ *                 success:
+ *                   type: boolean
+ *                   example: true
+ *                 data:
+ *                   $ref: '#/components/schemas/Firmware'
+ *       400:
+ *         $ref: '#/components/responses/ValidationError'
+ *       401:
+ *         $ref: '#/components/responses/Unauthorized'
+ *       409:
+ *         description: A release with this version already exists
+ *       500:
+ *         $ref: '#/components/responses/InternalServerError'
+ */
+router.post(
+  '/',
+  authenticateApiKey,
+  raw({ type: 'application/octet-stream', limit: FIRMWARE_MAX_SIZE }),
+  firmwareController.uploadFirmware,
+);
+
+/**
+ * @swagger
+ * /firmware:
+ *   get:
+ *     summary: List the firmware releases
+ *     description: Releases newest first, the first one is the release announced to the devices. Requires API Key authentication.
+ *     tags: [Firmware]
+ *     security:
+ *       - apiKeyAuth: []
+ *     responses:
+ *       200:
+ *         description: Releases retrieved successfully
+ *         content:
+ *           application/json:
+ *             schema:
+ *               type: object
+ *               properties:
+ *                 success:
+ *                   type: boolean
+ *                   example: true
+ *                 data:
+ *                   type: array
+ *                   items:
+ *                     $ref: '#/components/schemas/Firmware'
+ *                 count:
+ *                   type: integer
+ *                   example: 2
+ *       401:
+ *         $ref: '#/components/responses/Unauthorized'
+ *       500:
+ *         $ref: '#/components/responses/InternalServerError'
+ */
+router.get('/', authenticateApiKey, firmwareController.listFirmware);
+
+/**
+ * @swagger
+ * /firmware/download:
+ *   get:
+ *     summary: Download the current firmware release (device)
+ *     description: Serves the current release, one HTTP Range per chunk (single ranges of at most FIRMWARE_MAX_CHUNK bytes). Every response carries X-Firmware-Version and X-Firmware-MD5. Requires device JWT authentication.
+ *     tags: [Firmware]
+ *     security:
+ *       - bearerAuth: []
+ *     parameters:
+ *       - in: query
+ *         name: version
+ *         required: false
+ *         schema:
+ *           type: string
+ *         description: Release the device is downloading, 409 if it is no longer the current one
+ *         example: 1.1.0
+ *       - in: header
+ *         name: Range
+ *         required: false
+ *         schema:
+ *           type: string
+ *         example: bytes=0-16383
+ *     responses:
+ *       200:
+ *         description: Whole image (no Range header)
+ *       206:
+ *         description: Requested part of the image (Content-Range bytes first-last/size)
+ *         headers:
+ *           X-Firmware-Version:
+ *             schema:
+ *               type: string
+ *           X-Firmware-MD5:
+ *             schema:
+ *               type: string
+ *         content:
+ *           application/octet-stream:
+ *             schema:
+ *               type: string
+ *               format: binary
+ *       401:
+ *         $ref: '#/components/responses/Unauthorized'
+ *       404:
+ *         description: No release published
+ *       409:
+ *         description: The requested version is no longer the current release
+ *       416:
+ *         description: Range not satisfiable
+ */
+router.get('/download', authenticateDeviceJWT, firmwareController.downloadFirmware);
+
+/**
+ * @swagger
+ * /firmware/{version}:
+ *   delete:
+ *     summary: Withdraw a firmware release
+ *     description: Deletes a release, the previous one becomes current if it was the newest. Devices still downloading it drop the download. Requires API Key authentication.
+ *     tags: [Firmware]
+ *     security:
+ *       - apiKeyAuth: []
+ *     parameters:
+ *       - in: path
+ *         name: version
+ *         required: true
+ *         schema:
+ *           type: string
+ *         example: 1.1.0
+ *     responses:
+ *       200:
+ *         description: Release deleted
+ *       401:
+ *         $ref: '#/components/responses/Unauthorized'
+ *       404:
+ *         $ref: '#/components/responses/NotFound'
+ *       500:
+ *         $ref: '#/components/responses/InternalServerError'
+ */
+router.delete('/:version', authenticateApiKey, firmwareController.deleteFirmware);
+
+export default router;
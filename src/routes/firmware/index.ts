@@ -0,0 +1 @@
+export { default as firmwareRoutes } from './firmware.routes';
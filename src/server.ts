@@ -5,9 +5,14 @@ dotenv.config();
 
 import app from './app';
 import Logger from './logger/logger';
+import { HTTP_KEEP_ALIVE_TIMEOUT_MS } from './config/http';
 const PORT = process.env.PORT || 3000;
 
 // start server
-app.listen(PORT, () => {
+const server = app.listen(PORT, () => {
   Logger.info(`SmartDrawer API started on port ${PORT}`);
 });
+
+// Keep device connections open between polls (headersTimeout must be longer than keepAliveTimeout)
+server.keepAliveTimeout = HTTP_KEEP_ALIVE_TIMEOUT_MS;
+server.headersTimeout = HTTP_KEEP_ALIVE_TIMEOUT_MS + 1000;
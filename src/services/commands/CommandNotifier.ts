@@ -0,0 +1,112 @@
+import Logger from '../../logger/logger';
+
+/**
+ * Handle returned when waiting for a command notification
+ */
+export interface CommandWaiter {
+  /** Resolves true when a command was queued for the device, false on timeout/abort */
+  promise: Promise<boolean>;
+  /** Stop waiting (resolves the promise with false) */
+  cancel: () => void;
+}
+
+/**
+ * CommandNotifier
+ *
+ * In-process notification hub used by long-polling devices.
+ * Held poll requests register a waiter per device and are woken up
+ * as soon as a new command is queued for that device.
+ */
+export class CommandNotifier {
+  private waiters = new Map<string, Set<() => void>>();
+  private logger = Logger.child({ component: 'CommandNotifier' });
+
+  constructor() {
+    this.logger.debug('CommandNotifier initialized');
+  }
+
+  /**
+   * Wake up every request waiting for commands of a device
+   * @param deviceId - The device ID
+   */
+  notify(deviceId: string): void {
+    const listeners = this.waiters.get(deviceId);
+    if (!listeners) {
+      return;
+    }
+
+    this.logger.debug('Waking up waiting pollers', { deviceId, waiters: listeners.size });
+    this.waiters.delete(deviceId);
+    listeners.forEach((listener) => listener());
+  }
+
+  /**
+   * Wait until a command is queued for a device
+   * @param deviceId - The device ID
+   * @param timeoutMs - Maximum time to wait in milliseconds
+   * @param signal - Optional signal to abort the wait (e.g. client disconnected)
+   * @returns CommandWaiter handle
+   */
+  waitForCommand(deviceId: string, timeoutMs: number, signal?: AbortSignal): CommandWaiter {
+    let settle: (notified: boolean) => void = () => undefined;
+    const promise = new Promise<boolean>((resolve) => {
+      settle = resolve;
+    });
+
+    let done = false;
+    let timer: NodeJS.Timeout | undefined;
+
+    const finish = (notified: boolean) => {
+      if (done) {
+        return;
+      }
+      done = true;
+
+      if (timer) {
+        clearTimeout(timer);
+      }
+      signal?.removeEventListener('abort', onAbort);
+
+      const listeners = this.waiters.get(deviceId);
+      if (listeners) {
+        listeners.delete(listener);
+        if (listeners.size === 0) {
+          this.waiters.delete(deviceId);
+        }
+      }
+
+      settle(notified);
+    };
+    const listener = () => finish(true);
+    const onAbort = () => finish(false);
+
+    if (signal?.aborted || timeoutMs <= 0) {
+      finish(false);
+      return { promise, cancel: () => finish(false) };
+    }
+
+    let listeners = this.waiters.get(deviceId);
+    if (!listeners) {
+      listeners = new Set();
+      this.waiters.set(deviceId, listeners);
+    }
+    listeners.add(listener);
+
+    timer = setTimeout(() => finish(false), timeoutMs);
+    signal?.addEventListener('abort', onAbort, { once: true });
+
+    return { promise, cancel: () => finish(false) };
+  }
+
+  /**
+   * Get the number of requests currently waiting
+   * @returns number of waiting requests across all devices
+   */
+  getWaitingCount(): number {
+    let count = 0;
+    this.waiters.forEach((listeners) => {
+      count += listeners.size;
+    });
+    return count;
+  }
+}
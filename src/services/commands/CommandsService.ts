@@ -1,6 +1,36 @@
 import { CommandsRepository, CreateCommandDto, Command } from '../../repositories/commands/CommandsRepository';
+import { CommandNotifier } from './CommandNotifier';
+import { PendingCommandIndex } from './PendingCommandIndex';
 import Logger from '../../logger/logger';
 
+/**
+ * Execution result reported by a device for one command
+ */
+export interface CommandAckDto {
+  code: string;
+  status: string; // EXECUTED or FAILED
+  errorMessage?: string;
+}
+
+/**
+ * Outcome of applying one acknowledgement
+ */
+export interface CommandAckResult {
+  code: string;
+  success: boolean;
+  status?: string; // New command status when applied
+  error?: string; // Why the acknowledgement was rejected
+}
+
+/** Maximum number of acknowledgements accepted in one batch */
+export const MAX_ACK_BATCH_SIZE = 50;
+
+/** Maximum length of the error message of a FAILED acknowledgement */
+export const MAX_ACK_ERROR_MESSAGE_LENGTH = 255;
+
+/** Highest drawer number a device can have, must match the firmware (DRAWER_MAX_COUNT) */
+export const MAX_DRAWERS = 20;
+
 /**
  * CommandsService
  *
@@ -9,20 +39,30 @@ import Logger from '../../logger/logger';
  */
 export class CommandsService {
   private commandsRepository: CommandsRepository;
+  private commandNotifier: CommandNotifier;
+  private pendingIndex: PendingCommandIndex;
   private logger = Logger.child({ component: 'CommandsService' });
 
   /**
-   * Constructor - Injects the CommandsRepository dependency
+   * Constructor - Injects the CommandsRepository, CommandNotifier and PendingCommandIndex dependencies
    * @param commandsRepository - The repository to handle data operations
+   * @param commandNotifier - Notifier used to wake up long-polling devices
+   * @param pendingIndex - In-memory index answering polls without querying the database
    */
-  constructor(commandsRepository: CommandsRepository) {
+  constructor(
+    commandsRepository: CommandsRepository,
+    commandNotifier: CommandNotifier,
+    pendingIndex: PendingCommandIndex,
+  ) {
     this.commandsRepository = commandsRepository;
+    this.commandNotifier = commandNotifier;
+    this.pendingIndex = pendingIndex;
     this.logger.debug('CommandsService initialized');
   }
 
   /**
    * Create a new command for a device
-   * @param data - Command data (deviceId, action, drawer)
+   * @param data - Command data (deviceId, action, drawer, priority)
    * @returns Promise<Command> The created command with unique code
    */
   async createCommand(data: CreateCommandDto): Promise<Command> {
@@ -36,15 +76,35 @@ export class CommandsService {
       throw new Error('Action is required');
     }
 
-    const validActions = ['OPEN', 'CLOSE', 'UNLOCK', 'LOCK'];
+    const validActions = ['OPEN', 'OPEN_MANY', 'CLOSE', 'UNLOCK', 'LOCK'];
     if (!validActions.includes(data.action.toUpperCase())) {
       throw new Error(`Invalid action. Must be one of: ${validActions.join(', ')}`);
     }
 
     // Validate drawer if provided
     if (data.drawer !== undefined) {
-      if (!Number.isInteger(data.drawer) || data.drawer < 1 || data.drawer > 10) {
-        throw new Error('Drawer must be an integer between 1 and 10');
+      if (!Number.isInteger(data.drawer) || data.drawer < 1 || data.drawer > MAX_DRAWERS) {
+        throw new Error(`Invalid drawer: must be an integer between 1 and ${MAX_DRAWERS}`);
+      }
+    }
+
+    // Validate drawer list (required for OPEN_MANY)
+    if (data.action.toUpperCase() === 'OPEN_MANY') {
+      if (!Array.isArray(data.drawers) || data.drawers.length === 0) {
+        throw new Error('Invalid drawers: a drawer list is required for OPEN_MANY');
+      }
+      if (data.drawers.some((drawer) => !Number.isInteger(drawer) || drawer < 1 || drawer > MAX_DRAWERS)) {
+        throw new Error(`Invalid drawers: drawer numbers must be integers between 1 and ${MAX_DRAWERS}`);
+      }
+      if (new Set(data.drawers).size !== data.drawers.length) {
+        throw new Error('Invalid drawers: duplicated drawer numbers');
+      }
+    }
+
+    // Validate priority if provided (higher priorities are delivered first)
+    if (data.priority !== undefined) {
+      if (!Number.isInteger(data.priority) || data.priority < 0 || data.priority > 9) {
+        throw new Error('Priority must be an integer between 0 and 9');
       }
     }
 
@@ -53,6 +113,8 @@ export class CommandsService {
         deviceId: data.deviceId.trim(),
         action: data.action.toUpperCase(),
         drawer: data.drawer,
+        drawers: data.drawers,
+        priority: data.priority,
       });
 
       this.logger.info('Command created successfully', {
@@ -62,6 +124,10 @@ export class CommandsService {
         action: command.action,
       });
 
+      // Index it, then wake up the device if it is holding a long-poll request
+      this.pendingIndex.add(command);
+      this.commandNotifier.notify(command.deviceId);
+
       return command;
     } catch (error) {
       this.logger.error('Failed to create command', {
@@ -95,6 +161,7 @@ export class CommandsService {
 
   /**
    * Get the next pending command for a device
+   * Answered from the pending command index, see PendingCommandIndex.
    * @param deviceId - The device ID
    * @returns Promise<Command | null>
    */
@@ -104,7 +171,8 @@ export class CommandsService {
     }
 
     try {
-      return await this.commandsRepository.findNextPending(deviceId.trim());
+      const [command] = await this.pendingIndex.getPending(deviceId.trim(), 1);
+      return command ?? null;
     } catch (error) {
       this.logger.error('Failed to get next pending command', {
         error: error instanceof Error ? error.message : 'Unknown error',
@@ -114,6 +182,182 @@ export class CommandsService {
     }
   }
 
+  /**
+   * Get the pending commands for a device, highest priority first, then oldest
+   * Answered from the pending command index, see PendingCommandIndex.
+   * @param deviceId - The device ID
+   * @param max - Maximum number of commands to return
+   * @returns Promise<Command[]>
+   */
+  async getNextPendingCommands(deviceId: string, max: number): Promise<Command[]> {
+    if (!deviceId || deviceId.trim() === '') {
+      throw new Error('Device ID is required');
+    }
+
+    if (!Number.isInteger(max) || max < 1) {
+      throw new Error('max must be a positive integer');
+    }
+
+    try {
+      return await this.pendingIndex.getPending(deviceId.trim(), max);
+    } catch (error) {
+      this.logger.error('Failed to get next pending commands', {
+        error: error instanceof Error ? error.message : 'Unknown error',
+        deviceId,
+        max,
+      });
+      throw new Error('Failed to retrieve next pending commands');
+    }
+  }
+
+  /**
+   * Wait for the next pending command for a device (long-polling)
+   * Returns immediately if a command is already pending, otherwise holds
+   * until a command is queued for the device or the timeout expires.
+   * @param deviceId - The device ID
+   * @param timeoutMs - Maximum time to wait in milliseconds
+   * @param signal - Optional signal to abort the wait (e.g. client disconnected)
+   * @returns Promise<Command | null> null if no command arrived in time
+   */
+  async waitForNextPendingCommand(deviceId: string, timeoutMs: number, signal?: AbortSignal): Promise<Command | null> {
+    const commands = await this.waitForNextPendingCommands(deviceId, 1, timeoutMs, signal);
+    return commands[0] ?? null;
+  }
+
+  /**
+   * Wait for pending commands for a device (long-polling, batched)
+   * Returns immediately if commands are already pending, otherwise holds
+   * until a command is queued for the device or the timeout expires.
+   * @param deviceId - The device ID
+   * @param max - Maximum number of commands to return
+   * @param timeoutMs - Maximum time to wait in milliseconds
+   * @param signal - Optional signal to abort the wait (e.g. client disconnected)
+   * @returns Promise<Command[]> empty if no command arrived in time
+   */
+  async waitForNextPendingCommands(
+    deviceId: string,
+    max: number,
+    timeoutMs: number,
+    signal?: AbortSignal,
+  ): Promise<Command[]> {
+    if (!deviceId || deviceId.trim() === '') {
+      throw new Error('Device ID is required');
+    }
+
+    const id = deviceId.trim();
+    const deadline = Date.now() + timeoutMs;
+
+    for (;;) {
+      // Register before querying so a command created in between is not missed
+      const waiter = this.commandNotifier.waitForCommand(id, deadline - Date.now(), signal);
+
+      const commands = await this.getNextPendingCommands(id, max);
+      if (commands.length > 0) {
+        waiter.cancel();
+        return commands;
+      }
+
+      const notified = await waiter.promise;
+      if (!notified) {
+        // Timed out or the client went away
+        return [];
+      }
+    }
+  }
+
+  /**
+   * Apply a batch of execution results reported by a device
+   * Executed commands are updated in a single query.
+   * @param acks - Results for each command code
+   * @returns Promise<CommandAckResult[]> Outcome for each acknowledgement, in order
+   */
+  async acknowledgeCommands(acks: CommandAckDto[]): Promise<CommandAckResult[]> {
+    if (!Array.isArray(acks) || acks.length === 0) {
+      throw new Error('Invalid acknowledgements: at least one result is required');
+    }
+
+    if (acks.length > MAX_ACK_BATCH_SIZE) {
+      throw new Error(`Invalid acknowledgements: at most ${MAX_ACK_BATCH_SIZE} results per batch`);
+    }
+
+    for (const ack of acks) {
+      if (!ack || typeof ack.code !== 'string' || ack.code.trim() === '') {
+        throw new Error('Invalid acknowledgements: every result needs a command code');
+      }
+      if (typeof ack.status !== 'string' || !['EXECUTED', 'FAILED'].includes(ack.status.toUpperCase())) {
+        throw new Error('Invalid acknowledgements: status must be EXECUTED or FAILED');
+      }
+      if (
+        ack.errorMessage !== undefined &&
+        ack.errorMessage !== null &&
+        (typeof ack.errorMessage !== 'string' || ack.errorMessage.length > MAX_ACK_ERROR_MESSAGE_LENGTH)
+      ) {
+        throw new Error(
+          `Invalid acknowledgements: errorMessage must be a string of at most ${MAX_ACK_ERROR_MESSAGE_LENGTH} characters`,
+        );
+      }
+    }
+
+    try {
+      const codes = acks.map((ack) => ack.code.trim());
+      const commands = await this.commandsRepository.findByCodes(codes);
+      const statusByCode = new Map(commands.map((command) => [command.code, command.status]));
+
+      const results: CommandAckResult[] = [];
+      const executedCodes: string[] = [];
+      const failedAcks: CommandAckDto[] = [];
+
+      for (const ack of acks) {
+        const code = ack.code.trim();
+        const currentStatus = statusByCode.get(code);
+
+        if (!currentStatus) {
+          results.push({ code, success: false, error: 'not found' });
+        } else if (currentStatus !== 'PENDING') {
+          results.push({ code, success: false, error: `not in PENDING status (current: ${currentStatus})` });
+        } else {
+          const status = ack.status.toUpperCase();
+          results.push({ code, success: true, status });
+          if (status === 'EXECUTED') {
+            executedCodes.push(code);
+          } else {
+            failedAcks.push(ack);
+          }
+          // Duplicated codes in the same batch are only applied once
+          statusByCode.set(code, status);
+        }
+      }
+
+      if (executedCodes.length > 0) {
+        await this.commandsRepository.markManyAsExecuted(executedCodes);
+      }
+      for (const ack of failedAcks) {
+        await this.commandsRepository.markAsFailed(ack.code.trim(), ack.errorMessage?.trim());
+      }
+
+      // Applied commands are no longer pending
+      const applied = new Set(results.filter((result) => result.success).map((result) => result.code));
+      commands
+        .filter((command) => applied.has(command.code))
+        .forEach((command) => this.pendingIndex.remove(command.deviceId, [command.code]));
+
+      this.logger.info('Command acknowledgements applied', {
+        total: acks.length,
+        executed: executedCodes.length,
+        failed: failedAcks.length,
+        rejected: results.filter((result) => !result.success).length,
+      });
+
+      return results;
+    } catch (error) {
+      this.logger.error('Failed to apply command acknowledgements', {
+        error: error instanceof Error ? error.message : 'Unknown error',
+        count: acks.length,
+      });
+      throw new Error('Failed to acknowledge commands');
+    }
+  }
+
   /**
    * Mark a command as successfully executed
    * @param code - The command code
@@ -136,7 +380,9 @@ export class CommandsService {
         throw new Error(`Command with code ${code} is not in PENDING status (current: ${command.status})`);
       }
 
-      return await this.commandsRepository.markAsExecuted(code.trim());
+      const executed = await this.commandsRepository.markAsExecuted(code.trim());
+      this.pendingIndex.remove(executed.deviceId, [executed.code]);
+      return executed;
     } catch (error) {
       this.logger.error('Failed to mark command as executed', {
         error: error instanceof Error ? error.message : 'Unknown error',
@@ -175,7 +421,9 @@ export class CommandsService {
         throw new Error(`Command with code ${code} is not in PENDING status (current: ${command.status})`);
       }
 
-      return await this.commandsRepository.markAsFailed(code.trim(), errorMessage?.trim());
+      const failed = await this.commandsRepository.markAsFailed(code.trim(), errorMessage?.trim());
+      this.pendingIndex.remove(failed.deviceId, [failed.code]);
+      return failed;
     } catch (error) {
       this.logger.error('Failed to mark command as failed', {
         error: error instanceof Error ? error.message : 'Unknown error',
@@ -192,6 +440,14 @@ export class CommandsService {
     }
   }
 
+  /**
+   * Drop the in-memory pending commands of a device (e.g. the device was deleted)
+   * @param deviceId - The device ID
+   */
+  forgetDevice(deviceId: string): void {
+    this.pendingIndex.forget(deviceId);
+  }
+
   /**
    * Get all commands for a device
    * @param deviceId - The device ID
@@ -0,0 +1,184 @@
+import { CommandsRepository, Command } from '../../repositories/commands/CommandsRepository';
+import { PENDING_INDEX_MAX_PER_DEVICE } from '../../config/polling';
+import Logger from '../../logger/logger';
+
+/**
+ * Pending commands of one device held in memory
+ */
+interface DeviceEntry {
+  /** Pending commands by code, in delivery order (highest priority first, then oldest) */
+  commands: Map<string, Command>;
+  /** false when the database may hold pending commands that are not in memory */
+  complete: boolean;
+  /** Load from the database in progress */
+  loading?: Promise<void>;
+  /** Codes removed while the load was in progress (the load must not bring them back) */
+  removedWhileLoading?: Set<string>;
+}
+
+/**
+ * Delivery order of pending commands: highest priority first, then oldest
+ */
+function byDeliveryOrder(a: Command, b: Command): number {
+  return b.priority - a.priority || a.createdAt.getTime() - b.createdAt.getTime();
+}
+
+/**
+ * PendingCommandIndex
+ *
+ * In-process index of the PENDING commands of each device, so polls (and
+ * long-polls waking up) are answered from memory instead of querying the
+ * database. A device's entry is loaded from the database on its first poll,
+ * then kept up to date by CommandsService: created commands are added,
+ * executed/failed ones removed.
+ *
+ * At most PENDING_INDEX_MAX_PER_DEVICE commands are held per device; past that the
+ * entry is marked incomplete and reloaded from the database once it drains.
+ * Commands are kept in delivery order, so a full entry still holds the most
+ * urgent ones: a new command evicts the last one if its priority is higher.
+ * Like CommandNotifier it lives in the process, so the API must run as a single instance.
+ */
+export class PendingCommandIndex {
+  private commandsRepository: CommandsRepository;
+  private maxPerDevice: number;
+  private devices = new Map<string, DeviceEntry>();
+  private logger = Logger.child({ component: 'PendingCommandIndex' });
+
+  /**
+   * Constructor - Injects the CommandsRepository dependency
+   * @param commandsRepository - Repository used to load a device's pending commands
+   * @param maxPerDevice - Maximum number of commands held in memory per device
+   */
+  constructor(commandsRepository: CommandsRepository, maxPerDevice: number = PENDING_INDEX_MAX_PER_DEVICE) {
+    this.commandsRepository = commandsRepository;
+    this.maxPerDevice = Math.max(1, maxPerDevice);
+    this.logger.debug('PendingCommandIndex initialized', { maxPerDevice: this.maxPerDevice });
+  }
+
+  /**
+   * Get the next pending commands of a device (highest priority first, then oldest)
+   * Only queries the database the first time a device is seen, or when
+   * its backlog did not fit in memory.
+   * @param deviceId - The device ID
+   * @param max - Maximum number of commands to return
+   * @returns Promise<Command[]>
+   */
+  async getPending(deviceId: string, max: number): Promise<Command[]> {
+    let entry = this.devices.get(deviceId);
+    if (!entry) {
+      entry = { commands: new Map(), complete: false };
+      this.devices.set(deviceId, entry);
+    }
+
+    if (!entry.complete && (entry.loading || entry.commands.size < max)) {
+      await this.load(deviceId, entry);
+    }
+
+    const commands: Command[] = [];
+    for (const command of entry.commands.values()) {
+      if (commands.length >= max) {
+        break;
+      }
+      commands.push(command);
+    }
+    return commands;
+  }
+
+  /**
+   * Add a newly created command
+   * Devices that never polled are skipped, their entry is loaded on the first poll.
+   * @param command - The created command (PENDING)
+   */
+  add(command: Command): void {
+    const entry = this.devices.get(command.deviceId);
+    if (!entry) {
+      return;
+    }
+
+    const commands = [...entry.commands.values()];
+    const last = commands[commands.length - 1];
+    if (entry.commands.size >= this.maxPerDevice) {
+      // Stays in the database only, picked up by the next load
+      entry.complete = false;
+      if (!last || command.priority <= last.priority) {
+        return;
+      }
+      entry.commands.delete(last.code);
+      commands.pop();
+    }
+
+    if (!last || command.priority <= last.priority) {
+      entry.commands.set(command.code, command);
+      return;
+    }
+    // Jumps the queue: rebuild the entry in delivery order
+    entry.commands = new Map([...commands, command].sort(byDeliveryOrder).map((c) => [c.code, c]));
+  }
+
+  /**
+   * Remove commands that left the PENDING status
+   * @param deviceId - The device ID
+   * @param codes - Codes of the executed/failed commands
+   */
+  remove(deviceId: string, codes: string[]): void {
+    const entry = this.devices.get(deviceId);
+    if (!entry) {
+      return;
+    }
+
+    for (const code of codes) {
+      entry.commands.delete(code);
+      entry.removedWhileLoading?.add(code);
+    }
+  }
+
+  /**
+   * Drop the entry of a device (e.g. the device was deleted)
+   * @param deviceId - The device ID
+   */
+  forget(deviceId: string): void {
+    this.devices.delete(deviceId);
+  }
+
+  /**
+   * Get the size of the index
+   * @returns number of devices indexed and of pending commands held in memory
+   */
+  getStats(): { devices: number; commands: number } {
+    let commands = 0;
+    this.devices.forEach((entry) => {
+      commands += entry.commands.size;
+    });
+    return { devices: this.devices.size, commands };
+  }
+
+  /**
+   * Load the pending commands of a device from the database, merging them with
+   * the changes made while the query ran (concurrent polls share one query)
+   * @param deviceId - The device ID
+   * @param entry - The device entry
+   */
+  private async load(deviceId: string, entry: DeviceEntry): Promise<void> {
+    if (!entry.loading) {
+      entry.removedWhileLoading = new Set();
+      entry.loading = (async () => {
+        const loaded = await this.commandsRepository.findPendingByDevice(deviceId, this.maxPerDevice);
+        const removed = entry.removedWhileLoading ?? new Set<string>();
+
+        const merged = new Map<string, Command>();
+        [...loaded, ...entry.commands.values()]
+          .filter((command) => !removed.has(command.code))
+          .sort(byDeliveryOrder)
+          .forEach((command) => merged.set(command.code, command));
+
+        entry.commands = merged;
+        entry.complete = loaded.length < this.maxPerDevice;
+        this.logger.debug('Pending commands loaded', { deviceId, count: merged.size, complete: entry.complete });
+      })().finally(() => {
+        entry.loading = undefined;
+        entry.removedWhileLoading = undefined;
+      });
+    }
+    await entry.loading;
+  }
+}
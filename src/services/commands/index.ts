@@ -1 +1,3 @@
 export * from './CommandsService';
+export * from './CommandNotifier';
+export * from './PendingCommandIndex';
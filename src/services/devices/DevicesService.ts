@@ -1,6 +1,22 @@
 import { DevicesRepository } from '../../repositories/devices/DevicesRepository';
-import { Device, CreateDeviceDto, UpdateDeviceDto, DeviceStatus, CommandDto } from '../../types/devices.types';
-import { CommandsService } from '../commands/CommandsService';
+import {
+  Device,
+  CreateDeviceDto,
+  UpdateDeviceDto,
+  DeviceStatus,
+  CommandDto,
+  DeviceMetrics,
+  DeviceMetricsReport,
+  DeviceDrawerStates,
+  DrawerState,
+  DrawerConfig,
+  DeviceConfigBlob,
+  PollSlot,
+} from '../../types/devices.types';
+import { CommandsService, MAX_DRAWERS } from '../commands/CommandsService';
+import { FirmwareService } from '../firmware/FirmwareService';
+import { Command } from '../../repositories/commands/CommandsRepository';
+import { DEVICE_POLL_SLOT_INTERVAL_MS } from '../../config/polling';
 import Logger from '../../logger/logger';
 
 /**
@@ -13,16 +29,29 @@ import Logger from '../../logger/logger';
 export class DevicesService {
   private devicesRepository: DevicesRepository;
   private commandsService: CommandsService;
+  private firmwareService: FirmwareService;
   private logger = Logger.child({ component: 'DevicesService' });
+  // Version of the drawer table last sent or set per device (announced on polls)
+  private configVersions = new Map<string, number>();
+
+  // Metrics a single report may carry (counters + gauges + histograms)
+  private static readonly MAX_METRICS = 64;
+
+  // Drawer pulse limit, must match the firmware (DRAWER_PULSE_MAX_MS), the drawer count limit is MAX_DRAWERS
+  private static readonly MAX_PULSE_MS = 2000;
+  // ESP32 GPIOs that can drive a relay, must match drawerPinValid in the firmware (drawerConfig.h)
+  private static readonly RELAY_PINS = [0, 2, 4, 5, 12, 13, 14, 15, 16, 17, 18, 19, 21, 22, 23, 25, 26, 27, 32, 33];
 
   /**
-   * Constructor - Injects the DevicesRepository and CommandsService dependencies
+   * Constructor - Injects the DevicesRepository, CommandsService and FirmwareService dependencies
    * @param devicesRepository - The repository to handle data operations
    * @param commandsService - The service to handle command operations
+   * @param firmwareService - The service holding the firmware release devices should run
    */
-  constructor(devicesRepository: DevicesRepository, commandsService: CommandsService) {
+  constructor(devicesRepository: DevicesRepository, commandsService: CommandsService, firmwareService: FirmwareService) {
     this.devicesRepository = devicesRepository;
     this.commandsService = commandsService;
+    this.firmwareService = firmwareService;
     this.logger.debug('DevicesService initialized');
   }
 
@@ -169,8 +198,12 @@ export class DevicesService {
 
     // Business rule: Validate drawerCount if provided
     if (deviceData.drawerCount !== undefined) {
-      if (!Number.isInteger(deviceData.drawerCount) || deviceData.drawerCount < 1 || deviceData.drawerCount > 20) {
-        throw new Error('Drawer count must be an integer between 1 and 20');
+      if (
+        !Number.isInteger(deviceData.drawerCount) ||
+        deviceData.drawerCount < 1 ||
+        deviceData.drawerCount > MAX_DRAWERS
+      ) {
+        throw new Error(`Drawer count must be an integer between 1 and ${MAX_DRAWERS}`);
       }
     }
 
@@ -246,8 +279,17 @@ export class DevicesService {
 
     // Business rule: DrawerCount validation if provided
     if (deviceData.drawerCount !== undefined) {
-      if (!Number.isInteger(deviceData.drawerCount) || deviceData.drawerCount < 1 || deviceData.drawerCount > 20) {
-        throw new Error('Drawer count must be an integer between 1 and 20');
+      if (
+        !Number.isInteger(deviceData.drawerCount) ||
+        deviceData.drawerCount < 1 ||
+        deviceData.drawerCount > MAX_DRAWERS
+      ) {
+        throw new Error(`Drawer count must be an integer between 1 and ${MAX_DRAWERS}`);
+      }
+      // Business rule: A drawer table defines the drawer count
+      const config = this.parseDrawerConfig(existingDevice.drawerConfig);
+      if (config && config.pins.length !== deviceData.drawerCount) {
+        throw new Error(`Invalid drawer count: the drawer config defines ${config.pins.length} drawers`);
       }
     }
 
@@ -296,6 +338,8 @@ export class DevicesService {
 
     try {
       await this.devicesRepository.delete(id);
+      this.commandsService.forgetDevice(id);
+      this.configVersions.delete(id);
     } catch {
       throw new Error(`Failed to delete device with ID: ${id}`);
     }
@@ -355,22 +399,22 @@ export class DevicesService {
   /**
    * Get the next command for a specific device
    * @param id - The device ID
+   * @param waitMs - Optional time to hold the request waiting for a command (long-polling)
+   * @param signal - Optional signal to abort the wait (e.g. client disconnected)
    * @returns The next command for the device or null if none exists
    */
-  async getNextCommandForDevice(id: string): Promise<CommandDto | null> {
+  async getNextCommandForDevice(id: string, waitMs: number = 0, signal?: AbortSignal): Promise<CommandDto | null> {
     try {
-      const command = await this.commandsService.getNextPendingCommand(id);
+      const command =
+        waitMs > 0
+          ? await this.commandsService.waitForNextPendingCommand(id, waitMs, signal)
+          : await this.commandsService.getNextPendingCommand(id);
 
       if (!command) {
         return null;
       }
 
-      // Convert database command format to CommandDto format
-      return {
-        action: command.action.toLowerCase().replace('_', ' '), // Convert 'OPEN' to 'open'
-        drawer: command.drawer ?? undefined,
-        code: command.code, // Include the unique code for tracking
-      };
+      return this.toCommandDto(command);
     } catch (error) {
       this.logger.error('Failed to get next command for device', {
         error: error instanceof Error ? error.message : 'Unknown error',
@@ -380,6 +424,248 @@ export class DevicesService {
     }
   }
 
+  /**
+   * Get up to `max` pending commands for a specific device in one request
+   * @param id - The device ID
+   * @param max - Maximum number of commands to return
+   * @param waitMs - Optional time to hold the request waiting for a command (long-polling)
+   * @param signal - Optional signal to abort the wait (e.g. client disconnected)
+   * @returns The pending commands for the device (empty if none exists)
+   */
+  async getNextCommandsForDevice(
+    id: string,
+    max: number,
+    waitMs: number = 0,
+    signal?: AbortSignal,
+  ): Promise<CommandDto[]> {
+    try {
+      const commands =
+        waitMs > 0
+          ? await this.commandsService.waitForNextPendingCommands(id, max, waitMs, signal)
+          : await this.commandsService.getNextPendingCommands(id, max);
+
+      return commands.map((command) => this.toCommandDto(command));
+    } catch (error) {
+      this.logger.error('Failed to get next commands for device', {
+        error: error instanceof Error ? error.message : 'Unknown error',
+        deviceId: id,
+        max,
+      });
+      return [];
+    }
+  }
+
+  /**
+   * Get the poll slot of a device
+   * @param id - The device ID
+   * @returns The slot, or null when slots are disabled (DEVICE_POLL_SLOT_INTERVAL_MS = 0)
+   */
+  getPollSlot(id: string): PollSlot | null {
+    if (!(DEVICE_POLL_SLOT_INTERVAL_MS > 0)) {
+      return null;
+    }
+    return { intervalMs: DEVICE_POLL_SLOT_INTERVAL_MS, offsetMs: this.slotPhase(id, DEVICE_POLL_SLOT_INTERVAL_MS) };
+  }
+
+  /**
+   * Get how long to hold a long-poll of a device
+   * With slots enabled the hold ends on the device's phase of a waitSeconds grid, so
+   * devices that polled together answer, and poll again, at different times.
+   * @param id - The device ID
+   * @param waitSeconds - Wait requested by the device
+   * @param now - Current time in ms
+   * @returns Hold time in ms, between 1 and waitSeconds * 1000
+   */
+  getLongPollHoldMs(id: string, waitSeconds: number, now: number = Date.now()): number {
+    const waitMs = waitSeconds * 1000;
+    if (waitMs <= 0 || !(DEVICE_POLL_SLOT_INTERVAL_MS > 0)) {
+      return waitMs;
+    }
+    const untilSlot = (this.slotPhase(id, waitMs) - (now % waitMs) + waitMs) % waitMs;
+    return untilSlot === 0 ? waitMs : untilSlot;
+  }
+
+  /**
+   * Set the drawer hardware table of a device
+   * The table is sent to the device with its next token, and the device's
+   * drawer count follows it so the two can't drift apart.
+   * @param id - The device ID
+   * @param config - The drawer table
+   * @returns Promise<Device> The updated device
+   * @throws Error if the device is not found or the table is invalid
+   */
+  async setDrawerConfig(id: string, config: DrawerConfig): Promise<Device> {
+    this.validateDrawerConfig(config);
+
+    const device = await this.devicesRepository.findById(id);
+    if (!device) {
+      throw new Error(`Device with ID ${id} not found`);
+    }
+
+    const stored: DrawerConfig = { pins: config.pins, pulseMs: config.pulseMs, activeLevel: config.activeLevel ?? 0 };
+    const json = JSON.stringify(stored);
+    this.logger.info('Drawer config updated', { id, drawers: stored.pins.length });
+    const updated = await this.devicesRepository.updateDrawerConfig(id, json, stored.pins.length);
+    this.configVersions.set(id, this.fnv1a(json));
+    return updated;
+  }
+
+  /**
+   * Get the version of the drawer table a device should run
+   * Sent on polls (X-Config-Version) so a device picks up a new table within
+   * one poll by authenticating again, instead of waiting for its token renewal.
+   * @param id - The device ID
+   * @returns The version, or undefined if unknown to this process
+   */
+  getConfigVersion(id: string): number | undefined {
+    return this.configVersions.get(id);
+  }
+
+  /**
+   * Get the firmware release every device should run
+   * Sent on polls (X-Firmware-Version), devices running another release download it.
+   * @returns The release name, or undefined if none was uploaded
+   */
+  getFirmwareVersion(): string | undefined {
+    return this.firmwareService.getCurrentVersion();
+  }
+
+  /**
+   * Get the drawer hardware table of a device
+   * @param id - The device ID
+   * @returns The drawer table, or null when the firmware defaults apply
+   * @throws Error if the device is not found
+   */
+  async getDrawerConfig(id: string): Promise<DrawerConfig | null> {
+    const device = await this.devicesRepository.findById(id);
+    if (!device) {
+      throw new Error(`Device with ID ${id} not found`);
+    }
+    return this.parseDrawerConfig(device.drawerConfig);
+  }
+
+  /**
+   * Build the compact drawer table sent to a device with its token
+   * @param device - The device
+   * @returns The table with its version, or null when the firmware defaults apply
+   */
+  getDeviceConfigBlob(device: Device): DeviceConfigBlob | null {
+    const config = this.parseDrawerConfig(device.drawerConfig);
+    if (!config) {
+      return null;
+    }
+    const v = this.fnv1a(device.drawerConfig ?? '');
+    this.configVersions.set(device.id, v);
+    return {
+      v,
+      pins: config.pins,
+      pulse: config.pulseMs,
+      active: config.activeLevel,
+    };
+  }
+
+  /**
+   * Validate the delivery priority of a command
+   * @param priority - Priority to validate (undefined = default)
+   * @throws Error if the priority is not an integer between 0 and 9
+   */
+  private validatePriority(priority: number | undefined): void {
+    if (priority !== undefined && (!Number.isInteger(priority) || priority < 0 || priority > 9)) {
+      throw new Error('Invalid priority: must be an integer between 0 and 9');
+    }
+  }
+
+  /**
+   * Validate a drawer hardware table
+   * @param config - The table to validate
+   * @throws Error if the table is invalid
+   */
+  private validateDrawerConfig(config: DrawerConfig): void {
+    // Same rule as drawerPinValid in the firmware (drawerConfig.h): 1 and 3 are the Serial TX/RX,
+    // 6-11 are wired to the flash, 20, 24 and 28-31 don't exist, 34-39 are input only
+    const isRelayPin = (pin: unknown) => Number.isInteger(pin) && DevicesService.RELAY_PINS.includes(pin as number);
+
+    if (!config || typeof config !== 'object') {
+      throw new Error('Invalid drawer config: body must be an object');
+    }
+    if (!Array.isArray(config.pins) || config.pins.length < 1 || config.pins.length > MAX_DRAWERS) {
+      throw new Error(`Invalid drawer config: pins must list 1 to ${MAX_DRAWERS} GPIOs`);
+    }
+    if (!config.pins.every(isRelayPin)) {
+      throw new Error('Invalid drawer config: pins must be relay GPIOs (0, 2, 4, 5, 12-19, 21-23, 25-27, 32, 33)');
+    }
+    if (new Set(config.pins).size !== config.pins.length) {
+      throw new Error('Invalid drawer config: pins must not contain duplicates');
+    }
+    if (
+      !Array.isArray(config.pulseMs) ||
+      config.pulseMs.length !== config.pins.length ||
+      !config.pulseMs.every((ms) => Number.isInteger(ms) && ms >= 1 && ms <= DevicesService.MAX_PULSE_MS)
+    ) {
+      throw new Error(
+        `Invalid drawer config: pulseMs must have one width per pin, between 1 and ${DevicesService.MAX_PULSE_MS} ms`,
+      );
+    }
+    if (config.activeLevel !== undefined && config.activeLevel !== 0 && config.activeLevel !== 1) {
+      throw new Error('Invalid drawer config: activeLevel must be 0 or 1');
+    }
+  }
+
+  /**
+   * Parse a stored drawer table, ignoring unreadable data
+   * @param json - Stored drawer table JSON
+   * @returns The table, or null if none is stored
+   */
+  private parseDrawerConfig(json: string | null | undefined): DrawerConfig | null {
+    if (!json) {
+      return null;
+    }
+    try {
+      return JSON.parse(json) as DrawerConfig;
+    } catch {
+      this.logger.warn('Discarding unreadable drawer config');
+      return null;
+    }
+  }
+
+  /**
+   * Stable phase of a device inside a period (FNV-1a hash of its ID)
+   * @param id - The device ID
+   * @param periodMs - Period in ms
+   * @returns Phase in ms, between 0 and periodMs - 1
+   */
+  private slotPhase(id: string, periodMs: number): number {
+    return this.fnv1a(id) % periodMs;
+  }
+
+  /**
+   * 32-bit FNV-1a hash of a string
+   * @param text - The string to hash
+   * @returns The hash as an unsigned integer
+   */
+  private fnv1a(text: string): number {
+    let hash = 0x811c9dc5;
+    for (let i = 0; i < text.length; i++) {
+      hash = Math.imul(hash ^ text.charCodeAt(i), 0x01000193);
+    }
+    return hash >>> 0;
+  }
+
+  /**
+   * Convert database command format to CommandDto format
+   * @param command - The stored command
+   * @returns CommandDto sent to the device
+   */
+  private toCommandDto(command: Command): CommandDto {
+    return {
+      action: command.action.toLowerCase().replace('_', ' '), // Convert 'OPEN' to 'open'
+      drawer: command.drawer ?? undefined,
+      drawers: command.drawers ? command.drawers.split(',').map(Number) : undefined,
+      priority: command.priority || undefined, // Only sent when above the default
+      code: command.code, // Include the unique code for tracking
+    };
+  }
+
   /**
    * Queue a command for a specific device
    * @param id - The device ID
@@ -397,6 +683,8 @@ export class DevicesService {
         deviceId: id,
         action,
         drawer: command.drawer,
+        drawers: command.drawers,
+        priority: command.priority,
       });
 
       this.logger.info('Command queued successfully', {
@@ -411,6 +699,11 @@ export class DevicesService {
         deviceId: id,
         command,
       });
+      // Re-throw with original message if the command itself was rejected
+      if (error instanceof Error && error.message.includes('Invalid')) {
+        throw error;
+      }
+
       throw new Error('Failed to queue command for device');
     }
   }
@@ -419,14 +712,16 @@ export class DevicesService {
    * Open a specific drawer for a device
    * @param id - The device ID
    * @param drawerNumber - The number of the drawer to open
+   * @param priority - Delivery priority 0-9, higher first (default 0)
    * @returns Promise<string> The unique command code
    * @throws Error if device not found or drawer is invalid
    */
-  async openDrawer(id: string, drawerNumber: number): Promise<string> {
+  async openDrawer(id: string, drawerNumber: number, priority?: number): Promise<string> {
     // Validate drawer number
     if (!Number.isInteger(drawerNumber) || drawerNumber < 1) {
       throw new Error('Drawer number must be a positive integer');
     }
+    this.validatePriority(priority);
 
     // Get device to check drawer count
     const device = await this.devicesRepository.findById(id);
@@ -441,11 +736,51 @@ export class DevicesService {
       );
     }
 
-    const command: CommandDto = { action: 'open', drawer: drawerNumber };
+    const command: CommandDto = { action: 'open', drawer: drawerNumber, priority };
     this.logger.debug('Queueing open drawer command for device', { id, drawerNumber });
     return await this.queueCommandForDevice(id, command);
   }
 
+  /**
+   * Open several drawers of a device together (one command, one relay pulse on the device)
+   * @param id - The device ID
+   * @param drawerNumbers - The numbers of the drawers to open
+   * @param priority - Delivery priority 0-9, higher first (default 0)
+   * @returns Promise<string> The unique command code
+   * @throws Error if device not found or a drawer is invalid
+   */
+  async openDrawers(id: string, drawerNumbers: number[], priority?: number): Promise<string> {
+    // Validate drawer numbers
+    if (!Array.isArray(drawerNumbers) || drawerNumbers.length === 0) {
+      throw new Error('Invalid drawers: at least one drawer is required');
+    }
+    if (drawerNumbers.some((drawer) => !Number.isInteger(drawer) || drawer < 1)) {
+      throw new Error('Invalid drawers: drawer numbers must be positive integers');
+    }
+    if (new Set(drawerNumbers).size !== drawerNumbers.length) {
+      throw new Error('Invalid drawers: duplicated drawer numbers');
+    }
+    this.validatePriority(priority);
+
+    // Get device to check drawer count
+    const device = await this.devicesRepository.findById(id);
+    if (!device) {
+      throw new Error(`Device with ID ${id} not found`);
+    }
+
+    // Validate every drawer exists for this device
+    const missing = drawerNumbers.filter((drawer) => drawer > device.drawerCount);
+    if (missing.length > 0) {
+      throw new Error(
+        `Drawers ${missing.join(', ')} out of range. This device has ${device.drawerCount} drawer${device.drawerCount !== 1 ? 's' : ''} (valid: 1-${device.drawerCount})`,
+      );
+    }
+
+    const command: CommandDto = { action: 'open_many', drawers: drawerNumbers, priority };
+    this.logger.debug('Queueing open drawers command for device', { id, drawerNumbers });
+    return await this.queueCommandForDevice(id, command);
+  }
+
   /**
    * Store a confirmed command execution result for a device
    * device send a confirmation that a command was executed
@@ -476,4 +811,222 @@ export class DevicesService {
       throw new Error(`Failed to update last poll for device with ID: ${id}`);
     }
   }
+
+  /**
+   * Accumulate a metrics report sent by a device
+   * Reports are deltas, so they are added to the stored totals. Totals restart
+   * when the device reports different histogram buckets (firmware change).
+   * @param id - The device ID
+   * @param report - The metrics report
+   * @throws Error if the device is not found or the report is invalid
+   */
+  async reportMetrics(id: string, report: DeviceMetricsReport): Promise<void> {
+    this.validateMetricsReport(report);
+
+    const device = await this.devicesRepository.findById(id);
+    if (!device) {
+      throw new Error(`Device with ID ${id} not found`);
+    }
+
+    let metrics = this.parseMetrics((await this.devicesRepository.getDeviceStatus(id))?.metrics);
+    if (!metrics || metrics.buckets.join(',') !== report.buckets.join(',')) {
+      metrics = {
+        since: new Date().toISOString(),
+        reports: 0,
+        uptimeMs: 0,
+        gauges: {},
+        counters: {},
+        buckets: report.buckets,
+        histograms: {},
+      };
+    }
+
+    this.logDrawerChanges(id, metrics.gauges, report.gauges ?? {});
+    if (typeof report.firmware === 'string' && report.firmware !== device.firmwareVersion) {
+      this.logger.info('Device firmware changed', { id, from: device.firmwareVersion, to: report.firmware });
+      await this.devicesRepository.updateFirmwareVersion(id, report.firmware);
+    }
+    if (report.counters?.restarts) {
+      // resetReason is esp_reset_reason(), restartCause is set when the firmware supervisor restarted it
+      this.logger.warn('Device restarted', { id, resetReason: report.gauges?.resetReason, restartCause: report.gauges?.restartCause });
+    }
+    metrics.reports++;
+    metrics.uptimeMs = report.uptimeMs ?? metrics.uptimeMs;
+    metrics.gauges = { ...metrics.gauges, ...report.gauges };
+    for (const [name, count] of Object.entries(report.counters ?? {})) {
+      metrics.counters[name] = (metrics.counters[name] ?? 0) + count;
+    }
+    for (const [name, counts] of Object.entries(report.histograms ?? {})) {
+      const totals = metrics.histograms[name] ?? new Array(counts.length).fill(0);
+      metrics.histograms[name] = totals.map((total, bucket) => total + counts[bucket]);
+    }
+
+    this.logger.debug('Metrics report received from device', { id, histograms: Object.keys(report.histograms ?? {}) });
+    await this.devicesRepository.updateMetrics(id, JSON.stringify(metrics));
+  }
+
+  /**
+   * Get the accumulated metrics of a device with estimated percentiles per histogram
+   * @param id - The device ID
+   * @returns The metrics, or null if the device never reported any
+   * @throws Error if the device is not found
+   */
+  async getDeviceMetrics(
+    id: string,
+  ): Promise<(DeviceMetrics & { lastReport: Date | null; percentiles: Record<string, Record<string, number | null>> }) | null> {
+    const device = await this.devicesRepository.findById(id);
+    if (!device) {
+      throw new Error(`Device with ID ${id} not found`);
+    }
+
+    const status = await this.devicesRepository.getDeviceStatus(id);
+    const metrics = this.parseMetrics(status?.metrics);
+    if (!metrics) {
+      return null;
+    }
+
+    // Upper bound of the bucket holding each percentile (null = overflow bucket)
+    const percentiles: Record<string, Record<string, number | null>> = {};
+    for (const [name, counts] of Object.entries(metrics.histograms)) {
+      percentiles[name] = {
+        p50: this.bucketPercentile(counts, metrics.buckets, 0.5),
+        p90: this.bucketPercentile(counts, metrics.buckets, 0.9),
+        p99: this.bucketPercentile(counts, metrics.buckets, 0.99),
+      };
+    }
+
+    return { ...metrics, lastReport: status?.lastReport ?? null, percentiles };
+  }
+
+  /**
+   * Get the open/closed state of the drawers of a device
+   * Devices with drawer sensors push a status report on every change, so this is
+   * answered from the last report without querying the device.
+   * @param id - The device ID
+   * @returns The state of each drawer (null for drawers without a sensor or before any report)
+   * @throws Error if the device is not found
+   */
+  async getDrawerStates(id: string): Promise<DeviceDrawerStates> {
+    const device = await this.devicesRepository.findById(id);
+    if (!device) {
+      throw new Error(`Device with ID ${id} not found`);
+    }
+
+    const status = await this.devicesRepository.getDeviceStatus(id);
+    const gauges = this.parseMetrics(status?.metrics)?.gauges ?? {};
+    const open = (gauges.drawersOpen ?? 0) >>> 0;
+    const sensed = (gauges.drawersSensed ?? 0) >>> 0;
+
+    const drawers: DrawerState[] = [];
+    for (let drawer = 1; drawer <= device.drawerCount; drawer++) {
+      const bit = drawer <= 32 ? 1 << (drawer - 1) : 0;
+      drawers.push({ drawer, open: sensed & bit ? (open & bit) !== 0 : null });
+    }
+    return { drawers, reportedAt: status?.lastReport ?? null };
+  }
+
+  /**
+   * Log the drawers that opened or closed since the previous report
+   * @param id - The device ID
+   * @param previous - Gauges of the previous report
+   * @param current - Gauges of the new report
+   */
+  private logDrawerChanges(id: string, previous: Record<string, number>, current: Record<string, number>): void {
+    if (current.drawersOpen === undefined || current.drawersOpen === previous.drawersOpen) {
+      return;
+    }
+    const sensed = (current.drawersSensed ?? 0) >>> 0;
+    const changed = ((current.drawersOpen ^ (previous.drawersOpen ?? 0)) & sensed) >>> 0;
+    const opened: number[] = [];
+    const closed: number[] = [];
+    for (let bit = 0; bit < 32; bit++) {
+      if (changed & (1 << bit)) {
+        (current.drawersOpen & (1 << bit) ? opened : closed).push(bit + 1);
+      }
+    }
+    if (opened.length > 0 || closed.length > 0) {
+      this.logger.info('Drawer state changed', { id, opened, closed });
+    }
+  }
+
+  /**
+   * Validate the shape of a metrics report
+   * @param report - The report to validate
+   * @throws Error if the report is invalid
+   */
+  private validateMetricsReport(report: DeviceMetricsReport): void {
+    const isCount = (value: unknown) => Number.isInteger(value) && (value as number) >= 0;
+    const isName = (name: string) => /^[A-Za-z][A-Za-z0-9.]{0,63}$/.test(name) && !(name in Object.prototype);
+
+    if (!report || typeof report !== 'object') {
+      throw new Error('Invalid metrics report: body must be an object');
+    }
+    if (report.firmware !== undefined && (typeof report.firmware !== 'string' || !/^[0-9A-Za-z._+-]{1,32}$/.test(report.firmware))) {
+      throw new Error('Invalid metrics report: firmware must be a release name');
+    }
+    if (!Array.isArray(report.buckets) || report.buckets.length === 0 || !report.buckets.every(isCount)) {
+      throw new Error('Invalid metrics report: buckets must be a non-empty array of bounds');
+    }
+
+    const counters = Object.entries(report.counters ?? {});
+    const histograms = Object.entries(report.histograms ?? {});
+    const gauges = Object.entries(report.gauges ?? {});
+    if (counters.length + histograms.length + gauges.length > DevicesService.MAX_METRICS) {
+      throw new Error(`Invalid metrics report: more than ${DevicesService.MAX_METRICS} metrics`);
+    }
+    if (!counters.every(([name, count]) => isName(name) && isCount(count))) {
+      throw new Error('Invalid metrics report: counters must be non-negative integers');
+    }
+    if (!gauges.every(([name, value]) => isName(name) && Number.isFinite(value))) {
+      throw new Error('Invalid metrics report: gauges must be numbers');
+    }
+    const bucketCount = report.buckets.length + 1;
+    if (
+      !histograms.every(
+        ([name, counts]) => isName(name) && Array.isArray(counts) && counts.length === bucketCount && counts.every(isCount),
+      )
+    ) {
+      throw new Error(`Invalid metrics report: histograms must have ${bucketCount} non-negative counts`);
+    }
+  }
+
+  /**
+   * Parse stored metrics, ignoring unreadable data
+   * @param json - Stored metrics JSON
+   * @returns The metrics, or null if none are stored
+   */
+  private parseMetrics(json: string | null | undefined): DeviceMetrics | null {
+    if (!json) {
+      return null;
+    }
+    try {
+      return JSON.parse(json) as DeviceMetrics;
+    } catch {
+      this.logger.warn('Discarding unreadable stored metrics');
+      return null;
+    }
+  }
+
+  /**
+   * Estimate a percentile from histogram buckets
+   * @param counts - Count of each bucket
+   * @param bounds - Upper bound of each bucket (the last bucket is the overflow)
+   * @param quantile - Percentile between 0 and 1
+   * @returns Upper bound of the bucket holding the percentile, null if it falls in the overflow bucket or there is no data
+   */
+  private bucketPercentile(counts: number[], bounds: number[], quantile: number): number | null {
+    const total = counts.reduce((sum, count) => sum + count, 0);
+    if (total === 0) {
+      return null;
+    }
+    const target = Math.ceil(total * quantile);
+    let seen = 0;
+    for (let bucket = 0; bucket < counts.length; bucket++) {
+      seen += counts[bucket];
+      if (seen >= target) {
+        return bucket < bounds.length ? bounds[bucket] : null;
+      }
+    }
+    return null;
+  }
 }
@@ -0,0 +1,162 @@
+import { createHash } from 'crypto';
+import { FirmwareRepository, Firmware, FirmwareInfo } from '../../repositories/firmware/FirmwareRepository';
+import { FIRMWARE_MAX_CHUNK, FIRMWARE_MAX_SIZE } from '../../config/firmware';
+import Logger from '../../logger/logger';
+
+/**
+ * Byte range of the image served by one request (inclusive bounds)
+ */
+export interface FirmwareRange {
+  start: number;
+  end: number;
+}
+
+/**
+ * FirmwareService
+ *
+ * Manages the firmware releases installed over the air by the devices.
+ * The latest uploaded release is the one the fleet should run: it is announced
+ * on every poll (X-Firmware-Version) and devices running another release
+ * download it in chunks. The current image is kept in memory, so chunk
+ * requests never read the database.
+ */
+export class FirmwareService {
+  private firmwareRepository: FirmwareRepository;
+  private logger = Logger.child({ component: 'FirmwareService' });
+  // Current release, undefined until loaded from the database
+  private current: Firmware | null | undefined;
+  private loading: Promise<Firmware | null> | null = null;
+
+  // First byte of an ESP32 application image
+  private static readonly IMAGE_MAGIC = 0xe9;
+
+  /**
+   * Constructor - Injects the FirmwareRepository dependency
+   * @param firmwareRepository - The repository to handle data operations
+   */
+  constructor(firmwareRepository: FirmwareRepository) {
+    this.firmwareRepository = firmwareRepository;
+    this.logger.debug('FirmwareService initialized');
+  }
+
+  /**
+   * Store a new release, it becomes the one announced to every device
+   * @param version - Release name (reported by the firmware as FIRMWARE_VERSION)
+   * @param data - ESP32 application image (.bin)
+   * @returns Promise<FirmwareInfo> The stored release
+   * @throws Error if the release name or the image is invalid, or the name is taken
+   */
+  async uploadFirmware(version: unknown, data: unknown): Promise<FirmwareInfo> {
+    if (typeof version !== 'string' || !/^[0-9A-Za-z._+-]{1,32}$/.test(version)) {
+      throw new Error('Invalid version: 1-32 characters among letters, digits and . _ + -');
+    }
+    if (!Buffer.isBuffer(data) || data.length === 0) {
+      throw new Error('Invalid firmware image: send the .bin file as application/octet-stream');
+    }
+    if (data.length > FIRMWARE_MAX_SIZE) {
+      throw new Error(`Invalid firmware image: larger than ${FIRMWARE_MAX_SIZE} bytes`);
+    }
+    if (data[0] !== FirmwareService.IMAGE_MAGIC) {
+      throw new Error('Invalid firmware image: not an ESP32 application image');
+    }
+    if (await this.firmwareRepository.exists(version)) {
+      throw new Error(`Firmware version ${version} already exists`);
+    }
+
+    const info = await this.firmwareRepository.create({
+      version,
+      size: data.length,
+      md5: createHash('md5').update(data).digest('hex'),
+      sha256: createHash('sha256').update(data).digest('hex'),
+      data,
+    });
+    this.current = { ...info, data };
+    this.logger.info('Firmware release published', { version, size: info.size, sha256: info.sha256 });
+    return info;
+  }
+
+  /**
+   * List every release, newest (current) first
+   * @returns Promise<FirmwareInfo[]>
+   */
+  async listFirmware(): Promise<FirmwareInfo[]> {
+    return this.firmwareRepository.findAll();
+  }
+
+  /**
+   * Delete a release, the previous one becomes current if it was the latest
+   * @param version - Release name
+   * @throws Error if the release is not found
+   */
+  async deleteFirmware(version: string): Promise<void> {
+    if (!(await this.firmwareRepository.delete(version))) {
+      throw new Error(`Firmware version ${version} not found`);
+    }
+    if (this.current?.version === version) {
+      this.current = undefined;
+      await this.getCurrentFirmware();
+    }
+    this.logger.info('Firmware release deleted', { version, current: this.current?.version });
+  }
+
+  /**
+   * Get the release the fleet should run, with its image
+   * @returns Promise<Firmware | null> null if no release was uploaded
+   */
+  async getCurrentFirmware(): Promise<Firmware | null> {
+    if (this.current !== undefined) {
+      return this.current;
+    }
+    if (!this.loading) {
+      this.loading = this.firmwareRepository
+        .findLatest()
+        .then((firmware) => {
+          this.current = firmware;
+          return firmware;
+        })
+        .finally(() => {
+          this.loading = null;
+        });
+    }
+    return this.loading;
+  }
+
+  /**
+   * Get the release announced on polls without waiting for the database
+   * (loaded in the background on first use)
+   * @returns Release name, undefined if none is known yet
+   */
+  getCurrentVersion(): string | undefined {
+    if (this.current === undefined) {
+      this.getCurrentFirmware().catch((error) => {
+        this.logger.error('Error loading the current firmware release', {
+          error: error instanceof Error ? error.message : 'Unknown error',
+        });
+      });
+    }
+    return this.current?.version;
+  }
+
+  /**
+   * Resolve the Range header of a download request
+   * Only single ranges are served, cut to FIRMWARE_MAX_CHUNK bytes.
+   * @param header - Range header value (e.g. "bytes=16384-32767")
+   * @param size - Image size
+   * @returns The range, undefined for the whole image (no header), null if it can't be satisfied
+   */
+  resolveRange(header: string | undefined, size: number): FirmwareRange | null | undefined {
+    if (!header) {
+      return undefined;
+    }
+    const match = /^bytes=(\d+)-(\d*)$/.exec(header.trim());
+    if (!match) {
+      return null;
+    }
+    const start = parseInt(match[1], 10);
+    const last = match[2] ? parseInt(match[2], 10) : size - 1;
+    if (start >= size || last < start) {
+      return null;
+    }
+    return { start, end: Math.min(last, size - 1, start + FIRMWARE_MAX_CHUNK - 1) };
+  }
+}
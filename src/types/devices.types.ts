@@ -20,6 +20,10 @@ export interface Device {
   status: string;
   /** Number of drawers this device has */
   drawerCount: number;
+  /** Drawer hardware table (JSON DrawerConfig), null when the firmware defaults apply */
+  drawerConfig?: string | null;
+  /** Firmware release last reported by the device (FIRMWARE_VERSION) */
+  firmwareVersion?: string | null;
   /** Timestamp when the device was created */
   createdAt: Date;
   /** Timestamp when the device was last updated */
@@ -68,5 +72,111 @@ export interface UpdateDeviceDto {
 export interface CommandDto {
   action: string;
   drawer?: number;
+  drawers?: number[]; // Drawer list for 'open_many'
+  priority?: number; // Delivery priority 0-9, higher first (omitted when 0)
   code?: string; // Unique command code for tracking
 }
+
+/**
+ * Poll slot assigned to a device (returned with its token)
+ * Idle polls are sent when server time % intervalMs == offsetMs, so devices
+ * that booted together don't poll in lockstep.
+ */
+export interface PollSlot {
+  /** Time between two idle polls in ms */
+  intervalMs: number;
+  /** Phase of the device inside the interval in ms */
+  offsetMs: number;
+}
+
+/**
+ * Drawer hardware table of a device (PUT /devices/:id/config)
+ * One entry per drawer, drawer N uses index N - 1 of each list.
+ */
+export interface DrawerConfig {
+  /** Relay GPIO of each drawer */
+  pins: number[];
+  /** Relay pulse width of each drawer in ms */
+  pulseMs: number[];
+  /** GPIO level that energizes the relays (0 = LOW, 1 = HIGH) */
+  activeLevel: 0 | 1;
+}
+
+/**
+ * Compact drawer table sent to the device with its token
+ * The device caches it in NVS and only reapplies it when v changes.
+ */
+export interface DeviceConfigBlob {
+  /** Version (hash of the table) */
+  v: number;
+  /** Relay GPIO of each drawer */
+  pins: number[];
+  /** Relay pulse width of each drawer in ms */
+  pulse: number[];
+  /** GPIO level that energizes the relays */
+  active: 0 | 1;
+}
+
+/**
+ * Metrics report sent by a device (POST /devices/status)
+ * Counters and histograms are deltas since the previous accepted report.
+ */
+export interface DeviceMetricsReport {
+  /** Device reported status */
+  status?: string;
+  /** Firmware release the device runs (FIRMWARE_VERSION) */
+  firmware?: string;
+  /** Device uptime in milliseconds */
+  uptimeMs?: number;
+  /** Time covered by this report in milliseconds */
+  intervalMs?: number;
+  /** Latest values (freeHeap, minFreeHeap, maxAllocHeap, rssi, ...) */
+  gauges?: Record<string, number>;
+  /** Event counts since the previous report (reauths, wifiReconnects, ...) */
+  counters?: Record<string, number>;
+  /** Upper bound in ms of each histogram bucket (the last bucket, not listed, is the overflow) */
+  buckets: number[];
+  /** Bucket counts since the previous report, keyed by histogram name (poll.ttfb, actuation, ...) */
+  histograms?: Record<string, number[]>;
+}
+
+/**
+ * Metrics accumulated for a device since the first report
+ * (or since the device changed its histogram buckets)
+ */
+export interface DeviceMetrics {
+  /** When accumulation started */
+  since: string;
+  /** Number of reports accumulated */
+  reports: number;
+  /** Device uptime at the last report */
+  uptimeMs: number;
+  /** Latest gauge values */
+  gauges: Record<string, number>;
+  /** Accumulated event counts */
+  counters: Record<string, number>;
+  /** Upper bound in ms of each histogram bucket */
+  buckets: number[];
+  /** Accumulated bucket counts */
+  histograms: Record<string, number[]>;
+}
+
+/**
+ * Drawer state reported by the device sensors (gauges drawersOpen / drawersSensed)
+ */
+export interface DrawerState {
+  /** Drawer number (1-based) */
+  drawer: number;
+  /** true if open, false if closed, null if the drawer has no sensor */
+  open: boolean | null;
+}
+
+/**
+ * Drawer states of a device, as of its last status report
+ */
+export interface DeviceDrawerStates {
+  /** State of each drawer of the device */
+  drawers: DrawerState[];
+  /** When the device sent the state (its last status report) */
+  reportedAt: Date | null;
+}
@@ -0,0 +1,237 @@
+/**
+ * Minimal MessagePack encoder/decoder
+ *
+ * Covers the types exchanged with the devices: nil, boolean, integers,
+ * floats, strings, binary, arrays and maps (string keys).
+ * Spec: https://github.com/msgpack/msgpack/blob/master/spec.md
+ */
+
+export const MSGPACK_CONTENT_TYPE = 'application/msgpack';
+
+/**
+ * Encode a value as MessagePack
+ * Dates are encoded as ISO strings, undefined object properties are skipped (like JSON.stringify).
+ * @param value - Value to encode
+ * @returns Encoded bytes
+ */
+export function encode(value: unknown): Buffer {
+  const chunks: Buffer[] = [];
+  encodeValue(value, chunks);
+  return Buffer.concat(chunks);
+}
+
+/**
+ * Decode a MessagePack buffer
+ * @param buffer - Encoded bytes (a single value)
+ * @returns Decoded value
+ * @throws Error if the buffer is truncated or uses an unsupported type
+ */
+export function decode(buffer: Buffer): unknown {
+  const reader = { buffer, offset: 0 };
+  const value = decodeValue(reader);
+  if (reader.offset !== buffer.length) {
+    throw new Error('Invalid MessagePack: trailing bytes');
+  }
+  return value;
+}
+
+function header(type: number, size: number, width: number): Buffer {
+  const out = Buffer.alloc(1 + width);
+  out[0] = type;
+  if (width === 1) out.writeUInt8(size, 1);
+  else if (width === 2) out.writeUInt16BE(size, 1);
+  else out.writeUInt32BE(size, 1);
+  return out;
+}
+
+function encodeValue(value: unknown, chunks: Buffer[]): void {
+  if (value === null || value === undefined) {
+    chunks.push(Buffer.from([0xc0]));
+  } else if (typeof value === 'boolean') {
+    chunks.push(Buffer.from([value ? 0xc3 : 0xc2]));
+  } else if (typeof value === 'number') {
+    encodeNumber(value, chunks);
+  } else if (typeof value === 'string') {
+    const bytes = Buffer.from(value, 'utf8');
+    if (bytes.length < 32) chunks.push(Buffer.from([0xa0 | bytes.length]));
+    else if (bytes.length < 0x100) chunks.push(header(0xd9, bytes.length, 1));
+    else if (bytes.length < 0x10000) chunks.push(header(0xda, bytes.length, 2));
+    else chunks.push(header(0xdb, bytes.length, 4));
+    chunks.push(bytes);
+  } else if (Buffer.isBuffer(value)) {
+    if (value.length < 0x100) chunks.push(header(0xc4, value.length, 1));
+    else if (value.length < 0x10000) chunks.push(header(0xc5, value.length, 2));
+    else chunks.push(header(0xc6, value.length, 4));
+    chunks.push(value);
+  } else if (value instanceof Date) {
+    encodeValue(value.toISOString(), chunks);
+  } else if (Array.isArray(value)) {
+    if (value.length < 16) chunks.push(Buffer.from([0x90 | value.length]));
+    else if (value.length < 0x10000) chunks.push(header(0xdc, value.length, 2));
+    else chunks.push(header(0xdd, value.length, 4));
+    value.forEach((item) => encodeValue(item, chunks));
+  } else if (typeof value === 'object') {
+    const entries = Object.entries(value as Record<string, unknown>).filter(([, item]) => item !== undefined);
+    if (entries.length < 16) chunks.push(Buffer.from([0x80 | entries.length]));
+    else if (entries.length < 0x10000) chunks.push(header(0xde, entries.length, 2));
+    else chunks.push(header(0xdf, entries.length, 4));
+    entries.forEach(([key, item]) => {
+      encodeValue(key, chunks);
+      encodeValue(item, chunks);
+    });
+  } else {
+    throw new Error(`Cannot encode ${typeof value} as MessagePack`);
+  }
+}
+
+function encodeNumber(value: number, chunks: Buffer[]): void {
+  if (!Number.isInteger(value) || !Number.isSafeInteger(value)) {
+    const out = Buffer.alloc(9);
+    out[0] = 0xcb;
+    out.writeDoubleBE(value, 1);
+    chunks.push(out);
+    return;
+  }
+
+  if (value >= 0) {
+    if (value < 0x80) chunks.push(Buffer.from([value]));
+    else if (value < 0x100) chunks.push(header(0xcc, value, 1));
+    else if (value < 0x10000) chunks.push(header(0xcd, value, 2));
+    else if (value < 0x100000000) chunks.push(header(0xce, value, 4));
+    else {
+      const out = Buffer.alloc(9);
+      out[0] = 0xcf;
+      out.writeBigUInt64BE(BigInt(value), 1);
+      chunks.push(out);
+    }
+    return;
+  }
+
+  if (value >= -32) {
+    chunks.push(Buffer.from([value & 0xff]));
+  } else if (value >= -0x80) {
+    const out = Buffer.alloc(2);
+    out[0] = 0xd0;
+    out.writeInt8(value, 1);
+    chunks.push(out);
+  } else if (value >= -0x8000) {
+    const out = Buffer.alloc(3);
+    out[0] = 0xd1;
+    out.writeInt16BE(value, 1);
+    chunks.push(out);
+  } else if (value >= -0x80000000) {
+    const out = Buffer.alloc(5);
+    out[0] = 0xd2;
+    out.writeInt32BE(value, 1);
+    chunks.push(out);
+  } else {
+    const out = Buffer.alloc(9);
+    out[0] = 0xd3;
+    out.writeBigInt64BE(BigInt(value), 1);
+    chunks.push(out);
+  }
+}
+
+interface Reader {
+  buffer: Buffer;
+  offset: number;
+}
+
+function take(reader: Reader, length: number): number {
+  const start = reader.offset;
+  if (start + length > reader.buffer.length) {
+    throw new Error('Invalid MessagePack: unexpected end of data');
+  }
+  reader.offset += length;
+  return start;
+}
+
+function readString(reader: Reader, length: number): string {
+  const start = take(reader, length);
+  return reader.buffer.toString('utf8', start, start + length);
+}
+
+function readArray(reader: Reader, length: number): unknown[] {
+  const items: unknown[] = [];
+  for (let i = 0; i < length; i++) {
+    items.push(decodeValue(reader));
+  }
+  return items;
+}
+
+function readMap(reader: Reader, length: number): Record<string, unknown> {
+  const map: Record<string, unknown> = {};
+  for (let i = 0; i < length; i++) {
+    const key = String(decodeValue(reader));
+    const value = decodeValue(reader);
+    if (key !== '__proto__') {
+      map[key] = value;
+    }
+  }
+  return map;
+}
+
+function decodeValue(reader: Reader): unknown {
+  const buffer = reader.buffer;
+  const type = buffer[take(reader, 1)];
+
+  if (type < 0x80) return type; // positive fixint
+  if (type >= 0xe0) return type - 0x100; // negative fixint
+  if ((type & 0xf0) === 0x80) return readMap(reader, type & 0x0f);
+  if ((type & 0xf0) === 0x90) return readArray(reader, type & 0x0f);
+  if ((type & 0xe0) === 0xa0) return readString(reader, type & 0x1f);
+
+  switch (type) {
+    case 0xc0:
+      return null;
+    case 0xc2:
+      return false;
+    case 0xc3:
+      return true;
+    case 0xc4:
+    case 0xc5:
+    case 0xc6: {
+      const width = type === 0xc4 ? 1 : type === 0xc5 ? 2 : 4;
+      const at = take(reader, width);
+      const length = width === 1 ? buffer.readUInt8(at) : width === 2 ? buffer.readUInt16BE(at) : buffer.readUInt32BE(at);
+      const start = take(reader, length);
+      return Buffer.from(buffer.subarray(start, start + length));
+    }
+    case 0xca:
+      return buffer.readFloatBE(take(reader, 4));
+    case 0xcb:
+      return buffer.readDoubleBE(take(reader, 8));
+    case 0xcc:
+      return buffer.readUInt8(take(reader, 1));
+    case 0xcd:
+      return buffer.readUInt16BE(take(reader, 2));
+    case 0xce:
+      return buffer.readUInt32BE(take(reader, 4));
+    case 0xcf:
+      return Number(buffer.readBigUInt64BE(take(reader, 8)));
+    case 0xd0:
+      return buffer.readInt8(take(reader, 1));
+    case 0xd1:
+      return buffer.readInt16BE(take(reader, 2));
+    case 0xd2:
+      return buffer.readInt32BE(take(reader, 4));
+    case 0xd3:
+      return Number(buffer.readBigInt64BE(take(reader, 8)));
+    case 0xd9:
+      return readString(reader, buffer.readUInt8(take(reader, 1)));
+    case 0xda:
+      return readString(reader, buffer.readUInt16BE(take(reader, 2)));
+    case 0xdb:
+      return readString(reader, buffer.readUInt32BE(take(reader, 4)));
+    case 0xdc:
+      return readArray(reader, buffer.readUInt16BE(take(reader, 2)));
+    case 0xdd:
+      return readArray(reader, buffer.readUInt32BE(take(reader, 4)));
+    case 0xde:
+      return readMap(reader, buffer.readUInt16BE(take(reader, 2)));
+    case 0xdf:
+      return readMap(reader, buffer.readUInt32BE(take(reader, 4)));
+    default:
+      throw new Error(`Invalid MessagePack: unsupported type 0x${type.toString(16)}`);
+  }
+}